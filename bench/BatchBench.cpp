@@ -0,0 +1,155 @@
+#include "BenchUtil.hpp"
+#include "../src/Database.hpp"
+#include "../src/Printer.hpp"
+#include "../src/Reader.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Per-key against batched access on a Database larger than the caches. The database holds keys "key:<n>" with
+ * values drawn from 100000 distinct ones; every operation picks uniformly random keys (or values for NUMEQUALTO).
+ *   direct - Database::dbGet/dbSet/dbNumEqualTo one key at a time, against dbGetViews/dbSetMany/dbNumEqualToMany
+ *            for batch sizes 1 to 512, in keys per second.
+ *   reader - Reader::run in quiet mode: "GET k" lines against "MGET k1 .. kn" lines with the same keys, which adds
+ *            the parsing and reply costs the commands pay end to end.
+ *
+ * Usage: simpleDB_batch_bench [keys] [operations]   (default: 4000000 keys, 2000000 operations per measurement)
+ */
+
+static const size_t VALUES = 100000;
+static const size_t BATCHES[] = {1, 4, 16, 64, 512};
+
+struct Keys
+{
+    std::vector<std::string> strings;
+    std::vector<std::string_view> views;
+
+    Keys(size_t count, const char* prefix, size_t range, uint64_t seed)
+    {
+        Random random(seed);
+        char buffer[32];
+        for(size_t i = 0; i < count; i++)
+            strings.push_back(std::string(formatKey(buffer, prefix, random.below(range))));
+        for(const std::string& s: strings)
+            views.push_back(s);
+    }
+};
+
+static void report(const char* name, size_t batch, size_t ops, double seconds, double base)
+{
+    double rate = ops / seconds;
+    if(batch == 0)
+        std::printf("  %-14s per key     %8.2f M keys/s\n", name, rate / 1e6);
+    else
+        std::printf("  %-14s batch %4zu  %8.2f M keys/s  %5.2fx\n", name, batch, rate / 1e6, rate / base);
+}
+
+static void benchDirect(Database& db, size_t keys, size_t ops)
+{
+    Keys gets(ops, "key:", keys, 11);
+    Keys values(ops, "value-", VALUES, 12);
+    size_t sink = 0;
+
+    Timer timer;
+    std::string value;
+    for(std::string_view key: gets.views)
+        sink += db.dbGet(key, value) == Database::DB_GOOD ? value.size() : 0;
+    double base = ops / timer.seconds();
+    report("GET", 0, ops, ops / base, base);
+    for(size_t batch: BATCHES)
+    {
+        timer.reset();
+        for(size_t i = 0; i < ops; i += batch)
+            db.dbGetViews(gets.views.data() + i, std::min(batch, ops - i),
+                          [&](size_t, int, std::string_view found) {value.assign(found); sink += value.size();});
+        report("MGET", batch, ops, timer.seconds(), base);
+    }
+
+    timer.reset();
+    for(size_t i = 0; i < ops; i++)
+        db.dbSet(gets.views[i], values.views[i]);
+    base = ops / timer.seconds();
+    report("SET", 0, ops, ops / base, base);
+    for(size_t batch: BATCHES)
+    {
+        timer.reset();
+        for(size_t i = 0; i < ops; i += batch)
+            db.dbSetMany(gets.views.data() + i, values.views.data() + i, std::min(batch, ops - i));
+        report("MSET", batch, ops, timer.seconds(), base);
+    }
+
+    std::vector<int> counts(ops);
+    timer.reset();
+    for(size_t i = 0; i < ops; i++)
+        db.dbNumEqualTo(values.views[i], counts[i]);
+    base = ops / timer.seconds();
+    report("NUMEQUALTO", 0, ops, ops / base, base);
+    for(size_t batch: BATCHES)
+    {
+        timer.reset();
+        for(size_t i = 0; i < ops; i += batch)
+            db.dbNumEqualToMany(values.views.data() + i, std::min(batch, ops - i), counts.data() + i);
+        report("NUMEQUALTO n", batch, ops, timer.seconds(), base);
+    }
+    if(sink == 1)
+        std::printf("\n");
+}
+
+static double runLines(Reader& reader, const std::vector<std::string>& lines)
+{
+    MuteStdout mute;
+    Timer timer;
+    for(const std::string& line: lines)
+        reader.run(line);
+    Printer::getInstance().flush();
+    return timer.seconds();
+}
+
+static void benchReader(std::shared_ptr<Database> db, size_t keys, size_t ops)
+{
+    Keys gets(ops, "key:", keys, 21);
+    Reader reader(db);
+    std::vector<std::string> lines;
+    for(std::string_view key: gets.views)
+        lines.push_back("GET " + std::string(key));
+    double base = ops / runLines(reader, lines);
+    report("GET lines", 0, ops, ops / base, base);
+    for(size_t batch: BATCHES)
+    {
+        lines.clear();
+        for(size_t i = 0; i < ops; i += batch)
+        {
+            std::string line = "MGET";
+            for(size_t j = i; j < std::min(ops, i + batch); j++)
+                (line += " ").append(gets.views[j]);
+            lines.push_back(line);
+        }
+        report("MGET lines", batch, ops, runLines(reader, lines), base);
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+    size_t ops = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000000;
+    Printer::getInstance().setEcho(false);
+    Printer::getInstance().setFlushPolicy(Printer::FLUSH_FULL);
+
+    std::shared_ptr<Database> db(new Database());
+    db->reserve(keys);
+    char key[32], value[32];
+    for(size_t i = 0; i < keys; i++)
+        db->dbSet(formatKey(key, "key:", i), formatKey(value, "value-", i % VALUES));
+
+    std::printf("%zu keys, %zu operations per measurement\n", keys, ops);
+    std::printf("direct\n");
+    benchDirect(*db, keys, ops);
+    std::printf("reader\n");
+    benchReader(db, keys, ops);
+    return 0;
+}
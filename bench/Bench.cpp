@@ -0,0 +1,353 @@
+#include "BenchUtil.hpp"
+#include "../src/Database.hpp"
+#include "../src/Printer.hpp"
+#include "../src/Reader.hpp"
+#include "../src/Transaction.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * The standard benchmark suite, meant to be run on every version to track regressions. Each workload drives a
+ * Database, a Transaction or a Reader directly with a fixed seed:
+ *   uniform     - 90% GET, 10% SET of keys drawn uniformly from a preloaded database.
+ *   zipf        - the same mix with keys drawn from a Zipfian distribution (theta 0.99).
+ *   numequalto  - 90% NUMEQUALTO of values drawn from 1000 distinct ones, 10% SET.
+ *   incrby      - INCRBY 1 of keys drawn uniformly from a database of integer values.
+ *   numbetween  - 90% NUMBETWEEN of ranges 100 wide, 10% INCRBY 1, on a database of integer values.
+ *   nested      - blocks of 100 nested BEGINs, each followed by 10 SETs, then 100 ROLLBACKs; every command counts.
+ *   large-tx    - one BEGIN, a SET of every op, then a ROLLBACK and the same again with a COMMIT.
+ *   insert      - SETs of distinct new keys with distinct values into an empty database.
+ *   reader      - "GET"/"SET" lines through Reader::run in quiet mode: parsing plus execution.
+ * Every workload runs in a child process of its own, so that its peak RSS (getrusage) is its own. One op in
+ * --sample is timed individually for the latency percentiles; throughput is taken over the whole run.
+ * Results are printed as one JSON object per line, or as CSV with --csv:
+ *   {"workload":"uniform","ops":2000000,"seconds":0.41,"ops_per_sec":4.9e6,"ns_p50":..,"ns_p90":..,"ns_p99":..,
+ *    "ns_p999":..,"ns_max":..,"peak_rss_kb":..}
+ *
+ * Usage: simpleDB_bench [--keys n] [--ops n] [--sample n] [--csv] [workload...]   (default: all workloads,
+ *        1000000 keys, 2000000 ops, sample 1 op in 8)
+ */
+
+struct Options
+{
+    size_t keys;
+    size_t ops;
+    size_t sample;
+    bool csv;
+};
+
+// Op latencies of a run and its duration.
+class Samples
+{
+public:
+    Samples(size_t inEvery): every(inEvery), count(0) {}
+
+    template <typename F>
+    void run(F f) // Run one op, timing it if it is a sampled one.
+    {
+        if(this->count++ % this->every != 0)
+        {
+            f();
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        f();
+        this->ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    void start() {this->timer.reset();}
+    void stop() {this->seconds = this->timer.seconds();}
+
+    size_t every;
+    size_t count; // Ops run.
+    double seconds;
+    std::vector<uint64_t> ns;
+    Timer timer;
+};
+
+static std::string key(uint64_t n)
+{
+    char buffer[32];
+    return std::string(formatKey(buffer, "key:", n));
+}
+
+static std::shared_ptr<Database> preload(size_t keys, size_t values)
+{
+    std::shared_ptr<Database> db(new Database());
+    db->reserve(keys);
+    char k[32], v[32];
+    for(size_t i = 0; i < keys; i++)
+        db->dbSet(formatKey(k, "key:", i), formatKey(v, "value-", i % values));
+    return db;
+}
+
+template <typename Next>
+static void getSet(const Options& options, Samples& samples, size_t values, bool numEqualTo, Next next)
+{
+    auto db = preload(options.keys, values);
+    Random random(1);
+    char k[32], v[32];
+    std::string out;
+    int count = 0;
+    samples.start();
+    for(size_t i = 0; i < options.ops; i++)
+    {
+        uint64_t r = random.next();
+        if(r % 10 == 0)
+            samples.run([&]() {db->dbSet(formatKey(k, "key:", next(random)), formatKey(v, "value-", r % values));});
+        else if(numEqualTo)
+            samples.run([&]() {db->dbNumEqualTo(formatKey(v, "value-", (r >> 8) % values), count);});
+        else
+            samples.run([&]() {db->dbGet(formatKey(k, "key:", next(random)), out);});
+    }
+    samples.stop();
+}
+
+static void uniform(const Options& options, Samples& samples)
+{
+    getSet(options, samples, 1000, false, [&](Random& random) {return random.below(options.keys);});
+}
+
+static void zipf(const Options& options, Samples& samples)
+{
+    Zipf distribution(options.keys);
+    getSet(options, samples, 1000, false, [&](Random& random) {return distribution.next(random);});
+}
+
+static void numEqualTo(const Options& options, Samples& samples)
+{
+    getSet(options, samples, 1000, true, [&](Random& random) {return random.below(options.keys);});
+}
+
+// Keys with the integer values 0 to 999, then ops of INCRBY and, if ranges, mostly NUMBETWEEN.
+static void counters(const Options& options, Samples& samples, bool ranges)
+{
+    Database db;
+    db.reserve(options.keys);
+    char k[32], v[32];
+    for(size_t i = 0; i < options.keys; i++)
+        db.dbSet(formatKey(k, "key:", i), formatKey(v, "", i % 1000));
+    Random random(5);
+    int64_t result = 0;
+    int count = 0;
+    samples.start();
+    for(size_t i = 0; i < options.ops; i++)
+    {
+        uint64_t r = random.next();
+        if(!ranges || r % 10 == 0)
+            samples.run([&]() {db.dbIncrBy(formatKey(k, "key:", random.below(options.keys)), 1, result);});
+        else
+            samples.run([&]() {db.dbNumBetween((r >> 8) % 1000, (r >> 8) % 1000 + 99, count);});
+    }
+    samples.stop();
+}
+
+static void incrBy(const Options& options, Samples& samples)
+{
+    counters(options, samples, false);
+}
+
+static void numBetween(const Options& options, Samples& samples)
+{
+    counters(options, samples, true);
+}
+
+static void nested(const Options& options, Samples& samples)
+{
+    static const size_t DEPTH = 100, WRITES = 10;
+    auto db = preload(options.keys, 1000);
+    Transaction transaction(db);
+    Random random(2);
+    char k[32], v[32];
+    samples.start();
+    while(samples.count < options.ops)
+    {
+        for(size_t level = 0; level < DEPTH; level++)
+        {
+            samples.run([&]() {transaction.begin();});
+            for(size_t i = 0; i < WRITES; i++)
+            {
+                samples.run([&]()
+                {
+                    std::string_view name = formatKey(k, "key:", random.below(options.keys));
+                    transaction.record(name);
+                    db->dbSet(name, formatKey(v, "value-", random.below(1000)));
+                });
+            }
+        }
+        for(size_t level = 0; level < DEPTH; level++)
+            samples.run([&]() {transaction.rollback();});
+    }
+    samples.stop();
+}
+
+static void largeTransaction(const Options& options, Samples& samples)
+{
+    auto db = preload(options.keys, 1000);
+    Transaction transaction(db);
+    Random random(3);
+    char k[32], v[32];
+    samples.start();
+    for(int round = 0; round < 2; round++)
+    {
+        samples.run([&]() {transaction.begin();});
+        for(size_t i = 0; i < options.ops / 2; i++)
+        {
+            samples.run([&]()
+            {
+                std::string_view name = formatKey(k, "key:", random.below(options.keys * 2));
+                transaction.record(name);
+                db->dbSet(name, formatKey(v, "value-", random.below(1000)));
+            });
+        }
+        samples.run([&]() {round == 0 ? transaction.rollback() : transaction.commit();});
+    }
+    samples.stop();
+}
+
+static void insert(const Options& options, Samples& samples)
+{
+    Database db;
+    char k[32], v[32];
+    samples.start();
+    for(size_t i = 0; i < options.ops; i++)
+        samples.run([&]() {db.dbSet(formatKey(k, "key:", i), formatKey(v, "value-", i));});
+    samples.stop();
+}
+
+static void reader(const Options& options, Samples& samples)
+{
+    auto db = preload(options.keys, 1000);
+    Random random(4);
+    std::vector<std::string> lines;
+    for(size_t i = 0; i < options.ops; i++)
+    {
+        uint64_t r = random.next();
+        lines.push_back(r % 10 == 0 ? "SET " + key(r % options.keys) + " value-" + std::to_string((r >> 32) % 1000)
+                                    : "GET " + key(r % options.keys));
+    }
+    Printer::getInstance().setEcho(false);
+    Printer::getInstance().setFlushPolicy(Printer::FLUSH_FULL);
+    Reader session(db);
+    MuteStdout mute;
+    samples.start();
+    for(const std::string& line: lines)
+        samples.run([&]() {session.run(line);});
+    Printer::getInstance().flush();
+    samples.stop();
+}
+
+struct Workload
+{
+    const char* name;
+    void (*run)(const Options& options, Samples& samples);
+};
+
+static const Workload WORKLOADS[] = {
+    {"uniform", uniform},
+    {"zipf", zipf},
+    {"numequalto", numEqualTo},
+    {"incrby", incrBy},
+    {"numbetween", numBetween},
+    {"nested", nested},
+    {"large-tx", largeTransaction},
+    {"insert", insert},
+    {"reader", reader}
+};
+
+static void report(const Options& options, const char* name, Samples& samples)
+{
+    std::sort(samples.ns.begin(), samples.ns.end());
+    auto at = [&](double q) -> unsigned long long
+    {
+        return samples.ns.empty() ? 0 : samples.ns[std::min(samples.ns.size() - 1, (size_t)(q * samples.ns.size()))];
+    };
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double rate = samples.count / samples.seconds;
+    unsigned long long max = samples.ns.empty() ? 0 : samples.ns.back();
+    if(options.csv)
+        std::printf("%s,%zu,%.6f,%.0f,%llu,%llu,%llu,%llu,%llu,%ld\n", name, samples.count, samples.seconds, rate,
+                    at(0.5), at(0.9), at(0.99), at(0.999), max, usage.ru_maxrss);
+    else
+        std::printf("{\"workload\":\"%s\",\"ops\":%zu,\"seconds\":%.6f,\"ops_per_sec\":%.0f,\"ns_p50\":%llu,"
+                    "\"ns_p90\":%llu,\"ns_p99\":%llu,\"ns_p999\":%llu,\"ns_max\":%llu,\"peak_rss_kb\":%ld}\n",
+                    name, samples.count, samples.seconds, rate, at(0.5), at(0.9), at(0.99), at(0.999), max,
+                    usage.ru_maxrss);
+    std::fflush(stdout);
+}
+
+// Run a workload in a child process, so that its peak RSS is not that of the workloads before it.
+static bool runIsolated(const Options& options, const Workload& workload)
+{
+    std::fflush(stdout);
+    pid_t child = fork();
+    if(child < 0)
+        return false;
+    if(child == 0)
+    {
+        Samples samples(options.sample);
+        workload.run(options, samples);
+        report(options, workload.name, samples);
+        _exit(0);
+    }
+    int status = 0;
+    while(waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, const char* argv[])
+{
+    Options options = {1000000, 2000000, 8, false};
+    std::vector<const Workload*> selected;
+    for(int i = 1; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--csv") == 0)
+            options.csv = true;
+        else if(i + 1 < argc && std::strcmp(argv[i], "--keys") == 0)
+            options.keys = std::max(1ULL, std::strtoull(argv[++i], nullptr, 10));
+        else if(i + 1 < argc && std::strcmp(argv[i], "--ops") == 0)
+            options.ops = std::strtoull(argv[++i], nullptr, 10);
+        else if(i + 1 < argc && std::strcmp(argv[i], "--sample") == 0)
+            options.sample = std::max(1ULL, std::strtoull(argv[++i], nullptr, 10));
+        else
+        {
+            const Workload* found = nullptr;
+            for(const Workload& workload: WORKLOADS)
+                if(std::strcmp(argv[i], workload.name) == 0)
+                    found = &workload;
+            if(found == nullptr)
+            {
+                std::fprintf(stderr, "unknown workload or option %s\n", argv[i]);
+                return 2;
+            }
+            selected.push_back(found);
+        }
+    }
+    if(selected.empty())
+        for(const Workload& workload: WORKLOADS)
+            selected.push_back(&workload);
+
+    if(options.csv)
+        std::printf("workload,ops,seconds,ops_per_sec,ns_p50,ns_p90,ns_p99,ns_p999,ns_max,peak_rss_kb\n");
+    bool ok = true;
+    for(const Workload* workload: selected)
+    {
+        if(!runIsolated(options, *workload))
+        {
+            std::fprintf(stderr, "workload %s failed\n", workload->name);
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+#ifndef BenchUtil_hpp
+#define BenchUtil_hpp
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <streambuf>
+#include <string_view>
+
+/**
+ * Small helpers shared by the benchmark programs.
+ */
+class Timer
+{
+public:
+    Timer(): start(std::chrono::steady_clock::now()) {}
+    
+    void reset() {start = std::chrono::steady_clock::now();}
+    double seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * Discards everything written to std::cout while it is alive, so that database replies do not end up in the
+ * benchmark report.
+ */
+class MuteStdout
+{
+public:
+    MuteStdout(): old(std::cout.rdbuf(&sink)) {}
+    ~MuteStdout() {std::cout.rdbuf(old);}
+    
+private:
+    class NullBuffer: public std::streambuf
+    {
+    protected:
+        virtual int overflow(int c) {return c;}
+        virtual std::streamsize xsputn(const char*, std::streamsize n) {return n;}
+    };
+    
+    NullBuffer sink;
+    std::streambuf* old;
+};
+
+/**
+ * Deterministic 64-bit generator (splitmix64), cheap enough to not show up in the measurements.
+ */
+class Random
+{
+public:
+    Random(uint64_t seed): state(seed) {}
+    
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    uint64_t below(uint64_t n) {return next() % n;}
+    double unit() {return (next() >> 11) * (1.0 / 9007199254740992.0);}
+    
+private:
+    uint64_t state;
+};
+
+/**
+ * Zipfian item generator over [0, n) as used by YCSB (Gray et al., "Quickly generating billion-record synthetic
+ * databases"). Item 0 is the most popular one; theta 0.99 is the usual skew.
+ */
+class Zipf
+{
+public:
+    Zipf(uint64_t inN, double inTheta = 0.99): n(inN), theta(inTheta)
+    {
+        double zeta2 = zeta(2);
+        zetaN = zeta(n);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetaN);
+    }
+    
+    uint64_t next(Random& random)
+    {
+        double u = random.unit();
+        double uz = u * zetaN;
+        if(uz < 1.0)
+            return 0;
+        if(uz < 1.0 + std::pow(0.5, theta))
+            return 1;
+        uint64_t item = (uint64_t)(n * std::pow(eta * u - eta + 1.0, alpha));
+        return item < n ? item : n - 1;
+    }
+    
+private:
+    uint64_t n;
+    double theta, zetaN, alpha, eta;
+    
+    double zeta(uint64_t count) const
+    {
+        double sum = 0;
+        for(uint64_t i = 1; i <= count; i++)
+            sum += 1.0 / std::pow((double)i, theta);
+        return sum;
+    }
+};
+
+/**
+ * Format "<prefix><number>" into a caller-provided buffer and return a view of it.
+ */
+inline std::string_view formatKey(char* buffer, const char* prefix, uint64_t number)
+{
+    char* p = buffer;
+    while(*prefix)
+        *p++ = *prefix++;
+    char digits[20];
+    int count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + number % 10);
+        number /= 10;
+    } while(number != 0);
+    while(count > 0)
+        *p++ = digits[--count];
+    return std::string_view(buffer, p - buffer);
+}
+
+#endif /* BenchUtil_hpp */
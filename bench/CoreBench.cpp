@@ -0,0 +1,156 @@
+#include "BenchUtil.hpp"
+#include "../src/CoreDatabase.hpp"
+#include "../src/Database.hpp"
+#include "../src/Engine.hpp"
+#include "../src/ShardedDatabase.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Throughput against the number of cores of a CoreDatabase, from 1 up to the number of hardware threads (at least
+ * 4), compared with a ShardedDatabase of as many shards. Each run has as many session threads as cores, each with an
+ * engine of its own, on a store preloaded with 1M keys, in one of three workloads:
+ *   mixed - 50% GET, 50% SET of uniformly chosen keys, and every 1000th operation a NUMEQUALTO, which every core
+ *           answers in parallel;
+ *   batch - MGET and MSET of BATCH keys, half each, which the cores of the keys apply in parallel; an operation is a
+ *           key;
+ *   tx    - a transaction block of two SETs, usually of keys of different cores, committed, or rolled back one time in
+ *           four, which prepares both cores first.
+ * The total number of operations is fixed. Each session waits for the core of every request, so a core only has work
+ * while sessions send it some: with fewer hardware threads than cores plus sessions, the cores and the sessions take
+ * turns on the CPUs and message passing costs a context switch per request.
+ *
+ * Usage: simpleDB_core_bench [ops] [max cores]   (default: 2000000, the number of hardware threads)
+ */
+
+static const size_t PRELOAD = 1000000;
+static const size_t BATCH = 16;
+
+enum
+{
+    WORK_MIXED,
+    WORK_BATCH,
+    WORK_TX
+};
+
+static void work(Engine& engine, uint64_t seed, size_t ops, int workload)
+{
+    Random random(seed);
+    char key[BATCH][32], value[32];
+    std::vector<std::string_view> keys(BATCH), values(BATCH);
+    std::vector<std::string> out;
+    std::vector<int> status;
+    std::string one;
+    int count = 0;
+    for(size_t i = 1; i <= ops;)
+    {
+        uint64_t r = random.next();
+        if(workload == WORK_MIXED)
+        {
+            std::string_view k = formatKey(key[0], "key:", (r >> 8) % PRELOAD);
+            if(i % 1000 == 0)
+                engine.dbNumEqualTo(formatKey(value, "v", r % 100), count);
+            else if(r & 1)
+                engine.dbGet(k, one);
+            else
+                engine.dbSet(k, formatKey(value, "v", (r >> 40) % 100));
+            i++;
+        }
+        else if(workload == WORK_BATCH)
+        {
+            for(size_t j = 0; j < BATCH; j++)
+            {
+                keys[j] = formatKey(key[j], "key:", random.below(PRELOAD));
+                values[j] = keys[j];
+            }
+            if(r & 1)
+                engine.dbGetMany(keys, out, status);
+            else
+                engine.dbSetMany(keys, values);
+            i += BATCH;
+        }
+        else
+        {
+            engine.begin();
+            engine.dbSet(formatKey(key[0], "key:", (r >> 8) % PRELOAD), formatKey(value, "v", r % 100));
+            engine.dbSet(formatKey(key[1], "key:", (r >> 32) % PRELOAD), value);
+            if(r % 4 == 0)
+                engine.rollback();
+            else
+                engine.commit();
+            i += 2;
+        }
+    }
+}
+
+static double run(size_t threads, size_t ops, int workload, const std::function<std::shared_ptr<Engine>()>& newEngine)
+{
+    std::vector<std::thread> workers;
+    Timer timer;
+    for(size_t t = 0; t < threads; t++)
+        workers.emplace_back([&, t]() {
+            std::shared_ptr<Engine> engine = newEngine();
+            work(*engine, t + 1, ops / threads, workload);
+        });
+    for(std::thread& worker: workers)
+        worker.join();
+    return timer.seconds();
+}
+
+static void preload(Engine& engine)
+{
+    char key[32], value[32];
+    std::vector<std::string> keys, values;
+    for(size_t i = 0; i < PRELOAD; i += keys.size())
+    {
+        keys.clear();
+        values.clear();
+        for(size_t j = i; j < std::min(i + 1000, PRELOAD); j++)
+        {
+            keys.emplace_back(formatKey(key, "key:", j));
+            values.emplace_back(formatKey(value, "v", j % 100));
+        }
+        engine.dbSetMany(std::vector<std::string_view>(keys.begin(), keys.end()),
+                         std::vector<std::string_view>(values.begin(), values.end()));
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t ops = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    size_t maxCores = argc > 2 ? std::strtoull(argv[2], nullptr, 10) :
+        std::max<size_t>(std::thread::hardware_concurrency(), 4);
+
+    std::printf("%u hardware threads, %zu ops per run, one session per core\n", std::thread::hardware_concurrency(),
+                ops);
+    const char* names[] = {"mixed", "batch", "tx"};
+    std::vector<double> coreBase(3), shardedBase(3);
+    for(size_t cores = 1; cores <= maxCores; cores *= 2)
+    {
+        auto coreDb = std::shared_ptr<CoreDatabase>(new CoreDatabase(cores));
+        auto shardedDb = std::shared_ptr<ShardedDatabase>(new ShardedDatabase(cores));
+        preload(*Engine::create(coreDb));
+        preload(*Engine::create(shardedDb));
+        for(int w = WORK_MIXED; w <= WORK_TX; w++)
+        {
+            double core = run(cores, ops, w, [&]() {return Engine::create(coreDb);});
+            double sharded = run(cores, ops, w, [&]() {return Engine::create(shardedDb);});
+            if(cores == 1)
+            {
+                coreBase[w] = core;
+                shardedBase[w] = sharded;
+            }
+            std::printf("%-5s cores=%-3zu core-per-shard %7.2f Mops/s (x%5.2f)   sharded %7.2f Mops/s (x%5.2f)\n",
+                        names[w], cores, ops / core / 1e6, coreBase[w] / core, ops / sharded / 1e6,
+                        shardedBase[w] / sharded);
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "BenchUtil.hpp"
+#include "../src/Database.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+
+/**
+ * Measures what a memory limit costs on the SET path and what each policy keeps. For no limit and for LRU and LFU at
+ * several sample counts, a Database limited to a quarter of what the keys need is filled with n new keys (SET of
+ * a new key, to one of 100 values; every one of them evicts once the limit is reached), then serves n requests of a
+ * cache workload: GET of a Zipfian key, and SET of it on a miss. Reported are the ns/op of the inserts and of the
+ * cache requests, the keys evicted and left, and the hit rate of the GETs.
+ *
+ * Usage: simpleDB_eviction_bench [n] [theta]   (default: 2000000 0.99)
+ */
+
+struct Config
+{
+    const char* name;
+    int policy;
+    unsigned samples;
+    bool limited;
+};
+
+static void run(const Config& config, size_t n, size_t limit, Zipf& zipf)
+{
+    Database db;
+    if(config.limited)
+        db.setMaxMemory(limit, config.policy, config.samples);
+    char key[32], value[32];
+    Timer timer;
+    for(size_t i = 0; i < n; i++)
+        db.dbSet(formatKey(key, "key:", i), formatKey(value, "v", i % 100));
+    double insertSeconds = timer.seconds();
+
+    Random random(n);
+    size_t hits = 0;
+    std::string_view found;
+    timer.reset();
+    for(size_t i = 0; i < n; i++)
+    {
+        std::string_view k = formatKey(key, "key:", zipf.next(random));
+        if(db.dbGetView(k, found) == Database::DB_GOOD)
+            hits++;
+        else
+            db.dbSet(k, formatKey(value, "v", i % 100));
+    }
+    double cacheSeconds = timer.seconds();
+    StoreStats stats = db.stats();
+    std::printf("%-8s samples=%-3u insert %7.1f ns/op %9.0f ops/s   cache %7.1f ns/op   evicted %9llu keys %8zu"
+                "   hit rate %5.1f%%\n", config.name, config.samples, insertSeconds * 1e9 / n, n / insertSeconds,
+                cacheSeconds * 1e9 / n, (unsigned long long)stats.evictedKeys, stats.keys, 100.0 * hits / n);
+    std::fflush(stdout);
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    double theta = argc > 2 ? std::atof(argv[2]) : 0.99;
+    // The tracked memory of all n keys, measured with a limit that is never reached.
+    size_t limit;
+    {
+        Database db;
+        db.setMaxMemory(SIZE_MAX);
+        char key[32], value[32];
+        for(size_t i = 0; i < n; i++)
+            db.dbSet(formatKey(key, "key:", i), formatKey(value, "v", i % 100));
+        limit = db.usedMemory() / 4;
+    }
+    std::printf("%zu keys, limit %zu bytes, Zipf theta %.2f\n", n, limit, theta);
+    Zipf zipf(n, theta);
+    const Config configs[] = {
+        {"none", Database::EVICT_LRU, Database::DEFAULT_EVICTION_SAMPLES, false},
+        {"lru", Database::EVICT_LRU, 1, true},
+        {"lru", Database::EVICT_LRU, 5, true},
+        {"lru", Database::EVICT_LRU, 10, true},
+        {"lfu", Database::EVICT_LFU, 5, true},
+        {"lfu", Database::EVICT_LFU, 10, true},
+    };
+    for(const Config& config: configs)
+        run(config, n, limit, zipf);
+    return 0;
+}
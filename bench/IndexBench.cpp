@@ -0,0 +1,119 @@
+#include "BenchUtil.hpp"
+#include "../src/Database.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Measures what the ordered key index costs on writes and what it gains for listing keys. For a Database without and
+ * with the index: n SETs of new keys in random order ("user:<id>:<field>", 10 fields per user), n SETs that
+ * overwrite random keys (which leave the index alone), and n UNSETs of all keys in random order, in ns/op, and the
+ * memory of the tables with the index. Then, with the index, SCAN with PREFIX of a random user and COUNT 10, in
+ * ns/call and keys per second, against finding the same keys by walking the whole key table.
+ *
+ * Usage: simpleDB_index_bench [n]   (default: 2000000)
+ */
+
+static std::string_view makeKey(char* buffer, uint64_t i)
+{
+    int length = std::snprintf(buffer, 48, "user:%llu:f%llu", (unsigned long long)(i / 10),
+                               (unsigned long long)(i % 10));
+    return std::string_view(buffer, length);
+}
+
+static void shuffle(std::vector<uint64_t>& order, Random& random)
+{
+    for(size_t i = order.size(); i > 1; i--)
+        std::swap(order[i - 1], order[random.below(i)]);
+}
+
+static void run(bool indexed, size_t n)
+{
+    Database db;
+    if(indexed)
+        db.enableKeyIndex();
+    Random random(42);
+    std::vector<uint64_t> order(n);
+    for(size_t i = 0; i < n; i++)
+        order[i] = i;
+    shuffle(order, random);
+    char key[48], value[32];
+
+    Timer timer;
+    for(size_t i = 0; i < n; i++)
+        db.dbSet(makeKey(key, order[i]), formatKey(value, "v", i % 100));
+    double insertSeconds = timer.seconds();
+    size_t memory = db.stats().memoryBytes;
+
+    timer.reset();
+    for(size_t i = 0; i < n; i++)
+        db.dbSet(makeKey(key, random.below(n)), formatKey(value, "v", i % 100));
+    double overwriteSeconds = timer.seconds();
+
+    double scanSeconds = 0;
+    size_t scans = 0, scanned = 0;
+    if(indexed)
+    {
+        std::vector<std::string> keys;
+        std::string next;
+        char prefix[32], end[32];
+        timer.reset();
+        for(scans = 0; scans < n / 10; scans++)
+        {
+            uint64_t user = random.below(n / 10);
+            std::snprintf(prefix, sizeof(prefix), "user:%llu:", (unsigned long long)user);
+            std::snprintf(end, sizeof(end), "user:%llu;", (unsigned long long)user); // ';' follows ':'.
+            keys.clear();
+            db.dbScan(prefix, end, 10, keys, next);
+            scanned += keys.size();
+        }
+        scanSeconds = timer.seconds();
+    }
+
+    timer.reset();
+    shuffle(order, random);
+    for(size_t i = 0; i < n; i++)
+        db.dbUnset(makeKey(key, order[i]));
+    double unsetSeconds = timer.seconds();
+
+    std::printf("%-9s SET new %7.1f ns/op   SET existing %7.1f ns/op   UNSET %7.1f ns/op   memory %6.1f bytes/key",
+                indexed ? "index" : "no index", insertSeconds * 1e9 / n, overwriteSeconds * 1e9 / n,
+                unsetSeconds * 1e9 / n, (double)memory / n);
+    if(indexed)
+        std::printf("   SCAN PREFIX %7.1f ns/call %6.1f M keys/s", scanSeconds * 1e9 / scans,
+                    scanned / scanSeconds / 1e6);
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+// Without an index, the keys of a prefix can only be found by walking every key.
+static void runFullScan(size_t n)
+{
+    Database db;
+    char key[48], value[32];
+    for(size_t i = 0; i < n; i++)
+        db.dbSet(makeKey(key, i), formatKey(value, "v", i % 100));
+    Random random(7);
+    size_t calls = 10, found = 0;
+    Timer timer;
+    for(size_t i = 0; i < calls; i++)
+    {
+        char prefix[32];
+        int length = std::snprintf(prefix, sizeof(prefix), "user:%llu:", (unsigned long long)random.below(n / 10));
+        db.forEach([&](std::string_view k, std::string_view) {found += k.compare(0, length, prefix) == 0;});
+    }
+    double seconds = timer.seconds();
+    std::printf("no index  prefix by walking all keys %10.1f ns/call (%zu keys found)\n", seconds * 1e9 / calls, found);
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    std::printf("%zu keys\n", n);
+    run(false, n);
+    run(true, n);
+    runFullScan(n);
+    return 0;
+}
@@ -0,0 +1,425 @@
+#include "BenchUtil.hpp"
+#include "../src/Client.hpp"
+#include "../src/Histogram.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <poll.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+/**
+ * Load generator for a running simpleDB. It opens many connections to a server (--connect), or starts simpleDB
+ * processes and drives their stdin interface through pipes (--spawn, one process per connection), and issues a
+ * configurable mix of commands for a fixed duration from one or more threads, each thread running an event loop over
+ * its share of the connections.
+ *   Closed loop (--rate 0, the default): every connection keeps --pipeline requests in flight, as fast as the server
+ *     answers. Latency is measured from the moment a request is queued.
+ *   Open loop (--rate n): requests are scheduled at n per second in total, spread evenly over the connections, no
+ *     matter how fast replies come back. Latency is measured from the scheduled time, so a server that stalls is
+ *     charged for every request that should have been sent meanwhile instead of hiding them (coordinated omission).
+ * Latencies are recorded in HDR-style histograms per command type and reported as percentiles in microseconds, as a
+ * table or as JSON lines (--json).
+ *
+ * Usage: simpleDB_loadgen (--connect <address> | --spawn "<simpleDB command line>") [--connections n] [--threads n]
+ *        [--rate ops/s] [--pipeline n] [--duration s] [--mix get:80,set:15,numequalto:5] [--keys n] [--values n]
+ *        [--value-size n] [--batch n] [--zipf theta] [--preload] [--json]
+ * Command types for --mix: get, set, unset, numequalto, mget, mset (--batch keys each).
+ */
+
+enum
+{
+    TYPE_GET,
+    TYPE_SET,
+    TYPE_UNSET,
+    TYPE_NUMEQUALTO,
+    TYPE_MGET,
+    TYPE_MSET,
+    TYPES
+};
+
+static const char* TYPE_NAMES[TYPES] = {"get", "set", "unset", "numequalto", "mget", "mset"};
+static const size_t MAX_IN_FLIGHT = 100000; // Per connection; an open loop that runs this far ahead stops sending.
+
+struct Options
+{
+    std::string connect;
+    std::vector<std::string> spawn;
+    size_t connections = 16;
+    size_t threads = 1;
+    double rate = 0;
+    size_t pipeline = 1;
+    double duration = 10;
+    unsigned weights[TYPES] = {80, 15, 0, 5, 0, 0};
+    size_t keys = 100000;
+    size_t values = 1000;
+    size_t valueSize = 16;
+    size_t batch = 10;
+    double zipf = 0;
+    bool preload = false;
+    bool json = false;
+};
+
+static uint64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Builds the commands of the mix.
+class Generator
+{
+public:
+    Generator(const Options& inOptions, uint64_t seed): options(inOptions), random(seed)
+    {
+        if(options.zipf > 0)
+            zipf.reset(new Zipf(options.keys, options.zipf));
+        for(unsigned weight: options.weights)
+            total += weight;
+    }
+
+    int next(std::vector<std::string>& words) // Fill the words of the next command, return its type.
+    {
+        uint64_t pick = random.below(total);
+        int type = 0;
+        while(pick >= options.weights[type])
+            pick -= options.weights[type++];
+        words.clear();
+        words.push_back(type == TYPE_GET ? "GET" : type == TYPE_SET ? "SET" : type == TYPE_UNSET ? "UNSET" :
+                        type == TYPE_NUMEQUALTO ? "NUMEQUALTO" : type == TYPE_MGET ? "MGET" : "MSET");
+        size_t count = type == TYPE_MGET || type == TYPE_MSET ? options.batch : 1;
+        for(size_t i = 0; i < count; i++)
+        {
+            if(type != TYPE_NUMEQUALTO)
+                words.push_back(key(nextKey()));
+            if(type == TYPE_SET || type == TYPE_MSET || type == TYPE_NUMEQUALTO)
+                words.push_back(value(random.below(options.values)));
+        }
+        return type;
+    }
+
+    std::string key(uint64_t n) const {char buffer[32]; return std::string(formatKey(buffer, "key:", n));}
+    std::string value(uint64_t n) const
+    {
+        char buffer[32];
+        std::string text(formatKey(buffer, "value-", n));
+        if(text.size() < options.valueSize)
+            text.resize(options.valueSize, '.');
+        return text;
+    }
+
+private:
+    const Options& options;
+    Random random;
+    std::unique_ptr<Zipf> zipf;
+    uint64_t total = 0;
+
+    uint64_t nextKey() {return zipf ? zipf->next(random) : random.below(options.keys);}
+};
+
+struct Connection
+{
+    Client client;
+    std::deque<std::pair<int, uint64_t> > inFlight; // Type and start time of every request, oldest first.
+    uint64_t nextSend; // Scheduled time of the next request in an open loop.
+};
+
+struct Stats
+{
+    Histogram histograms[TYPES];
+    uint64_t errors = 0; // Error replies.
+    uint64_t failures = 0; // Connections lost.
+};
+
+static void issue(Connection& conn, Generator& generator, std::vector<std::string>& words, uint64_t start)
+{
+    int type = generator.next(words);
+    std::vector<std::string_view> args(words.begin(), words.end());
+    conn.client.append(args);
+    conn.inFlight.push_back(std::make_pair(type, start));
+}
+
+// Run the event loop of one thread over its connections.
+static void runThread(const Options& options, std::vector<Connection*> conns, size_t first, uint64_t start,
+                      Stats& stats)
+{
+    Generator generator(options, 1000 + first);
+    std::vector<std::string> words;
+    uint64_t end = start + (uint64_t)(options.duration * 1e9);
+    uint64_t interval = options.rate > 0 ? (uint64_t)(options.connections * 1e9 / options.rate) : 0;
+    for(size_t i = 0; i < conns.size(); i++)
+    {
+        conns[i]->client.setNonBlocking();
+        conns[i]->nextSend = start + (uint64_t)((first + i) * 1e9 / std::max(options.rate, 1.0));
+    }
+    std::vector<struct pollfd> fds;
+    std::vector<Connection*> owners; // The connection of each entry of fds.
+    Reply reply;
+    while(true)
+    {
+        uint64_t time = now();
+        bool sending = time < end;
+        uint64_t wake = end;
+        size_t busy = 0;
+        fds.clear();
+        owners.clear();
+        for(Connection* conn: conns)
+        {
+            if(conn->client.getReadFd() < 0)
+                continue;
+            if(sending && interval > 0)
+            {
+                while(conn->nextSend <= time && conn->inFlight.size() < MAX_IN_FLIGHT)
+                {
+                    issue(*conn, generator, words, conn->nextSend);
+                    conn->nextSend += interval;
+                }
+                wake = std::min(wake, conn->nextSend);
+            }
+            else if(sending)
+            {
+                while(conn->inFlight.size() < options.pipeline)
+                    issue(*conn, generator, words, time);
+            }
+            if(conn->client.hasOutput() && conn->client.send() == Client::CLIENT_ERROR)
+            {
+                stats.failures++;
+                conn->client.close();
+                continue;
+            }
+            busy += !conn->inFlight.empty();
+            fds.push_back(pollfd{conn->client.getReadFd(), POLLIN, 0});
+            owners.push_back(conn);
+            if(conn->client.hasOutput())
+            {
+                fds.push_back(pollfd{conn->client.getWriteFd(), POLLOUT, 0});
+                owners.push_back(conn);
+            }
+        }
+        if(!sending && (busy == 0 || time > end + 5000000000ULL))
+            break;
+
+        uint64_t wait = sending && wake > time ? wake - time : sending ? 0 : 100000000;
+        struct timespec timeout = {(time_t)(wait / 1000000000), (long)(wait % 1000000000)};
+        if(ppoll(fds.data(), fds.size(), &timeout, nullptr) <= 0)
+            continue;
+        for(size_t i = 0; i < fds.size(); i++)
+        {
+            Connection* conn = owners[i];
+            if(fds[i].events != POLLIN || fds[i].revents == 0 || conn->client.getReadFd() < 0)
+                continue;
+            int status;
+            while((status = conn->client.receive()) == Client::CLIENT_GOOD) {}
+            if(status == Client::CLIENT_ERROR)
+            {
+                stats.failures++;
+                conn->client.close();
+                continue;
+            }
+            uint64_t received = now();
+            while(!conn->inFlight.empty() && conn->client.nextReply(reply) == Client::CLIENT_GOOD)
+            {
+                std::pair<int, uint64_t> request = conn->inFlight.front();
+                conn->inFlight.pop_front();
+                stats.histograms[request.first].record(received - request.second);
+                stats.errors += reply.type == Reply::REPLY_ERROR;
+            }
+        }
+    }
+}
+
+static bool preload(const Options& options, Client& client)
+{
+    Generator generator(options, 1);
+    std::vector<std::string> words;
+    Reply reply;
+    for(size_t start = 0; start < options.keys; start += 1000)
+    {
+        words.assign(1, "MSET");
+        for(size_t i = start; i < std::min(options.keys, start + 1000); i++)
+        {
+            words.push_back(generator.key(i));
+            words.push_back(generator.value(i % options.values));
+        }
+        std::vector<std::string_view> args(words.begin(), words.end());
+        if(client.call(args, reply) != Client::CLIENT_GOOD || reply.type == Reply::REPLY_ERROR)
+            return false;
+    }
+    return true;
+}
+
+static void report(const Options& options, const char* name, const Histogram& histogram, double seconds)
+{
+    auto us = [](uint64_t ns) {return ns / 1000.0;};
+    if(options.json)
+        std::printf("{\"type\":\"%s\",\"count\":%llu,\"ops_per_sec\":%.0f,\"us_mean\":%.2f,\"us_p50\":%.2f,"
+                    "\"us_p90\":%.2f,\"us_p99\":%.2f,\"us_p999\":%.2f,\"us_p9999\":%.2f,\"us_max\":%.2f}\n", name,
+                    (unsigned long long)histogram.count(), histogram.count() / seconds, histogram.mean() / 1000,
+                    us(histogram.percentile(0.5)), us(histogram.percentile(0.9)), us(histogram.percentile(0.99)),
+                    us(histogram.percentile(0.999)), us(histogram.percentile(0.9999)), us(histogram.max()));
+    else
+        std::printf("%-11s %10llu %11.0f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %10.1f\n", name,
+                    (unsigned long long)histogram.count(), histogram.count() / seconds, histogram.mean() / 1000,
+                    us(histogram.percentile(0.5)), us(histogram.percentile(0.9)), us(histogram.percentile(0.99)),
+                    us(histogram.percentile(0.999)), us(histogram.percentile(0.9999)), us(histogram.max()));
+}
+
+static bool parseMix(const char* text, Options& options)
+{
+    std::fill(options.weights, options.weights + TYPES, 0);
+    std::stringstream stream(text);
+    std::string item;
+    unsigned total = 0;
+    while(std::getline(stream, item, ','))
+    {
+        size_t colon = item.find(':');
+        int type = 0;
+        while(type < TYPES && item.compare(0, colon, TYPE_NAMES[type]) != 0)
+            type++;
+        if(type == TYPES || colon == std::string::npos)
+            return false;
+        options.weights[type] = std::atoi(item.c_str() + colon + 1);
+        total += options.weights[type];
+    }
+    return total > 0;
+}
+
+int main(int argc, const char* argv[])
+{
+    Options options;
+    for(int i = 1; i < argc; i++)
+    {
+        bool more = i + 1 < argc;
+        if(std::strcmp(argv[i], "--connect") == 0 && more)
+            options.connect = argv[++i];
+        else if(std::strcmp(argv[i], "--spawn") == 0 && more)
+        {
+            std::stringstream stream(argv[++i]);
+            std::string word;
+            while(stream >> word)
+                options.spawn.push_back(word);
+        }
+        else if(std::strcmp(argv[i], "--connections") == 0 && more)
+            options.connections = std::max(1, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "--threads") == 0 && more)
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "--rate") == 0 && more)
+            options.rate = std::atof(argv[++i]);
+        else if(std::strcmp(argv[i], "--pipeline") == 0 && more)
+            options.pipeline = std::max(1, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "--duration") == 0 && more)
+            options.duration = std::atof(argv[++i]);
+        else if(std::strcmp(argv[i], "--mix") == 0 && more)
+        {
+            if(!parseMix(argv[++i], options))
+            {
+                std::fprintf(stderr, "bad --mix %s\n", argv[i]);
+                return 2;
+            }
+        }
+        else if(std::strcmp(argv[i], "--keys") == 0 && more)
+            options.keys = std::max(1LL, std::atoll(argv[++i]));
+        else if(std::strcmp(argv[i], "--values") == 0 && more)
+            options.values = std::max(1LL, std::atoll(argv[++i]));
+        else if(std::strcmp(argv[i], "--value-size") == 0 && more)
+            options.valueSize = std::atoll(argv[++i]);
+        else if(std::strcmp(argv[i], "--batch") == 0 && more)
+            options.batch = std::max(1, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "--zipf") == 0 && more)
+            options.zipf = std::atof(argv[++i]);
+        else if(std::strcmp(argv[i], "--preload") == 0)
+            options.preload = true;
+        else if(std::strcmp(argv[i], "--json") == 0)
+            options.json = true;
+        else
+        {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if(options.connect.empty() == options.spawn.empty())
+    {
+        std::fprintf(stderr, "give one of --connect <address> and --spawn \"<command line>\"\n");
+        return 2;
+    }
+    options.threads = std::min(options.threads, options.connections);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::unique_ptr<Connection> > conns;
+    for(size_t i = 0; i < options.connections; i++)
+    {
+        conns.emplace_back(new Connection());
+        Client& client = conns.back()->client;
+        int status = options.spawn.empty() ? client.connect(options.connect) : client.spawn(options.spawn);
+        if(status != Client::CLIENT_GOOD)
+        {
+            std::fprintf(stderr, "cannot connect: %s\n", std::strerror(errno));
+            return 1;
+        }
+        // Every spawned process has a database of its own; a server is loaded once.
+        if(options.preload && (i == 0 || !options.spawn.empty()) && !preload(options, client))
+        {
+            std::fprintf(stderr, "preload failed: %s\n", std::strerror(errno));
+            return 1;
+        }
+    }
+
+    std::vector<Stats> stats(options.threads);
+    std::vector<std::thread> threads;
+    uint64_t start = now();
+    for(size_t t = 0; t < options.threads; t++)
+    {
+        std::vector<Connection*> mine;
+        size_t first = t * options.connections / options.threads;
+        size_t last = (t + 1) * options.connections / options.threads;
+        for(size_t i = first; i < last; i++)
+            mine.push_back(conns[i].get());
+        threads.emplace_back(runThread, std::cref(options), mine, first, start, std::ref(stats[t]));
+    }
+    for(std::thread& thread: threads)
+        thread.join();
+    double seconds = (now() - start) / 1e9;
+
+    Stats total;
+    Histogram all;
+    for(Stats& s: stats)
+    {
+        for(int type = 0; type < TYPES; type++)
+            total.histograms[type].merge(s.histograms[type]);
+        total.errors += s.errors;
+        total.failures += s.failures;
+    }
+    if(!options.json)
+    {
+        std::printf("%zu connections, %zu threads, %s, %.1f s, %llu error replies, %llu connections lost\n",
+                    options.connections, options.threads, options.rate > 0 ? "open loop" : "closed loop", seconds,
+                    (unsigned long long)total.errors, (unsigned long long)total.failures);
+        std::printf("%-11s %10s %11s %9s %9s %9s %9s %9s %9s %10s   (latencies in us)\n", "command", "count",
+                    "ops/s", "mean", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+    }
+    for(int type = 0; type < TYPES; type++)
+    {
+        all.merge(total.histograms[type]);
+        if(total.histograms[type].count() > 0)
+            report(options, TYPE_NAMES[type], total.histograms[type], seconds);
+    }
+    report(options, "all", all, seconds);
+    for(auto& conn: conns)
+    {
+        if(conn->client.getReadFd() >= 0)
+        {
+            conn->client.append(std::vector<std::string_view>{"END"});
+            conn->client.flush();
+        }
+    }
+    return total.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#include "BenchUtil.hpp"
+#include "../src/Database.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <string>
+#include <vector>
+
+/**
+ * Heap bytes per key of a Database loaded with n keys, measured with mallinfo2() so that allocator overhead is
+ * included. Each run uses a fixed number of distinct values of a given length, e.g. short status flags or longer
+ * status strings that do not fit the small-string buffer of std::string. The arena statistics are printed after the
+ * load and again after a churn phase that unsets half of the keys and sets as many new ones, which should reuse the
+ * freed blocks instead of adding slabs.
+ *
+ * Usage: simpleDB_memory_bench [keys]   (default: 1000000)
+ */
+
+static size_t heapInUse()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+static void printStats(const char* phase, const Database& db)
+{
+    ArenaStats stats = db.arenaStats();
+    std::printf("    %-6s arena live %10zu wasted %9zu slabs %6zu, tables %10zu bytes\n", phase, stats.liveBytes,
+                stats.wastedBytes, stats.slabCount, db.tableBytes());
+}
+
+static void run(size_t keys, size_t distinct, size_t valueLength)
+{
+    std::vector<std::string> values;
+    char buffer[64];
+    for(size_t i = 0; i < distinct; i++)
+    {
+        std::string value(formatKey(buffer, "v", i));
+        value.resize(valueLength, 'x');
+        values.push_back(value);
+    }
+
+    size_t before = heapInUse();
+    {
+        Database db;
+        for(size_t i = 0; i < keys; i++)
+            db.dbSet(formatKey(buffer, "user:session:", i), values[i % distinct]);
+        size_t after = heapInUse();
+        std::printf("%10zu keys %7zu values of %3zu bytes: %7.1f bytes/key\n", keys, distinct, valueLength,
+                    (double)(after - before) / keys);
+        printStats("load", db);
+        for(size_t i = 0; i < keys; i += 2)
+        {
+            db.dbUnset(formatKey(buffer, "user:session:", i));
+            db.dbSet(formatKey(buffer, "user:session:x", i), values[(i + 1) % distinct]);
+        }
+        printStats("churn", db);
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    run(keys, 2, 4);
+    run(keys, 100, 8);
+    run(keys, 10, 32);
+    run(keys, keys, 16);
+    return 0;
+}
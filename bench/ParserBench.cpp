@@ -0,0 +1,146 @@
+#include "BenchUtil.hpp"
+#include "../src/Command.hpp"
+#include "../src/Database.hpp"
+#include "../src/Parser.hpp"
+#include "../src/Printer.hpp"
+#include "../src/Reader.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Parse throughput per command type. For every command type a batch of lines is run through
+ *   legacy - the old Reader::run path: std::stringstream, isPrefix() chain, std::string tokens and a heap
+ *            allocated Command (without executing it),
+ *   parse  - Parser::parse into a reused ParsedCommand,
+ *   run    - Reader::run, parsing and executing against a Database in quiet mode,
+ * and the number of heap allocations per command is reported for each path.
+ *
+ * Usage: simpleDB_parser_bench [lines_per_type]
+ */
+
+static size_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    allocations++;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if(p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {std::free(p);}
+void operator delete(void* p, size_t) noexcept {std::free(p);}
+
+static bool isPrefix(const std::string& haystack, const std::string& needle)
+{
+    return haystack.substr(0, needle.size()) == needle;
+}
+
+static std::shared_ptr<Command> legacyParse(const std::string& inCmd)
+{
+    std::stringstream buffer(inCmd);
+    std::string cmd, key, value;
+    if(isPrefix(inCmd, "SET"))
+    {
+        buffer >> cmd >> key >> value;
+        return std::shared_ptr<Command>(new CmdSet(key, value));
+    }
+    else if(isPrefix(inCmd, "UNSET"))
+    {
+        buffer >> cmd >> key;
+        return std::shared_ptr<Command>(new CmdUnset(key));
+    }
+    else if(isPrefix(inCmd, "GET"))
+    {
+        buffer >> cmd >> key;
+        return std::shared_ptr<Command>(new CmdGet(key));
+    }
+    else if(isPrefix(inCmd, "NUMEQUALTO"))
+    {
+        buffer >> cmd >> value;
+        return std::shared_ptr<Command>(new CmdNumEqualTo(value));
+    }
+    else if(isPrefix(inCmd, "BEGIN"))
+        return std::shared_ptr<Command>(new CmdBegin());
+    else if(isPrefix(inCmd, "ROLLBACK"))
+        return std::shared_ptr<Command>(new CmdRollback());
+    else if(isPrefix(inCmd, "COMMIT"))
+        return std::shared_ptr<Command>(new CmdCommit());
+    else if(isPrefix(inCmd, "END"))
+        return std::shared_ptr<Command>(new CmdEnd());
+    return nullptr;
+}
+
+static void report(const char* type, const char* path, size_t lines, double seconds, size_t allocs)
+{
+    std::printf("%-11s %-7s %10.2f Mcmd/s %8.1f ns/cmd %6.2f allocs/cmd\n", type, path,
+                lines / seconds / 1e6, seconds * 1e9 / lines, (double)allocs / lines);
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t lines = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const char* formats[][2] = {
+        {"SET", "SET key%zu %zu"},
+        {"GET", "GET key%zu"},
+        {"UNSET", "UNSET key%zu"},
+        {"NUMEQUALTO", "NUMEQUALTO %zu"},
+        {"BEGIN", "BEGIN"},
+        {"COMMIT", "COMMIT"},
+    };
+    Printer::getInstance().setEcho(false);
+    Printer::getInstance().setFlushPolicy(Printer::FLUSH_FULL);
+
+    for(auto& format: formats)
+    {
+        std::vector<std::string> input;
+        input.reserve(lines);
+        char line[64];
+        for(size_t i = 0; i < lines; i++)
+        {
+            std::snprintf(line, sizeof(line), format[1], i % 10000, i % 100);
+            input.push_back(line);
+        }
+
+        size_t before = allocations;
+        size_t check = 0;
+        Timer timer;
+        for(auto& text: input)
+            check += legacyParse(text)->name();
+        report(format[0], "legacy", lines, timer.seconds(), allocations - before);
+
+        ParsedCommand parsed;
+        before = allocations;
+        timer.reset();
+        for(auto& text: input)
+            check += Parser::parse(text, parsed) + parsed.args.size();
+        report(format[0], "parse", lines, timer.seconds(), allocations - before);
+
+        auto db = std::shared_ptr<Database>(new Database());
+        Reader reader(db);
+        for(size_t i = 0; i < 10000; i++)
+        {
+            std::snprintf(line, sizeof(line), "SET key%zu %zu", i, i % 100);
+            reader.run(std::string_view(line));
+        }
+        {
+            MuteStdout mute;
+            before = allocations;
+            timer.reset();
+            for(auto& text: input)
+                check += reader.run(text);
+            double seconds = timer.seconds();
+            size_t allocs = allocations - before;
+            Printer::getInstance().flush();
+            report(format[0], "run", lines, seconds, allocs);
+        }
+        if(check == 0)
+            std::printf("unexpected checksum\n");
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include "BenchUtil.hpp"
+#include "../src/Database.hpp"
+#include "../src/RcuDatabase.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Reader scaling under a single writer. One writer thread SETs uniformly chosen keys of a database preloaded with
+ * 1M keys as fast as it can, while 1, 2, 4, ... reader threads run 95% GET and 5% NUMEQUALTO for a fixed time.
+ * Three stores are compared:
+ *   mutex  - a Database behind one std::mutex
+ *   rwlock - a Database behind a std::shared_mutex, readers share it
+ *   rcu    - an RcuDatabase, readers take no lock
+ * Ideal scaling keeps reads/s growing linearly with the readers, up to the number of cores, without slowing the
+ * writer down.
+ *
+ * Usage: simpleDB_rcu_bench [seconds] [max_readers]   (default: 1 64)
+ */
+
+static const size_t PRELOAD = 1000000;
+
+class MutexStore
+{
+public:
+    void set(std::string_view key, std::string_view value)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        db.dbSet(key, value);
+    }
+    void get(std::string_view key, std::string& value)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        db.dbGet(key, value);
+    }
+    void numEqualTo(std::string_view value, int& count)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        db.dbNumEqualTo(value, count);
+    }
+
+private:
+    Database db;
+    std::mutex lock;
+};
+
+class RwLockStore
+{
+public:
+    void set(std::string_view key, std::string_view value)
+    {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        db.dbSet(key, value);
+    }
+    void get(std::string_view key, std::string& value)
+    {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        db.dbGet(key, value);
+    }
+    void numEqualTo(std::string_view value, int& count)
+    {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        db.dbNumEqualTo(value, count);
+    }
+
+private:
+    Database db;
+    std::shared_mutex lock;
+};
+
+class RcuStore
+{
+public:
+    void set(std::string_view key, std::string_view value) {db.dbSet(key, value);}
+    void get(std::string_view key, std::string& value) {db.dbGet(key, value);}
+    void numEqualTo(std::string_view value, int& count) {db.dbNumEqualTo(value, count);}
+
+private:
+    RcuDatabase db;
+};
+
+struct Result
+{
+    double reads; // Per second, all readers together.
+    double writes; // Per second.
+};
+
+template <typename Store>
+static Result run(Store& store, size_t readers, double seconds)
+{
+    std::atomic<bool> stop(false);
+    std::vector<size_t> reads(readers * 8, 0); // Counters 64 bytes apart.
+    size_t writes = 0;
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]() {
+        Random random(1);
+        char key[32], value[32];
+        while(!stop.load(std::memory_order_relaxed))
+        {
+            uint64_t r = random.next();
+            store.set(formatKey(key, "key:", (r >> 8) % PRELOAD), formatKey(value, "v", (r >> 40) % 100));
+            writes++;
+        }
+    });
+    for(size_t t = 0; t < readers; t++)
+        threads.emplace_back([&, t]() {
+            Random random(t + 2);
+            char key[32], value[32];
+            std::string out;
+            int count = 0;
+            size_t done = 0;
+            while(!stop.load(std::memory_order_relaxed))
+            {
+                uint64_t r = random.next();
+                if(r % 100 < 5)
+                    store.numEqualTo(formatKey(value, "v", (r >> 40) % 100), count);
+                else
+                    store.get(formatKey(key, "key:", (r >> 8) % PRELOAD), out);
+                done++;
+            }
+            reads[t * 8] = done;
+        });
+    Timer timer;
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for(std::thread& thread: threads)
+        thread.join();
+    double elapsed = timer.seconds();
+    size_t total = 0;
+    for(size_t t = 0; t < readers; t++)
+        total += reads[t * 8];
+    return Result{total / elapsed, writes / elapsed};
+}
+
+template <typename Store>
+static void preload(Store& store)
+{
+    char key[32], value[32];
+    for(size_t i = 0; i < PRELOAD; i++)
+        store.set(formatKey(key, "key:", i), formatKey(value, "v", i % 100));
+}
+
+int main(int argc, const char* argv[])
+{
+    double seconds = argc > 1 ? std::atof(argv[1]) : 1;
+    size_t maxReaders = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 64;
+
+    MutexStore mutexStore;
+    RwLockStore rwLockStore;
+    RcuStore rcuStore;
+    preload(mutexStore);
+    preload(rwLockStore);
+    preload(rcuStore);
+
+    std::printf("%u hardware threads, %.1f s per run, reads and writes in Mops/s\n", std::thread::hardware_concurrency(),
+                seconds);
+    for(size_t readers = 1; readers <= maxReaders; readers *= 2)
+    {
+        Result mutex = run(mutexStore, readers, seconds);
+        Result rwLock = run(rwLockStore, readers, seconds);
+        Result rcu = run(rcuStore, readers, seconds);
+        std::printf("readers=%-2zu mutex %7.2f reads %6.2f writes   rwlock %7.2f reads %6.2f writes   "
+                    "rcu %7.2f reads %6.2f writes\n", readers, mutex.reads / 1e6, mutex.writes / 1e6,
+                    rwLock.reads / 1e6, rwLock.writes / 1e6, rcu.reads / 1e6, rcu.writes / 1e6);
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include "BenchUtil.hpp"
+#include "../src/InputFile.hpp"
+#include "../src/Parser.hpp"
+#include "../src/Scanner.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Input scanning throughput in GB/s, for every Scanner level the CPU supports. The input is a command file given on
+ * the command line, or a generated one of about 64 MB that mixes SET, GET, UNSET, NUMEQUALTO, MSET, MGET and
+ * transaction commands with realistic key and value lengths. Measured are
+ *   lines - finding every line with Scanner::findNewline(), against memchr() as a reference,
+ *   split - lines plus Scanner::split() of every line, against the byte loop of Parser::nextToken(),
+ *   parse - lines plus Parser::parse() of every line (split and keyword classification).
+ * Before timing, all levels are checked to give the same lines and tokens as the scalar level, on the input and on
+ * random lines full of whitespace and non-ASCII bytes; the program fails if they differ.
+ *
+ * Usage: simpleDB_scan_bench [command_file] [rounds]
+ */
+
+static std::string generate(size_t bytes)
+{
+    Random random(5);
+    std::string text;
+    char key[32], value[64];
+    while(text.size() < bytes)
+    {
+        uint64_t r = random.below(100);
+        std::string_view k = formatKey(key, "user:session:", random.below(1000000));
+        std::string_view v = formatKey(value, "value-0123456789-", random.below(10000));
+        if(r < 40)
+            ((((text += "SET ") += k) += ' ') += v) += '\n';
+        else if(r < 75)
+            ((text += "GET ") += k) += '\n';
+        else if(r < 82)
+            ((text += "UNSET ") += k) += '\n';
+        else if(r < 88)
+            ((text += "NUMEQUALTO ") += v) += '\n';
+        else if(r < 92)
+        {
+            text += "MGET";
+            for(int i = 0; i < 8; i++)
+                (text += ' ') += formatKey(key, "user:session:", random.below(1000000));
+            text += '\n';
+        }
+        else if(r < 94)
+        {
+            text += "MSET";
+            for(int i = 0; i < 4; i++)
+                (((text += ' ') += formatKey(key, "user:session:", random.below(1000000))) += ' ') += v;
+            text += '\n';
+        }
+        else if(r < 97)
+            text += "BEGIN\n";
+        else if(r < 99)
+            text += "ROLLBACK\n";
+        else
+            text += "COMMIT\n";
+    }
+    return text;
+}
+
+static std::string randomLine(Random& random)
+{
+    static const char alphabet[] = " \t\n\r\v\f\x08\x0e\x7f\x80\xff" "ab";
+    std::string line(random.below(200), ' ');
+    for(char& c: line)
+        c = alphabet[random.below(sizeof(alphabet) - 1)];
+    return line;
+}
+
+static bool sameTokens(std::string_view line, int level)
+{
+    std::vector<std::string_view> expected, got;
+    Scanner::setLevel(Scanner::SCANNER_SCALAR);
+    Scanner::split(line, expected);
+    Scanner::setLevel(level);
+    Scanner::split(line, got);
+    return expected == got;
+}
+
+static void verify(std::string_view text, int best)
+{
+    Random random(9);
+    for(int level = Scanner::SCANNER_SSE2; level <= best; level++)
+    {
+        const char* end = text.data() + text.size();
+        for(const char* p = text.data(); p < end; )
+        {
+            Scanner::setLevel(Scanner::SCANNER_SCALAR);
+            const char* expected = Scanner::findNewline(p, end);
+            Scanner::setLevel(level);
+            if(Scanner::findNewline(p, end) != expected ||
+               !sameTokens(std::string_view(p, expected - p), level))
+            {
+                std::printf("%s differs from scalar at byte %zu\n", Scanner::levelName(level),
+                            (size_t)(p - text.data()));
+                std::exit(1);
+            }
+            p = expected + 1;
+        }
+        for(int i = 0; i < 100000; i++)
+        {
+            std::string line = randomLine(random);
+            if(!sameTokens(line, level))
+            {
+                std::printf("%s differs from scalar on a random line of %zu bytes\n", Scanner::levelName(level),
+                            line.size());
+                std::exit(1);
+            }
+        }
+    }
+}
+
+// Call f(line) for every line of text.
+template <typename F>
+static void forLines(std::string_view text, bool useMemchr, F f)
+{
+    const char* end = text.data() + text.size();
+    for(const char* p = text.data(); p < end; )
+    {
+        const char* newline = useMemchr ? static_cast<const char*>(std::memchr(p, '\n', end - p))
+                                        : Scanner::findNewline(p, end);
+        if(newline == nullptr)
+            newline = end;
+        f(std::string_view(p, newline - p));
+        p = newline + 1;
+    }
+}
+
+template <typename F>
+static void measure(const char* name, std::string_view text, int rounds, F f)
+{
+    Timer timer;
+    for(int i = 0; i < rounds; i++)
+        f();
+    std::printf("  %-22s %7.2f GB/s\n", name, text.size() * (double)rounds / timer.seconds() / 1e9);
+}
+
+int main(int argc, const char* argv[])
+{
+    std::string text;
+    if(argc > 1 && std::strcmp(argv[1], "-") != 0)
+    {
+        InputFile input;
+        if(input.open(argv[1]) != InputFile::FILE_GOOD)
+        {
+            std::printf("cannot open %s\n", argv[1]);
+            return 1;
+        }
+        std::string_view line;
+        while(input.nextLine(line))
+            (text += line) += '\n';
+    }
+    else
+        text = generate(64 << 20);
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+    int best = Scanner::bestLevel();
+    verify(text, best);
+
+    size_t sink = 0;
+    std::printf("%.1f MB of commands, best level %s\n", text.size() / 1e6, Scanner::levelName(best));
+    auto countLines = [&](std::string_view line) {sink += line.size();};
+    measure("lines memchr", text, rounds, [&]() {forLines(text, true, countLines);});
+    ParsedCommand parsed;
+    measure("split nextToken", text, rounds, [&]()
+    {
+        forLines(text, true, [&](std::string_view line)
+        {
+            size_t pos = 0;
+            while(!Parser::nextToken(line, pos).empty())
+                sink++;
+        });
+    });
+    for(int level = Scanner::SCANNER_SCALAR; level <= best; level++)
+    {
+        Scanner::setLevel(level);
+        std::printf("%s\n", Scanner::levelName(level));
+        measure("lines", text, rounds, [&]() {forLines(text, false, countLines);});
+        measure("split", text, rounds, [&]()
+        {
+            forLines(text, false, [&](std::string_view line)
+            {
+                parsed.args.clear();
+                Scanner::split(line, parsed.args);
+                sink += parsed.args.size();
+            });
+        });
+        measure("parse", text, rounds, [&]()
+        {
+            forLines(text, false, [&](std::string_view line) {sink += Parser::parse(line, parsed);});
+        });
+    }
+    Scanner::setLevel(best);
+    return sink == 1 ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+#include "BenchUtil.hpp"
+#include "../src/Client.hpp"
+#include "../src/Database.hpp"
+#include "../src/Printer.hpp"
+#include "../src/Reader.hpp"
+#include "../src/Server.hpp"
+#include "../src/ShardedDatabase.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * What a rule costs as separate commands against one EVAL. The rule reads a key, sets another one if the value read
+ * is below a limit (it always is) and bumps a counter. Each rule runs through Reader::run in quiet mode:
+ *   lines    - three lines, "GET k", "SET k:seen v" and "INCRBY hits 1", parsed and executed one at a time, as a
+ *              client without scripts sends them (on a network connection, also three round trips).
+ *   eval     - one EVAL line of the rule with the keys as arguments: the script is compiled once and then found in the
+ *              cache of the session.
+ *   compiled - one EVAL line of the rule with the keys written in the script, so that every line is a new script
+ *              that is compiled before it runs.
+ * In rules per second and ns per rule, for the undo engine and for 4 shards. Then, through a server on a Unix-domain
+ * socket in the same process, one client that runs the rule itself with a round trip per command, against one EVAL
+ * per rule, which is what a client saves by sending its rules as scripts.
+ *
+ * Usage: simpleDB_script_bench [keys] [rules]   (default: 1000000 keys, 1000000 rules per measurement; a tenth of
+ *                                                 the rules through the socket)
+ */
+
+static const char* const RULE = "@v = GET $1; IF @v < 1000; SET $2 $1; END; INCRBY hits 1";
+
+static double runLines(Reader& reader, const std::vector<std::string>& lines)
+{
+    MuteStdout mute;
+    Timer timer;
+    for(const std::string& line: lines)
+        reader.run(line);
+    Printer::getInstance().flush();
+    return timer.seconds();
+}
+
+static void report(const char* name, size_t rules, double seconds, double base)
+{
+    std::printf("  %-9s %10.0f rules/s %8.1f ns/rule %6.2fx\n", name, rules / seconds, seconds * 1e9 / rules,
+                base / seconds);
+    std::fflush(stdout);
+}
+
+static void run(const char* name, Reader& reader, size_t keys, size_t rules)
+{
+    Random random(5);
+    std::vector<std::string> lines, evals, compiled;
+    char key[32];
+    for(size_t i = 0; i < rules; i++)
+    {
+        std::string k(formatKey(key, "key:", random.below(keys)));
+        lines.push_back("GET " + k);
+        lines.push_back("SET " + k + ":seen " + k);
+        lines.push_back("INCRBY hits 1");
+        evals.push_back(std::string("EVAL ") + RULE + " ARGS " + k + " " + k + ":seen");
+        compiled.push_back("EVAL @v = GET " + k + "; IF @v < 1000; SET " + k + ":seen " + k + "; END; INCRBY hits 1");
+    }
+    std::printf("%s\n", name);
+    double base = runLines(reader, lines);
+    report("lines", rules, base, base);
+    report("eval", rules, runLines(reader, evals), base);
+    report("compiled", rules, runLines(reader, compiled), base);
+}
+
+// The rule run by a client: a round trip for GET, and then for SET and INCRBY.
+static bool ruleByCommands(Client& client, std::string_view key, std::string_view seen, Reply& reply)
+{
+    if(client.call({"GET", key}, reply) != Client::CLIENT_GOOD)
+        return false;
+    if(reply.type == Reply::REPLY_BULK && std::strtoll(reply.text.c_str(), nullptr, 10) < 1000 &&
+       client.call({"SET", seen, key}, reply) != Client::CLIENT_GOOD)
+        return false;
+    return client.call({"INCRBY", "hits", "1"}, reply) == Client::CLIENT_GOOD;
+}
+
+static void runSocket(std::shared_ptr<Database> db, size_t keys, size_t rules)
+{
+    std::string path = "/tmp/simpleDB_script_bench." + std::to_string(getpid()) + ".sock";
+    Server server(db);
+    if(server.listen("unix:" + path) != Server::SERVER_GOOD)
+    {
+        std::printf("socket: cannot listen on %s\n", path.c_str());
+        return;
+    }
+    std::thread thread([&server]() {server.run();});
+    Client client;
+    Random random(9);
+    std::vector<std::string> names(rules);
+    char key[32];
+    for(size_t i = 0; i < rules; i++)
+        names[i] = formatKey(key, "key:", random.below(keys));
+    Reply reply;
+    bool ok = client.connect("unix:" + path) == Client::CLIENT_GOOD;
+    std::printf("socket\n");
+    Timer timer;
+    for(size_t i = 0; ok && i < rules; i++)
+        ok = ruleByCommands(client, names[i], names[i] + ":seen", reply);
+    double base = timer.seconds();
+    if(ok)
+        report("commands", rules, base, base);
+    timer.reset();
+    for(size_t i = 0; ok && i < rules; i++)
+        ok = client.call({"EVAL", RULE, "ARGS", names[i], names[i] + ":seen"}, reply) == Client::CLIENT_GOOD &&
+             reply.type != Reply::REPLY_ERROR;
+    if(ok)
+        report("eval", rules, timer.seconds(), base);
+    else
+        std::printf("socket: the rule failed\n");
+    client.close();
+    server.stop();
+    thread.join();
+    unlink(path.c_str());
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t rules = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+    Printer::getInstance().setEcho(false);
+    Printer::getInstance().setFlushPolicy(Printer::FLUSH_FULL);
+    std::printf("%zu keys, %zu rules per measurement\n", keys, rules);
+
+    char key[32], value[32];
+    std::shared_ptr<Database> db(new Database());
+    for(size_t i = 0; i < keys; i++)
+        db->dbSet(formatKey(key, "key:", i), formatKey(value, "", i % 1000));
+    Reader undo(db);
+    run("undo", undo, keys, rules);
+
+    std::shared_ptr<ShardedDatabase> shards(new ShardedDatabase(4));
+    for(size_t i = 0; i < keys; i++)
+        shards->dbSet(formatKey(key, "key:", i), formatKey(value, "", i % 1000));
+    Reader sharded(Engine::create(shards), nullptr);
+    run("4 shards", sharded, keys, rules);
+
+    runSocket(db, keys, std::max<size_t>(rules / 10, 1));
+    return 0;
+}
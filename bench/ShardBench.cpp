@@ -0,0 +1,142 @@
+#include "BenchUtil.hpp"
+#include "../src/Database.hpp"
+#include "../src/Engine.hpp"
+#include "../src/ShardedDatabase.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Scaling of concurrent sessions from 1 to 64 threads. Every thread runs a session of its own (an engine outside of
+ * any transaction block) that executes GETs and SETs of uniformly chosen keys of a database preloaded with 1M keys,
+ * in one of three ratios:
+ *   read-heavy  - 95% GET, 5% SET
+ *   mixed       - 50% GET, 50% SET
+ *   write-heavy - 10% GET, 90% SET
+ * and every 1000th operation of a thread is a NUMEQUALTO. Two stores are compared: "global" is a single Database
+ * behind one mutex, "sharded" is a ShardedDatabase with one lock per shard. The total number of operations is fixed,
+ * so ideal scaling keeps the time per run falling with the thread count, up to the number of cores.
+ *
+ * Usage: simpleDB_shard_bench [ops] [shards]   (default: 4000000 64)
+ */
+
+static const size_t PRELOAD = 1000000;
+
+// A session on a single Database with one global lock.
+class GlobalSession
+{
+public:
+    GlobalSession(Database& inDb, std::mutex& inLock): db(inDb), lock(inLock) {}
+
+    void set(std::string_view key, std::string_view value)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        db.dbSet(key, value);
+    }
+    void get(std::string_view key, std::string& value)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        db.dbGet(key, value);
+    }
+    void numEqualTo(std::string_view value, int& count)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        db.dbNumEqualTo(value, count);
+    }
+
+private:
+    Database& db;
+    std::mutex& lock;
+};
+
+// A session on a ShardedDatabase.
+class ShardedSession
+{
+public:
+    ShardedSession(std::shared_ptr<ShardedDatabase> db): engine(Engine::create(db)) {}
+
+    void set(std::string_view key, std::string_view value) {engine->dbSet(key, value);}
+    void get(std::string_view key, std::string& value) {engine->dbGet(key, value);}
+    void numEqualTo(std::string_view value, int& count) {engine->dbNumEqualTo(value, count);}
+
+private:
+    std::shared_ptr<Engine> engine;
+};
+
+template <typename Session>
+static void work(Session& session, uint64_t seed, size_t ops, unsigned readPercent)
+{
+    Random random(seed);
+    char key[32], value[32];
+    std::string out;
+    int count = 0;
+    for(size_t i = 1; i <= ops; i++)
+    {
+        uint64_t r = random.next();
+        std::string_view k = formatKey(key, "key:", (r >> 8) % PRELOAD);
+        if(i % 1000 == 0)
+            session.numEqualTo(formatKey(value, "v", r % 100), count);
+        else if((r & 0xFF) * 100 < readPercent * 256)
+            session.get(k, out);
+        else
+            session.set(k, formatKey(value, "v", (r >> 40) % 100));
+    }
+}
+
+template <typename MakeSession>
+static double run(size_t threads, size_t ops, unsigned readPercent, MakeSession makeSession)
+{
+    std::vector<std::thread> workers;
+    Timer timer;
+    for(size_t t = 0; t < threads; t++)
+        workers.emplace_back([&, t]() {
+            auto session = makeSession();
+            work(session, t + 1, ops / threads, readPercent);
+        });
+    for(std::thread& worker: workers)
+        worker.join();
+    return timer.seconds();
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t ops = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+    size_t shards = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : ShardedDatabase::DEFAULT_SHARDS;
+
+    Database globalDb;
+    std::mutex globalLock;
+    auto shardedDb = std::shared_ptr<ShardedDatabase>(new ShardedDatabase(shards));
+    char key[32], value[32];
+    for(size_t i = 0; i < PRELOAD; i++)
+    {
+        globalDb.dbSet(formatKey(key, "key:", i), formatKey(value, "v", i % 100));
+        shardedDb->dbSet(formatKey(key, "key:", i), formatKey(value, "v", i % 100));
+    }
+
+    std::printf("%u hardware threads, %zu shards, %zu ops per run\n", std::thread::hardware_concurrency(),
+                shardedDb->shardCount(), ops);
+    const char* names[] = {"read-heavy", "mixed", "write-heavy"};
+    const unsigned reads[] = {95, 50, 10};
+    for(size_t w = 0; w < 3; w++)
+    {
+        double globalBase = 0, shardedBase = 0;
+        for(size_t threads = 1; threads <= 64; threads *= 2)
+        {
+            double global = run(threads, ops, reads[w], [&]() {return GlobalSession(globalDb, globalLock);});
+            double sharded = run(threads, ops, reads[w], [&]() {return ShardedSession(shardedDb);});
+            if(threads == 1)
+            {
+                globalBase = global;
+                shardedBase = sharded;
+            }
+            std::printf("%-11s threads=%-2zu global %7.2f Mops/s (x%5.2f)   sharded %7.2f Mops/s (x%5.2f)\n", names[w],
+                        threads, ops / global / 1e6, globalBase / global, ops / sharded / 1e6, shardedBase / sharded);
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "BenchUtil.hpp"
+#include "../src/Database.hpp"
+#include "../src/ShardedDatabase.hpp"
+#include "../src/Snapshot.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Snapshot save and load against the dataset size. For every size, a Database is filled with keys "key:<n>" holding
+ * 32-byte values drawn from 10000 distinct ones, and then:
+ *   save      - SAVE: the file is written in the foreground; reports MB/s and the file size.
+ *   bgsave    - BGSAVE: reports how long the store was locked for the fork, how long the child took, and the latency
+ *               of SETs to random keys run in the parent until the child is done, against the same SETs without a
+ *               background save (copy-on-write faults show up in the tail).
+ *   load      - the file loaded into an empty Database and into a ShardedDatabase with 1 thread and with one thread
+ *               per hardware thread.
+ *
+ * Usage: simpleDB_snapshot_bench [keys...]   (default: 250000 1000000 4000000; the file is written to $TMPDIR or /tmp)
+ */
+
+static std::string makeValue(uint64_t n)
+{
+    char buffer[32];
+    std::string value = "value-";
+    value += formatKey(buffer, "", n);
+    value.resize(32, '.');
+    return value;
+}
+
+static void fill(Database& db, size_t keys, const std::vector<std::string>& values)
+{
+    char key[32];
+    db.reserve(keys);
+    for(size_t i = 0; i < keys; i++)
+        db.dbSet(formatKey(key, "key:", i), values[i % values.size()]);
+}
+
+struct Latency
+{
+    double p50, p99, p999, max; // Microseconds.
+    size_t ops;
+};
+
+static Latency summarize(std::vector<double>& samples)
+{
+    std::sort(samples.begin(), samples.end());
+    if(samples.empty())
+        return Latency{0, 0, 0, 0, 0};
+    auto at = [&](double q) {return samples[std::min(samples.size() - 1, (size_t)(q * samples.size()))] * 1e6;};
+    return Latency{at(0.5), at(0.99), at(0.999), samples.back() * 1e6, samples.size()};
+}
+
+// Time SETs to random keys until done() is true, or for count SETs if count is not 0.
+template <typename Done>
+static Latency timeSets(Database& db, size_t keys, const std::vector<std::string>& values, size_t count, Done done)
+{
+    Random random(7);
+    std::vector<double> samples;
+    char key[32];
+    for(size_t i = 0; count == 0 ? (i % 256 != 0 || !done()) : i < count; i++)
+    {
+        uint64_t r = random.next();
+        Timer timer;
+        db.dbSet(formatKey(key, "key:", r % keys), values[(r >> 32) % values.size()]);
+        samples.push_back(timer.seconds());
+    }
+    return summarize(samples);
+}
+
+static void printLatency(const char* name, const Latency& latency)
+{
+    std::printf("  %-18s %9zu SETs  p50 %6.2f us  p99 %7.2f us  p99.9 %8.2f us  max %9.1f us\n", name, latency.ops,
+                latency.p50, latency.p99, latency.p999, latency.max);
+}
+
+template <typename Store>
+static double timeLoad(Snapshot& snapshot, size_t threads)
+{
+    Store store;
+    Timer timer;
+    if(snapshot.load(store, threads) != Snapshot::SNAPSHOT_GOOD)
+    {
+        std::printf("load failed\n");
+        std::exit(1);
+    }
+    return timer.seconds();
+}
+
+int main(int argc, const char* argv[])
+{
+    std::vector<size_t> sizes;
+    for(int i = 1; i < argc; i++)
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    if(sizes.empty())
+        sizes = {250000, 1000000, 4000000};
+    const char* dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir != nullptr ? dir : "/tmp") + "/simpleDB_snapshot_bench.sdb";
+    std::vector<std::string> values;
+    for(size_t i = 0; i < 10000; i++)
+        values.push_back(makeValue(i));
+    size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+
+    std::printf("%zu hardware threads, snapshot file %s\n", hardware, path.c_str());
+    for(size_t keys: sizes)
+    {
+        Database db;
+        fill(db, keys, values);
+        Snapshot snapshot(path);
+
+        Timer timer;
+        snapshot.save(db, false);
+        double saveSeconds = timer.seconds();
+        struct stat info;
+        stat(path.c_str(), &info);
+        double megabytes = info.st_size / 1e6;
+        std::printf("%zu keys, %.1f MB file\n", keys, megabytes);
+        std::printf("  save               %8.3f s  %8.1f MB/s\n", saveSeconds, megabytes / saveSeconds);
+
+        timer.reset();
+        snapshot.save(db, true);
+        double forkSeconds = timer.seconds();
+        Latency during = timeSets(db, keys, values, 0, [&]() {return !snapshot.busy();});
+        double childSeconds = timer.seconds();
+        Latency baseline = timeSets(db, keys, values, during.ops, []() {return true;});
+        std::printf("  bgsave             %8.3f s  fork %.2f ms\n", childSeconds, forkSeconds * 1e3);
+        printLatency("SET during bgsave", during);
+        printLatency("SET without", baseline);
+
+        std::printf("  load Database      1 thread %7.3f s  %zu threads %7.3f s\n",
+                    timeLoad<Database>(snapshot, 1), hardware, timeLoad<Database>(snapshot, hardware));
+        std::printf("  load Sharded       1 thread %7.3f s  %zu threads %7.3f s\n",
+                    timeLoad<ShardedDatabase>(snapshot, 1), hardware, timeLoad<ShardedDatabase>(snapshot, hardware));
+        std::fflush(stdout);
+    }
+    unlink(path.c_str());
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include "BenchUtil.hpp"
+#include "../src/Database.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Compares the FlatMap based Database with the previous two std::unordered_map tables (kept here as
+ * LegacyDatabase) on the same operation sequences:
+ *   load      - SET of n distinct keys into an empty database,
+ *   get-uni   - n GETs of uniformly chosen keys,
+ *   get-zipf  - n GETs of Zipfian chosen keys (theta 0.99),
+ *   set-zipf  - n SETs of Zipfian chosen keys to one of 100 values,
+ *   churn     - n alternating UNSET/SET pairs of uniformly chosen keys,
+ *   numeq     - n NUMEQUALTO of one of 100 values.
+ *
+ * Usage: simpleDB_table_bench [keys...]   (default: 1000000)
+ */
+
+class LegacyDatabase
+{
+public:
+    int dbSet(const std::string& key, const std::string& value)
+    {
+        decOldValue(key);
+        this->keyToValue[key] = value;
+        this->valueToCount[value]++;
+        return Database::DB_GOOD;
+    }
+
+    int dbUnset(const std::string& key)
+    {
+        if(decOldValue(key) == Database::DB_NOT_FOUND)
+            return Database::DB_NOT_FOUND;
+        this->keyToValue.erase(key);
+        return Database::DB_GOOD;
+    }
+
+    int dbGet(const std::string& key, std::string& value)
+    {
+        auto iter = this->keyToValue.find(key);
+        if(iter == this->keyToValue.end())
+            return Database::DB_NOT_FOUND;
+        value = iter->second;
+        return Database::DB_GOOD;
+    }
+
+    int dbNumEqualTo(const std::string& value, int& count)
+    {
+        count = 0;
+        auto iter = this->valueToCount.find(value);
+        if(iter == this->valueToCount.end())
+            return Database::DB_NOT_FOUND;
+        count = this->valueToCount[value];
+        return Database::DB_GOOD;
+    }
+
+private:
+    std::unordered_map<std::string, std::string> keyToValue;
+    std::unordered_map<std::string, int> valueToCount;
+
+    int decOldValue(const std::string& key)
+    {
+        auto iter = this->keyToValue.find(key);
+        if(iter == this->keyToValue.end())
+            return Database::DB_NOT_FOUND;
+        this->valueToCount[iter->second]--;
+        if(this->valueToCount[iter->second] == 0)
+            this->valueToCount.erase(iter->second);
+        return Database::DB_GOOD;
+    }
+};
+
+static void report(const char* engine, size_t keys, const char* workload, size_t ops, double seconds)
+{
+    std::printf("%-7s %11zu keys %-9s %8.2f Mops/s %8.1f ns/op\n", engine, keys, workload,
+                ops / seconds / 1e6, seconds * 1e9 / ops);
+    std::fflush(stdout);
+}
+
+// The key and value text is built in a std::string so that both engines see the same argument type.
+template <typename DB>
+static void run(const char* engine, size_t keys, const std::vector<uint32_t>& uniform,
+                const std::vector<uint32_t>& zipf)
+{
+    DB db;
+    std::string key, value, out;
+    char buffer[32];
+    size_t found = 0;
+
+    Timer timer;
+    for(size_t i = 0; i < keys; i++)
+    {
+        key.assign(formatKey(buffer, "key:", i));
+        value.assign(formatKey(buffer, "v", i % 100));
+        db.dbSet(key, value);
+    }
+    report(engine, keys, "load", keys, timer.seconds());
+
+    timer.reset();
+    for(uint32_t k: uniform)
+    {
+        key.assign(formatKey(buffer, "key:", k));
+        found += db.dbGet(key, out) == Database::DB_GOOD;
+    }
+    report(engine, keys, "get-uni", uniform.size(), timer.seconds());
+
+    timer.reset();
+    for(uint32_t k: zipf)
+    {
+        key.assign(formatKey(buffer, "key:", k));
+        found += db.dbGet(key, out) == Database::DB_GOOD;
+    }
+    report(engine, keys, "get-zipf", zipf.size(), timer.seconds());
+
+    timer.reset();
+    for(size_t i = 0; i < zipf.size(); i++)
+    {
+        key.assign(formatKey(buffer, "key:", zipf[i]));
+        value.assign(formatKey(buffer, "v", uniform[i] % 100));
+        db.dbSet(key, value);
+    }
+    report(engine, keys, "set-zipf", zipf.size(), timer.seconds());
+
+    timer.reset();
+    for(size_t i = 0; i + 1 < uniform.size(); i += 2)
+    {
+        key.assign(formatKey(buffer, "key:", uniform[i]));
+        db.dbUnset(key);
+        value.assign(formatKey(buffer, "v", uniform[i + 1] % 100));
+        db.dbSet(key, value);
+    }
+    report(engine, keys, "churn", uniform.size(), timer.seconds());
+
+    int count = 0;
+    timer.reset();
+    for(uint32_t k: uniform)
+    {
+        value.assign(formatKey(buffer, "v", k % 100));
+        db.dbNumEqualTo(value, count);
+        found += count;
+    }
+    report(engine, keys, "numeq", uniform.size(), timer.seconds());
+
+    if(found == 0)
+        std::printf("unexpected: nothing found\n");
+}
+
+int main(int argc, const char* argv[])
+{
+    std::vector<size_t> sizes;
+    for(int i = 1; i < argc; i++)
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    if(sizes.empty())
+        sizes.push_back(1000000);
+
+    for(size_t keys: sizes)
+    {
+        Random random(keys);
+        Zipf zipfGen(keys);
+        std::vector<uint32_t> uniform(keys), zipf(keys);
+        for(size_t i = 0; i < keys; i++)
+        {
+            uniform[i] = (uint32_t)random.below(keys);
+            zipf[i] = (uint32_t)zipfGen.next(random);
+        }
+        run<LegacyDatabase>("legacy", keys, uniform, zipf);
+        run<Database>("flat", keys, uniform, zipf);
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "BenchUtil.hpp"
+#include "../src/Database.hpp"
+#include "../src/Engine.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Compares the transaction engines on a Database preloaded with 1M keys. Each workload opens a block, writes n keys
+ * (SET of existing keys, to one of 100 values) and closes it; the time of the writes and of the closing command are
+ * reported separately:
+ *   rollback   - BEGIN, n SETs, ROLLBACK
+ *   commit     - BEGIN, n SETs, COMMIT
+ *   nested     - 10 nested BEGINs with n/10 SETs each, then 10 ROLLBACKs
+ *   read-write - BEGIN, n SETs, n GETs of the written keys, ROLLBACK
+ *
+ * Usage: simpleDB_tx_bench [n...]   (default: 1000 100000 1000000)
+ */
+
+static const size_t PRELOAD = 1000000;
+
+static void report(const char* engine, const char* workload, size_t n, double writeSeconds, double closeSeconds)
+{
+    std::printf("%-8s %-10s n=%-8zu writes %7.1f ns/op   close %10.3f ms (%6.1f ns/key)\n", engine, workload, n,
+                writeSeconds * 1e9 / n, closeSeconds * 1e3, closeSeconds * 1e9 / n);
+    std::fflush(stdout);
+}
+
+static void run(const char* name, int type, size_t n)
+{
+    auto db = std::shared_ptr<Database>(new Database());
+    char key[32], value[32];
+    for(size_t i = 0; i < PRELOAD; i++)
+        db->dbSet(formatKey(key, "key:", i), formatKey(value, "v", i % 100));
+    auto engine = Engine::create(type, db);
+    Random random(n);
+    std::string out;
+
+    const char* workloads[] = {"rollback", "commit", "nested", "read-write"};
+    for(size_t w = 0; w < 4; w++)
+    {
+        size_t levels = w == 2 ? 10 : 1;
+        Timer timer;
+        for(size_t level = 0; level < levels; level++)
+        {
+            engine->begin();
+            for(size_t i = 0; i < n / levels; i++)
+                engine->dbSet(formatKey(key, "key:", random.below(PRELOAD)), formatKey(value, "v", random.below(100)));
+        }
+        if(w == 3)
+            for(size_t i = 0; i < n; i++)
+                engine->dbGet(formatKey(key, "key:", random.below(PRELOAD)), out);
+        double writeSeconds = timer.seconds();
+        timer.reset();
+        if(w == 1)
+            engine->commit();
+        else
+            for(size_t level = 0; level < levels; level++)
+                engine->rollback();
+        report(name, workloads[w], n, writeSeconds, timer.seconds());
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    std::vector<size_t> sizes;
+    for(int i = 1; i < argc; i++)
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    if(sizes.empty())
+        sizes = {1000, 100000, 1000000};
+    for(size_t n: sizes)
+    {
+        run("undo", Engine::ENGINE_UNDO, n);
+        run("overlay", Engine::ENGINE_OVERLAY, n);
+    }
+    return 0;
+}
@@ -1,19 +1,316 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "src/CoreDatabase.hpp"
 #include "src/Database.hpp"
+#include "src/InputFile.hpp"
+#include "src/Printer.hpp"
+#include "src/RcuDatabase.hpp"
 #include "src/Reader.hpp"
+#include "src/Server.hpp"
+#include "src/ShardedDatabase.hpp"
+#include "src/Snapshot.hpp"
+#include "src/Stats.hpp"
+#include "src/VersionedDatabase.hpp"
+#include "src/Wal.hpp"
 
 using namespace std;
 
+static void usage(const char* prog)
+{
+    cerr << "Usage: " << prog << " [-q|--quiet] [--flush=line|full] [--engine=undo|overlay|mvcc|rcu] [-f <file>] [--resp]"
+         << " [--shards <n>|--cores <n>] [--listen <address>]... [--threads <n>]"
+         << " [--wal <file> [--wal-sync always|none|<ms>] [--wal-compact-size <bytes>]] [--snapshot <file>]"
+         << " [--slowlog-threshold <us>] [--slowlog-size <n>]"
+         << " [--maxmemory <bytes> [--maxmemory-policy lru|lfu] [--maxmemory-samples <n>]] [--ordered-index]" << endl;
+    cerr << "  -q, --quiet    print only replies, do not echo input commands" << endl;
+    cerr << "  --flush=line   flush output after every line (default when stdin is a terminal)" << endl;
+    cerr << "  --flush=full   flush output only when the buffer is full or on END" << endl;
+    cerr << "  --engine=undo  apply writes at once and undo them on ROLLBACK (default)" << endl;
+    cerr << "  --engine=overlay  buffer writes of transaction blocks and apply them on COMMIT" << endl;
+    cerr << "  --engine=mvcc  like overlay, and each block reads from a snapshot taken at its BEGIN" << endl;
+    cerr << "  --engine=rcu  like undo, with one writer at a time and GET/NUMEQUALTO taking no lock" << endl;
+    cerr << "  -f <file>      read commands from a file (\"-\" for stdin) in bulk instead of line by line" << endl;
+    cerr << "  --resp         reply to the commands read from stdin or a file in RESP, one reply per command" << endl;
+    cerr << "  --shards <n>   partition the keys into n independently locked shards (undo engine only)" << endl;
+    cerr << "  --cores <n>    partition the keys into n shards, each owned by a thread pinned to a CPU that executes"
+         << " the commands sent to it (undo engine only)" << endl;
+    cerr << "  --listen <address>  serve clients on \"[host:]port\" or \"unix:<path>\" instead of reading stdin" << endl;
+    cerr << "  --threads <n>  serve clients from n worker threads (with the undo engine, implies --shards "
+         << ShardedDatabase::DEFAULT_SHARDS << " unless --shards or --cores is given)" << endl;
+    cerr << "  --wal <file>   restore the database from a write-ahead log and log every commit to it" << endl;
+    cerr << "  --wal-sync always  fsync the log before replying to a commit" << endl;
+    cerr << "  --wal-sync <ms>    fsync the log every <ms> milliseconds (default " << Wal::DEFAULT_INTERVAL_MS << ")"
+         << endl;
+    cerr << "  --wal-sync none    write the log every second and never fsync it" << endl;
+    cerr << "  --wal-compact-size <bytes>  rewrite the log once it has grown past <bytes> (default "
+         << Wal::DEFAULT_COMPACT_SIZE << ")" << endl;
+    cerr << "  --snapshot <file>  load the database from a snapshot file, if it exists, and SAVE/BGSAVE to it" << endl;
+    cerr << "  --slowlog-threshold <us>  list commands that take at least <us> microseconds in INFO (default "
+         << Stats::DEFAULT_SLOW_THRESHOLD_NS / 1000 << ", -1 for none)" << endl;
+    cerr << "  --slowlog-size <n>  keep the <n> most recent slow commands (default " << Stats::DEFAULT_SLOW_LOG_SIZE
+         << ")" << endl;
+    cerr << "  --maxmemory <bytes>  evict keys to keep keys, values and undo logs under <bytes>, which may end in K, M"
+         << " or G (undo and overlay engines only)" << endl;
+    cerr << "  --maxmemory-policy lru  evict the least recently used of the sampled keys (default)" << endl;
+    cerr << "  --maxmemory-policy lfu  evict the least frequently used of the sampled keys" << endl;
+    cerr << "  --maxmemory-samples <n>  sample <n> keys per eviction (default " << Database::DEFAULT_EVICTION_SAMPLES
+         << ")" << endl;
+    cerr << "  --ordered-index  keep the keys in order as well, for SCAN (undo engine only)" << endl;
+}
+
+// Parse a byte count with an optional K, M or G suffix. Return false if it is not one.
+static bool parseBytes(const char* text, size_t& bytes) {
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if(end == text || text[0] == '-')
+        return false;
+    if(*end == 'K' || *end == 'k')
+        value <<= 10;
+    else if(*end == 'M' || *end == 'm')
+        value <<= 20;
+    else if(*end == 'G' || *end == 'g')
+        value <<= 30;
+    else if(*end != '\0')
+        return false;
+    if(*end != '\0' && end[1] != '\0')
+        return false;
+    bytes = value;
+    return true;
+}
+
+// Load a snapshot file into a new store, if there is one. Return false on failure.
+template <typename Store>
+static bool loadSnapshot(Snapshot* snapshot, Store& store)
+{
+    if(snapshot == nullptr || snapshot->load(store, thread::hardware_concurrency()) == Snapshot::SNAPSHOT_GOOD ||
+       errno == ENOENT)
+        return true;
+    cerr << "Cannot load " << snapshot->getPath() << ": " << strerror(errno) << endl;
+    return false;
+}
+
+static Server* activeServer = nullptr;
+
+static void onSignal(int)
+{
+    if(activeServer != nullptr)
+        activeServer->stop();
+}
+
+static int serve(Server& server, const vector<string>& addresses)
+{
+    for(const string& address: addresses) {
+        if(server.listen(address) != Server::SERVER_GOOD) {
+            cerr << "Cannot listen on " << address << ": " << strerror(errno) << endl;
+            return 1;
+        }
+    }
+    activeServer = &server;
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    int status = server.run();
+    activeServer = nullptr;
+    return status == Server::SERVER_GOOD ? 0 : 1;
+}
+
 int main(int argc, const char * argv[]) {
-    string line;
-    auto db = std::shared_ptr<Database>(new Database());
-    Reader reader(db);
-    while(true) {
-        std::getline(cin, line);
-        reader.run(line);
-        if(line.substr(0, 3) == "END") break;
+    Printer& printer = Printer::getInstance();
+    printer.setFlushPolicy(isatty(STDIN_FILENO) ? Printer::FLUSH_LINE : Printer::FLUSH_FULL);
+    const char* inputPath = nullptr;
+    int engineType = Engine::ENGINE_UNDO;
+    vector<string> addresses;
+    size_t shards = 0;
+    size_t cores = 0;
+    size_t threads = 1;
+    const char* walPath = nullptr;
+    int walPolicy = Wal::SYNC_EVERY;
+    unsigned walIntervalMs = Wal::DEFAULT_INTERVAL_MS;
+    uint64_t walCompactSize = Wal::DEFAULT_COMPACT_SIZE;
+    std::shared_ptr<Snapshot> snapshot;
+    uint64_t slowThresholdNs = Stats::DEFAULT_SLOW_THRESHOLD_NS;
+    size_t slowLogSize = Stats::DEFAULT_SLOW_LOG_SIZE;
+    size_t maxMemory = 0;
+    int evictionPolicy = Database::EVICT_LRU;
+    unsigned evictionSamples = Database::DEFAULT_EVICTION_SAMPLES;
+    bool orderedIndex = false;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--quiet") == 0)
+            printer.setEcho(false);
+        else if(strcmp(argv[i], "--flush=line") == 0)
+            printer.setFlushPolicy(Printer::FLUSH_LINE);
+        else if(strcmp(argv[i], "--flush=full") == 0)
+            printer.setFlushPolicy(Printer::FLUSH_FULL);
+        else if(strcmp(argv[i], "--engine=undo") == 0)
+            engineType = Engine::ENGINE_UNDO;
+        else if(strcmp(argv[i], "--engine=overlay") == 0)
+            engineType = Engine::ENGINE_OVERLAY;
+        else if(strcmp(argv[i], "--engine=mvcc") == 0)
+            engineType = Engine::ENGINE_MVCC;
+        else if(strcmp(argv[i], "--engine=rcu") == 0)
+            engineType = Engine::ENGINE_RCU;
+        else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            inputPath = argv[++i];
+        else if(strcmp(argv[i], "--resp") == 0)
+            printer.setProtocol(Printer::PROTOCOL_RESP);
+        else if(strcmp(argv[i], "--listen") == 0 && i + 1 < argc)
+            addresses.push_back(argv[++i]);
+        else if(strcmp(argv[i], "--shards") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            shards = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--cores") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            cores = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--wal") == 0 && i + 1 < argc)
+            walPath = argv[++i];
+        else if(strcmp(argv[i], "--wal-sync") == 0 && i + 1 < argc && strcmp(argv[i + 1], "always") == 0) {
+            walPolicy = Wal::SYNC_ALWAYS;
+            i++;
+        }
+        else if(strcmp(argv[i], "--wal-sync") == 0 && i + 1 < argc && strcmp(argv[i + 1], "none") == 0) {
+            walPolicy = Wal::SYNC_NONE;
+            i++;
+        }
+        else if(strcmp(argv[i], "--wal-sync") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            walPolicy = Wal::SYNC_EVERY;
+            walIntervalMs = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--wal-compact-size") == 0 && i + 1 < argc && atoll(argv[i + 1]) > 0)
+            walCompactSize = atoll(argv[++i]);
+        else if(strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc)
+            snapshot.reset(new Snapshot(argv[++i]));
+        else if(strcmp(argv[i], "--slowlog-threshold") == 0 && i + 1 < argc) {
+            long long us = atoll(argv[++i]);
+            slowThresholdNs = us < 0 ? UINT64_MAX : (uint64_t)us * 1000;
+        }
+        else if(strcmp(argv[i], "--slowlog-size") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0)
+            slowLogSize = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--maxmemory") == 0 && i + 1 < argc && parseBytes(argv[i + 1], maxMemory))
+            i++;
+        else if(strcmp(argv[i], "--maxmemory-policy") == 0 && i + 1 < argc && strcmp(argv[i + 1], "lru") == 0) {
+            evictionPolicy = Database::EVICT_LRU;
+            i++;
+        }
+        else if(strcmp(argv[i], "--maxmemory-policy") == 0 && i + 1 < argc && strcmp(argv[i + 1], "lfu") == 0) {
+            evictionPolicy = Database::EVICT_LFU;
+            i++;
+        }
+        else if(strcmp(argv[i], "--maxmemory-samples") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            evictionSamples = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--ordered-index") == 0)
+            orderedIndex = true;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    Stats::getInstance().setSlowLog(slowThresholdNs, slowLogSize);
+    if(cores > 0 && (shards > 0 || engineType != Engine::ENGINE_UNDO || orderedIndex)) {
+        cerr << "--cores requires --engine=undo and cannot be combined with --shards or --ordered-index" << endl;
+        return 1;
+    }
+    if(threads > 1 && shards == 0 && cores == 0 && engineType == Engine::ENGINE_UNDO)
+        shards = ShardedDatabase::DEFAULT_SHARDS;
+    if((shards > 0 && engineType != Engine::ENGINE_UNDO) || (threads > 1 && engineType == Engine::ENGINE_OVERLAY)) {
+        cerr << "--shards requires --engine=undo, --threads does not work with --engine=overlay" << endl;
+        return 1;
+    }
+    if(walPath != nullptr && snapshot) {
+        cerr << "--wal and --snapshot cannot be combined" << endl;
+        return 1;
+    }
+    if(maxMemory > 0 && (engineType == Engine::ENGINE_MVCC || engineType == Engine::ENGINE_RCU)) {
+        cerr << "--maxmemory requires --engine=undo or --engine=overlay" << endl;
+        return 1;
+    }
+    if(orderedIndex && engineType != Engine::ENGINE_UNDO) {
+        cerr << "--ordered-index requires --engine=undo" << endl;
+        return 1;
+    }
+
+    // Every session (the stdin session or a client connection) gets its own engine on the one shared store.
+    std::function<std::shared_ptr<Engine>()> newEngine;
+    if(engineType == Engine::ENGINE_MVCC) {
+        auto versionedDb = std::shared_ptr<VersionedDatabase>(new VersionedDatabase());
+        if(!loadSnapshot(snapshot.get(), *versionedDb))
+            return 1;
+        newEngine = [versionedDb]() {return Engine::create(versionedDb);};
+    }
+    else if(engineType == Engine::ENGINE_RCU) {
+        auto rcuDb = std::shared_ptr<RcuDatabase>(new RcuDatabase());
+        if(!loadSnapshot(snapshot.get(), *rcuDb))
+            return 1;
+        newEngine = [rcuDb]() {return Engine::create(rcuDb);};
+    }
+    else if(cores > 0) {
+        auto coreDb = std::shared_ptr<CoreDatabase>(new CoreDatabase(cores));
+        if(!loadSnapshot(snapshot.get(), *coreDb))
+            return 1;
+        coreDb->setMaxMemory(maxMemory, evictionPolicy, evictionSamples);
+        newEngine = [coreDb]() {return Engine::create(coreDb);};
+    }
+    else if(shards > 0) {
+        auto shardedDb = std::shared_ptr<ShardedDatabase>(new ShardedDatabase(shards));
+        if(!loadSnapshot(snapshot.get(), *shardedDb))
+            return 1;
+        shardedDb->setMaxMemory(maxMemory, evictionPolicy, evictionSamples);
+        if(orderedIndex)
+            shardedDb->enableKeyIndex();
+        newEngine = [shardedDb]() {return Engine::create(shardedDb);};
+    }
+    else {
+        auto db = std::shared_ptr<Database>(new Database());
+        if(!loadSnapshot(snapshot.get(), *db))
+            return 1;
+        db->setMaxMemory(maxMemory, evictionPolicy, evictionSamples);
+        if(orderedIndex)
+            db->enableKeyIndex();
+        newEngine = [db, engineType]() {return Engine::create(engineType, db);};
+    }
+    if(walPath != nullptr) {
+        auto wal = std::shared_ptr<Wal>(new Wal(walPath, walPolicy, walIntervalMs, walCompactSize));
+        if(wal->open(*newEngine()) != Wal::WAL_GOOD) {
+            cerr << "Cannot open " << walPath << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        auto baseEngine = newEngine;
+        newEngine = [baseEngine, wal]() {return Engine::create(baseEngine(), wal);};
+    }
+    if(!addresses.empty()) {
+        Server server(newEngine, threads, snapshot);
+        return serve(server, addresses);
+    }
+    Reader reader(newEngine(), snapshot);
+    if(inputPath != nullptr) {
+        InputFile input;
+        if(input.open(inputPath) != InputFile::FILE_GOOD) {
+            cerr << "Cannot open " << inputPath << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        string_view line;
+        while(true) {
+            // Send the replies to everything that has arrived before waiting for more, as a pipe client expects.
+            if(!input.hasLine())
+                printer.flush();
+            if(!input.nextLine(line) || reader.run(line) == Command::CMD_END) break;
+        }
+    }
+    else {
+        string line;
+        while(std::getline(cin, line)) {
+            if(reader.run(line) == Command::CMD_END) break;
+        }
     }
+    printer.flush();
     return 0;
 }
@@ -0,0 +1,100 @@
+#include "Arena.hpp"
+#include <cstdlib>
+#include <new>
+
+SlabArena::~SlabArena()
+{
+    for(char* slab: this->slabs)
+        std::free(slab);
+}
+
+char* SlabArena::allocate(size_t size)
+{
+    this->liveBytes += size;
+    if(size > LARGE_LIMIT)
+    {
+        char* block = static_cast<char*>(std::malloc(size));
+        if(block == nullptr)
+            throw std::bad_alloc();
+        this->reservedBytes += size;
+        this->largeCount++;
+        return block;
+    }
+    
+    size_t index = sizeClass(size);
+    FreeBlock* head = this->freeLists[index];
+    if(head != nullptr)
+    {
+        this->freeLists[index] = head->next;
+        return reinterpret_cast<char*>(head);
+    }
+    
+    size_t blockSize = classSize(index);
+    if(this->bump == nullptr || (size_t)(this->bumpEnd - this->bump) < blockSize)
+    {
+        // The tail of the old slab is too small for this class; hand it to the smaller classes it fits.
+        while(this->bump != nullptr && (size_t)(this->bumpEnd - this->bump) >= 8)
+        {
+            size_t tail = this->bumpEnd - this->bump;
+            size_t fit = sizeClass(tail);
+            if(classSize(fit) > tail)
+                fit--;
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(this->bump);
+            block->next = this->freeLists[fit];
+            this->freeLists[fit] = block;
+            this->bump += classSize(fit);
+        }
+        this->bump = static_cast<char*>(std::malloc(SLAB_SIZE));
+        if(this->bump == nullptr)
+            throw std::bad_alloc();
+        this->bumpEnd = this->bump + SLAB_SIZE;
+        this->slabs.push_back(this->bump);
+        this->reservedBytes += SLAB_SIZE;
+    }
+    char* block = this->bump;
+    this->bump += blockSize;
+    return block;
+}
+
+void SlabArena::free(char* block, size_t size)
+{
+    this->liveBytes -= size;
+    if(size > LARGE_LIMIT)
+    {
+        std::free(block);
+        this->reservedBytes -= size;
+        this->largeCount--;
+        return;
+    }
+    size_t index = sizeClass(size);
+    FreeBlock* head = reinterpret_cast<FreeBlock*>(block);
+    head->next = this->freeLists[index];
+    this->freeLists[index] = head;
+}
+
+ArenaStats SlabArena::stats() const
+{
+    ArenaStats stats;
+    stats.liveBytes = this->liveBytes;
+    stats.reservedBytes = this->reservedBytes;
+    stats.wastedBytes = this->reservedBytes - this->liveBytes;
+    stats.slabCount = this->slabs.size() + this->largeCount;
+    return stats;
+}
+
+size_t SlabArena::sizeClass(size_t size)
+{
+    if(size <= SMALL_LIMIT)
+        return size == 0 ? 0 : (size - 1) / 8;
+    size_t index = SMALL_LIMIT / 8;
+    for(size_t limit = SMALL_LIMIT * 2; limit < size; limit *= 2)
+        index++;
+    return index;
+}
+
+size_t SlabArena::classSize(size_t index)
+{
+    if(index < SMALL_LIMIT / 8)
+        return (index + 1) * 8;
+    return SMALL_LIMIT << (index - SMALL_LIMIT / 8 + 1);
+}
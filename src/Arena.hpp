@@ -0,0 +1,136 @@
+#ifndef Arena_hpp
+#define Arena_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+/**
+ * Allocator statistics of a SlabArena, in bytes unless noted otherwise.
+ */
+struct ArenaStats
+{
+    size_t liveBytes; // Bytes requested by live allocations.
+    size_t wastedBytes; // Reserved but not live: size-class rounding, free blocks and unused slab tails.
+    size_t reservedBytes; // Total size of all slabs and large blocks.
+    size_t slabCount; // Number of slabs, including one per large block.
+};
+
+/**
+ * This class hands out memory for key and value bytes. Requests are rounded up to a size class (multiples of 8 up
+ * to 256 bytes, then powers of two up to 4 KiB) and bump-allocated from 64 KiB slabs; larger requests get a block
+ * of their own. A freed block is pushed on the free list of its size class and reused by the next request of that
+ * class, so memory released by UNSET or by a transaction rollback is recycled instead of returned to malloc. The
+ * caller passes the requested size to free(), which keeps blocks free of headers.
+ */
+class SlabArena
+{
+public:
+    SlabArena(): bump(nullptr), bumpEnd(nullptr), liveBytes(0), reservedBytes(0), freeLists(CLASS_COUNT, nullptr),
+        largeCount(0) {}
+    ~SlabArena();
+    
+    char* allocate(size_t size);
+    void free(char* block, size_t size);
+    
+    ArenaStats stats() const;
+    
+private:
+    SlabArena(const SlabArena& arena);
+    SlabArena& operator=(const SlabArena& arena);
+    
+    static const size_t SLAB_SIZE = 64 * 1024;
+    static const size_t SMALL_LIMIT = 256; // Largest size served in steps of 8 bytes.
+    static const size_t LARGE_LIMIT = 4096; // Larger requests get a block of their own.
+    static const size_t CLASS_COUNT = SMALL_LIMIT / 8 + 4; // 8..256 in steps of 8, then 512, 1024, 2048, 4096.
+    
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+    
+    char* bump; // Next free byte in the current slab.
+    char* bumpEnd;
+    size_t liveBytes;
+    size_t reservedBytes;
+    std::vector<FreeBlock*> freeLists; // One list per size class.
+    std::vector<char*> slabs;
+    size_t largeCount; // Number of live blocks larger than LARGE_LIMIT.
+    
+    static size_t sizeClass(size_t size);
+    static size_t classSize(size_t index);
+};
+
+/**
+ * A 16-byte string handle for table slots. Strings of up to 15 bytes are stored inline in the handle itself; longer
+ * strings point to bytes allocated from a SlabArena. The handle is trivially copyable and does not own its bytes: the
+ * table that stores it calls make() and release() with its arena.
+ */
+class ArenaString
+{
+public:
+    ArenaString() {std::memset(this->bytes, 0, sizeof(this->bytes)); this->bytes[15] = INLINE_MAX;}
+    
+    static ArenaString make(std::string_view s, SlabArena& arena)
+    {
+        ArenaString str;
+        if(s.size() <= INLINE_MAX)
+        {
+            std::memcpy(str.bytes, s.data(), s.size());
+            str.bytes[15] = (char)(INLINE_MAX - s.size());
+        }
+        else
+        {
+            char* data = arena.allocate(s.size());
+            std::memcpy(data, s.data(), s.size());
+            uint32_t length = (uint32_t)s.size();
+            std::memcpy(str.bytes, &data, sizeof(data));
+            std::memcpy(str.bytes + 8, &length, sizeof(length));
+            str.bytes[15] = HEAP;
+        }
+        return str;
+    }
+    
+    void release(SlabArena& arena)
+    {
+        if(isInline())
+            return;
+        std::string_view s = view();
+        arena.free(const_cast<char*>(s.data()), s.size());
+        *this = ArenaString();
+    }
+    
+    bool isInline() const {return this->bytes[15] != HEAP;}
+    std::string_view view() const
+    {
+        if(isInline())
+            return std::string_view(this->bytes, INLINE_MAX - this->bytes[15]);
+        const char* data;
+        uint32_t length;
+        std::memcpy(&data, this->bytes, sizeof(data));
+        std::memcpy(&length, this->bytes + 8, sizeof(length));
+        return std::string_view(data, length);
+    }
+    
+private:
+    static const char INLINE_MAX = 15;
+    static const char HEAP = (char)0x80;
+    
+    char bytes[16]; // Inline: data, then 15 - length in the last byte. Heap: pointer, length, HEAP in the last byte.
+};
+
+struct ArenaStringHash
+{
+    size_t operator()(const ArenaString& s) const {return std::hash<std::string_view>()(s.view());}
+    size_t operator()(std::string_view s) const {return std::hash<std::string_view>()(s);}
+};
+
+struct ArenaStringEq
+{
+    bool operator()(const ArenaString& a, std::string_view b) const {return a.view() == b;}
+    bool operator()(const ArenaString& a, const ArenaString& b) const {return a.view() == b.view();}
+};
+
+#endif /* Arena_hpp */
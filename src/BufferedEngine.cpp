@@ -0,0 +1,205 @@
+#include "BufferedEngine.hpp"
+
+int BufferedEngine::dbSet(std::string_view key, std::string_view value)
+{
+    if(this->overlays.empty())
+        return baseSet(key, value);
+    write(key, ArenaStringHash()(key), &value);
+    return Database::DB_GOOD;
+}
+
+int BufferedEngine::dbUnset(std::string_view key)
+{
+    if(this->overlays.empty())
+        return baseUnset(key);
+    size_t h = ArenaStringHash()(key);
+    std::string_view old;
+    if(!lookup(key, h, old))
+        return Database::DB_NOT_FOUND;
+    write(key, h, nullptr);
+    return Database::DB_GOOD;
+}
+
+int BufferedEngine::dbGet(std::string_view key, std::string& value)
+{
+    std::string_view found;
+    if(!lookup(key, ArenaStringHash()(key), found))
+        return Database::DB_NOT_FOUND;
+    value.assign(found);
+    return Database::DB_GOOD;
+}
+
+int BufferedEngine::dbNumEqualTo(std::string_view value, int& count)
+{
+    baseNumEqualTo(value, count);
+    if(!this->overlays.empty() && !baseIsSnapshot())
+    {
+        // The newest write of every key replaces the value the store has for it now.
+        FlatMap<std::string_view, char, StringHash, StringEq> seen;
+        for(size_t i = this->overlays.size(); i-- > 0; )
+        {
+            this->overlays[i]->writes.forEach([&](const ArenaString& key, const Write& write)
+            {
+                std::string_view keyView = key.view(), old;
+                if(!seen.insert(keyView).second)
+                    return;
+                if(baseGet(keyView, old) && old == value)
+                    count--;
+                if(write.present && write.value.view() == value)
+                    count++;
+            });
+        }
+    }
+    else if(!this->overlays.empty())
+    {
+        size_t h = ArenaStringHash()(value);
+        for(auto& overlay: this->overlays)
+        {
+            auto delta = overlay->deltas.find(value, h);
+            if(delta != nullptr)
+                count += delta->value;
+        }
+    }
+    return count == 0 ? Database::DB_NOT_FOUND : Database::DB_GOOD;
+}
+
+int BufferedEngine::dbSetMany(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& values)
+{
+    bool outside = this->overlays.empty();
+    if(outside)
+        this->overlays.emplace_back(new Overlay()); // Without a snapshot: writes that read nothing cannot conflict.
+    for(size_t i = 0; i < keys.size(); i++)
+        dbSet(keys[i], values[i]);
+    if(outside)
+        commit();
+    return Database::DB_GOOD;
+}
+
+int BufferedEngine::dbUnsetMany(const std::vector<std::string_view>& keys)
+{
+    bool outside = this->overlays.empty();
+    if(outside)
+        this->overlays.emplace_back(new Overlay()); // Without a snapshot: writes that read nothing cannot conflict.
+    for(std::string_view key: keys)
+        dbUnset(key);
+    if(outside)
+        commit();
+    return Database::DB_GOOD;
+}
+
+void BufferedEngine::begin()
+{
+    if(this->overlays.empty())
+        baseBegin();
+    this->overlays.emplace_back(new Overlay());
+}
+
+EngineStats BufferedEngine::stats()
+{
+    size_t writes = 0;
+    for(auto& overlay: this->overlays)
+        writes += overlay->writes.size();
+    return EngineStats{baseStats(), this->overlays.size(), writes};
+}
+
+bool BufferedEngine::rollback()
+{
+    if(this->overlays.empty())
+        return false;
+    this->overlays.pop_back();
+    if(this->overlays.empty())
+        baseEnd();
+    return true;
+}
+
+bool BufferedEngine::commit()
+{
+    if(this->overlays.empty())
+        return false;
+    // Keys already taken from an inner overlay; the views point into the overlays, which outlive this map.
+    FlatMap<std::string_view, char, StringHash, StringEq> applied;
+    this->changes.clear();
+    for(size_t i = this->overlays.size(); i-- > 0; )
+    {
+        this->overlays[i]->writes.forEach([&](const ArenaString& key, const Write& write)
+        {
+            std::string_view keyView = key.view();
+            if(applied.insert(keyView).second)
+                this->changes.push_back(KeyChange{keyView, write.value.view(), write.present});
+        });
+    }
+    bool done = baseApply(this->changes);
+    this->changes.clear();
+    this->overlays.clear();
+    baseEnd();
+    return done;
+}
+
+bool BufferedEngine::commitBlock()
+{
+    if(this->overlays.size() <= 1)
+        return commit();
+    Overlay& top = *this->overlays.back();
+    Overlay& below = *this->overlays[this->overlays.size() - 2];
+    top.writes.forEach([&](const ArenaString& key, const Write& write)
+    {
+        std::string_view keyView = key.view();
+        auto slot = below.writes.insertWith(keyView, ArenaStringHash()(keyView),
+                                            [&]() {return ArenaString::make(keyView, below.arena);});
+        if(!slot.second)
+            slot.first->value.value.release(below.arena);
+        slot.first->value.value = write.present ? ArenaString::make(write.value.view(), below.arena) : ArenaString();
+        slot.first->value.present = write.present;
+    });
+    if(baseIsSnapshot())
+        top.deltas.forEach([&](const ArenaString& value, int delta) {addDelta(below, value.view(), delta);});
+    this->overlays.pop_back();
+    return true;
+}
+
+bool BufferedEngine::lookup(std::string_view key, size_t h, std::string_view& value)
+{
+    for(size_t i = this->overlays.size(); i-- > 0; )
+    {
+        auto slot = this->overlays[i]->writes.find(key, h);
+        if(slot != nullptr)
+        {
+            value = slot->value.value.view();
+            return slot->value.present;
+        }
+    }
+    return baseGet(key, value);
+}
+
+void BufferedEngine::addDelta(Overlay& overlay, std::string_view value, int delta)
+{
+    auto slot = overlay.deltas.insertWith(value, ArenaStringHash()(value),
+                                          [&]() {return ArenaString::make(value, overlay.arena);});
+    slot.first->value += delta;
+    if(slot.first->value == 0)
+    {
+        slot.first->key.release(overlay.arena);
+        overlay.deltas.erase(slot.first);
+    }
+}
+
+void BufferedEngine::write(std::string_view key, size_t h, const std::string_view* value)
+{
+    Overlay& top = *this->overlays.back();
+    std::string_view old;
+    // Even a write of the value the key has is kept: on a store other sessions commit to, the value may change before
+    // the commit.
+    if(baseIsSnapshot())
+    {
+        if(lookup(key, h, old))
+            addDelta(top, old, -1);
+        if(value != nullptr)
+            addDelta(top, *value, 1);
+    }
+    
+    auto slot = top.writes.insertWith(key, h, [&]() {return ArenaString::make(key, top.arena);});
+    if(!slot.second)
+        slot.first->value.value.release(top.arena);
+    slot.first->value.value = value != nullptr ? ArenaString::make(*value, top.arena) : ArenaString();
+    slot.first->value.present = value != nullptr;
+}
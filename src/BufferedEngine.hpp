@@ -0,0 +1,80 @@
+#ifndef BufferedEngine_hpp
+#define BufferedEngine_hpp
+
+#include "Arena.hpp"
+#include "Database.hpp"
+#include "Engine.hpp"
+#include "FlatMap.hpp"
+#include <memory>
+#include <vector>
+
+/**
+ * This class is the base of the engines that buffer the writes of transaction blocks. Outside a transaction block,
+ * writes go straight to the underlying store. Each open block has an overlay holding the writes made in it (a new
+ * value or a deletion per key) and the change it makes to the count of every value. Reads look for the key in the
+ * overlays from the innermost block outwards and fall back to the store. On a store read at a snapshot, NUMEQUALTO
+ * adds the count deltas of all overlays to the store's count; on a store other sessions commit to meanwhile, the
+ * deltas would be against values the store no longer has, so it corrects the store's count by the keys of the
+ * overlays and their current values in the store instead. Rollback drops the innermost overlay without touching the store, at the cost of
+ * freeing its memory. Commit collects the newest write of every key once, walking the overlays from the innermost
+ * outwards, and hands them to the store in one call. Closing an inner block with commitBlock() copies its overlay
+ * into the enclosing one. A multi-key write outside of a block is made in a block of its own, so that it reaches
+ * the store as one commit.
+ * Subclasses connect the overlays to a store through the base*() methods:
+ *   OverlayEngine - a Database, updated in place on commit.
+ *   MvccEngine    - a VersionedDatabase, read at the snapshot taken by the outermost BEGIN and committed to as one
+ *                   new version.
+ */
+class BufferedEngine: public Engine
+{
+public:
+    virtual int dbSet(std::string_view key, std::string_view value);
+    virtual int dbUnset(std::string_view key);
+    virtual int dbGet(std::string_view key, std::string& value);
+    virtual int dbNumEqualTo(std::string_view value, int& count);
+    virtual int dbSetMany(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& values);
+    virtual int dbUnsetMany(const std::vector<std::string_view>& keys);
+
+    virtual void begin();
+    virtual bool rollback();
+    virtual bool commit();
+    virtual bool commitBlock();
+    virtual size_t depth() const {return this->overlays.size();}
+    virtual bool buffersBlocks() const {return true;}
+    virtual EngineStats stats();
+
+protected:
+    virtual int baseSet(std::string_view key, std::string_view value) = 0; // A write outside of any block.
+    virtual int baseUnset(std::string_view key) = 0;
+    virtual bool baseGet(std::string_view key, std::string_view& value) = 0; // Valid until the next base call.
+    virtual int baseNumEqualTo(std::string_view value, int& count) = 0;
+    virtual bool baseApply(const std::vector<KeyChange>& changes) = 0; // Commit the writes of all blocks, or refuse.
+    virtual StoreStats baseStats() = 0;
+    virtual void baseBegin() {} // The outermost block is being opened.
+    virtual void baseEnd() {} // The outermost block has been closed.
+    virtual bool baseIsSnapshot() const {return false;} // Whether base reads stay as of the outermost BEGIN.
+
+private:
+    struct Write
+    {
+        ArenaString value;
+        bool present; // False if the key was unset.
+    };
+
+    struct Overlay
+    {
+        SlabArena arena; // Key and value bytes of this overlay.
+        FlatMap<ArenaString, Write, ArenaStringHash, ArenaStringEq> writes;
+        // Change of each value's count, only kept on a snapshot.
+        FlatMap<ArenaString, int, ArenaStringHash, ArenaStringEq> deltas;
+    };
+
+    std::vector<std::unique_ptr<Overlay> > overlays; // Innermost block last.
+    std::vector<KeyChange> changes; // Reused by commit().
+
+    bool lookup(std::string_view key, size_t h, std::string_view& value); // The value visible to this session.
+    void addDelta(Overlay& overlay, std::string_view value, int delta);
+    void write(std::string_view key, size_t h, const std::string_view* value); // nullptr value means unset.
+};
+
+#endif /* BufferedEngine_hpp */
@@ -0,0 +1,42 @@
+#include "Checksum.hpp"
+#include <cstring>
+
+// tables[0] is the classic byte-at-a-time table; tables[k][b] is the CRC of byte b followed by k zero bytes.
+struct Crc32cTables
+{
+    uint32_t tables[8][256];
+
+    Crc32cTables()
+    {
+        for(uint32_t b = 0; b < 256; b++)
+        {
+            uint32_t crc = b;
+            for(int bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+            tables[0][b] = crc;
+        }
+        for(int k = 1; k < 8; k++)
+            for(uint32_t b = 0; b < 256; b++)
+                tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+    }
+};
+
+static const Crc32cTables crc32cTables;
+
+uint32_t crc32c(const void* data, size_t size, uint32_t crc)
+{
+    const uint32_t (*t)[256] = crc32cTables.tables;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for(; size >= 8; size -= 8, p += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, 8); // Little-endian.
+        word ^= crc;
+        crc = t[7][word & 0xFF] ^ t[6][(word >> 8) & 0xFF] ^ t[5][(word >> 16) & 0xFF] ^ t[4][(word >> 24) & 0xFF] ^
+              t[3][(word >> 32) & 0xFF] ^ t[2][(word >> 40) & 0xFF] ^ t[1][(word >> 48) & 0xFF] ^ t[0][word >> 56];
+    }
+    for(; size > 0; size--, p++)
+        crc = t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
@@ -0,0 +1,14 @@
+#ifndef Checksum_hpp
+#define Checksum_hpp
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * CRC-32C (Castagnoli) of a byte range, used to detect torn or corrupted records in files written by the database.
+ * Pass the result of a previous call as crc to checksum data in pieces. The table-driven implementation consumes
+ * 8 bytes per step (slicing-by-8).
+ */
+uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0);
+
+#endif /* Checksum_hpp */
@@ -0,0 +1,329 @@
+#include "Client.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const size_t READ_SIZE = 64 * 1024;
+
+static int connectTcp(const std::string& host, const std::string& port)
+{
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    if(getaddrinfo(host.empty() ? "127.0.0.1" : host.c_str(), port.c_str(), &hints, &result) != 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd = -1;
+    for(struct addrinfo* info = result; info != nullptr && fd < 0; info = info->ai_next)
+    {
+        fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+        if(fd >= 0 && ::connect(fd, info->ai_addr, info->ai_addrlen) != 0)
+        {
+            int error = errno;
+            ::close(fd);
+            errno = error;
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    if(fd >= 0)
+    {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+static int connectUnix(const std::string& path)
+{
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    if(path.empty() || path.size() >= sizeof(addr.sun_path))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.data(), path.size());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd >= 0 && ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        fd = -1;
+    }
+    return fd;
+}
+
+int Client::connect(const std::string& address)
+{
+    close();
+    int fd;
+    if(address.compare(0, 5, "unix:") == 0)
+        fd = connectUnix(address.substr(5));
+    else
+    {
+        size_t colon = address.rfind(':');
+        std::string host = colon == std::string::npos ? "" : address.substr(0, colon);
+        if(host.size() >= 2 && host.front() == '[' && host.back() == ']')
+            host = host.substr(1, host.size() - 2);
+        fd = connectTcp(host, colon == std::string::npos ? address : address.substr(colon + 1));
+    }
+    if(fd < 0)
+        return CLIENT_ERROR;
+    this->readFd = fd;
+    this->writeFd = fd;
+    this->pipe = false;
+    return CLIENT_GOOD;
+}
+
+int Client::spawn(const std::vector<std::string>& command)
+{
+    close();
+    int toChild[2], fromChild[2];
+    if(command.empty() || ::pipe2(toChild, O_CLOEXEC) != 0)
+        return CLIENT_ERROR;
+    if(::pipe2(fromChild, O_CLOEXEC) != 0)
+    {
+        ::close(toChild[0]);
+        ::close(toChild[1]);
+        return CLIENT_ERROR;
+    }
+    std::vector<std::string> args(command);
+    args.insert(args.end(), {"--resp", "-q", "-f", "-"});
+    std::vector<char*> argv;
+    for(std::string& arg: args)
+        argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        dup2(toChild[0], STDIN_FILENO);
+        dup2(fromChild[1], STDOUT_FILENO);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    int error = errno;
+    ::close(toChild[0]);
+    ::close(fromChild[1]);
+    if(pid < 0)
+    {
+        ::close(toChild[1]);
+        ::close(fromChild[0]);
+        errno = error;
+        return CLIENT_ERROR;
+    }
+    this->child = pid;
+    this->readFd = fromChild[0];
+    this->writeFd = toChild[1];
+    this->pipe = true;
+    return CLIENT_GOOD;
+}
+
+void Client::close()
+{
+    if(this->writeFd >= 0 && this->writeFd != this->readFd)
+        ::close(this->writeFd);
+    if(this->readFd >= 0)
+        ::close(this->readFd);
+    if(this->child > 0)
+    {
+        int status;
+        while(waitpid(this->child, &status, 0) < 0 && errno == EINTR) {}
+    }
+    this->readFd = -1;
+    this->writeFd = -1;
+    this->child = -1;
+    this->output.clear();
+    this->outputSent = 0;
+    this->input.clear();
+    this->inputPos = 0;
+}
+
+void Client::setNonBlocking()
+{
+    fcntl(this->readFd, F_SETFL, fcntl(this->readFd, F_GETFL) | O_NONBLOCK);
+    fcntl(this->writeFd, F_SETFL, fcntl(this->writeFd, F_GETFL) | O_NONBLOCK);
+}
+
+void Client::append(const std::vector<std::string_view>& args)
+{
+    if(this->outputSent > 0 && this->outputSent == this->output.size())
+    {
+        this->output.clear();
+        this->outputSent = 0;
+    }
+    if(this->pipe)
+    {
+        for(size_t i = 0; i < args.size(); i++)
+            (this->output += i == 0 ? "" : " ").append(args[i]);
+        this->output += '\n';
+        return;
+    }
+    ((this->output += '*') += std::to_string(args.size())) += "\r\n";
+    for(std::string_view arg: args)
+        ((((this->output += '$') += std::to_string(arg.size())) += "\r\n").append(arg)) += "\r\n";
+}
+
+int Client::call(const std::vector<std::string_view>& args, Reply& reply)
+{
+    append(args);
+    int status = flush();
+    return status == CLIENT_GOOD ? readReply(reply) : status;
+}
+
+int Client::flush()
+{
+    while(true)
+    {
+        int status = send();
+        if(status != CLIENT_AGAIN)
+            return status;
+        if(wait(this->writeFd, POLLOUT) != CLIENT_GOOD)
+            return CLIENT_ERROR;
+    }
+}
+
+int Client::readReply(Reply& reply)
+{
+    while(true)
+    {
+        int status = nextReply(reply);
+        if(status != CLIENT_AGAIN)
+            return status;
+        status = receive();
+        if(status == CLIENT_ERROR)
+            return status;
+        if(status == CLIENT_AGAIN && wait(this->readFd, POLLIN) != CLIENT_GOOD)
+            return CLIENT_ERROR;
+    }
+}
+
+int Client::send()
+{
+    while(this->outputSent < this->output.size())
+    {
+        ssize_t count = ::write(this->writeFd, this->output.data() + this->outputSent,
+                                this->output.size() - this->outputSent);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK ? CLIENT_AGAIN : CLIENT_ERROR;
+        this->outputSent += count;
+    }
+    this->output.clear();
+    this->outputSent = 0;
+    return CLIENT_GOOD;
+}
+
+int Client::receive()
+{
+    if(this->inputPos > 0 && this->inputPos * 2 >= this->input.size())
+    {
+        this->input.erase(0, this->inputPos);
+        this->inputPos = 0;
+    }
+    size_t used = this->input.size();
+    this->input.resize(used + READ_SIZE);
+    ssize_t count;
+    do
+        count = ::read(this->readFd, &this->input[used], READ_SIZE);
+    while(count < 0 && errno == EINTR);
+    this->input.resize(used + (count > 0 ? count : 0));
+    if(count == 0)
+    {
+        errno = ECONNRESET;
+        return CLIENT_ERROR;
+    }
+    if(count < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK ? CLIENT_AGAIN : CLIENT_ERROR;
+    return CLIENT_GOOD;
+}
+
+int Client::nextReply(Reply& reply)
+{
+    size_t pos = this->inputPos;
+    int status = parse(pos, reply);
+    if(status == CLIENT_GOOD)
+        this->inputPos = pos;
+    return status;
+}
+
+int Client::parse(size_t& pos, Reply& reply)
+{
+    size_t end = this->input.find("\r\n", pos);
+    if(end == std::string::npos)
+        return CLIENT_AGAIN;
+    char kind = this->input[pos];
+    std::string_view line(this->input.data() + pos + 1, end - pos - 1);
+    pos = end + 2;
+    reply.elements.clear();
+    switch(kind)
+    {
+        case '+':
+        case '-':
+            reply.type = kind == '+' ? Reply::REPLY_STATUS : Reply::REPLY_ERROR;
+            reply.text.assign(line);
+            return CLIENT_GOOD;
+        case ':':
+            reply.type = Reply::REPLY_INTEGER;
+            reply.integer = std::strtoll(std::string(line).c_str(), nullptr, 10);
+            return CLIENT_GOOD;
+        case '$':
+        {
+            long long length = std::strtoll(std::string(line).c_str(), nullptr, 10);
+            if(length < 0)
+            {
+                reply.type = Reply::REPLY_NULL;
+                return CLIENT_GOOD;
+            }
+            if(this->input.size() - pos < (size_t)length + 2)
+                return CLIENT_AGAIN;
+            reply.type = Reply::REPLY_BULK;
+            reply.text.assign(this->input, pos, length);
+            pos += length + 2;
+            return CLIENT_GOOD;
+        }
+        case '*':
+        {
+            long long count = std::strtoll(std::string(line).c_str(), nullptr, 10);
+            reply.type = Reply::REPLY_ARRAY;
+            reply.elements.resize(count > 0 ? count : 0);
+            for(Reply& element: reply.elements)
+            {
+                int status = parse(pos, element);
+                if(status != CLIENT_GOOD)
+                    return status;
+            }
+            return CLIENT_GOOD;
+        }
+    }
+    errno = EPROTO;
+    return CLIENT_ERROR;
+}
+
+int Client::wait(int fd, short events)
+{
+    struct pollfd entry = {fd, events, 0};
+    while(poll(&entry, 1, -1) < 0)
+    {
+        if(errno != EINTR)
+            return CLIENT_ERROR;
+    }
+    return CLIENT_GOOD;
+}
@@ -0,0 +1,87 @@
+#ifndef Client_hpp
+#define Client_hpp
+
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * One reply of the server: a status (+OK), an error, an integer, a bulk string, a null bulk string or an array.
+ */
+struct Reply
+{
+    enum
+    {
+        REPLY_STATUS,
+        REPLY_ERROR,
+        REPLY_INTEGER,
+        REPLY_BULK,
+        REPLY_NULL,
+        REPLY_ARRAY
+    };
+
+    int type;
+    std::string text; // Of a status, an error or a bulk string.
+    long long integer;
+    std::vector<Reply> elements;
+};
+
+/**
+ * This class is a client of a simpleDB server, over TCP or a Unix-domain socket, or of a simpleDB process it starts
+ * with "--resp -q -f -" and talks to through pipes (its stdin interface). Commands are queued with append(), which
+ * encodes them as RESP arrays for a server and as inline lines for a pipe (so their arguments must not contain
+ * whitespace there), and the replies are read back in order, so any number of commands can be pipelined.
+ * The blocking calls (call(), flush(), readReply()) suit simple tools. For event loops, the descriptors are
+ * non-blocking after setNonBlocking(): send() writes what it can, receive() reads what has arrived, and nextReply()
+ * parses one complete reply from what has been received, if there is one.
+ */
+class Client
+{
+public:
+    enum
+    {
+        CLIENT_GOOD,
+        CLIENT_AGAIN, // Nothing more can be sent or no complete reply has been received yet.
+        CLIENT_ERROR // See errno; EPROTO for a malformed reply, ECONNRESET when the other side has closed.
+    };
+
+    Client(): readFd(-1), writeFd(-1), child(-1), pipe(false), outputSent(0), inputPos(0) {}
+    ~Client() {close();}
+
+    int connect(const std::string& address); // "[host:]port" or "unix:<path>".
+    int spawn(const std::vector<std::string>& command); // Start a process; "--resp -q -f -" is appended.
+    void close(); // Disconnect, and wait for a spawned process to exit.
+    void setNonBlocking();
+
+    void append(const std::vector<std::string_view>& args); // Queue a command.
+    int call(const std::vector<std::string_view>& args, Reply& reply); // Send a command and wait for its reply.
+    int flush(); // Send all queued commands, waiting as needed.
+    int readReply(Reply& reply); // Wait for the next reply.
+
+    int send(); // Send what can be sent without waiting. CLIENT_GOOD once nothing is left.
+    int receive(); // Read what has arrived. CLIENT_AGAIN if nothing had.
+    int nextReply(Reply& reply); // Parse the next received reply, or CLIENT_AGAIN.
+
+    int getReadFd() const {return this->readFd;}
+    int getWriteFd() const {return this->writeFd;}
+    bool hasOutput() const {return this->outputSent < this->output.size();}
+
+private:
+    Client(const Client& client);
+    Client& operator=(const Client& client);
+
+    int readFd; // The socket, or the stdout of the process.
+    int writeFd; // The socket, or the stdin of the process.
+    pid_t child;
+    bool pipe; // Whether commands are sent as inline lines.
+    std::string output; // Queued command bytes; the first outputSent are sent.
+    size_t outputSent;
+    std::string input; // Received bytes; the first inputPos are parsed.
+    size_t inputPos;
+
+    int parse(size_t& pos, Reply& reply); // Parse a reply at pos of input, CLIENT_AGAIN if incomplete.
+    int wait(int fd, short events); // Wait until fd is ready.
+};
+
+#endif /* Client_hpp */
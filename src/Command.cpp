@@ -1 +1,204 @@
 #include "Command.hpp"
+#include "Stats.hpp"
+#include <cctype>
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Names of the command types in the Commandstats section, indexed by Command::CMD_*.
+static const char* const COMMAND_NAMES[Command::CMD_INVALID] = {
+    "set", "unset", "get", "numequalto", "mset", "munset", "mget", "expire", "ttl", "scan", "incrby", "decrby",
+    "numbetween", "eval", "begin", "commit", "rollback", "save", "bgsave", "info", "end"
+};
+
+// Resident set size of the process in bytes, or 0 if it cannot be read.
+static size_t residentBytes()
+{
+    size_t pages = 0, resident = 0;
+    std::FILE* file = std::fopen("/proc/self/statm", "r");
+    if(file == nullptr)
+        return 0;
+    if(std::fscanf(file, "%zu %zu", &pages, &resident) != 2)
+        resident = 0;
+    std::fclose(file);
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static void appendField(std::string& text, const char* name, unsigned long long value)
+{
+    char buffer[96];
+    std::snprintf(buffer, sizeof(buffer), "%s:%llu\r\n", name, value);
+    text += buffer;
+}
+
+// Whether a word equals a name, ignoring case.
+static bool sameWord(std::string_view word, std::string_view name)
+{
+    if(word.size() != name.size())
+        return false;
+    for(size_t i = 0; i < word.size(); i++)
+    {
+        if(std::tolower((unsigned char)word[i]) != std::tolower((unsigned char)name[i]))
+            return false;
+    }
+    return true;
+}
+
+void CmdEval::assign(const std::vector<std::string_view>& words)
+{
+    this->source.clear();
+    this->args.clear();
+    size_t i = 0;
+    for(; i < words.size() && words[i] != "ARGS"; i++)
+    {
+        if(i > 0)
+            this->source += ' ';
+        this->source.append(words[i]);
+    }
+    if(i < words.size())
+        this->args.assign(words.begin() + i + 1, words.end());
+}
+
+int CmdEval::execute(Engine& engine)
+{
+    echo();
+    Printer& printer = Printer::getInstance();
+    uint64_t h = this->cache.hash(std::string_view(this->source));
+    auto found = this->cache.find(std::string_view(this->source), h);
+    Script* script = found == nullptr ? nullptr : this->scripts[found->value].get();
+    if(script == nullptr)
+    {
+        script = Script::compile(this->source, this->error);
+        if(script == nullptr)
+        {
+            printer.replyError(this->error);
+            return Database::DB_ERROR;
+        }
+        if(this->scripts.size() == MAX_SCRIPTS)
+        {
+            this->cache.clear();
+            this->scripts.clear();
+        }
+        this->scripts.emplace_back(script);
+        // The key is a view of the source held by the script.
+        this->cache.insert(script->source(), h).first->value = (uint32_t)(this->scripts.size() - 1);
+    }
+    std::string_view value;
+    switch(script->run(engine, this->args, value))
+    {
+        case Script::SCRIPT_ERROR:
+            printer.replyError(value);
+            return Database::DB_ERROR;
+        case Script::SCRIPT_VALUE:
+            printer.reply(value);
+            break;
+        case Script::SCRIPT_NULL:
+            printer.replyNull();
+            break;
+        default:
+            printer.replyOk();
+            break;
+    }
+    return Database::DB_GOOD;
+}
+
+std::string CmdEval::toString() const
+{
+    std::string text = "EVAL " + this->source;
+    if(!this->args.empty())
+        text += " ARGS";
+    for(std::string_view arg: this->args)
+        text.append(" ").append(arg);
+    return text;
+}
+
+bool CmdInfo::wants(const char* name) const
+{
+    return this->section.empty() || sameWord(this->section, "all") || sameWord(this->section, name);
+}
+
+int CmdInfo::execute(Engine& engine)
+{
+    echo();
+    Stats& stats = Stats::getInstance();
+    std::string text;
+    if(wants("Keyspace") || wants("Transactions") || wants("Memory"))
+    {
+        EngineStats sizes = engine.stats();
+        if(wants("Keyspace"))
+        {
+            text += "# Keyspace\r\n";
+            appendField(text, "keys", sizes.store.keys);
+            appendField(text, "distinct_values", sizes.store.values);
+            appendField(text, "expiring_keys", sizes.store.expiringKeys);
+            appendField(text, "expired_keys", sizes.store.expiredKeys);
+        }
+        if(wants("Transactions"))
+        {
+            text += "# Transactions\r\n";
+            appendField(text, "tx_depth", sizes.depth);
+            appendField(text, "undo_entries", sizes.undoEntries);
+        }
+        if(wants("Memory"))
+        {
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            text += "# Memory\r\n";
+            appendField(text, "used_memory", sizes.store.memoryBytes);
+            appendField(text, "used_memory_rss", residentBytes());
+            appendField(text, "used_memory_peak_rss", (unsigned long long)usage.ru_maxrss * 1024);
+            appendField(text, "maxmemory", sizes.store.maxBytes);
+            if(sizes.store.maxBytes != 0)
+                appendField(text, "maxmemory_tracked", sizes.store.trackedBytes);
+            appendField(text, "evicted_keys", sizes.store.evictedKeys);
+        }
+    }
+    if(wants("Commandstats"))
+    {
+        text += "# Commandstats\r\n";
+        appendField(text, "stats_threads", stats.threadCount());
+        for(int type = 0; type < Command::CMD_INVALID; type++)
+        {
+            CommandLatency latency = stats.latency(type);
+            if(latency.calls == 0)
+                continue;
+            char buffer[256];
+            std::snprintf(buffer, sizeof(buffer), "cmdstat_%s:calls=%llu,usec_per_call=%.3f,p50_usec=%.3f,"
+                          "p99_usec=%.3f,p999_usec=%.3f,max_usec=%.3f\r\n", COMMAND_NAMES[type],
+                          (unsigned long long)latency.calls, latency.mean / 1e3, latency.p50 / 1e3, latency.p99 / 1e3,
+                          latency.p999 / 1e3, latency.max / 1e3);
+            text += buffer;
+        }
+    }
+    if(wants("Slowlog"))
+    {
+        std::vector<SlowEntry> slow = stats.slowLog();
+        uint64_t threshold = stats.getSlowThreshold();
+        text += "# Slowlog\r\n";
+        if(threshold != UINT64_MAX)
+            appendField(text, "slowlog_threshold_usec", threshold / 1000);
+        appendField(text, "slowlog_len", slow.size());
+        for(size_t i = 0; i < slow.size(); i++)
+        {
+            char buffer[128];
+            std::snprintf(buffer, sizeof(buffer), "slowlog_%zu:id=%llu,time=%lld,usec=%llu,command=", i,
+                          (unsigned long long)slow[i].id, (long long)slow[i].time,
+                          (unsigned long long)(slow[i].ns / 1000));
+            ((text += buffer) += slow[i].command) += "\r\n";
+        }
+    }
+
+    Printer& printer = Printer::getInstance();
+    if(printer.getProtocol() == Printer::PROTOCOL_RESP)
+    {
+        printer.reply(text);
+        return Database::DB_GOOD;
+    }
+    for(size_t start = 0; start < text.size(); )
+    {
+        size_t end = text.find("\r\n", start);
+        printer.reply(std::string_view(text).substr(start, end - start));
+        start = end + 2;
+    }
+    return Database::DB_GOOD;
+}
@@ -2,14 +2,32 @@
 #define Command_hpp
 
 #include "Database.hpp"
+#include "Engine.hpp"
+#include "FlatMap.hpp"
 #include "Printer.hpp"
+#include "Script.hpp"
+#include "Snapshot.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 /**
  * This class provides a structure with abstraction and encapsulation that fit the requirements of an in-memory database.
  * First, an interface, Command, is created on top of all required database commands. Then, each database command inherits this
- * interface, overrides the virtual function defined in the interface, and implements their own logics. Note that for write-method,
- * such as Set() and Unset(), a private member variable is used to record the old value, so that it can be rollbacked when indicated.
+ * interface, overrides the virtual function defined in the interface, and implements their own logics. Write commands, such as
+ * Set() and Unset(), do not keep the old value themselves: the transaction engine takes care of undoing them.
+ * Commands are executed against an Engine, the session's view of the Database including its open transaction blocks,
+ * and give their reply through the Printer of the session: writes reply with replyOk(), which prints nothing in the
+ * text protocol, so every command has exactly one reply on a network connection.
+ * The assign() methods let the Reader keep one reusable object per command type and refill it for every line; the
+ * strings keep their capacity, so executing a command does not allocate once they have grown to the working size.
+ * The multi-key commands (MSET, MUNSET, MGET and NUMEQUALTO with several values) keep views of the arguments instead,
+ * which are only valid while the Reader runs the line they came from, and hand the whole batch to the Engine at once.
  */
 class Command
 {
@@ -20,71 +38,111 @@ public:
         CMD_UNSET,
         CMD_GET,
         CMD_NUMEQUALTO,
+        CMD_MSET,
+        CMD_MUNSET,
+        CMD_MGET,
+        CMD_EXPIRE,
+        CMD_TTL,
+        CMD_SCAN,
+        CMD_INCRBY,
+        CMD_DECRBY,
+        CMD_NUMBETWEEN,
+        CMD_EVAL,
         CMD_BEGIN,
         CMD_COMMIT,
         CMD_ROLLBACK,
-        CMD_END
+        CMD_SAVE,
+        CMD_BGSAVE,
+        CMD_INFO,
+        CMD_END,
+        CMD_INVALID
     };
     
-    virtual int execute(std::shared_ptr<Database> db) = 0;
-    virtual int undo(std::shared_ptr<Database> db) = 0;
+    virtual int execute(Engine& engine) = 0;
     virtual int name() const = 0 ;
     virtual std::string toString() const = 0;
+    
+protected:
+    void echo() const // Print the command itself, unless the printer is in quiet mode.
+    {
+        Printer& printer = Printer::getInstance();
+        if(printer.isEcho())
+            printer.print(toString());
+    }
+    
+    static std::string join(const std::vector<std::string_view>& args) // Each argument preceded by a space.
+    {
+        std::string text;
+        for(std::string_view arg: args)
+            (text += " ").append(arg);
+        return text;
+    }
 };
 
 class CmdSet: public Command
 {
 public:
-    CmdSet(const std::string& inKey, const std::string& inValue): key(inKey), value(inValue), oldValue("") {}
-    
-    virtual int name() const {return Command::CMD_SET;}
+    CmdSet(const std::string& inKey, const std::string& inValue): key(inKey), value(inValue), ttlMs(0),
+        inSeconds(false) {}
     
-    virtual int execute(std::shared_ptr<Database> db)
+    // ttlMs is the time to live of the key in milliseconds, or 0 for none; inSeconds tells if it was given as EX.
+    void assign(std::string_view inKey, std::string_view inValue, long long inTtlMs = 0, bool inInSeconds = false)
     {
-        Printer::getInstance().print(toString());
-        db->dbGet(key, this->oldValue);
-        return db->dbSet(key, value);
+        key.assign(inKey);
+        value.assign(inValue);
+        ttlMs = inTtlMs;
+        inSeconds = inInSeconds;
     }
     
-    virtual int undo(std::shared_ptr<Database> db)
+    virtual int name() const {return Command::CMD_SET;}
+    
+    virtual int execute(Engine& engine)
     {
-        if(this->oldValue == "")
-            return db->dbUnset(key);
+        echo();
+        if(ttlMs == 0)
+        {
+            int status = engine.dbSet(key, value);
+            Printer::getInstance().replyOk();
+            return status;
+        }
+        int status = engine.dbSetExpiring(key, value, Database::nowMs() + ttlMs);
+        if(status == Database::DB_ERROR)
+            Printer::getInstance().replyError("ERR expiry not supported by this engine");
         else
-            return db->dbSet(key, oldValue);
+            Printer::getInstance().replyOk();
+        return status;
     }
     
     virtual std::string toString() const
     {
-        return "SET " + this->key + " " + this->value;
+        if(ttlMs == 0)
+            return "SET " + this->key + " " + this->value;
+        return "SET " + this->key + " " + this->value + (inSeconds ? " EX " + std::to_string(ttlMs / 1000)
+                                                                   : " PX " + std::to_string(ttlMs));
     }
     
 private:
     std::string key;
     std::string value;
-    std::string oldValue;
+    long long ttlMs;
+    bool inSeconds;
 };
 
 class CmdUnset: public Command
 {
 public:
-    CmdUnset(const std::string& inKey): key(inKey), oldValue("") {}
+    CmdUnset(const std::string& inKey): key(inKey) {}
     
-    virtual int name() const {return Command::CMD_UNSET;}
+    void assign(std::string_view inKey) {key.assign(inKey);}
     
-    virtual int execute(std::shared_ptr<Database> db)
-    {
-        Printer::getInstance().print(toString());
-        db->dbGet(key, oldValue);
-        return db->dbUnset(key);
-    }
+    virtual int name() const {return Command::CMD_UNSET;}
     
-    virtual int undo(std::shared_ptr<Database> db)
+    virtual int execute(Engine& engine)
     {
-        if(this->oldValue != "")
-            return db->dbSet(key, oldValue);
-        else
-            return Database::DB_GOOD;
+        echo();
+        int status = engine.dbUnset(key);
+        Printer::getInstance().replyOk();
+        return status;
     }
     
     virtual std::string toString() const
@@ -94,7 +152,6 @@ public:
     
 private:
     std::string key;
-    std::string oldValue;
 };
 
 class CmdGet: public Command
@@ -102,22 +159,21 @@ class CmdGet: public Command
 public:
     CmdGet(const std::string& inKey): key(inKey) {}
     
+    void assign(std::string_view inKey) {key.assign(inKey);}
+    
     virtual int name() const {return Command::CMD_GET;}
     
-    virtual int execute(std::shared_ptr<Database> db)
+    virtual int execute(Engine& engine)
     {
-        Printer::getInstance().print(toString());
-        std::string value = "";
-        int status = db->dbGet(key, value);
+        echo();
+        int status = engine.dbGet(key, value);
         if(status == Database::DB_NOT_FOUND)
-            Printer::getInstance().print("> NULL");
+            Printer::getInstance().replyNull();
         else
-            Printer::getInstance().print("> " + value);
+            Printer::getInstance().reply(value);
         return status;
     }
     
-    virtual int undo(std::shared_ptr<Database> db) {return Database::DB_GOOD;}
-    
     virtual std::string toString() const
     {
         return "GET " + this->key;
@@ -125,6 +181,7 @@ public:
     
 private:
     std::string key;
+    std::string value; // Reused buffer for the value read from the database.
 };
 
 class CmdNumEqualTo: public Command
@@ -132,29 +189,371 @@ class CmdNumEqualTo: public Command
 public:
     CmdNumEqualTo(const std::string& inValue): value(inValue) {}
     
+    void assign(std::string_view inValue) {value.assign(inValue);}
+    
     virtual int name() const {return Command::CMD_NUMEQUALTO;}
     
-    virtual int execute(std::shared_ptr<Database> db)
+    virtual int execute(Engine& engine)
     {
-        Printer::getInstance().print(toString());
+        echo();
         int count = 0;
-        int status = db->dbNumEqualTo(value, count);
-        Printer::getInstance().print("> " + std::to_string(count));
+        int status = engine.dbNumEqualTo(value, count);
+        Printer::getInstance().reply((long long)count);
         return status;
     }
     
-    virtual int undo(std::shared_ptr<Database> db)
+    virtual std::string toString() const
     {
-        return Database::DB_GOOD;
+        return "NUMEQUALTO " + this->value;
+    }
+    
+private:
+    std::string value;
+};
+
+class CmdNumEqualToMany: public Command
+{
+public:
+    CmdNumEqualToMany() {}
+    
+    void assign(const std::vector<std::string_view>& inValues) {values.assign(inValues.begin(), inValues.end());}
+    
+    virtual int name() const {return Command::CMD_NUMEQUALTO;}
+    
+    virtual int execute(Engine& engine)
+    {
+        echo();
+        int status = engine.dbNumEqualToMany(values, counts);
+        Printer& printer = Printer::getInstance();
+        printer.replyArray(counts.size());
+        for(int count: counts)
+            printer.reply((long long)count);
+        return status;
     }
     
     virtual std::string toString() const
     {
-        return "NUMEQUALTO " + this->value;
+        return "NUMEQUALTO" + join(values);
     }
     
 private:
-    std::string value;
+    std::vector<std::string_view> values;
+    std::vector<int> counts; // Reused for the results.
+};
+
+class CmdMSet: public Command
+{
+public:
+    CmdMSet() {}
+    
+    void assign(const std::vector<std::string_view>& inArgs) // Keys and values alternate.
+    {
+        keys.clear();
+        values.clear();
+        for(size_t i = 0; i + 1 < inArgs.size(); i += 2)
+        {
+            keys.push_back(inArgs[i]);
+            values.push_back(inArgs[i + 1]);
+        }
+    }
+    
+    virtual int name() const {return Command::CMD_MSET;}
+    
+    virtual int execute(Engine& engine)
+    {
+        echo();
+        int status = engine.dbSetMany(keys, values);
+        Printer::getInstance().replyOk();
+        return status;
+    }
+    
+    virtual std::string toString() const
+    {
+        std::string text = "MSET";
+        for(size_t i = 0; i < keys.size(); i++)
+            ((text += " ").append(keys[i]) += " ").append(values[i]);
+        return text;
+    }
+    
+private:
+    std::vector<std::string_view> keys;
+    std::vector<std::string_view> values;
+};
+
+class CmdMUnset: public Command
+{
+public:
+    CmdMUnset() {}
+    
+    void assign(const std::vector<std::string_view>& inKeys) {keys.assign(inKeys.begin(), inKeys.end());}
+    
+    virtual int name() const {return Command::CMD_MUNSET;}
+    
+    virtual int execute(Engine& engine)
+    {
+        echo();
+        int status = engine.dbUnsetMany(keys);
+        Printer::getInstance().replyOk();
+        return status;
+    }
+    
+    virtual std::string toString() const
+    {
+        return "MUNSET" + join(keys);
+    }
+    
+private:
+    std::vector<std::string_view> keys;
+};
+
+class CmdMGet: public Command
+{
+public:
+    CmdMGet() {}
+    
+    void assign(const std::vector<std::string_view>& inKeys) {keys.assign(inKeys.begin(), inKeys.end());}
+    
+    virtual int name() const {return Command::CMD_MGET;}
+    
+    virtual int execute(Engine& engine)
+    {
+        echo();
+        int result = engine.dbGetMany(keys, values, status);
+        Printer& printer = Printer::getInstance();
+        printer.replyArray(keys.size());
+        for(size_t i = 0; i < keys.size(); i++)
+        {
+            if(status[i] == Database::DB_NOT_FOUND)
+                printer.replyNull();
+            else
+                printer.reply(values[i]);
+        }
+        return result;
+    }
+    
+    virtual std::string toString() const
+    {
+        return "MGET" + join(keys);
+    }
+    
+private:
+    std::vector<std::string_view> keys;
+    std::vector<std::string> values; // Reused buffers for the values read from the database.
+    std::vector<int> status;
+};
+
+class CmdExpire: public Command
+{
+public:
+    CmdExpire(): seconds(0) {}
+    
+    void assign(std::string_view inKey, long long inSeconds) {key.assign(inKey); seconds = inSeconds;}
+    
+    virtual int name() const {return Command::CMD_EXPIRE;}
+    
+    // Reply 1 if the key exists and got the expiry time, 0 if it does not exist. A time that is not positive unsets it.
+    virtual int execute(Engine& engine)
+    {
+        echo();
+        int64_t deadline = seconds <= 0 ? 1 : Database::nowMs() + seconds * 1000;
+        int status = engine.dbExpire(key, deadline);
+        if(status == Database::DB_ERROR)
+            Printer::getInstance().replyError("ERR expiry not supported by this engine");
+        else
+            Printer::getInstance().reply(status == Database::DB_GOOD ? 1LL : 0LL);
+        return status;
+    }
+    
+    virtual std::string toString() const
+    {
+        return "EXPIRE " + this->key + " " + std::to_string(seconds);
+    }
+    
+private:
+    std::string key;
+    long long seconds;
+};
+
+class CmdTtl: public Command
+{
+public:
+    CmdTtl() {}
+    
+    void assign(std::string_view inKey) {key.assign(inKey);}
+    
+    virtual int name() const {return Command::CMD_TTL;}
+    
+    // Reply the seconds a key has left, rounded, or -1 if it has no expiry time and -2 if it does not exist.
+    virtual int execute(Engine& engine)
+    {
+        echo();
+        int64_t deadline = Database::NO_EXPIRY;
+        int status = engine.dbGetExpiry(key, deadline);
+        Printer& printer = Printer::getInstance();
+        if(status == Database::DB_ERROR)
+            printer.replyError("ERR expiry not supported by this engine");
+        else if(status == Database::DB_NOT_FOUND)
+            printer.reply(-2LL);
+        else if(deadline == Database::NO_EXPIRY)
+            printer.reply(-1LL);
+        else
+            printer.reply((long long)std::max<int64_t>(0, (deadline - Database::nowMs() + 500) / 1000));
+        return status;
+    }
+    
+    virtual std::string toString() const
+    {
+        return "TTL " + this->key;
+    }
+    
+private:
+    std::string key;
+};
+
+class CmdScan: public Command
+{
+public:
+    CmdScan(): count(0) {}
+    
+    // List the keys from inFrom on and below inTo (no bound if empty), visiting at most inCount keys.
+    void assign(std::string_view inFrom, std::string_view inTo, size_t inCount)
+    {
+        from.assign(inFrom);
+        to.assign(inTo);
+        count = inCount;
+    }
+    
+    virtual int name() const {return Command::CMD_SCAN;}
+    
+    // Reply an array of the cursor, the key to pass as FROM to continue or NULL at the end, and an array of the keys.
+    virtual int execute(Engine& engine)
+    {
+        echo();
+        keys.clear();
+        int status = engine.dbScan(from, to, count, keys, next);
+        Printer& printer = Printer::getInstance();
+        if(status == Database::DB_ERROR)
+        {
+            printer.replyError("ERR SCAN needs --ordered-index and the undo engine");
+            return status;
+        }
+        printer.replyArray(2);
+        if(next.empty())
+            printer.replyNull();
+        else
+            printer.reply(next);
+        printer.replyArray(keys.size());
+        for(const std::string& key: keys)
+            printer.reply(key);
+        return status;
+    }
+    
+    virtual std::string toString() const
+    {
+        return "SCAN FROM " + this->from + (to.empty() ? "" : " BELOW " + this->to) + " COUNT " + std::to_string(count);
+    }
+    
+private:
+    std::string from;
+    std::string to;
+    size_t count;
+    std::vector<std::string> keys; // Reused for the results.
+    std::string next;
+};
+
+class CmdIncrBy: public Command
+{
+public:
+    CmdIncrBy(bool inDecrement): amount(0), decrement(inDecrement) {}
+    
+    void assign(std::string_view inKey, long long inAmount) {key.assign(inKey); amount = inAmount;}
+    
+    virtual int name() const {return decrement ? Command::CMD_DECRBY : Command::CMD_INCRBY;}
+    
+    // Reply the new value of the key, as an integer.
+    virtual int execute(Engine& engine)
+    {
+        echo();
+        int64_t result = 0;
+        int status = engine.dbIncrBy(key, decrement ? -amount : amount, result);
+        Printer& printer = Printer::getInstance();
+        if(status == Database::DB_ERROR)
+            printer.replyError("ERR INCRBY and DECRBY are not supported by this engine");
+        else if(status == Database::DB_NOT_A_NUMBER)
+            printer.replyError("ERR value is not an integer or out of range");
+        else
+            printer.reply((long long)result);
+        return status;
+    }
+    
+    virtual std::string toString() const
+    {
+        return (decrement ? "DECRBY " : "INCRBY ") + this->key + " " + std::to_string(amount);
+    }
+    
+private:
+    std::string key;
+    long long amount; // Never LLONG_MIN for DECRBY, so that it can be negated.
+    bool decrement;
+};
+
+class CmdNumBetween: public Command
+{
+public:
+    CmdNumBetween(): low(0), high(0) {}
+    
+    void assign(long long inLow, long long inHigh) {low = inLow; high = inHigh;}
+    
+    virtual int name() const {return Command::CMD_NUMBETWEEN;}
+    
+    // Reply the number of keys whose value is an integer from low to high, both included.
+    virtual int execute(Engine& engine)
+    {
+        echo();
+        int count = 0;
+        int status = engine.dbNumBetween(low, high, count);
+        if(status == Database::DB_ERROR)
+            Printer::getInstance().replyError("ERR NUMBETWEEN is not supported by this engine");
+        else
+            Printer::getInstance().reply((long long)count);
+        return status;
+    }
+    
+    virtual std::string toString() const
+    {
+        return "NUMBETWEEN " + std::to_string(low) + " " + std::to_string(high);
+    }
+    
+private:
+    long long low;
+    long long high;
+};
+
+class CmdEval: public Command
+{
+public:
+    CmdEval() {}
+    
+    // The words of the script up to the first "ARGS", which are joined with spaces into its source, and the arguments
+    // after it, as views that are only valid while the Reader runs the line.
+    void assign(const std::vector<std::string_view>& words);
+    
+    virtual int name() const {return Command::CMD_EVAL;}
+    
+    // Compile the script, or find it among the scripts of the session, and run it. Reply the value of its RETURN, or
+    // OK if it has none, or the error that stopped it.
+    virtual int execute(Engine& engine);
+    
+    virtual std::string toString() const;
+    
+private:
+    static const size_t MAX_SCRIPTS = 1000; // The cache is dropped when it is full.
+    
+    std::string source;
+    std::vector<std::string_view> args;
+    std::vector<std::unique_ptr<Script> > scripts; // Compiled scripts of the session.
+    FlatMap<std::string_view, uint32_t, std::hash<std::string_view>, std::equal_to<std::string_view> > cache;
+    std::string error;
 };
 
 class CmdBegin: public Command
@@ -164,12 +563,13 @@ public:
     
     virtual int name() const {return Command::CMD_BEGIN;}
     
-    virtual int execute(std::shared_ptr<Database> db)
+    virtual int execute(Engine& engine)
     {
-        Printer::getInstance().print(toString());
+        echo();
+        engine.begin();
+        Printer::getInstance().replyOk();
         return Database::DB_GOOD;
     }
-    virtual int undo(std::shared_ptr<Database> db) {return Database::DB_GOOD;}
     
     virtual std::string toString() const
     {
@@ -184,12 +584,17 @@ public:
     
     virtual int name() const {return Command::CMD_ROLLBACK;}
     
-    virtual int execute(std::shared_ptr<Database> db)
+    virtual int execute(Engine& engine)
     {
-        Printer::getInstance().print(toString());
+        echo();
+        if(!engine.rollback())
+        {
+            Printer::getInstance().replyError("NO TRANSACTION");
+            return Database::DB_NOT_FOUND;
+        }
+        Printer::getInstance().replyOk();
         return Database::DB_GOOD;
     }
-    virtual int undo(std::shared_ptr<Database> db) {return Database::DB_GOOD;}
     
     virtual std::string toString() const
     {
@@ -204,20 +609,94 @@ public:
     
     virtual int name() const {return Command::CMD_COMMIT;}
     
-    virtual int execute(std::shared_ptr<Database> db)
+    virtual int execute(Engine& engine)
     {
-        Printer::getInstance().print(toString());
+        echo();
+        if(engine.depth() == 0)
+        {
+            Printer::getInstance().replyError("NO TRANSACTION");
+            return Database::DB_NOT_FOUND;
+        }
+        if(!engine.commit())
+        {
+            Printer::getInstance().replyError("ERR write conflict, the transaction was rolled back");
+            return Database::DB_ERROR;
+        }
+        Printer::getInstance().replyOk();
         return Database::DB_GOOD;
     }
     
-    virtual int undo(std::shared_ptr<Database> db) {return Database::DB_GOOD;}
-    
     virtual std::string toString() const
     {
         return "COMMIT";
     }
 };
 
+class CmdSave: public Command
+{
+public:
+    CmdSave(bool inBackground): snapshot(nullptr), background(inBackground) {}
+    
+    void setSnapshot(Snapshot* inSnapshot) {snapshot = inSnapshot;}
+    
+    virtual int name() const {return background ? Command::CMD_BGSAVE : Command::CMD_SAVE;}
+    
+    virtual int execute(Engine& engine)
+    {
+        echo();
+        // The writes of an open block of an engine that does not buffer them are in the store already, where a
+        // ROLLBACK after the save would leave them in the snapshot. Those of other sessions make save() refuse.
+        bool inBlock = engine.depth() > 0 && !engine.buffersBlocks();
+        int status = snapshot == nullptr || inBlock ? Snapshot::SNAPSHOT_ERROR : engine.save(*snapshot, background);
+        if(snapshot == nullptr)
+            Printer::getInstance().replyError("ERR no snapshot file");
+        else if(inBlock)
+            Printer::getInstance().replyError("ERR " + toString() + " inside a transaction block");
+        else if(status == Snapshot::SNAPSHOT_BUSY)
+            Printer::getInstance().replyError("ERR a background save is in progress");
+        else if(status == Snapshot::SNAPSHOT_OPEN_BLOCK)
+            Printer::getInstance().replyError("ERR " + toString() + " while another session has a block open");
+        else if(status == Snapshot::SNAPSHOT_ERROR)
+            Printer::getInstance().replyError(std::string("ERR ") + std::strerror(errno));
+        else
+            Printer::getInstance().replyOk();
+        return status == Snapshot::SNAPSHOT_GOOD ? Database::DB_GOOD : Database::DB_ERROR;
+    }
+    
+    virtual std::string toString() const
+    {
+        return background ? "BGSAVE" : "SAVE";
+    }
+    
+private:
+    Snapshot* snapshot; // Owned by the Reader.
+    bool background;
+};
+
+class CmdInfo: public Command
+{
+public:
+    CmdInfo() {}
+    
+    void assign(std::string_view inSection) {section.assign(inSection);} // Empty for all sections.
+    
+    virtual int name() const {return Command::CMD_INFO;}
+    
+    // Reply the sections Keyspace, Transactions, Memory, Commandstats and Slowlog as "field:value" lines under a
+    // "# Section" header: one bulk string in RESP, one reply per line in the text protocol.
+    virtual int execute(Engine& engine);
+    
+    virtual std::string toString() const
+    {
+        return section.empty() ? "INFO" : "INFO " + section;
+    }
+    
+private:
+    std::string section;
+    
+    bool wants(const char* name) const; // Whether a section is selected.
+};
+
 class CmdEnd: public Command
 {
 public:
@@ -225,14 +704,14 @@ public:
     
     virtual int name() const {return Command::CMD_END;}
     
-    virtual int execute(std::shared_ptr<Database> db)
+    virtual int execute(Engine& engine)
     {
-        Printer::getInstance().print(toString());
+        echo();
+        Printer::getInstance().replyOk();
+        Printer::getInstance().flush();
         return Database::DB_GOOD;
     }
     
-    virtual int undo(std::shared_ptr<Database> db) {return Database::DB_GOOD;}
-    
     virtual std::string toString() const
     {
         return "END";
@@ -0,0 +1,319 @@
+#include "CoreDatabase.hpp"
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+
+struct CoreDatabase::Inbox
+{
+    Inbox(): queue(QUEUE_CAPACITY), closed(false) {}
+
+    SpscQueue<Message*> queue;
+    std::atomic<bool> closed; // Set by the channel after its last message.
+};
+
+CoreDatabase::Channel::Channel(CoreDatabase& inDb): db(inDb)
+{
+    for(auto& core: inDb.cores)
+    {
+        Inbox* inbox = new Inbox();
+        this->inboxes.push_back(inbox);
+        std::lock_guard<std::mutex> guard(core->lock);
+        core->joining.push_back(inbox);
+        core->hasJoining.store(true, std::memory_order_release);
+        core->wake.notify_one();
+    }
+}
+
+CoreDatabase::Channel::~Channel()
+{
+    // The core frees the queue when it finds it closed and empty.
+    for(Inbox* inbox: this->inboxes)
+        inbox->closed.store(true, std::memory_order_release);
+}
+
+void CoreDatabase::Channel::send(size_t core, Message& message)
+{
+    message.done.store(false, std::memory_order_relaxed);
+    Core& target = *this->db.cores[core];
+    while(!this->inboxes[core]->queue.push(&message))
+    {
+        wake(target);
+        std::this_thread::yield();
+    }
+    wake(target);
+}
+
+void CoreDatabase::Channel::wait(Message& message)
+{
+    for(unsigned rounds = 0; !message.done.load(std::memory_order_acquire); rounds++)
+    {
+        if(rounds >= SPIN_ROUNDS)
+            std::this_thread::yield();
+    }
+}
+
+CoreDatabase::CoreDatabase(size_t inCoreCount, bool pin): stopping(false)
+{
+    for(size_t i = 0; i < inCoreCount || i == 0; i++)
+        this->cores.emplace_back(new Core());
+    for(size_t i = 0; i < this->cores.size(); i++)
+        this->cores[i]->thread = std::thread([this, i, pin]() {run(i, pin);});
+}
+
+CoreDatabase::~CoreDatabase()
+{
+    this->stopping.store(true, std::memory_order_seq_cst);
+    for(auto& core: this->cores)
+    {
+        {
+            std::lock_guard<std::mutex> guard(core->lock);
+            core->wake.notify_one();
+        }
+        core->thread.join();
+        for(Inbox* inbox: core->inboxes)
+            delete inbox;
+        for(Inbox* inbox: core->joining)
+            delete inbox;
+    }
+}
+
+void CoreDatabase::forEachShard(Channel& channel, const std::function<void(size_t, Database&)>& f)
+{
+    std::unique_ptr<Message[]> messages(new Message[this->cores.size()]);
+    for(size_t i = 0; i < this->cores.size(); i++)
+    {
+        messages[i].op = OP_CALL;
+        messages[i].call = &f;
+        channel.send(i, messages[i]);
+    }
+    for(size_t i = 0; i < this->cores.size(); i++)
+        Channel::wait(messages[i]);
+}
+
+void CoreDatabase::exclusive(Channel& channel, const std::function<void()>& f)
+{
+    Message message;
+    for(size_t i = 0; i < this->cores.size(); i++)
+    {
+        message.op = OP_PREPARE;
+        channel.call(i, message);
+    }
+    f();
+    std::unique_ptr<Message[]> releases(new Message[this->cores.size()]);
+    for(size_t i = 0; i < this->cores.size(); i++)
+    {
+        releases[i].op = OP_RELEASE;
+        channel.send(i, releases[i]);
+    }
+    for(size_t i = 0; i < this->cores.size(); i++)
+        Channel::wait(releases[i]);
+}
+
+void CoreDatabase::setMaxMemory(size_t maxBytes, int policy, unsigned samples)
+{
+    size_t part = maxBytes == 0 ? 0 : std::max<size_t>(maxBytes / this->cores.size(), 1);
+    Channel channel(*this);
+    forEachShard(channel, [&](size_t, Database& db) {db.setMaxMemory(part, policy, samples);});
+}
+
+StoreStats CoreDatabase::stats(Channel& channel)
+{
+    std::vector<StoreStats> partials(this->cores.size());
+    forEachShard(channel, [&](size_t index, Database& db) {partials[index] = db.stats();});
+    StoreStats total = {0, 0, 0, 0, 0, 0, 0, 0};
+    for(const StoreStats& partial: partials)
+    {
+        total.keys += partial.keys;
+        total.values += partial.values;
+        total.memoryBytes += partial.memoryBytes;
+        total.trackedBytes += partial.trackedBytes;
+        total.maxBytes += partial.maxBytes;
+        total.evictedKeys += partial.evictedKeys;
+        total.expiringKeys += partial.expiringKeys;
+        total.expiredKeys += partial.expiredKeys;
+    }
+    return total;
+}
+
+void CoreDatabase::run(size_t index, bool pin)
+{
+    Core& core = *this->cores[index];
+    unsigned cpus = std::thread::hardware_concurrency();
+    if(pin && cpus > 0)
+    {
+        // Best effort: without the permission, or on a CPU set smaller than the cores, the scheduler places them.
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % cpus, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    unsigned rounds = 0;
+    while(true)
+    {
+        if(core.hasJoining.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> guard(core.lock);
+            core.inboxes.insert(core.inboxes.end(), core.joining.begin(), core.joining.end());
+            core.joining.clear();
+            core.hasJoining.store(false, std::memory_order_relaxed);
+        }
+        bool worked = false;
+        for(size_t i = 0; i < core.inboxes.size();)
+        {
+            Inbox* inbox = core.inboxes[i];
+            Message* message;
+            for(size_t n = 0; n < BURST && inbox->queue.pop(message); n++)
+            {
+                worked = true;
+                if(execute(core, index, *message))
+                    dedicate(core, index, *inbox);
+            }
+            // A channel is closed after its last message is done, so a closed queue that is empty stays empty.
+            if(inbox->closed.load(std::memory_order_acquire) && inbox->queue.empty())
+            {
+                delete inbox;
+                core.inboxes[i] = core.inboxes.back();
+                core.inboxes.pop_back();
+                continue;
+            }
+            i++;
+        }
+        if(worked)
+            rounds = 0;
+        else if(this->stopping.load(std::memory_order_acquire))
+            return;
+        else
+            idle(core, rounds, nullptr);
+    }
+}
+
+bool CoreDatabase::execute(Core& core, size_t index, Message& message)
+{
+    Database& db = core.db;
+    int op = message.op;
+    switch(op)
+    {
+        case OP_SET:
+            message.transaction->record(message.key);
+            message.status = db.dbSet(message.key, message.value);
+            break;
+        case OP_UNSET:
+            message.transaction->record(message.key);
+            message.status = db.dbUnset(message.key);
+            break;
+        case OP_GET:
+            message.status = db.dbGet(message.key, *message.result);
+            break;
+        case OP_INCRBY:
+            message.transaction->record(message.key);
+            message.status = db.dbIncrBy(message.key, message.number, message.number);
+            break;
+        case OP_EXPIRE:
+            message.transaction->record(message.key);
+            message.status = db.dbExpire(message.key, message.number);
+            break;
+        case OP_SET_EXPIRING:
+            message.transaction->record(message.key);
+            message.status = db.dbSetExpiring(message.key, message.value, message.number);
+            break;
+        case OP_GET_EXPIRY:
+            message.status = db.dbGetExpiry(message.key, message.number);
+            break;
+        case OP_NUMEQUALTO:
+            message.count = 0;
+            message.status = db.dbNumEqualTo(message.value, message.count);
+            break;
+        case OP_NUMBETWEEN:
+            message.count = 0;
+            message.status = db.dbNumBetween(message.number, message.high, message.count);
+            break;
+        case OP_SET_MANY:
+        case OP_UNSET_MANY:
+            for(uint32_t i: *message.indexes)
+            {
+                message.transaction->record((*message.keys)[i]);
+                if(op == OP_SET_MANY)
+                    db.dbSet((*message.keys)[i], (*message.values)[i]);
+                else
+                    db.dbUnset((*message.keys)[i]);
+            }
+            message.status = Database::DB_GOOD;
+            break;
+        case OP_GET_MANY:
+            for(uint32_t i: *message.indexes)
+                (*message.statuses)[i] = db.dbGet((*message.keys)[i], (*message.results)[i]);
+            message.status = Database::DB_GOOD;
+            break;
+        case OP_ROLLBACK:
+            message.transaction->rollback();
+            message.status = Database::DB_GOOD;
+            break;
+        case OP_COMMIT:
+            message.transaction->commit();
+            message.status = Database::DB_GOOD;
+            break;
+        case OP_CALL:
+            (*message.call)(index, db);
+            message.status = Database::DB_GOOD;
+            break;
+        default: // OP_PREPARE, and OP_RELEASE, which only ends one.
+            message.status = Database::DB_GOOD;
+            break;
+    }
+    // The sender may reuse the message as soon as it sees done.
+    message.done.store(true, std::memory_order_release);
+    return op == OP_PREPARE;
+}
+
+void CoreDatabase::dedicate(Core& core, size_t index, Inbox& inbox)
+{
+    unsigned rounds = 0;
+    while(true)
+    {
+        Message* message;
+        if(!inbox.queue.pop(message))
+        {
+            idle(core, rounds, &inbox);
+            continue;
+        }
+        rounds = 0;
+        int op = message->op;
+        execute(core, index, *message);
+        if(op == OP_ROLLBACK || op == OP_RELEASE)
+            return;
+    }
+}
+
+void CoreDatabase::idle(Core& core, unsigned& rounds, Inbox* only)
+{
+    rounds++;
+    if(rounds <= SPIN_ROUNDS)
+        return;
+    if(rounds <= SPIN_ROUNDS + YIELD_ROUNDS)
+    {
+        std::this_thread::yield();
+        return;
+    }
+    std::unique_lock<std::mutex> guard(core.lock);
+    core.sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool pending = !core.joining.empty() || this->stopping.load(std::memory_order_relaxed);
+    if(only != nullptr)
+        pending = !only->queue.empty();
+    for(size_t i = 0; only == nullptr && !pending && i < core.inboxes.size(); i++)
+        pending = !core.inboxes[i]->queue.empty();
+    if(!pending)
+        core.wake.wait(guard);
+    core.sleeping.store(false, std::memory_order_relaxed);
+    rounds = 0;
+}
+
+void CoreDatabase::wake(Core& core)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(core.sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> guard(core.lock);
+        core.wake.notify_one();
+    }
+}
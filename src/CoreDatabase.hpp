@@ -0,0 +1,161 @@
+#ifndef CoreDatabase_hpp
+#define CoreDatabase_hpp
+
+#include "Database.hpp"
+#include "SpscQueue.hpp"
+#include "Transaction.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * This class is the shared-nothing variant of ShardedDatabase: the keys are partitioned into shards the same way, by
+ * the high bits of their hash, but each shard is a Database owned by a thread of its own, its core, pinned to one CPU
+ * when it can be. Only the core touches its shard, so there are no locks on the data and a shard's tables stay in the
+ * cache of its CPU. Sessions do not call the shards: they send a Message to the core of the key and wait for it to be
+ * done. Each session has a Channel, one SpscQueue of messages per core, so every queue has exactly one producer and
+ * one consumer and sending costs no lock either. A core takes up to BURST messages from each of its queues in turn.
+ * A message that involves every shard, such as NUMEQUALTO, is sent to all cores at once and the partial results are
+ * added up by the session when all are done, so the cores work on it in parallel. As with ShardedDatabase, the sum
+ * reflects each shard at a slightly different moment when writes run concurrently.
+ * A core with nothing to do polls its queues SPIN_ROUNDS times, yields its CPU YIELD_ROUNDS times, and then sleeps on
+ * a condition variable; a sender wakes it after pushing when it sees its sleeping flag. Both sides set their flag or
+ * queue, issue a full fence and then read the other's, so one of them always sees the other.
+ * A PREPARE message dedicates its core to the channel that sent it: the core acknowledges it and then only takes
+ * messages from that channel until a ROLLBACK or a RELEASE, so the shard cannot change meanwhile except through that
+ * channel. A coordinator that prepares several cores does so in ascending order of core and waits for each
+ * acknowledgement before the next PREPARE, so two coordinators never wait for each other in a cycle. exclusive() uses
+ * this to stop every core while a function reads or writes all shards from the calling thread, which is how
+ * snapshots are saved and loaded. See CoreEngine for how transaction blocks use it.
+ */
+class CoreDatabase
+{
+public:
+    static const size_t BURST = 32; // Messages a core takes from one queue before it looks at the next.
+    static const size_t QUEUE_CAPACITY = 64; // Messages per queue; a sender waits while its queue is full.
+    static const unsigned SPIN_ROUNDS = 64; // Polls of an idle core, or of a waiting session, before yielding.
+    static const unsigned YIELD_ROUNDS = 64; // Yields of an idle core before it sleeps.
+
+    enum
+    {
+        OP_SET,
+        OP_UNSET,
+        OP_GET,
+        OP_INCRBY,
+        OP_EXPIRE,
+        OP_SET_EXPIRING,
+        OP_GET_EXPIRY,
+        OP_NUMEQUALTO,
+        OP_NUMBETWEEN,
+        OP_SET_MANY, // The keys of a batch listed by indexes, see Message.
+        OP_UNSET_MANY,
+        OP_GET_MANY,
+        OP_ROLLBACK, // Roll back the top block of the transaction, and end a PREPARE.
+        OP_COMMIT, // Commit all blocks of the transaction.
+        OP_PREPARE, // Take messages from this channel only, until a ROLLBACK or a RELEASE.
+        OP_RELEASE,
+        OP_CALL // Call a function with the shard.
+    };
+
+    /**
+     * A request to one core. The sender fills in op and what it uses, sends it and must not touch it until done is
+     * set; the core writes status and the results first.
+     */
+    struct Message
+    {
+        int op;
+        int status;
+        std::string_view key;
+        std::string_view value;
+        int64_t number; // The delta of INCRBY and then its result, the deadline of the *EXPIR* ops, low.
+        int64_t high; // Of NUMBETWEEN.
+        int count; // Result of NUMEQUALTO and NUMBETWEEN.
+        std::string* result; // Of GET.
+        Transaction* transaction; // The undo log of the session for this core's shard, which writes record to.
+        // The *_MANY operations work on the elements of the batch vectors at the listed indexes.
+        const std::vector<uint32_t>* indexes;
+        const std::vector<std::string_view>* keys;
+        const std::vector<std::string_view>* values;
+        std::vector<std::string>* results;
+        std::vector<int>* statuses;
+        const std::function<void(size_t, Database&)>* call; // Of CALL, with the core's index and shard.
+        std::atomic<bool> done;
+    };
+
+    struct Inbox; // The queue of one channel to one core, and whether the channel is closed.
+
+    /**
+     * The queues of one session to every core. A channel is used by one thread at a time; closing it lets the cores
+     * free its queues once they have taken the last messages.
+     */
+    class Channel
+    {
+    public:
+        Channel(CoreDatabase& inDb);
+        ~Channel();
+
+        void send(size_t core, Message& message);
+        static void wait(Message& message);
+        void call(size_t core, Message& message) {send(core, message); wait(message);}
+
+    private:
+        Channel(const Channel& channel);
+        Channel& operator=(const Channel& channel);
+
+        CoreDatabase& db;
+        std::vector<Inbox*> inboxes; // Index is the core.
+    };
+
+    CoreDatabase(size_t inCoreCount, bool pin = true); // Pin core i to CPU i modulo the number of CPUs.
+    ~CoreDatabase(); // Stop the cores. Every channel must be closed.
+
+    size_t coreCount() const {return cores.size();}
+    size_t shardOf(std::string_view key) const
+    {
+        return (size_t)(((unsigned __int128)ArenaStringHash()(key) * this->cores.size()) >> 64);
+    }
+
+    // Call f(index, shard) on every core at once, and wait for all.
+    void forEachShard(Channel& channel, const std::function<void(size_t, Database&)>& f);
+    // Prepare every core, call f from this thread, which may then use every shard(), and release them.
+    void exclusive(Channel& channel, const std::function<void()>& f);
+    Database& shard(size_t index) {return cores[index]->db;} // Only from f of forEachShard() or exclusive().
+
+    // Give each shard an equal part of a memory limit, see ShardedDatabase::setMaxMemory().
+    void setMaxMemory(size_t maxBytes, int policy, unsigned samples);
+    StoreStats stats(Channel& channel); // Sums over the shards, as ShardedDatabase::stats().
+
+private:
+    CoreDatabase(const CoreDatabase& db);
+    CoreDatabase& operator=(const CoreDatabase& db);
+
+    struct alignas(64) Core
+    {
+        Database db;
+        std::vector<Inbox*> inboxes; // Only used by the core's thread.
+        std::mutex lock; // Guards joining, and sleeping for the condition variable.
+        std::vector<Inbox*> joining; // Queues of new channels.
+        std::atomic<bool> hasJoining{false};
+        std::atomic<bool> sleeping{false};
+        std::condition_variable wake;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Core> > cores;
+    std::atomic<bool> stopping;
+
+    void run(size_t index, bool pin); // The loop of a core's thread.
+    bool execute(Core& core, size_t index, Message& message); // Return true for a PREPARE.
+    void dedicate(Core& core, size_t index, Inbox& inbox); // Serve one queue until it ends a PREPARE.
+    void idle(Core& core, unsigned& rounds, Inbox* only); // Back off while there is no message.
+    static void wake(Core& core); // Wake the core if it sleeps.
+};
+
+#endif /* CoreDatabase_hpp */
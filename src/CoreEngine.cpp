@@ -0,0 +1,249 @@
+#include "CoreEngine.hpp"
+
+CoreEngine::CoreEngine(std::shared_ptr<CoreDatabase> inDb):
+    db(inDb), channel(*inDb), messages(new CoreDatabase::Message[inDb->coreCount()]), batches(inDb->coreCount()),
+    frames(0)
+{
+    for(size_t i = 0; i < inDb->coreCount(); i++)
+        this->transactions.emplace_back(new Transaction(std::shared_ptr<Database>(inDb, &inDb->shard(i))));
+}
+
+Transaction* CoreEngine::enter(size_t core)
+{
+    Transaction* transaction = this->transactions[core].get();
+    while(transaction->depth() < this->frames)
+        transaction->begin();
+    return transaction;
+}
+
+int CoreEngine::write(int op, std::string_view key, std::string_view value)
+{
+    size_t core = this->db->shardOf(key);
+    CoreDatabase::Message& message = this->messages[core];
+    message.op = op;
+    message.key = key;
+    message.value = value;
+    message.transaction = enter(core);
+    this->channel.call(core, message);
+    return message.status;
+}
+
+int CoreEngine::dbGet(std::string_view key, std::string& value)
+{
+    size_t core = this->db->shardOf(key);
+    CoreDatabase::Message& message = this->messages[core];
+    message.op = CoreDatabase::OP_GET;
+    message.key = key;
+    message.result = &value;
+    this->channel.call(core, message);
+    return message.status;
+}
+
+int CoreEngine::dbIncrBy(std::string_view key, int64_t delta, int64_t& result)
+{
+    size_t core = this->db->shardOf(key);
+    CoreDatabase::Message& message = this->messages[core];
+    message.op = CoreDatabase::OP_INCRBY;
+    message.key = key;
+    message.number = delta;
+    message.transaction = enter(core);
+    this->channel.call(core, message);
+    result = message.number;
+    return message.status;
+}
+
+int CoreEngine::dbExpire(std::string_view key, int64_t deadlineMs)
+{
+    size_t core = this->db->shardOf(key);
+    CoreDatabase::Message& message = this->messages[core];
+    message.op = CoreDatabase::OP_EXPIRE;
+    message.key = key;
+    message.number = deadlineMs;
+    message.transaction = enter(core);
+    this->channel.call(core, message);
+    return message.status;
+}
+
+int CoreEngine::dbSetExpiring(std::string_view key, std::string_view value, int64_t deadlineMs)
+{
+    size_t core = this->db->shardOf(key);
+    CoreDatabase::Message& message = this->messages[core];
+    message.op = CoreDatabase::OP_SET_EXPIRING;
+    message.key = key;
+    message.value = value;
+    message.number = deadlineMs;
+    message.transaction = enter(core);
+    this->channel.call(core, message);
+    return message.status;
+}
+
+int CoreEngine::dbGetExpiry(std::string_view key, int64_t& deadlineMs)
+{
+    size_t core = this->db->shardOf(key);
+    CoreDatabase::Message& message = this->messages[core];
+    message.op = CoreDatabase::OP_GET_EXPIRY;
+    message.key = key;
+    this->channel.call(core, message);
+    deadlineMs = message.number;
+    return message.status;
+}
+
+int CoreEngine::countAll(int op, std::string_view value, int64_t low, int64_t high, int& count)
+{
+    size_t cores = this->db->coreCount();
+    for(size_t i = 0; i < cores; i++)
+    {
+        CoreDatabase::Message& message = this->messages[i];
+        message.op = op;
+        message.value = value;
+        message.number = low;
+        message.high = high;
+        this->channel.send(i, message);
+    }
+    count = 0;
+    for(size_t i = 0; i < cores; i++)
+    {
+        CoreDatabase::Channel::wait(this->messages[i]);
+        count += this->messages[i].count;
+    }
+    return count > 0 ? Database::DB_GOOD : Database::DB_NOT_FOUND;
+}
+
+int CoreEngine::dbNumEqualTo(std::string_view value, int& count)
+{
+    return countAll(CoreDatabase::OP_NUMEQUALTO, value, 0, 0, count);
+}
+
+int CoreEngine::dbNumBetween(int64_t low, int64_t high, int& count)
+{
+    return countAll(CoreDatabase::OP_NUMBETWEEN, std::string_view(), low, high, count);
+}
+
+int CoreEngine::sendBatch(int op, const std::vector<std::string_view>& keys,
+                          const std::vector<std::string_view>* values, std::vector<std::string>* results,
+                          std::vector<int>* status)
+{
+    // Keys of different cores are independent, so the cores apply their part of the batch in parallel; each core
+    // keeps the order of the keys it gets, which is all that the order of the batch decides.
+    for(auto& batch: this->batches)
+        batch.clear();
+    for(size_t i = 0; i < keys.size(); i++)
+        this->batches[this->db->shardOf(keys[i])].push_back((uint32_t)i);
+    for(size_t core = 0; core < this->batches.size(); core++)
+    {
+        if(this->batches[core].empty())
+            continue;
+        CoreDatabase::Message& message = this->messages[core];
+        message.op = op;
+        message.indexes = &this->batches[core];
+        message.keys = &keys;
+        message.values = values;
+        message.results = results;
+        message.statuses = status;
+        if(op != CoreDatabase::OP_GET_MANY)
+            message.transaction = enter(core);
+        this->channel.send(core, message);
+    }
+    for(size_t core = 0; core < this->batches.size(); core++)
+    {
+        if(!this->batches[core].empty())
+            CoreDatabase::Channel::wait(this->messages[core]);
+    }
+    return Database::DB_GOOD;
+}
+
+int CoreEngine::dbSetMany(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& values)
+{
+    return sendBatch(CoreDatabase::OP_SET_MANY, keys, &values, nullptr, nullptr);
+}
+
+int CoreEngine::dbUnsetMany(const std::vector<std::string_view>& keys)
+{
+    return sendBatch(CoreDatabase::OP_UNSET_MANY, keys, nullptr, nullptr, nullptr);
+}
+
+int CoreEngine::dbGetMany(const std::vector<std::string_view>& keys, std::vector<std::string>& values,
+                          std::vector<int>& status)
+{
+    if(values.size() < keys.size())
+        values.resize(keys.size());
+    status.resize(keys.size());
+    return sendBatch(CoreDatabase::OP_GET_MANY, keys, nullptr, &values, &status);
+}
+
+bool CoreEngine::rollback()
+{
+    if(this->frames == 0)
+        return false;
+    std::vector<size_t> participants;
+    for(size_t i = 0; i < this->transactions.size(); i++)
+    {
+        if(this->transactions[i]->depth() == this->frames)
+            participants.push_back(i);
+    }
+    if(participants.size() > 1)
+    {
+        for(size_t core: participants)
+        {
+            CoreDatabase::Message& message = this->messages[core];
+            message.op = CoreDatabase::OP_PREPARE;
+            this->channel.call(core, message);
+        }
+    }
+    for(size_t core: participants)
+    {
+        CoreDatabase::Message& message = this->messages[core];
+        message.op = CoreDatabase::OP_ROLLBACK;
+        message.transaction = this->transactions[core].get();
+        this->channel.send(core, message);
+    }
+    for(size_t core: participants)
+        CoreDatabase::Channel::wait(this->messages[core]);
+    this->frames--;
+    return true;
+}
+
+bool CoreEngine::commit()
+{
+    if(this->frames == 0)
+        return false;
+    std::vector<size_t> participants;
+    for(size_t i = 0; i < this->transactions.size(); i++)
+    {
+        if(this->transactions[i]->depth() > 0)
+            participants.push_back(i);
+    }
+    for(size_t core: participants)
+    {
+        CoreDatabase::Message& message = this->messages[core];
+        message.op = CoreDatabase::OP_COMMIT;
+        message.transaction = this->transactions[core].get();
+        this->channel.send(core, message);
+    }
+    for(size_t core: participants)
+        CoreDatabase::Channel::wait(this->messages[core]);
+    this->frames = 0;
+    return true;
+}
+
+bool CoreEngine::commitBlock()
+{
+    if(this->frames <= 1)
+        return commit();
+    // An inner block hands its entries to the enclosing block, which only changes the frames of the logs.
+    for(auto& transaction: this->transactions)
+    {
+        if(transaction->depth() == this->frames)
+            transaction->commitBlock();
+    }
+    this->frames--;
+    return true;
+}
+
+EngineStats CoreEngine::stats()
+{
+    size_t entries = 0;
+    for(auto& transaction: this->transactions)
+        entries += transaction->size();
+    return EngineStats{this->db->stats(this->channel), this->frames, entries};
+}
@@ -0,0 +1,74 @@
+#ifndef CoreEngine_hpp
+#define CoreEngine_hpp
+
+#include "CoreDatabase.hpp"
+#include "Engine.hpp"
+#include "Snapshot.hpp"
+#include "Transaction.hpp"
+#include <memory>
+#include <vector>
+
+/**
+ * This class is the undo-replay engine of a session on a CoreDatabase. Like ShardedEngine it keeps one Transaction
+ * undo log per shard, but a log is only used by the shard's core: a write is a message that records the old value in
+ * the log and applies the new one on the core, and the session only opens and closes frames between messages.
+ * Frames are opened lazily: BEGIN only counts the block, and the log of a core gets its frames up to the current
+ * depth before the first write the block sends to that core. So the cores a block writes to, its participants, are
+ * those whose log has as many frames as there are blocks, and the others are not involved when it ends:
+ *   commitBlock of an inner block - pops the top frame of each participant's log in the session; it touches no shard.
+ *   COMMIT - sends a COMMIT to every core whose log has a frame, all at once. It only drops undo records, which no
+ *            other session can observe, since the writes of the blocks are already visible (as with UndoEngine), so
+ *            it needs no agreement between the cores.
+ *   ROLLBACK - with a single participant, one ROLLBACK message. With several, a two-phase rollback: a PREPARE to each
+ *            participant in ascending order, waiting for each acknowledgement, so that all of them only take messages
+ *            from this session, then a ROLLBACK to each at once. Every other session therefore sees either all of
+ *            the block's writes or none of them undone, never a mix. The ascending order keeps concurrent rollbacks
+ *            and exclusive() from waiting for each other in a cycle.
+ * NUMEQUALTO, NUMBETWEEN and the batched commands send one message to each core they involve and wait for all, so the
+ * cores work on them in parallel.
+ */
+class CoreEngine: public Engine
+{
+public:
+    CoreEngine(std::shared_ptr<CoreDatabase> inDb);
+    virtual ~CoreEngine() {commit();}
+
+    virtual int dbSet(std::string_view key, std::string_view value) {return write(CoreDatabase::OP_SET, key, value);}
+    virtual int dbUnset(std::string_view key) {return write(CoreDatabase::OP_UNSET, key, std::string_view());}
+    virtual int dbGet(std::string_view key, std::string& value);
+    virtual int dbNumEqualTo(std::string_view value, int& count);
+    virtual int dbSetMany(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& values);
+    virtual int dbUnsetMany(const std::vector<std::string_view>& keys);
+    virtual int dbGetMany(const std::vector<std::string_view>& keys, std::vector<std::string>& values,
+                          std::vector<int>& status);
+    virtual int dbIncrBy(std::string_view key, int64_t delta, int64_t& result);
+    virtual int dbNumBetween(int64_t low, int64_t high, int& count);
+    virtual int dbExpire(std::string_view key, int64_t deadlineMs);
+    virtual int dbSetExpiring(std::string_view key, std::string_view value, int64_t deadlineMs);
+    virtual int dbGetExpiry(std::string_view key, int64_t& deadlineMs);
+
+    virtual void begin() {this->frames++;}
+    virtual bool rollback();
+    virtual bool commit();
+    virtual bool commitBlock();
+    virtual size_t depth() const {return this->frames;}
+    virtual int save(Snapshot& snapshot, bool background) {return snapshot.save(*this->db, background);}
+    virtual EngineStats stats();
+
+private:
+    std::shared_ptr<CoreDatabase> db;
+    CoreDatabase::Channel channel;
+    std::vector<std::unique_ptr<Transaction> > transactions; // Undo log of each shard, used by its core.
+    std::unique_ptr<CoreDatabase::Message[]> messages; // One per core.
+    std::vector<std::vector<uint32_t> > batches; // The indexes of the keys of a batch that go to each core.
+    size_t frames; // Number of open blocks.
+
+    Transaction* enter(size_t core); // Open the frames of the current blocks in the log of a core.
+    int write(int op, std::string_view key, std::string_view value);
+    int sendBatch(int op, const std::vector<std::string_view>& keys, const std::vector<std::string_view>* values,
+                  std::vector<std::string>* results, std::vector<int>* status);
+    // Send NUMEQUALTO or NUMBETWEEN to every core, wait for all and add up their counts.
+    int countAll(int op, std::string_view value, int64_t low, int64_t high, int& count);
+};
+
+#endif /* CoreEngine_hpp */
@@ -1,53 +1,531 @@
+#include "Command.hpp"
 #include "Database.hpp"
+#include <ctime>
 
-int Database::dbSet(const std::string& key, const std::string& value)
+int64_t Database::nowMs()
 {
-    decOldValue(key);
-    this->keyToValue[key] = value;
-    this->valueToCount[value]++;
+    struct timespec now;
+#ifdef CLOCK_REALTIME_COARSE
+    clock_gettime(CLOCK_REALTIME_COARSE, &now); // A few nanoseconds, at the resolution of the scheduler tick.
+#else
+    clock_gettime(CLOCK_REALTIME, &now);
+#endif
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+int Database::dbSet(std::string_view key, std::string_view value)
+{
+    expireSome(EXPIRY_SLICE);
+    reserveMemory();
+    auto entry = insertKey(key);
+    if(this->maxMemory != 0)
+        access(entry.first->value, entry.second);
+    if(!entry.second && !this->expiries.empty())
+        clearExpiry(entry.first->key);
+    if(!entry.second && this->values.value(entry.first->value.id) == value)
+        return DB_GOOD;
+    setValue(entry.first->value.id, this->values.intern(value));
+    return DB_GOOD;
+}
+
+int Database::dbSetId(std::string_view key, ValuePool::Id value)
+{
+    expireSome(EXPIRY_SLICE);
+    auto entry = insertKey(key);
+    if(entry.second && this->maxMemory != 0)
+        access(entry.first->value, true);
+    if(!entry.second && !this->expiries.empty())
+        clearExpiry(entry.first->key);
+    if(!entry.second && entry.first->value.id == value)
+        return DB_GOOD;
+    this->values.retain(value);
+    setValue(entry.first->value.id, value);
+    return DB_GOOD;
+}
+
+int Database::dbUnset(std::string_view key)
+{
+    expireSome(EXPIRY_SLICE);
+    auto entry = this->keyToValue.find(key);
+    if(entry == nullptr || entry->value.id == ValuePool::NONE)
+        return DB_NOT_FOUND;
+    erase(entry);
+    return DB_GOOD;
+}
+
+int Database::dbGet(std::string_view key, std::string& value)
+{
+    expireSome(EXPIRY_SLICE);
+    auto entry = this->keyToValue.find(key);
+    if(entry == nullptr || isExpired(entry))
+        return DB_NOT_FOUND;
+    touch(entry->value);
+    value.assign(this->values.value(entry->value.id));
     return DB_GOOD;
 }
 
-int Database::dbUnset(const std::string& key)
+int Database::dbGetView(std::string_view key, std::string_view& value)
 {
-    if(decOldValue(key) == DB_NOT_FOUND)
+    expireSome(EXPIRY_SLICE);
+    auto entry = this->keyToValue.find(key);
+    if(entry == nullptr || isExpired(entry))
         return DB_NOT_FOUND;
-    this->keyToValue.erase(key);
+    touch(entry->value);
+    value = this->values.value(entry->value.id);
     return DB_GOOD;
 }
 
-int Database::dbGet(const std::string& key, std::string& value)
+int Database::dbGetId(std::string_view key, ValuePool::Id& value)
 {
-    auto iter = this->keyToValue.find(key);
-    if(iter == this->keyToValue.end())
+    expireSome(EXPIRY_SLICE);
+    auto entry = this->keyToValue.find(key);
+    if(entry == nullptr || isExpired(entry))
         return DB_NOT_FOUND;
-    value = iter->second;
+    value = entry->value.id;
     return DB_GOOD;
 }
 
-int Database::dbNumEqualTo(const std::string& value, int& count)
+int Database::dbNumEqualTo(std::string_view value, int& count)
 {
+    expireSome(EXPIRY_SLICE);
+    if(this->expiryBacklog)
+        settleDue();
     count = 0;
-    auto iter = this->valueToCount.find(value);
-    if(iter == this->valueToCount.end())
+    ValuePool::Id id = this->values.find(value);
+    if(id == ValuePool::NONE || this->valueToCount[id] == 0)
         return DB_NOT_FOUND;
+    count = this->valueToCount[id];
+    return DB_GOOD;
+}
+
+int Database::dbIncrBy(std::string_view key, int64_t delta, int64_t& result)
+{
+    expireSome(EXPIRY_SLICE);
+    reserveMemory();
+    auto entry = this->keyToValue.find(key);
+    if(entry != nullptr && isExpired(entry))
+    {
+        if(entry->value.id != ValuePool::NONE) // Settled keys are counted already.
+            this->expired++;
+        erase(entry);
+        entry = nullptr;
+    }
+    int64_t number = 0;
+    if(entry != nullptr)
+    {
+        if(!this->values.isNumber(entry->value.id))
+            return DB_NOT_A_NUMBER;
+        number = this->values.number(entry->value.id);
+    }
+    if(__builtin_add_overflow(number, delta, &result))
+        return DB_NOT_A_NUMBER;
+    if(entry == nullptr)
+    {
+        entry = insertKey(key).first;
+        if(this->maxMemory != 0)
+            access(entry->value, true);
+    }
     else
+        touch(entry->value);
+    char buffer[ValuePool::NUMBER_CHARS];
+    setValue(entry->value.id, this->values.intern(ValuePool::formatNumber(result, buffer)));
+    return DB_GOOD;
+}
+
+int Database::dbNumBetween(int64_t low, int64_t high, int& count)
+{
+    expireSome(EXPIRY_SLICE);
+    if(this->expiryBacklog)
+        settleDue();
+    if(this->numbers == nullptr)
     {
-        count = this->valueToCount[value];
-        return DB_GOOD;
+        this->numbers.reset(new NumberIndex());
+        for(ValuePool::Id id = 0; id < this->valueToCount.size(); id++)
+        {
+            if(this->valueToCount[id] != 0 && this->values.isNumber(id))
+                this->numbers->add(id, this->values.number(id), this->valueToCount[id]);
+        }
     }
+    count = (int)this->numbers->countBetween(low, high);
+    return count == 0 ? DB_NOT_FOUND : DB_GOOD;
 }
 
-int Database::decOldValue(const std::string& key)
+void Database::dbSetMany(const std::string_view* keys, const std::string_view* values, size_t count)
 {
-    auto iter = this->keyToValue.find(key);
-    if(iter != this->keyToValue.end())
+    size_t keyHashes[BATCH_CHUNK], valueHashes[BATCH_CHUNK];
+    expireSome(EXPIRY_SLICE);
+    for(size_t start = 0; start < count; start += BATCH_CHUNK)
     {
-        this->valueToCount[iter->second]--;
-        if(this->valueToCount[iter->second] == 0)
-            this->valueToCount.erase(iter->second);
+        size_t n = std::min(count - start, BATCH_CHUNK);
+        reserveMemory();
+        for(size_t i = 0; i < n; i++)
+        {
+            keyHashes[i] = this->keyToValue.hash(keys[start + i]);
+            this->keyToValue.prefetch(keyHashes[i]);
+            valueHashes[i] = this->values.hash(values[start + i]);
+            this->values.prefetch(valueHashes[i]);
+        }
+        for(size_t i = 0; i < n; i++)
+        {
+            auto entry = insertKey(keys[start + i], keyHashes[i]);
+            if(this->maxMemory != 0)
+                access(entry.first->value, entry.second);
+            if(!entry.second && !this->expiries.empty())
+                clearExpiry(entry.first->key);
+            if(!entry.second && this->values.value(entry.first->value.id) == values[start + i])
+                continue;
+            setValue(entry.first->value.id, this->values.intern(values[start + i], valueHashes[i]));
+        }
+    }
+}
+
+void Database::dbUnsetMany(const std::string_view* keys, size_t count)
+{
+    size_t hashes[BATCH_CHUNK];
+    expireSome(EXPIRY_SLICE);
+    for(size_t start = 0; start < count; start += BATCH_CHUNK)
+    {
+        size_t n = std::min(count - start, BATCH_CHUNK);
+        for(size_t i = 0; i < n; i++)
+        {
+            hashes[i] = this->keyToValue.hash(keys[start + i]);
+            this->keyToValue.prefetch(hashes[i]);
+        }
+        for(size_t i = 0; i < n; i++)
+        {
+            auto entry = this->keyToValue.find(keys[start + i], hashes[i]);
+            if(entry != nullptr)
+                erase(entry);
+        }
+    }
+}
+
+void Database::dbNumEqualToMany(const std::string_view* values, size_t count, int* counts)
+{
+    size_t hashes[BATCH_CHUNK];
+    expireSome(EXPIRY_SLICE);
+    if(this->expiryBacklog)
+        settleDue();
+    for(size_t start = 0; start < count; start += BATCH_CHUNK)
+    {
+        size_t n = std::min(count - start, BATCH_CHUNK);
+        for(size_t i = 0; i < n; i++)
+        {
+            hashes[i] = this->values.hash(values[start + i]);
+            this->values.prefetch(hashes[i]);
+        }
+        for(size_t i = 0; i < n; i++)
+        {
+            ValuePool::Id id = this->values.find(values[start + i], hashes[i]);
+            counts[start + i] = id == ValuePool::NONE ? 0 : this->valueToCount[id];
+        }
+    }
+}
+
+void Database::setValue(ValuePool::Id& slot, ValuePool::Id value)
+{
+    if(value != ValuePool::NONE)
+    {
+        if(value >= this->valueToCount.size())
+            this->valueToCount.resize(this->values.capacity(), 0);
+        if(this->valueToCount[value]++ == 0)
+            this->distinctValues++;
+        if(this->numbers != nullptr && this->values.isNumber(value))
+            this->numbers->add(value, this->values.number(value), 1);
+    }
+    if(slot != ValuePool::NONE)
+    {
+        if(--this->valueToCount[slot] == 0)
+            this->distinctValues--;
+        if(this->numbers != nullptr && this->values.isNumber(slot))
+            this->numbers->add(slot, this->values.number(slot), -1);
+        this->values.release(slot);
+    }
+    slot = value;
+}
+
+size_t Database::tableBytes() const
+{
+    return this->keyToValue.memoryUsage() + this->values.memoryUsage() + this->valueToCount.capacity() * sizeof(int) +
+        this->expiries.memoryUsage() + this->timers.memoryUsage() +
+        (this->index == nullptr ? 0 : this->index->memoryUsage()) +
+        (this->numbers == nullptr ? 0 : this->numbers->memoryUsage());
+}
+
+StoreStats Database::stats() const
+{
+    return StoreStats{size(), this->distinctValues, tableBytes() + this->arena.stats().reservedBytes,
+                      this->maxMemory == 0 ? 0 : usedMemory(), this->maxMemory, this->evicted, this->expiries.size(),
+                      this->expired};
+}
+
+void Database::setMaxMemory(size_t maxBytes, int inPolicy, unsigned inSamples)
+{
+    this->maxMemory = maxBytes;
+    this->policy = inPolicy;
+    this->samples = inSamples == 0 ? 1 : inSamples;
+    // Keys set before the limit start out as if they were just accessed.
+    for(size_t i = 0; maxBytes != 0 && i < this->keyToValue.slotCount(); i++)
+    {
+        if(this->keyToValue.isFull(i))
+            access(this->keyToValue.slotAt(i).value, true);
+    }
+}
+
+size_t Database::usedMemory() const
+{
+    size_t keys = this->keyToValue.size();
+    return this->arena.stats().liveBytes + keys * sizeof(KeyTable::Slot) + keys + this->values.liveBytes() +
+        this->distinctValues * sizeof(int) + this->undoBytes +
+        this->expiries.size() * (sizeof(ExpiryTable::Slot) + 1) + this->timers.liveBytes() +
+        (this->index == nullptr ? 0 : this->index->memoryUsage()) +
+        (this->numbers == nullptr ? 0 : this->numbers->liveBytes());
+}
+
+void Database::pin(std::string_view key)
+{
+    if(this->maxMemory == 0)
+        return;
+    auto entry = this->pins.insertWith(key, this->pins.hash(key), [&]() {return ArenaString::make(key, this->arena);});
+    entry.first->value++;
+}
+
+void Database::unpin(std::string_view key)
+{
+    auto entry = this->pins.find(key);
+    if(entry == nullptr || --entry->value != 0)
+        return;
+    entry->key.release(this->arena);
+    this->pins.erase(entry);
+}
+
+void Database::access(KeyData& data, bool inserted)
+{
+    uint32_t now = ++this->clock;
+    if(this->policy == EVICT_LRU)
+    {
+        data.access = now;
+        return;
+    }
+    // LFU: the upper bits are the decay period of the last access, the lower 8 bits the count.
+    unsigned count = inserted ? LFU_INIT : lfuCount(data.access);
+    if(count < 255)
+    {
+        unsigned base = count > LFU_INIT ? count - LFU_INIT : 0;
+        if(nextRandom() % (base * LFU_LOG_FACTOR + 1) == 0)
+            count++;
+    }
+    data.access = (now >> LFU_DECAY_SHIFT) << 8 | count;
+}
+
+unsigned Database::lfuCount(uint32_t access) const
+{
+    uint32_t periods = ((this->clock >> LFU_DECAY_SHIFT) - (access >> 8)) & (UINT32_MAX >> LFU_DECAY_SHIFT);
+    unsigned count = access & 0xFF;
+    return periods >= count ? 0 : count - periods;
+}
+
+void Database::evict()
+{
+    size_t slots = this->keyToValue.slotCount();
+    for(unsigned misses = 0; this->keyToValue.size() > 0 && usedMemory() > this->maxMemory &&
+        misses < MAX_EVICTION_MISSES; )
+    {
+        KeyTable::Slot* victim = nullptr;
+        uint64_t victimScore = 0;
+        for(unsigned i = 0; i < this->samples; i++)
+        {
+            // The first full slot at or after a random index. The table is at most 7/8 full, so this is short.
+            size_t index = nextRandom() % slots;
+            while(!this->keyToValue.isFull(index))
+                index = index + 1 == slots ? 0 : index + 1;
+            KeyTable::Slot* slot = &this->keyToValue.slotAt(index);
+            if(this->pins.size() > 0 && this->pins.find(slot->key) != nullptr)
+                continue;
+            // Higher is a better victim: older for LRU, rarer for LFU.
+            uint64_t score = this->policy == EVICT_LRU ? (uint32_t)(this->clock - slot->value.access) :
+                256 - lfuCount(slot->value.access);
+            if(victim == nullptr || score > victimScore)
+            {
+                victim = slot;
+                victimScore = score;
+            }
+        }
+        if(victim == nullptr)
+        {
+            misses++;
+            continue;
+        }
+        if(victim->value.id != ValuePool::NONE) // Settled keys were expired, not evicted.
+            this->evicted++;
+        erase(victim);
+    }
+}
+
+uint64_t Database::nextRandom()
+{
+    // xorshift64.
+    this->random ^= this->random << 13;
+    this->random ^= this->random >> 7;
+    this->random ^= this->random << 17;
+    return this->random;
+}
+
+std::pair<Database::KeyTable::Slot*, bool> Database::insertKey(std::string_view key)
+{
+    return insertKey(key, this->keyToValue.hash(key));
+}
+
+std::pair<Database::KeyTable::Slot*, bool> Database::insertKey(std::string_view key, size_t h)
+{
+    auto entry = this->keyToValue.insertWith(key, h, [&]() {return ArenaString::make(key, this->arena);});
+    if(entry.second && this->index != nullptr)
+        this->index->insert(entry.first->key);
+    else if(!entry.second && entry.first->value.id == ValuePool::NONE)
+    {
+        this->settled--; // A settled key set again is a new key, in the slot it kept.
+        entry.second = true;
+    }
+    return entry;
+}
+
+void Database::erase(KeyTable::Slot* entry)
+{
+    if(entry->value.id == ValuePool::NONE)
+        this->settled--;
+    if(!this->expiries.empty())
+        clearExpiry(entry->key);
+    if(this->index != nullptr)
+        this->index->erase(entry->key.view());
+    setValue(entry->value.id, ValuePool::NONE);
+    entry->key.release(this->arena);
+    this->keyToValue.erase(entry);
+}
+
+int Database::dbExpire(std::string_view key, int64_t deadlineMs)
+{
+    expireSome(EXPIRY_SLICE);
+    auto entry = this->keyToValue.find(key);
+    if(entry == nullptr || isExpired(entry))
+        return DB_NOT_FOUND;
+    if(deadlineMs != NO_EXPIRY && deadlineMs <= nowMs())
+    {
+        erase(entry);
+        this->expired++;
         return DB_GOOD;
     }
-    else
+    if(deadlineMs == NO_EXPIRY)
+    {
+        if(!this->expiries.empty())
+            clearExpiry(entry->key);
+        return DB_GOOD;
+    }
+    if(this->timers.empty())
+        this->timers.advance(nowMs(), 0, [](const ArenaString&) {}); // Start the wheel at the current time.
+    auto slot = this->expiries.insertWith(key, this->expiries.hash(key), [&]() {return entry->key;});
+    if(!slot.second)
+        this->timers.cancel(slot.first->value);
+    slot.first->value = this->timers.add((uint64_t)deadlineMs, entry->key);
+    return DB_GOOD;
+}
+
+int Database::dbSetExpiring(std::string_view key, std::string_view value, int64_t deadlineMs)
+{
+    int status = dbSet(key, value);
+    return status == DB_GOOD ? dbExpire(key, deadlineMs) : status;
+}
+
+int Database::dbGetExpiry(std::string_view key, int64_t& deadlineMs)
+{
+    expireSome(EXPIRY_SLICE);
+    auto entry = this->keyToValue.find(key);
+    if(entry == nullptr || isExpired(entry))
         return DB_NOT_FOUND;
+    deadlineMs = expiryOf(key);
+    return DB_GOOD;
+}
+
+int64_t Database::expiryOf(std::string_view key) const
+{
+    auto slot = this->expiries.empty() ? nullptr : this->expiries.find(key);
+    return slot == nullptr ? NO_EXPIRY : (int64_t)this->timers.deadline(slot->value);
+}
+
+void Database::expireDue(size_t limit)
+{
+    size_t fired = this->timers.advance((uint64_t)nowMs(), limit, [&](const ArenaString& key) {
+        // The timer is gone already: drop the index entry first, so that erase() does not cancel it again.
+        this->expiries.erase(this->expiries.find(key));
+        erase(this->keyToValue.find(key.view()));
+        this->expired++;
+    });
+    this->expiryBacklog = fired == limit;
+}
+
+void Database::settleDue()
+{
+    this->timers.advance((uint64_t)nowMs(), SIZE_MAX, [&](const ArenaString& key) {
+        this->expiries.erase(this->expiries.find(key));
+        setValue(this->keyToValue.find(key.view())->value.id, ValuePool::NONE);
+        this->settledKeys.emplace_back(key.view());
+        this->settled++;
+        this->expired++;
+    });
+    this->expiryBacklog = false;
+}
+
+void Database::unsetSettled(size_t limit)
+{
+    for(size_t i = 0; i < limit && !this->settledKeys.empty(); i++)
+    {
+        auto entry = this->keyToValue.find(this->settledKeys.back());
+        if(entry != nullptr && entry->value.id == ValuePool::NONE)
+            erase(entry);
+        this->settledKeys.pop_back();
+    }
+}
+
+bool Database::isDue(const ArenaString& key) const
+{
+    auto slot = this->expiries.empty() ? nullptr : this->expiries.find(key);
+    return slot != nullptr && (int64_t)this->timers.deadline(slot->value) <= nowMs();
+}
+
+void Database::clearExpiry(const ArenaString& key)
+{
+    auto slot = this->expiries.find(key);
+    if(slot == nullptr)
+        return;
+    this->timers.cancel(slot->value);
+    this->expiries.erase(slot);
+}
+
+void Database::enableKeyIndex()
+{
+    if(this->index != nullptr)
+        return;
+    this->index.reset(new KeyIndex());
+    this->keyToValue.forEach([&](const ArenaString& key, const KeyData&) {this->index->insert(key);});
+}
+
+int Database::dbScan(std::string_view from, std::string_view to, size_t count, std::vector<std::string>& keys,
+                     std::string& next)
+{
+    if(this->index == nullptr)
+        return DB_ERROR;
+    expireSome(EXPIRY_SLICE);
+    size_t visited = 0;
+    next.clear();
+    this->index->scan(from, to, [&](std::string_view key) {
+        if(visited++ == count)
+        {
+            next.assign(key);
+            return false;
+        }
+        // Due keys not expired yet are skipped, but count as visited, so that a call stays bounded.
+        if((!this->expiryBacklog && this->settled == 0) || !isExpired(this->keyToValue.find(key)))
+            keys.emplace_back(key);
+        return true;
+    });
+    return DB_GOOD;
 }
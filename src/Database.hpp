@@ -1,14 +1,53 @@
 #ifndef Database_hpp
 #define Database_hpp
 
+#include "Arena.hpp"
+#include "FlatMap.hpp"
+#include "KeyIndex.hpp"
+#include "NumberIndex.hpp"
+#include "TimerWheel.hpp"
+#include "ValuePool.hpp"
+#include <algorithm>
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <vector>
+
+/**
+ * One write of a commit: the new value of a key, or its removal if present is false.
+ */
+struct KeyChange
+{
+    std::string_view key;
+    std::string_view value;
+    bool present;
+};
+
+/**
+ * The size of a store, as reported by INFO.
+ */
+struct StoreStats
+{
+    size_t keys;
+    size_t values; // Distinct values held by at least one key.
+    size_t memoryBytes; // Tables, counters and key and value bytes.
+    size_t trackedBytes; // What a memory limit is checked against, see Database::usedMemory(); 0 without a limit.
+    size_t maxBytes; // The memory limit, 0 for none.
+    uint64_t evictedKeys;
+    size_t expiringKeys; // Keys with an expiry time.
+    uint64_t expiredKeys;
+};
 
 /**
  * This class provides the underlying data structure and methods that manipulate the data for the in-memory database.
- * The key-value store is implemented using an unordered_map, so the Set(), Get(), Unset() methods have O(1) average-case
- * time complexity. To effectively retrieve the number of key-value pairs equal to a given value, another unordered_map
- * is used, so the NumEqualTo() method also has average-case time complexity O(1).
+ * Keys map to value ids in a FlatMap, an open-addressing hash table, and each distinct value string is interned once
+ * in a ValuePool, with its number of keys in valueToCount, so Set(), Get(), Unset() and NumEqualTo() are O(1) on
+ * average. Every method hashes each key and value it touches exactly once, and takes them as string views. The *Id
+ * methods let undo records hold a reference to an old value instead of a copy of the string.
+ * The optional parts keep structures of their own, which insertKey(), erase() and setValue() keep up to date for
+ * every write, including rollbacks, evictions and expirations: a memory limit with sampled LRU or LFU eviction
+ * (setMaxMemory()), expiry times in a TimerWheel (dbExpire()), a KeyIndex of the keys in order (enableKeyIndex()) and
+ * a NumberIndex of the integer values (dbNumBetween()).
  */
 class Database
 {
@@ -17,21 +56,216 @@ public:
     {
         DB_GOOD,
         DB_NOT_FOUND,
-        DB_ERROR
+        DB_ERROR,
+        DB_NOT_A_NUMBER // The value of the key is not an integer, or the result of arithmetic on it does not fit.
     };
     
-    Database() {}; // Default constructor.
-    int dbSet(const std::string& key, const std::string& value); // Set a key-value pair in the database.
-    int dbUnset(const std::string& key); // Erase a key-value pair with given key.
+    enum
+    {
+        EVICT_LRU,
+        EVICT_LFU
+    };
+    
+    static const unsigned DEFAULT_EVICTION_SAMPLES = 5;
+    static const int64_t NO_EXPIRY = 0;
+    static const size_t EXPIRY_SLICE = 32; // Most keys expired by one call.
+    
+    static int64_t nowMs(); // Unix time in milliseconds, by the coarse real-time clock.
+    
+    Database(): values(arena), distinctValues(0), maxMemory(0), policy(EVICT_LRU), samples(DEFAULT_EVICTION_SAMPLES),
+        clock(0), undoBytes(0), undoLogs(0), evicted(0), random(0x9E3779B97F4A7C15ULL), expiryBacklog(false),
+        expired(0), settled(0) {}; // Default constructor.
+    int dbSet(std::string_view key, std::string_view value); // Set a key-value pair in the database.
+    int dbSetId(std::string_view key, ValuePool::Id value); // Set a key to an interned value.
+    int dbUnset(std::string_view key); // Erase a key-value pair with given key.
     
-    int dbGet(const std::string& key, std::string& value); // Get a value associated a given key.
-    int dbNumEqualTo(const std::string& value, int& count); // Get the number of entries that has a specific value.
+    int dbGet(std::string_view key, std::string& value); // Get a value associated a given key.
+    int dbGetView(std::string_view key, std::string_view& value); // Get a view of a value, valid until the next write.
+    int dbGetId(std::string_view key, ValuePool::Id& value); // Get the interned value id of a key.
+    int dbNumEqualTo(std::string_view value, int& count); // Get the number of entries that has a specific value.
+    // Add delta to the integer value of a key, 0 if not set, and set result to the sum. DB_NOT_A_NUMBER if the value
+    // is not an integer or the sum overflows, in which case the key is left alone.
+    int dbIncrBy(std::string_view key, int64_t delta, int64_t& result);
+    int dbNumBetween(int64_t low, int64_t high, int& count); // Get the number of keys with an integer value in a range.
+    
+    // Batched forms for the multi-key commands, in order. The keys of a chunk of BATCH_CHUNK are hashed and their
+    // table groups prefetched before any is looked up, so that the cache misses of the chunk overlap.
+    void dbSetMany(const std::string_view* keys, const std::string_view* values, size_t count);
+    void dbUnsetMany(const std::string_view* keys, size_t count);
+    void dbNumEqualToMany(const std::string_view* values, size_t count, int* counts);
+    template <typename F>
+    void dbGetViews(const std::string_view* keys, size_t count, F f) // Call f(i, status, view of the value of keys[i]).
+    {
+        size_t hashes[BATCH_CHUNK];
+        KeyTable::Slot* slots[BATCH_CHUNK];
+        expireSome(EXPIRY_SLICE);
+        for(size_t start = 0; start < count; start += BATCH_CHUNK)
+        {
+            size_t n = std::min(count - start, BATCH_CHUNK);
+            for(size_t i = 0; i < n; i++)
+            {
+                hashes[i] = this->keyToValue.hash(keys[start + i]);
+                this->keyToValue.prefetch(hashes[i]);
+            }
+            for(size_t i = 0; i < n; i++)
+            {
+                slots[i] = this->keyToValue.find(keys[start + i], hashes[i]);
+                if(slots[i] != nullptr)
+                    this->values.prefetchId(slots[i]->value.id);
+            }
+            for(size_t i = 0; i < n; i++)
+            {
+                if(slots[i] == nullptr || isExpired(slots[i]))
+                    f(start + i, DB_NOT_FOUND, std::string_view());
+                else
+                {
+                    touch(slots[i]->value);
+                    f(start + i, DB_GOOD, this->values.value(slots[i]->value.id));
+                }
+            }
+        }
+    }
+    
+    // Expire a key at deadlineMs, or never with NO_EXPIRY. A time that has passed unsets the key now. A SET or UNSET
+    // of the key clears its expiry time.
+    int dbExpire(std::string_view key, int64_t deadlineMs);
+    int dbSetExpiring(std::string_view key, std::string_view value, int64_t deadlineMs); // dbSet(), then dbExpire().
+    int dbGetExpiry(std::string_view key, int64_t& deadlineMs); // The expiry time of a key, or NO_EXPIRY.
+    
+    void retainValue(ValuePool::Id value) {values.retain(value);} // Keep a value id alive for an undo record.
+    void releaseValue(ValuePool::Id value) {values.release(value);}
+    
+    template <typename F>
+    void forEach(F f) const // Call f(key, value) with string views of every key-value pair, in no particular order.
+    {
+        keyToValue.forEach([&](const ArenaString& key, const KeyData& data) {
+            if(data.id != ValuePool::NONE) // Not a settled key.
+                f(key.view(), values.value(data.id));
+        });
+    }
+    template <typename F>
+    void forEachExpiry(F f) const // Call f(key, deadline in Unix ms) for every key with an expiry time.
+    {
+        expiries.forEach([&](const ArenaString& key, Timers::Handle timer) {f(key.view(), timers.deadline(timer));});
+    }
+    int64_t expiryOf(std::string_view key) const; // The expiry time of a key, or NO_EXPIRY, without expiring anything.
+    
+    void enableKeyIndex(); // Keep the keys in order as well, for dbScan(), starting with the keys already set.
+    bool hasKeyIndex() const {return index != nullptr;}
+    // Append to keys the keys from from on and below to (no bound if to is empty), in order, after visiting at most
+    // count of them, and set next to the key to continue from, or clear it if none is left. DB_ERROR without an index.
+    int dbScan(std::string_view from, std::string_view to, size_t count, std::vector<std::string>& keys,
+               std::string& next);
+    size_t size() const {return keyToValue.size() - settled;} // Number of keys.
+    
+    void reserve(size_t keys) {keyToValue.reserve(keys);} // Size the key table for an expected number of keys.
+    ArenaStats arenaStats() const {return arena.stats();} // Allocator statistics of the key and value bytes.
+    size_t tableBytes() const; // Bytes used by the hash tables and counters, excluding the arena.
+    StoreStats stats() const;
+    
+    // Evict keys by policy before writes to keep usedMemory() at most maxBytes, 0 for no limit. Set before use.
+    void setMaxMemory(size_t maxBytes, int inPolicy = EVICT_LRU, unsigned inSamples = DEFAULT_EVICTION_SAMPLES);
+    size_t getMaxMemory() const {return maxMemory;}
+    // Tracked bytes: key and value bytes, the table entries of live keys and values, and the undo logs on the
+    // database. Tables count by entries rather than capacity, so that evicting keys brings the figure down.
+    size_t usedMemory() const;
+    void addUndoMemory(ptrdiff_t bytes) {undoBytes += bytes;} // Undo logs report their growth and shrinkage.
+    void addUndoLog(int delta) {undoLogs += delta;} // Undo logs report when they start and stop holding entries.
+    size_t undoLogCount() const {return undoLogs;} // Undo logs with writes of an open block in the database.
+    void pin(std::string_view key); // Keep a key from being evicted. Pins are counted. No-ops without a limit.
+    void unpin(std::string_view key);
     
 private:
-    std::unordered_map<std::string, std::string> keyToValue; // A map that stores key-value pairs from input.
-    std::unordered_map<std::string, int> valueToCount; // A map that stores the count of entries in keyToValue with a specific value.
+    Database(const Database& db);
+    Database& operator=(const Database& db);
+    
+    struct KeyData // What the key table holds for a key.
+    {
+        ValuePool::Id id = ValuePool::NONE; // The value.
+        uint32_t access = 0; // Eviction state: the clock at the last access (LRU), or a decay period and a count (LFU).
+    };
+    
+    typedef FlatMap<ArenaString, KeyData, ArenaStringHash, ArenaStringEq> KeyTable;
+    typedef TimerWheel<ArenaString> Timers; // Timers of the expiry times, carrying their key.
+    typedef FlatMap<ArenaString, Timers::Handle, ArenaStringHash, ArenaStringEq> ExpiryTable;
+    
+    static const size_t BATCH_CHUNK = 16; // Keys whose lookups are overlapped by the *Many methods.
+    static const unsigned LFU_INIT = 5; // Count of a new key, so that it is not the first to go.
+    static const unsigned LFU_LOG_FACTOR = 10; // A count of n is incremented with probability 1/((n-LFU_INIT)*10+1).
+    static const unsigned LFU_DECAY_SHIFT = 20; // The count decays by one every 2^20 accesses.
+    static const unsigned MAX_EVICTION_MISSES = 16; // Rounds of only pinned samples before a write gives up.
     
-    int decOldValue(const std::string& key); // Decrease the value-count by one, if the count is 0, delete the value.
+    SlabArena arena; // Storage of keys and values that are too long to be stored inline.
+    KeyTable keyToValue; // A map that stores key to value id pairs.
+    ValuePool values; // The distinct values, each stored once.
+    std::vector<int> valueToCount; // The count of entries in keyToValue with a specific value, indexed by value id.
+    size_t distinctValues; // Number of non-zero entries of valueToCount.
+    
+    size_t maxMemory; // 0 for no limit.
+    int policy; // EVICT_LRU or EVICT_LFU.
+    unsigned samples; // Keys sampled per eviction.
+    uint32_t clock; // Key accesses since the limit was set.
+    size_t undoBytes;
+    size_t undoLogs;
+    uint64_t evicted;
+    uint64_t random; // State of the generator for samples and LFU increments.
+    FlatMap<ArenaString, uint32_t, ArenaStringHash, ArenaStringEq> pins; // Pinned keys and their pin counts.
+    
+    Timers timers;
+    ExpiryTable expiries; // Keys with an expiry time and their timers; the key bytes are those of keyToValue.
+    bool expiryBacklog; // Whether the last slice of expirations may have left due keys behind.
+    uint64_t expired;
+    std::vector<std::string> settledKeys; // Keys settled by settleDue(), to unset in slices; some may be set again.
+    size_t settled; // Settled keys still in keyToValue.
+    
+    std::unique_ptr<KeyIndex> index; // The keys in order, if enabled.
+    std::unique_ptr<NumberIndex> numbers; // Counts of the integer values in order, once dbNumBetween() was called.
+    
+    std::pair<KeyTable::Slot*, bool> insertKey(std::string_view key); // Find or insert a key, copying new keys into the arena.
+    std::pair<KeyTable::Slot*, bool> insertKey(std::string_view key, size_t h);
+    void erase(KeyTable::Slot* entry); // Remove a key and release its value.
+    void setValue(ValuePool::Id& slot, ValuePool::Id value); // Store a referenced value id in a key slot.
+    
+    void touch(KeyData& data) // Update the eviction state of a key on access.
+    {
+        if(this->maxMemory != 0)
+            access(data, false);
+    }
+    void access(KeyData& data, bool inserted);
+    unsigned lfuCount(uint32_t access) const; // The LFU count of a key, decayed to the current period.
+    void reserveMemory() // Evict keys if needed before a write.
+    {
+        if(this->maxMemory != 0 && usedMemory() > this->maxMemory)
+            evict();
+    }
+    // Unset the best victim of samples keys taken at random slots, by the policy, until usedMemory() is within the
+    // limit. Keys pinned by an undo log are skipped; after MAX_EVICTION_MISSES rounds of only pinned samples the
+    // write goes ahead over the limit.
+    void evict();
+    uint64_t nextRandom();
+    
+    // Expire up to limit keys that are due; every method starts with a slice of EXPIRY_SLICE. Expiring a key is an
+    // unset, so valueToCount stays exact. While a slice leaves due keys behind, reads check the expiry time of the
+    // keys they find and report due ones as not found.
+    void expireSome(size_t limit)
+    {
+        if(!this->settledKeys.empty())
+            unsetSettled(limit);
+        if(!this->timers.empty())
+            expireDue(limit);
+    }
+    void expireDue(size_t limit);
+    // The counting reads cannot check keys one by one, so when a slice leaves due keys behind they settle all of
+    // them: only the value of a due key is dropped, which is what takes it out of valueToCount, and the key, its
+    // slot and its bytes are left to later slices. A settled key has no value and reads as not found.
+    void settleDue();
+    void unsetSettled(size_t limit);
+    bool isExpired(const KeyTable::Slot* entry) const // Whether a key is settled, or due but not expired yet.
+    {
+        return entry->value.id == ValuePool::NONE || (this->expiryBacklog && isDue(entry->key));
+    }
+    bool isDue(const ArenaString& key) const;
+    void clearExpiry(const ArenaString& key); // Cancel the timer of a key, if it has one.
 };
 
 #endif /* Database_hpp */
@@ -0,0 +1,104 @@
+#include "Engine.hpp"
+#include "CoreEngine.hpp"
+#include "LoggedEngine.hpp"
+#include "MvccEngine.hpp"
+#include "OverlayEngine.hpp"
+#include "RcuEngine.hpp"
+#include "ShardedEngine.hpp"
+#include "UndoEngine.hpp"
+
+std::shared_ptr<Engine> Engine::create(int type, std::shared_ptr<Database> db)
+{
+    if(type == ENGINE_OVERLAY)
+        return std::shared_ptr<Engine>(new OverlayEngine(db));
+    return std::shared_ptr<Engine>(new UndoEngine(db));
+}
+
+std::shared_ptr<Engine> Engine::create(std::shared_ptr<ShardedDatabase> db)
+{
+    return std::shared_ptr<Engine>(new ShardedEngine(db));
+}
+
+std::shared_ptr<Engine> Engine::create(std::shared_ptr<CoreDatabase> db)
+{
+    return std::shared_ptr<Engine>(new CoreEngine(db));
+}
+
+std::shared_ptr<Engine> Engine::create(std::shared_ptr<VersionedDatabase> db)
+{
+    return std::shared_ptr<Engine>(new MvccEngine(db));
+}
+
+std::shared_ptr<Engine> Engine::create(std::shared_ptr<RcuDatabase> db)
+{
+    return std::shared_ptr<Engine>(new RcuEngine(db));
+}
+
+std::shared_ptr<Engine> Engine::create(std::shared_ptr<Engine> engine, std::shared_ptr<Wal> wal)
+{
+    return std::shared_ptr<Engine>(new LoggedEngine(engine, wal));
+}
+
+int Engine::dbSetMany(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& values)
+{
+    for(size_t i = 0; i < keys.size(); i++)
+        dbSet(keys[i], values[i]);
+    return Database::DB_GOOD;
+}
+
+int Engine::dbUnsetMany(const std::vector<std::string_view>& keys)
+{
+    for(std::string_view key: keys)
+        dbUnset(key);
+    return Database::DB_GOOD;
+}
+
+int Engine::dbGetMany(const std::vector<std::string_view>& keys, std::vector<std::string>& values,
+                      std::vector<int>& status)
+{
+    if(values.size() < keys.size())
+        values.resize(keys.size());
+    status.resize(keys.size());
+    for(size_t i = 0; i < keys.size(); i++)
+        status[i] = dbGet(keys[i], values[i]);
+    return Database::DB_GOOD;
+}
+
+int Engine::dbNumEqualToMany(const std::vector<std::string_view>& values, std::vector<int>& counts)
+{
+    counts.resize(values.size());
+    for(size_t i = 0; i < values.size(); i++)
+        dbNumEqualTo(values[i], counts[i]);
+    return Database::DB_GOOD;
+}
+
+int Engine::dbIncrBy(std::string_view /*key*/, int64_t /*delta*/, int64_t& /*result*/)
+{
+    return Database::DB_ERROR;
+}
+
+int Engine::dbNumBetween(int64_t /*low*/, int64_t /*high*/, int& /*count*/)
+{
+    return Database::DB_ERROR;
+}
+
+int Engine::dbExpire(std::string_view /*key*/, int64_t /*deadlineMs*/)
+{
+    return Database::DB_ERROR;
+}
+
+int Engine::dbSetExpiring(std::string_view /*key*/, std::string_view /*value*/, int64_t /*deadlineMs*/)
+{
+    return Database::DB_ERROR;
+}
+
+int Engine::dbGetExpiry(std::string_view /*key*/, int64_t& /*deadlineMs*/)
+{
+    return Database::DB_ERROR;
+}
+
+int Engine::dbScan(std::string_view /*from*/, std::string_view /*to*/, size_t /*count*/,
+                   std::vector<std::string>& /*keys*/, std::string& /*next*/)
+{
+    return Database::DB_ERROR;
+}
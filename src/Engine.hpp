@@ -0,0 +1,108 @@
+#ifndef Engine_hpp
+#define Engine_hpp
+
+#include "Database.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class CoreDatabase;
+class RcuDatabase;
+class ShardedDatabase;
+class Snapshot;
+class VersionedDatabase;
+class Wal;
+
+/**
+ * What INFO reports about the store a session works on and about the session's open transaction blocks.
+ */
+struct EngineStats
+{
+    StoreStats store;
+    size_t depth; // Open transaction blocks.
+    size_t undoEntries; // Undo records, or buffered writes, of the open blocks.
+};
+
+/**
+ * This class is the interface commands are executed against: the data operations of a Database plus the transaction
+ * operations of one session. Implementations differ in how they keep transaction blocks:
+ *   ENGINE_UNDO    - writes go to the Database immediately and a Transaction undo log restores old values on
+ *                    rollback (UndoEngine).
+ *   ENGINE_OVERLAY - writes inside a block are buffered in a per-block overlay that reads consult before the
+ *                    Database; rollback drops the overlay and commit applies it once (OverlayEngine).
+ *   ENGINE_MVCC    - like ENGINE_OVERLAY, but on a VersionedDatabase: a block reads from the snapshot taken by its
+ *                    BEGIN and its commit is published as one new version (MvccEngine).
+ *   ENGINE_RCU     - like ENGINE_UNDO, on an RcuDatabase: sessions take turns to write, GET and NUMEQUALTO take no
+ *                    lock (RcuEngine).
+ * Sessions on a ShardedDatabase always use undo logs, one per shard (ShardedEngine), and so do sessions on a
+ * CoreDatabase, whose logs are used by the cores that own the shards (CoreEngine). Any engine can be wrapped to log
+ * its commits to a write-ahead log (LoggedEngine). Key expiry is supported by the engines that write to a Database
+ * directly, ENGINE_UNDO, ShardedEngine and CoreEngine; the others return DB_ERROR from dbExpire(),
+ * dbSetExpiring() and dbGetExpiry().
+ * So are the integer commands (dbIncrBy(), dbNumBetween()), and scans of a key index (dbScan()) except on CoreEngine.
+ */
+class Engine
+{
+public:
+    enum
+    {
+        ENGINE_UNDO,
+        ENGINE_OVERLAY,
+        ENGINE_MVCC,
+        ENGINE_RCU
+    };
+    
+    static std::shared_ptr<Engine> create(int type, std::shared_ptr<Database> db); // ENGINE_UNDO or ENGINE_OVERLAY.
+    static std::shared_ptr<Engine> create(std::shared_ptr<ShardedDatabase> db);
+    static std::shared_ptr<Engine> create(std::shared_ptr<CoreDatabase> db);
+    static std::shared_ptr<Engine> create(std::shared_ptr<VersionedDatabase> db);
+    static std::shared_ptr<Engine> create(std::shared_ptr<RcuDatabase> db);
+    static std::shared_ptr<Engine> create(std::shared_ptr<Engine> engine, std::shared_ptr<Wal> wal); // Log commits.
+    virtual ~Engine() {}
+    
+    virtual int dbSet(std::string_view key, std::string_view value) = 0;
+    virtual int dbUnset(std::string_view key) = 0;
+    virtual int dbGet(std::string_view key, std::string& value) = 0;
+    virtual int dbNumEqualTo(std::string_view value, int& count) = 0;
+    
+    // Batched forms for the multi-key commands, applied in order as one unit. The defaults call the single-key
+    // methods; engines on a Database override them to overlap the lookups of the batch (see Database::dbSetMany()).
+    virtual int dbSetMany(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& values);
+    virtual int dbUnsetMany(const std::vector<std::string_view>& keys);
+    virtual int dbGetMany(const std::vector<std::string_view>& keys, std::vector<std::string>& values,
+                          std::vector<int>& status); // values[i] is only set where status[i] is DB_GOOD.
+    virtual int dbNumEqualToMany(const std::vector<std::string_view>& values, std::vector<int>& counts);
+    
+    // Add to the integer value of a key (see Database::dbIncrBy()), and count the keys with an integer value in
+    // [low, high].
+    virtual int dbIncrBy(std::string_view key, int64_t delta, int64_t& result);
+    virtual int dbNumBetween(int64_t low, int64_t high, int& count);
+    
+    // Expire a key at deadlineMs (Unix milliseconds), or never with Database::NO_EXPIRY (see Database::dbExpire()).
+    virtual int dbExpire(std::string_view key, int64_t deadlineMs);
+    // Set a key that expires at deadlineMs as one write, which no other session and no log sees half done (SET EX).
+    virtual int dbSetExpiring(std::string_view key, std::string_view value, int64_t deadlineMs);
+    virtual int dbGetExpiry(std::string_view key, int64_t& deadlineMs);
+    // List keys in order (see Database::dbScan()), in the Database of the session, if it has a key index.
+    virtual int dbScan(std::string_view from, std::string_view to, size_t count, std::vector<std::string>& keys,
+                       std::string& next);
+    
+    virtual void begin() = 0; // Open a (nested) transaction block.
+    virtual bool rollback() = 0; // Undo and close the most recent block. Return false if no block is open.
+    // Close all blocks, keeping their changes. Return false if no block is open, or if the store refused the changes
+    // (a write conflict of the mvcc engine), in which case the blocks are rolled back.
+    virtual bool commit() = 0;
+    // Close the most recent block, keeping its changes as part of the enclosing block, or committing them if it is the
+    // outermost one. Return false if no block is open or that commit fails.
+    virtual bool commitBlock() = 0;
+    virtual size_t depth() const = 0; // Number of open blocks.
+    // Whether the writes of a block stay invisible to other sessions until its outermost commit, instead of being
+    // applied to the store as they are made.
+    virtual bool buffersBlocks() const {return false;}
+    
+    virtual int save(Snapshot& snapshot, bool background) = 0; // Write the store to a snapshot, see Snapshot::save().
+    virtual EngineStats stats() = 0;
+};
+
+#endif /* Engine_hpp */
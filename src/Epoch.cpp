@@ -0,0 +1,71 @@
+#include "Epoch.hpp"
+#include <cstddef>
+
+std::atomic<uint64_t> Epoch::global(1);
+
+struct alignas(64) EpochSlot
+{
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> used{true};
+    EpochSlot* next = nullptr;
+};
+
+// A thread's slot, taken on its first guard and handed back when the thread exits.
+struct LocalEpochSlot
+{
+    EpochSlot* slot = nullptr;
+    size_t depth = 0; // Number of guards of the thread alive.
+    ~LocalEpochSlot() {if(slot != nullptr) slot->used.store(false, std::memory_order_release);}
+};
+
+static std::atomic<EpochSlot*> slots(nullptr); // Every slot ever registered. Slots are reused, never freed.
+static thread_local LocalEpochSlot local;
+
+static EpochSlot* acquireSlot()
+{
+    for(EpochSlot* slot = slots.load(std::memory_order_acquire); slot != nullptr; slot = slot->next)
+    {
+        bool expected = false;
+        if(!slot->used.load(std::memory_order_relaxed) &&
+           slot->used.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            return slot;
+    }
+    EpochSlot* slot = new EpochSlot();
+    EpochSlot* head = slots.load(std::memory_order_relaxed);
+    do
+        slot->next = head;
+    while(!slots.compare_exchange_weak(head, slot, std::memory_order_release, std::memory_order_relaxed));
+    return slot;
+}
+
+Epoch::Guard::Guard(): slot(nullptr)
+{
+    if(local.depth++ > 0)
+        return;
+    if(local.slot == nullptr)
+        local.slot = acquireSlot();
+    this->slot = &local.slot->epoch;
+    this->slot->store(global.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // The announcement must be visible to the writer before this thread loads any pointer it protects.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+Epoch::Guard::~Guard()
+{
+    local.depth--;
+    if(this->slot != nullptr)
+        this->slot->store(0, std::memory_order_release);
+}
+
+uint64_t Epoch::oldestActive()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = global.load(std::memory_order_acquire);
+    for(EpochSlot* slot = slots.load(std::memory_order_acquire); slot != nullptr; slot = slot->next)
+    {
+        uint64_t epoch = slot->epoch.load(std::memory_order_acquire);
+        if(epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+    return oldest;
+}
@@ -0,0 +1,41 @@
+#ifndef Epoch_hpp
+#define Epoch_hpp
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * This class implements epoch-based reclamation for data structures that are read without locks. A reader brackets
+ * every access with an Epoch::Guard, which announces the current global epoch in a slot of its own thread. A writer
+ * that unlinks an object cannot free it at once, since a reader may still be looking at it: it stamps the object with
+ * current() and keeps it on a retired list. Later it calls advance() and frees the retired objects stamped before
+ * oldestActive(): every reader that entered its guard after the object was unlinked announced a later epoch and can
+ * no longer reach it. Readers never wait and never write shared state other than their own slot; the writer never
+ * waits for readers, it only frees later.
+ * Slots are cache-line sized, registered on a thread's first guard and handed back when the thread exits.
+ */
+class Epoch
+{
+public:
+    class Guard
+    {
+    public:
+        Guard();
+        ~Guard();
+
+    private:
+        Guard(const Guard& guard);
+        Guard& operator=(const Guard& guard);
+
+        std::atomic<uint64_t>* slot; // Announced epoch of this thread, or nullptr for a nested guard.
+    };
+
+    static uint64_t current() {return global.load(std::memory_order_acquire);}
+    static void advance() {global.fetch_add(1, std::memory_order_seq_cst);}
+    static uint64_t oldestActive(); // The smallest epoch announced by a reader inside a guard, or current() if none.
+
+private:
+    static std::atomic<uint64_t> global; // Starts at 1: a slot holding 0 is outside of any guard.
+};
+
+#endif /* Epoch_hpp */
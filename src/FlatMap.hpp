@@ -0,0 +1,292 @@
+#ifndef FlatMap_hpp
+#define FlatMap_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string_view>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * This class is an open-addressing hash table in the style of a Swiss table. Slots are stored in one flat array
+ * next to an array of one-byte control words; a control word is either EMPTY, DELETED, or the low 7 bits of the
+ * hash of the key in the slot. A lookup hashes the key once, uses the high bits to pick a group of 16 slots and
+ * compares all 16 control words against the low bits in one SSE2 instruction (a portable loop is used otherwise),
+ * so only slots whose control word matches are compared by key. Groups are probed in triangular order, and a probe
+ * stops at the first group that still has an EMPTY slot. Erased slots become DELETED tombstones (unless their group
+ * was never full), which are dropped the next time the table is rehashed.
+ *
+ * Lookups are heterogeneous: find() and insert() accept any type Q for which Hash and Eq are defined against K, so
+ * a table of std::string can be searched with a std::string_view. Callers that need both a lookup and an update can
+ * compute hash() once and pass it to every call. Slot pointers are stable until the next insert.
+ */
+template <typename K, typename V, typename Hash, typename Eq>
+class FlatMap
+{
+public:
+    struct Slot
+    {
+        K key;
+        V value;
+    };
+
+    FlatMap(const Hash& inHasher = Hash(), const Eq& inEqual = Eq()):
+        ctrl(nullptr), slots(nullptr), capacity(0), count(0), tombstones(0), hasher(inHasher), equal(inEqual) {}
+    ~FlatMap() {destroy();}
+
+    template <typename Q>
+    size_t hash(const Q& key) const {return hasher(key);}
+
+    template <typename Q>
+    Slot* find(const Q& key) const {return find(key, hasher(key));}
+
+    template <typename Q>
+    Slot* find(const Q& key, size_t h) const
+    {
+        if(this->capacity == 0)
+            return nullptr;
+        size_t mask = this->capacity / GROUP_SIZE - 1;
+        size_t group = (h >> 7) & mask;
+        for(size_t step = 1; ; step++)
+        {
+            const int8_t* g = this->ctrl + group * GROUP_SIZE;
+            for(uint32_t bits = matchByte(g, (int8_t)(h & 0x7F)); bits != 0; bits &= bits - 1)
+            {
+                Slot* slot = this->slots + group * GROUP_SIZE + __builtin_ctz(bits);
+                if(equal(slot->key, key))
+                    return slot;
+            }
+            if(matchByte(g, EMPTY) != 0)
+                return nullptr;
+            group = (group + step) & mask;
+        }
+    }
+
+    // Return the slot for key, inserting it with a default-constructed value if needed. The bool is true if the key
+    // was inserted.
+    template <typename Q>
+    std::pair<Slot*, bool> insert(const Q& key) {return insert(key, hasher(key));}
+
+    template <typename Q>
+    std::pair<Slot*, bool> insert(const Q& key, size_t h) {return insertWith(key, h, [&key]() {return K(key);});}
+
+    // Like insert(), but a new key is constructed from makeKey(), e.g. to copy the key bytes into an arena only when
+    // the key is actually inserted.
+    template <typename Q, typename MakeKey>
+    std::pair<Slot*, bool> insertWith(const Q& key, size_t h, MakeKey makeKey)
+    {
+        Slot* slot = find(key, h);
+        if(slot != nullptr)
+            return std::make_pair(slot, false);
+        if((this->count + this->tombstones + 1) * 8 > this->capacity * 7)
+            grow();
+        size_t index = findFree(h);
+        if(this->ctrl[index] == DELETED)
+            this->tombstones--;
+        this->ctrl[index] = (int8_t)(h & 0x7F);
+        slot = this->slots + index;
+        new (&slot->key) K(makeKey());
+        new (&slot->value) V();
+        this->count++;
+        return std::make_pair(slot, true);
+    }
+
+    void erase(Slot* slot)
+    {
+        size_t index = slot - this->slots;
+        slot->key.~K();
+        slot->value.~V();
+        this->count--;
+        // A group that still has an EMPTY slot has never been full, so no probe has passed through it and the slot
+        // can be made EMPTY again instead of leaving a tombstone.
+        if(matchByte(this->ctrl + index / GROUP_SIZE * GROUP_SIZE, EMPTY) != 0)
+            this->ctrl[index] = EMPTY;
+        else
+        {
+            this->ctrl[index] = DELETED;
+            this->tombstones++;
+        }
+    }
+
+    template <typename Q>
+    bool erase(const Q& key)
+    {
+        Slot* slot = find(key);
+        if(slot == nullptr)
+            return false;
+        erase(slot);
+        return true;
+    }
+
+    void reserve(size_t n)
+    {
+        size_t newCapacity = this->capacity == 0 ? GROUP_SIZE : this->capacity;
+        while(newCapacity * 7 < n * 8)
+            newCapacity *= 2;
+        if(newCapacity != this->capacity)
+            rehash(newCapacity);
+    }
+    void clear() {destroy();}
+    void reset() // Remove all entries but keep the table, for a map that is emptied and refilled often.
+    {
+        for(size_t i = 0; i < this->capacity; i++)
+            if(this->ctrl[i] >= 0)
+                this->slots[i].~Slot();
+        if(this->capacity != 0)
+            std::memset(this->ctrl, EMPTY, this->capacity);
+        this->count = 0;
+        this->tombstones = 0;
+    }
+
+    void prefetch(size_t h) const // Bring the first group a lookup for hash h would probe into cache.
+    {
+        if(this->capacity == 0)
+            return;
+        size_t group = (h >> 7) & (this->capacity / GROUP_SIZE - 1);
+        __builtin_prefetch(this->ctrl + group * GROUP_SIZE);
+        __builtin_prefetch(this->slots + group * GROUP_SIZE);
+    }
+
+    size_t size() const {return this->count;}
+    bool empty() const {return this->count == 0;}
+    size_t slotCount() const {return this->capacity;}
+    bool isFull(size_t index) const {return this->ctrl[index] >= 0;}
+    Slot& slotAt(size_t index) const {return this->slots[index];}
+    size_t memoryUsage() const {return this->capacity * (sizeof(Slot) + 1);}
+
+    template <typename F>
+    void forEach(F f) const // Call f(key, value) for every entry.
+    {
+        for(size_t i = 0; i < this->capacity; i++)
+            if(this->ctrl[i] >= 0)
+                f(this->slots[i].key, this->slots[i].value);
+    }
+
+private:
+    FlatMap(const FlatMap& map);
+    FlatMap& operator=(const FlatMap& map);
+
+    static const size_t GROUP_SIZE = 16;
+    static const int8_t EMPTY = -128;
+    static const int8_t DELETED = -2;
+
+    int8_t* ctrl; // capacity control bytes.
+    Slot* slots; // capacity slots, only those with a non-negative control byte are constructed.
+    size_t capacity; // Zero or a power of two, at least GROUP_SIZE.
+    size_t count;
+    size_t tombstones;
+    Hash hasher;
+    Eq equal;
+
+    static uint32_t matchByte(const int8_t* group, int8_t byte) // Bit i is set if group[i] == byte.
+    {
+#if defined(__SSE2__)
+        __m128i ctrlBytes = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrlBytes, _mm_set1_epi8(byte)));
+#else
+        uint32_t bits = 0;
+        for(size_t i = 0; i < GROUP_SIZE; i++)
+            bits |= (uint32_t)(group[i] == byte) << i;
+        return bits;
+#endif
+    }
+
+    static uint32_t matchFree(const int8_t* group) // Bit i is set if group[i] is EMPTY or DELETED.
+    {
+#if defined(__SSE2__)
+        __m128i ctrlBytes = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+        return (uint32_t)_mm_movemask_epi8(ctrlBytes);
+#else
+        uint32_t bits = 0;
+        for(size_t i = 0; i < GROUP_SIZE; i++)
+            bits |= (uint32_t)(group[i] < 0) << i;
+        return bits;
+#endif
+    }
+
+    size_t findFree(size_t h) const
+    {
+        size_t mask = this->capacity / GROUP_SIZE - 1;
+        size_t group = (h >> 7) & mask;
+        for(size_t step = 1; ; step++)
+        {
+            uint32_t bits = matchFree(this->ctrl + group * GROUP_SIZE);
+            if(bits != 0)
+                return group * GROUP_SIZE + __builtin_ctz(bits);
+            group = (group + step) & mask;
+        }
+    }
+
+    void grow() // Double the table, or only drop the tombstones if at most 7/16 of the slots are live.
+    {
+        size_t newCapacity = this->capacity == 0 ? GROUP_SIZE : this->capacity;
+        if((this->count + 1) * 16 > newCapacity * 7)
+            newCapacity *= 2;
+        rehash(newCapacity);
+    }
+
+    void rehash(size_t newCapacity)
+    {
+        int8_t* oldCtrl = this->ctrl;
+        Slot* oldSlots = this->slots;
+        size_t oldCapacity = this->capacity;
+
+        this->ctrl = static_cast<int8_t*>(::operator new(newCapacity, std::align_val_t(GROUP_SIZE)));
+        std::memset(this->ctrl, EMPTY, newCapacity);
+        this->slots = static_cast<Slot*>(::operator new(newCapacity * sizeof(Slot), std::align_val_t(alignof(Slot))));
+        this->capacity = newCapacity;
+        this->tombstones = 0;
+        for(size_t i = 0; i < oldCapacity; i++)
+        {
+            if(oldCtrl[i] < 0)
+                continue;
+            size_t h = hasher(oldSlots[i].key);
+            size_t index = findFree(h);
+            this->ctrl[index] = (int8_t)(h & 0x7F);
+            new (&this->slots[index]) Slot(std::move(oldSlots[i]));
+            oldSlots[i].~Slot();
+        }
+        release(oldCtrl, oldSlots);
+    }
+
+    void destroy()
+    {
+        for(size_t i = 0; i < this->capacity; i++)
+            if(this->ctrl[i] >= 0)
+                this->slots[i].~Slot();
+        release(this->ctrl, this->slots);
+        this->ctrl = nullptr;
+        this->slots = nullptr;
+        this->capacity = 0;
+        this->count = 0;
+        this->tombstones = 0;
+    }
+
+    static void release(int8_t* oldCtrl, Slot* oldSlots)
+    {
+        if(oldCtrl != nullptr)
+            ::operator delete(oldCtrl, std::align_val_t(GROUP_SIZE));
+        if(oldSlots != nullptr)
+            ::operator delete(oldSlots, std::align_val_t(alignof(Slot)));
+    }
+};
+
+/**
+ * Hash and equality functors for string keys that can be searched by std::string_view.
+ */
+struct StringHash
+{
+    size_t operator()(std::string_view s) const {return std::hash<std::string_view>()(s);}
+};
+
+struct StringEq
+{
+    bool operator()(std::string_view a, std::string_view b) const {return a == b;}
+};
+
+#endif /* FlatMap_hpp */
@@ -0,0 +1,61 @@
+#include "Histogram.hpp"
+
+void Histogram::record(uint64_t value, uint64_t count)
+{
+    if(count == 0)
+        return;
+    this->counts[bucket(value)] += count;
+    this->total += count;
+    this->sum += value * count;
+    if(value > this->maximum)
+        this->maximum = value;
+    if(value < this->minimum)
+        this->minimum = value;
+}
+
+void Histogram::merge(const Histogram& other)
+{
+    for(size_t i = 0; i < BUCKETS; i++)
+        this->counts[i] += other.counts[i];
+    this->total += other.total;
+    this->sum += other.sum;
+    if(other.maximum > this->maximum)
+        this->maximum = other.maximum;
+    if(other.minimum < this->minimum)
+        this->minimum = other.minimum;
+}
+
+void Histogram::reset()
+{
+    this->counts.assign(BUCKETS, 0);
+    this->total = 0;
+    this->sum = 0;
+    this->maximum = 0;
+    this->minimum = UINT64_MAX;
+}
+
+uint64_t Histogram::percentile(double q) const
+{
+    if(this->total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(q * this->total);
+    if(rank >= this->total)
+        rank = this->total - 1;
+    uint64_t seen = 0;
+    for(size_t i = 0; i < BUCKETS; i++)
+    {
+        seen += this->counts[i];
+        if(seen > rank)
+            return highest(i) < this->maximum ? highest(i) : this->maximum;
+    }
+    return this->maximum;
+}
+
+uint64_t Histogram::highest(size_t bucket)
+{
+    if(bucket < (1ULL << SUB_BITS))
+        return bucket;
+    unsigned exponent = (unsigned)(bucket >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t sub = (bucket & ((1ULL << SUB_BITS) - 1)) + (1ULL << SUB_BITS);
+    return ((sub + 1) << (exponent - SUB_BITS)) - 1;
+}
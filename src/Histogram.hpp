@@ -0,0 +1,66 @@
+#ifndef Histogram_hpp
+#define Histogram_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * This class counts values, such as latencies in nanoseconds, in logarithmic buckets with linear sub-buckets, like an
+ * HDR histogram: values below 2^SUB_BITS have a bucket each, and every power-of-two range above is split into
+ * 2^SUB_BITS buckets, so any recorded value is known to within 1/2^SUB_BITS (about 3%) at a fixed size, whatever the
+ * range. Values beyond 2^MAX_BITS are counted in the last bucket. record() is a few instructions and never allocates;
+ * histograms of the same kind can be merged, e.g. from several threads. Counts kept elsewhere by bucket() can be
+ * added with record(highest(bucket), count).
+ */
+class Histogram
+{
+public:
+    static const unsigned SUB_BITS = 5;
+    static const unsigned MAX_BITS = 48; // About 78 hours in nanoseconds.
+    static const size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+    Histogram(): counts(BUCKETS, 0), total(0), sum(0), maximum(0), minimum(UINT64_MAX) {}
+
+    void record(uint64_t value)
+    {
+        this->counts[bucket(value)]++;
+        this->total++;
+        this->sum += value;
+        if(value > this->maximum)
+            this->maximum = value;
+        if(value < this->minimum)
+            this->minimum = value;
+    }
+    void record(uint64_t value, uint64_t count); // Record a value count times.
+    void merge(const Histogram& other);
+    void reset();
+
+    uint64_t count() const {return this->total;}
+    uint64_t max() const {return this->maximum;}
+    uint64_t min() const {return this->total == 0 ? 0 : this->minimum;}
+    double mean() const {return this->total == 0 ? 0 : (double)this->sum / this->total;}
+    // The value below or at which a fraction q of the values lie, as the highest value of its bucket.
+    uint64_t percentile(double q) const;
+
+    static size_t bucket(uint64_t value) // The bucket of a value, below BUCKETS.
+    {
+        if(value < (1ULL << SUB_BITS))
+            return (size_t)value;
+        unsigned exponent = 63 - __builtin_clzll(value);
+        if(exponent >= MAX_BITS)
+            return BUCKETS - 1;
+        return ((size_t)(exponent - SUB_BITS + 1) << SUB_BITS) + (size_t)((value >> (exponent - SUB_BITS)) -
+                                                                           (1ULL << SUB_BITS));
+    }
+    static uint64_t highest(size_t bucket); // The highest value counted in a bucket.
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t sum;
+    uint64_t maximum;
+    uint64_t minimum;
+};
+
+#endif /* Histogram_hpp */
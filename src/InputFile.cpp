@@ -0,0 +1,111 @@
+#include "InputFile.hpp"
+#include "Scanner.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int InputFile::open(const std::string& path)
+{
+    close();
+    this->fd = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+    if(this->fd < 0)
+        return FILE_ERROR;
+    
+    struct stat info;
+    if(fstat(this->fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+        if(addr != MAP_FAILED)
+        {
+            madvise(addr, info.st_size, MADV_SEQUENTIAL);
+            this->mapped = static_cast<const char*>(addr);
+            this->mappedSize = info.st_size;
+            return FILE_GOOD;
+        }
+    }
+    this->buffer.resize(BLOCK_SIZE);
+    return FILE_GOOD;
+}
+
+void InputFile::close()
+{
+    if(this->mapped != nullptr)
+        munmap(const_cast<char*>(this->mapped), this->mappedSize);
+    if(this->fd > STDIN_FILENO)
+        ::close(this->fd);
+    this->fd = -1;
+    this->mapped = nullptr;
+    this->mappedSize = 0;
+    this->pos = 0;
+    this->end = 0;
+    this->eof = false;
+}
+
+bool InputFile::nextLine(std::string_view& line)
+{
+    if(this->mapped != nullptr)
+    {
+        if(this->pos >= this->mappedSize)
+            return false;
+        const char* start = this->mapped + this->pos;
+        size_t length = Scanner::findNewline(start, this->mapped + this->mappedSize) - start;
+        line = std::string_view(start, length);
+        this->pos += length + 1;
+        return true;
+    }
+    
+    while(true)
+    {
+        const char* start = this->buffer.data() + this->pos;
+        const char* newline = Scanner::findNewline(start, this->buffer.data() + this->end);
+        if(newline != this->buffer.data() + this->end)
+        {
+            line = std::string_view(start, newline - start);
+            this->pos += line.size() + 1;
+            return true;
+        }
+        if(!fill())
+        {
+            if(this->pos == this->end)
+                return false;
+            line = std::string_view(this->buffer.data() + this->pos, this->end - this->pos);
+            this->pos = this->end;
+            return true;
+        }
+    }
+}
+
+bool InputFile::hasLine() const
+{
+    if(this->mapped != nullptr || this->eof)
+        return true;
+    const char* end = this->buffer.data() + this->end;
+    return Scanner::findNewline(this->buffer.data() + this->pos, end) != end;
+}
+
+bool InputFile::fill()
+{
+    if(this->eof || this->fd < 0)
+        return false;
+    size_t rest = this->end - this->pos;
+    if(rest > 0 && this->pos > 0)
+        std::memmove(this->buffer.data(), this->buffer.data() + this->pos, rest);
+    this->pos = 0;
+    this->end = rest;
+    if(this->buffer.size() - this->end < BLOCK_SIZE / 2)
+        this->buffer.resize(this->buffer.size() * 2); // A single line longer than the buffer.
+    ssize_t count;
+    do
+        count = read(this->fd, this->buffer.data() + this->end, this->buffer.size() - this->end);
+    while(count < 0 && errno == EINTR);
+    if(count <= 0)
+    {
+        this->eof = true;
+        return false;
+    }
+    this->end += count;
+    return true;
+}
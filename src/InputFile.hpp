@@ -0,0 +1,49 @@
+#ifndef InputFile_hpp
+#define InputFile_hpp
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * This class hands out the lines of a command file without copying them into std::string objects. Regular files are
+ * memory-mapped and split in place; anything that cannot be mapped (pipes, "-" for stdin) is read in large blocks
+ * into a reusable buffer, and each line is returned as a view into that buffer. A view stays valid until the next
+ * call to nextLine(). The last line does not need a trailing newline. Newlines are found by the Scanner.
+ */
+class InputFile
+{
+public:
+    enum
+    {
+        FILE_GOOD,
+        FILE_ERROR
+    };
+    
+    InputFile(): fd(-1), mapped(nullptr), mappedSize(0), pos(0), end(0), eof(false) {}
+    ~InputFile() {close();}
+    
+    int open(const std::string& path); // Open a file, or stdin when path is "-".
+    void close();
+    
+    bool nextLine(std::string_view& line); // Return false at end of input.
+    bool hasLine() const; // Whether nextLine() can return without waiting for more input to arrive.
+    
+private:
+    InputFile(const InputFile& file);
+    InputFile& operator=(const InputFile& file);
+    
+    static const size_t BLOCK_SIZE = 1 << 20; // Read size when the input is not mapped.
+    
+    int fd;
+    const char* mapped; // Start of the mapping, or nullptr when reading blocks.
+    size_t mappedSize;
+    std::vector<char> buffer; // Block buffer; holds the unread tail of the previous block plus a new block.
+    size_t pos; // Start of the next line in the mapping or in the buffer.
+    size_t end; // End of valid data in the buffer.
+    bool eof;
+    
+    bool fill(); // Read the next block, keeping the unread bytes. Return false when nothing new was read.
+};
+
+#endif /* InputFile_hpp */
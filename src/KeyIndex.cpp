@@ -0,0 +1,262 @@
+#include "KeyIndex.hpp"
+#include <algorithm>
+#include <utility>
+
+KeyIndex::~KeyIndex()
+{
+    if(this->root != nullptr)
+        destroy(this->root);
+}
+
+void KeyIndex::destroy(Node* node)
+{
+    if(node->leaf)
+    {
+        delete static_cast<Leaf*>(node);
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    for(unsigned i = 0; i < inner->count; i++)
+        destroy(inner->children[i]);
+    delete inner;
+}
+
+size_t KeyIndex::lowerBound(const Leaf* leaf, std::string_view key)
+{
+    const ArenaString* found = std::lower_bound(leaf->keys, leaf->keys + leaf->count, key,
+                                                [](const ArenaString& a, std::string_view b) {return a.view() < b;});
+    return found - leaf->keys;
+}
+
+size_t KeyIndex::childIndex(const Inner* inner, std::string_view key)
+{
+    const std::string* found = std::upper_bound(inner->separators, inner->separators + inner->count - 1, key,
+                                                [](std::string_view a, const std::string& b) {return a < b;});
+    return found - inner->separators;
+}
+
+const KeyIndex::Leaf* KeyIndex::findLeaf(std::string_view key) const
+{
+    const Node* node = this->root;
+    while(node != nullptr && !node->leaf)
+    {
+        const Inner* inner = static_cast<const Inner*>(node);
+        node = inner->children[childIndex(inner, key)];
+    }
+    return static_cast<const Leaf*>(node);
+}
+
+void KeyIndex::insert(const ArenaString& key)
+{
+    if(this->root == nullptr)
+    {
+        Leaf* leaf = new Leaf();
+        leaf->leaf = true;
+        leaf->count = 0;
+        leaf->next = nullptr;
+        this->root = leaf;
+        this->leaves++;
+    }
+    std::string separator;
+    Node* split = insertInto(this->root, key, separator);
+    if(split != nullptr)
+    {
+        Inner* inner = new Inner();
+        inner->leaf = false;
+        inner->count = 2;
+        inner->children[0] = this->root;
+        inner->children[1] = split;
+        inner->separators[0] = std::move(separator);
+        this->root = inner;
+        this->inners++;
+    }
+    this->count++;
+}
+
+KeyIndex::Node* KeyIndex::insertInto(Node* node, const ArenaString& key, std::string& separator)
+{
+    if(node->leaf)
+    {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        size_t i = lowerBound(leaf, key.view());
+        std::copy_backward(leaf->keys + i, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        leaf->keys[i] = key;
+        if(++leaf->count <= LEAF_MAX)
+            return nullptr;
+        // Split off the upper half into a new leaf to the right.
+        Leaf* right = new Leaf();
+        right->leaf = true;
+        right->count = leaf->count - leaf->count / 2;
+        leaf->count /= 2;
+        std::copy(leaf->keys + leaf->count, leaf->keys + leaf->count + right->count, right->keys);
+        right->next = leaf->next;
+        leaf->next = right;
+        separator.assign(right->keys[0].view());
+        this->leaves++;
+        return right;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    size_t i = childIndex(inner, key.view());
+    std::string childSeparator;
+    Node* child = insertInto(inner->children[i], key, childSeparator);
+    if(child == nullptr)
+        return nullptr;
+    std::move_backward(inner->separators + i, inner->separators + inner->count - 1, inner->separators + inner->count);
+    std::copy_backward(inner->children + i + 1, inner->children + inner->count, inner->children + inner->count + 1);
+    inner->separators[i] = std::move(childSeparator);
+    inner->children[i + 1] = child;
+    if(++inner->count <= INNER_MAX)
+        return nullptr;
+    // Split off the upper half of the children; the separator between the halves moves up.
+    Inner* right = new Inner();
+    right->leaf = false;
+    right->count = inner->count - inner->count / 2;
+    inner->count /= 2;
+    std::copy(inner->children + inner->count, inner->children + inner->count + right->count, right->children);
+    std::move(inner->separators + inner->count, inner->separators + inner->count + right->count - 1,
+              right->separators);
+    separator = std::move(inner->separators[inner->count - 1]);
+    this->inners++;
+    return right;
+}
+
+void KeyIndex::erase(std::string_view key)
+{
+    bool underflow = false;
+    if(this->root == nullptr || !eraseFrom(this->root, key, underflow))
+        return;
+    this->count--;
+    if(this->root->leaf && this->root->count == 0)
+    {
+        delete static_cast<Leaf*>(this->root);
+        this->root = nullptr;
+        this->leaves--;
+    }
+    else if(!this->root->leaf && this->root->count == 1)
+    {
+        Inner* inner = static_cast<Inner*>(this->root);
+        this->root = inner->children[0];
+        delete inner;
+        this->inners--;
+    }
+}
+
+bool KeyIndex::eraseFrom(Node* node, std::string_view key, bool& underflow)
+{
+    if(node->leaf)
+    {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        size_t i = lowerBound(leaf, key);
+        if(i == leaf->count || leaf->keys[i].view() != key)
+            return false;
+        std::copy(leaf->keys + i + 1, leaf->keys + leaf->count, leaf->keys + i);
+        leaf->count--;
+        underflow = leaf->count < LEAF_MIN;
+        return true;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    size_t i = childIndex(inner, key);
+    bool childUnderflow = false;
+    if(!eraseFrom(inner->children[i], key, childUnderflow))
+        return false;
+    if(childUnderflow)
+        rebalance(inner, i);
+    underflow = inner->count < INNER_MIN;
+    return true;
+}
+
+void KeyIndex::rebalance(Inner* parent, size_t child)
+{
+    if(parent->count < 2)
+        return; // Only the root can have a single child; erase() replaces it by that child.
+    size_t left = child > 0 ? child - 1 : child; // Fix the pair of child and a neighbour.
+    Node* a = parent->children[left];
+    Node* b = parent->children[left + 1];
+    if(a->leaf)
+    {
+        Leaf* l = static_cast<Leaf*>(a);
+        Leaf* r = static_cast<Leaf*>(b);
+        if(l->count + r->count <= LEAF_MAX)
+        {
+            std::copy(r->keys, r->keys + r->count, l->keys + l->count);
+            l->count += r->count;
+            l->next = r->next;
+            delete r;
+            this->leaves--;
+        }
+        else
+        {
+            // Move keys across so that both halves are even.
+            unsigned total = l->count + r->count;
+            unsigned target = total / 2;
+            if(l->count < target)
+            {
+                unsigned moved = target - l->count;
+                std::copy(r->keys, r->keys + moved, l->keys + l->count);
+                std::copy(r->keys + moved, r->keys + r->count, r->keys);
+                l->count += moved;
+                r->count -= moved;
+            }
+            else
+            {
+                unsigned moved = l->count - target;
+                std::copy_backward(r->keys, r->keys + r->count, r->keys + r->count + moved);
+                std::copy(l->keys + target, l->keys + l->count, r->keys);
+                l->count -= moved;
+                r->count += moved;
+            }
+            parent->separators[left].assign(r->keys[0].view());
+            return;
+        }
+    }
+    else
+    {
+        Inner* l = static_cast<Inner*>(a);
+        Inner* r = static_cast<Inner*>(b);
+        if(l->count + r->count <= INNER_MAX)
+        {
+            // The separator between them comes down between the children of both.
+            l->separators[l->count - 1] = std::move(parent->separators[left]);
+            std::move(r->separators, r->separators + r->count - 1, l->separators + l->count);
+            std::copy(r->children, r->children + r->count, l->children + l->count);
+            l->count += r->count;
+            delete r;
+            this->inners--;
+        }
+        else
+        {
+            unsigned target = (l->count + r->count) / 2;
+            if(l->count < target)
+            {
+                // Rotate children from the right node through the parent separator.
+                unsigned moved = target - l->count;
+                l->separators[l->count - 1] = std::move(parent->separators[left]);
+                std::move(r->separators, r->separators + moved - 1, l->separators + l->count);
+                std::copy(r->children, r->children + moved, l->children + l->count);
+                parent->separators[left] = std::move(r->separators[moved - 1]);
+                std::move(r->separators + moved, r->separators + r->count - 1, r->separators);
+                std::copy(r->children + moved, r->children + r->count, r->children);
+                l->count += moved;
+                r->count -= moved;
+            }
+            else
+            {
+                unsigned moved = l->count - target;
+                std::move_backward(r->separators, r->separators + r->count - 1, r->separators + r->count - 1 + moved);
+                std::copy_backward(r->children, r->children + r->count, r->children + r->count + moved);
+                r->separators[moved - 1] = std::move(parent->separators[left]);
+                std::move(l->separators + target, l->separators + l->count - 1, r->separators);
+                std::copy(l->children + target, l->children + l->count, r->children);
+                parent->separators[left] = std::move(l->separators[target - 1]);
+                l->count -= moved;
+                r->count += moved;
+            }
+            return;
+        }
+    }
+    // b was merged into a: drop it and the separator before it.
+    std::move(parent->separators + left + 1, parent->separators + parent->count - 1, parent->separators + left);
+    std::copy(parent->children + left + 2, parent->children + parent->count, parent->children + left + 1);
+    parent->count--;
+}
@@ -0,0 +1,94 @@
+#ifndef KeyIndex_hpp
+#define KeyIndex_hpp
+
+#include "Arena.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * This class keeps the keys of a Database in byte order, in a B+tree, so that the keys of a prefix or a range can be
+ * listed without going through the whole hash table. The leaves hold up to LEAF_MAX keys each, sorted, and are linked
+ * from left to right, so a scan finds its first key in O(log n) and then reads the following keys sequentially. The
+ * inner nodes hold up to INNER_MAX children and the separators between them: every key of a child is below the
+ * separator to its right and at least the separator to its left.
+ * The leaves hold copies of the ArenaString handles of the key table: inline keys are copied, and the bytes of
+ * longer keys are shared with the key table, which must erase a key from the index before it releases the bytes.
+ * Separators may outlive the key they were taken from, so inner nodes keep their own copies. A node that falls
+ * under a quarter full is merged with a neighbour, or takes keys from it if both do not fit in one node.
+ */
+class KeyIndex
+{
+public:
+    KeyIndex(): root(nullptr), count(0), leaves(0), inners(0) {}
+    ~KeyIndex();
+
+    void insert(const ArenaString& key); // Add a key that is not in the index.
+    void erase(std::string_view key); // Remove a key, if it is in the index.
+
+    // Call f(key) for every key from from on, below to (no bound if to is empty), in order, while f returns true.
+    template <typename F>
+    void scan(std::string_view from, std::string_view to, F f) const
+    {
+        const Leaf* leaf = findLeaf(from);
+        if(leaf == nullptr)
+            return;
+        size_t i = lowerBound(leaf, from);
+        for(; leaf != nullptr; leaf = leaf->next, i = 0)
+        {
+            for(; i < leaf->count; i++)
+            {
+                std::string_view key = leaf->keys[i].view();
+                if((!to.empty() && key >= to) || !f(key))
+                    return;
+            }
+        }
+    }
+
+    size_t size() const {return this->count;}
+    size_t memoryUsage() const {return this->leaves * sizeof(Leaf) + this->inners * sizeof(Inner);}
+
+private:
+    KeyIndex(const KeyIndex& index);
+    KeyIndex& operator=(const KeyIndex& index);
+
+    static const unsigned LEAF_MAX = 64; // 1 KiB of keys.
+    static const unsigned INNER_MAX = 64;
+    static const unsigned LEAF_MIN = LEAF_MAX / 4;
+    static const unsigned INNER_MIN = INNER_MAX / 4;
+
+    struct Node
+    {
+        bool leaf;
+        unsigned count; // Keys of a leaf, children of an inner node.
+    };
+
+    struct Leaf: Node
+    {
+        Leaf* next;
+        ArenaString keys[LEAF_MAX + 1]; // One more, so that a full leaf takes the insert before it splits.
+    };
+
+    struct Inner: Node
+    {
+        std::string separators[INNER_MAX]; // separators[i] is between children[i] and children[i + 1].
+        Node* children[INNER_MAX + 1];
+    };
+
+    Node* root; // nullptr when the index is empty.
+    size_t count;
+    size_t leaves;
+    size_t inners;
+
+    const Leaf* findLeaf(std::string_view key) const; // The leaf where key is or would be.
+    static size_t lowerBound(const Leaf* leaf, std::string_view key); // The first key of a leaf at least key.
+    static size_t childIndex(const Inner* inner, std::string_view key); // The child whose keys would include key.
+
+    Node* insertInto(Node* node, const ArenaString& key, std::string& separator); // Return the split-off node.
+    bool eraseFrom(Node* node, std::string_view key, bool& underflow); // Return whether key was found.
+    void rebalance(Inner* parent, size_t child); // Fix a child that fell under its minimum size.
+    void destroy(Node* node);
+};
+
+#endif /* KeyIndex_hpp */
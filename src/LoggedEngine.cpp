@@ -0,0 +1,305 @@
+#include "LoggedEngine.hpp"
+#include "Database.hpp"
+#include <algorithm>
+
+template <typename Apply>
+void LoggedEngine::log(Apply apply)
+{
+    uint64_t appended;
+    if(this->frames.empty())
+        appended = this->wal->append(this->batch, apply);
+    else
+    {
+        // The values the keys had before the block first writes them are read while the Wal orders the appends, so
+        // that no other write is logged in between.
+        std::string payload;
+        appended = this->wal->appendApplied(payload, [&]() {
+            if(this->block == 0)
+            {
+                this->block = this->wal->newBlock();
+                Wal::encodeBegin(payload, this->block);
+            }
+            for(const std::string& key: this->fresh)
+                encodeBefore(payload, key);
+            if(apply())
+                payload.append(this->batch);
+        });
+        this->fresh.clear();
+    }
+    if(this->frames.empty())
+        this->wal->sync(appended);
+    else if(appended != 0)
+        this->lsn = appended; // Synced by the COMMIT or ROLLBACK that ends the blocks.
+}
+
+int LoggedEngine::dbSet(std::string_view key, std::string_view value)
+{
+    int status = Database::DB_GOOD;
+    if(buffering())
+    {
+        status = this->engine->dbSet(key, value);
+        Wal::encodeSet(this->batch, key, value);
+        return logged(status);
+    }
+    this->batch.clear();
+    Wal::encodeSet(this->batch, key, value);
+    track(key);
+    log([&]() {
+        status = this->engine->dbSet(key, value);
+        return true;
+    });
+    return logged(status);
+}
+
+int LoggedEngine::dbUnset(std::string_view key)
+{
+    int status = Database::DB_GOOD;
+    if(buffering())
+    {
+        status = this->engine->dbUnset(key);
+        if(status == Database::DB_GOOD)
+            Wal::encodeUnset(this->batch, key);
+        return logged(status);
+    }
+    this->batch.clear();
+    Wal::encodeUnset(this->batch, key);
+    track(key);
+    log([&]() {
+        status = this->engine->dbUnset(key);
+        return status == Database::DB_GOOD;
+    });
+    return logged(status);
+}
+
+int LoggedEngine::dbSetMany(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& values)
+{
+    int status = Database::DB_GOOD;
+    if(!buffering())
+        this->batch.clear();
+    for(size_t i = 0; i < keys.size(); i++)
+        Wal::encodeSet(this->batch, keys[i], values[i]);
+    if(buffering())
+        return logged(this->engine->dbSetMany(keys, values));
+    for(std::string_view key: keys)
+        track(key);
+    log([&]() {
+        status = this->engine->dbSetMany(keys, values);
+        return true;
+    });
+    return logged(status);
+}
+
+int LoggedEngine::dbUnsetMany(const std::vector<std::string_view>& keys)
+{
+    int status = Database::DB_GOOD;
+    if(!buffering())
+        this->batch.clear();
+    for(std::string_view key: keys)
+        Wal::encodeUnset(this->batch, key);
+    if(buffering())
+        return logged(this->engine->dbUnsetMany(keys));
+    for(std::string_view key: keys)
+        track(key);
+    log([&]() {
+        status = this->engine->dbUnsetMany(keys);
+        return true;
+    });
+    return logged(status);
+}
+
+int LoggedEngine::dbExpire(std::string_view key, int64_t deadlineMs)
+{
+    int status = Database::DB_GOOD;
+    if(buffering())
+    {
+        status = this->engine->dbExpire(key, deadlineMs);
+        if(status == Database::DB_GOOD)
+            Wal::encodeExpire(this->batch, key, deadlineMs);
+        return logged(status);
+    }
+    this->batch.clear();
+    Wal::encodeExpire(this->batch, key, deadlineMs);
+    track(key);
+    log([&]() {
+        status = this->engine->dbExpire(key, deadlineMs);
+        return status == Database::DB_GOOD;
+    });
+    return logged(status);
+}
+
+int LoggedEngine::dbSetExpiring(std::string_view key, std::string_view value, int64_t deadlineMs)
+{
+    int status = Database::DB_GOOD;
+    if(buffering())
+    {
+        status = this->engine->dbSetExpiring(key, value, deadlineMs);
+        if(status == Database::DB_GOOD)
+        {
+            Wal::encodeSet(this->batch, key, value);
+            Wal::encodeExpire(this->batch, key, deadlineMs);
+        }
+        return logged(status);
+    }
+    this->batch.clear();
+    Wal::encodeSet(this->batch, key, value);
+    Wal::encodeExpire(this->batch, key, deadlineMs);
+    track(key);
+    log([&]() {
+        status = this->engine->dbSetExpiring(key, value, deadlineMs);
+        return status == Database::DB_GOOD;
+    });
+    return logged(status);
+}
+
+int LoggedEngine::dbIncrBy(std::string_view key, int64_t delta, int64_t& result)
+{
+    int status = Database::DB_GOOD;
+    if(buffering())
+    {
+        status = this->engine->dbIncrBy(key, delta, result);
+        if(status == Database::DB_GOOD)
+            Wal::encodeIncrBy(this->batch, key, delta);
+        return logged(status);
+    }
+    this->batch.clear();
+    Wal::encodeIncrBy(this->batch, key, delta);
+    track(key);
+    log([&]() {
+        status = this->engine->dbIncrBy(key, delta, result);
+        return status == Database::DB_GOOD;
+    });
+    return logged(status);
+}
+
+void LoggedEngine::begin()
+{
+    if(this->frames.empty())
+        this->batch.clear();
+    this->engine->begin();
+    this->frames.push_back(this->buffered ? this->batch.size() : this->keys.size());
+}
+
+bool LoggedEngine::rollback()
+{
+    if(this->buffered)
+    {
+        if(!this->engine->rollback())
+            return false;
+        this->batch.resize(this->frames.back());
+        this->frames.pop_back();
+        return true;
+    }
+    if(this->frames.empty())
+        return false;
+    // The writes of the block are in the log already. Log what the rollback puts back in their place while the Wal
+    // orders the appends, so that no other write is logged between the two, and end the block with the outermost one.
+    auto first = this->keys.begin() + this->frames.back();
+    std::sort(first, this->keys.end());
+    this->keys.erase(std::unique(first, this->keys.end()), this->keys.end());
+    bool done = false;
+    this->batch.clear();
+    uint64_t appended = this->wal->appendApplied(this->batch, [&]() {
+        done = this->engine->rollback();
+        for(size_t i = this->frames.back(); done && i < this->keys.size(); i++)
+            encodeCurrent(this->keys[i]);
+        if(done && this->frames.size() == 1 && this->block != 0)
+            Wal::encodeEnd(this->batch, this->block);
+    });
+    this->keys.resize(this->frames.back());
+    this->frames.pop_back();
+    if(appended != 0)
+        this->lsn = appended;
+    if(this->frames.empty())
+    {
+        this->wal->sync(this->lsn);
+        endBlock();
+    }
+    return done;
+}
+
+bool LoggedEngine::commit()
+{
+    if(this->frames.empty())
+        return false;
+    bool done = true;
+    if(this->buffered)
+        this->wal->sync(this->wal->append(this->batch, [&]() {return done = this->engine->commit();}));
+    else
+    {
+        // Every write of the blocks has been logged when it was applied; the END keeps them at a replay.
+        std::string payload;
+        uint64_t appended = this->wal->appendApplied(payload, [&]() {
+            this->engine->commit();
+            if(this->block != 0)
+                Wal::encodeEnd(payload, this->block);
+        });
+        this->wal->sync(appended != 0 ? appended : this->lsn);
+    }
+    this->batch.clear();
+    this->frames.clear();
+    endBlock();
+    return done;
+}
+
+bool LoggedEngine::commitBlock()
+{
+    if(this->frames.size() <= 1)
+        return commit();
+    // The writes of the block stay in the batch, or its keys in keys, now as part of the enclosing block.
+    if(!this->engine->commitBlock())
+        return false;
+    this->frames.pop_back();
+    return true;
+}
+
+void LoggedEngine::track(std::string_view key)
+{
+    if(this->frames.empty())
+        return;
+    this->keys.emplace_back(key);
+    if(this->recorded.emplace(key).second)
+        this->fresh.emplace_back(key);
+}
+
+void LoggedEngine::endBlock()
+{
+    this->keys.clear();
+    this->recorded.clear();
+    this->fresh.clear();
+    this->block = 0;
+    this->lsn = 0;
+}
+
+void LoggedEngine::encodeBefore(std::string& payload, std::string_view key)
+{
+    std::string value;
+    int64_t deadline;
+    if(this->engine->dbGet(key, value) != Database::DB_GOOD)
+    {
+        Wal::encodeBefore(payload, this->block, key, nullptr, Database::NO_EXPIRY);
+        return;
+    }
+    if(this->engine->dbGetExpiry(key, deadline) != Database::DB_GOOD)
+        deadline = Database::NO_EXPIRY;
+    std::string_view view(value);
+    Wal::encodeBefore(payload, this->block, key, &view, deadline);
+}
+
+void LoggedEngine::encodeCurrent(std::string_view key)
+{
+    std::string value;
+    int64_t deadline;
+    if(this->engine->dbGet(key, value) != Database::DB_GOOD)
+    {
+        Wal::encodeUnset(this->batch, key);
+        return;
+    }
+    Wal::encodeSet(this->batch, key, value);
+    if(this->engine->dbGetExpiry(key, deadline) == Database::DB_GOOD)
+        Wal::encodeExpire(this->batch, key, deadline);
+}
+
+int LoggedEngine::logged(int status)
+{
+    return this->wal->status() == Wal::WAL_GOOD ? status : Database::DB_ERROR;
+}
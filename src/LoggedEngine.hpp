@@ -0,0 +1,104 @@
+#ifndef LoggedEngine_hpp
+#define LoggedEngine_hpp
+
+#include "Engine.hpp"
+#include "Wal.hpp"
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * This class adds write-ahead logging to the engine of a session, so that the log lists the writes in the order they
+ * became visible in the store. A write outside of a transaction block is applied and appended to the Wal as a batch
+ * of its own. Inside blocks, it depends on when the engine makes their writes visible:
+ *   Engines that buffer blocks (overlay, mvcc) - writes are applied by the engine as usual and encoded into a
+ *       per-session batch, and each BEGIN remembers where the batch ended: ROLLBACK cuts the batch back to that point,
+ *       so discarded writes never reach the log, and the outermost COMMIT appends the whole batch at once.
+ *   The others (undo, rcu, shards, cores) - writes reach the store right away, where other sessions can build on
+ *       them, so each is logged as it is applied, like a write outside of a block, but after a BEGIN record for the
+ *       block and, for every key the block had not written yet, the value and expiry time the key had before. ROLLBACK
+ *       logs the values it restores to the keys the block wrote, in the same batch as the rollback itself. The
+ *       outermost COMMIT or ROLLBACK logs an END record; a replay rolls back the blocks without one, open at a crash,
+ *       by restoring those earlier values. A session that ends with blocks open rolls them back.
+ * Writes that change nothing, an UNSET of a missing key, are not logged, except as part of a MUNSET, which is logged
+ * whole. A multi-key write outside of a block is one batch. Every commit returns once the sync policy of the Wal is
+ * met. An expiry time is logged as the absolute time, so a replay unsets the keys whose time has passed meanwhile.
+ * INCRBY is logged as the amount added, applied while the Wal orders the appends, so concurrent increments of a key
+ * replay to the same sum.
+ */
+class LoggedEngine: public Engine
+{
+public:
+    LoggedEngine(std::shared_ptr<Engine> inEngine, std::shared_ptr<Wal> inWal):
+        engine(inEngine), wal(inWal), buffered(inEngine->buffersBlocks()), block(0), lsn(0) {}
+    virtual ~LoggedEngine()
+    {
+        while(rollback()) {}
+    }
+
+    virtual int dbSet(std::string_view key, std::string_view value);
+    virtual int dbUnset(std::string_view key);
+    virtual int dbGet(std::string_view key, std::string& value) {return this->engine->dbGet(key, value);}
+    virtual int dbNumEqualTo(std::string_view value, int& count) {return this->engine->dbNumEqualTo(value, count);}
+    virtual int dbIncrBy(std::string_view key, int64_t delta, int64_t& result);
+    virtual int dbNumBetween(int64_t low, int64_t high, int& count)
+    {
+        return this->engine->dbNumBetween(low, high, count);
+    }
+    virtual int dbSetMany(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& values);
+    virtual int dbUnsetMany(const std::vector<std::string_view>& keys);
+    virtual int dbGetMany(const std::vector<std::string_view>& keys, std::vector<std::string>& values,
+                          std::vector<int>& status)
+    {
+        return this->engine->dbGetMany(keys, values, status);
+    }
+    virtual int dbNumEqualToMany(const std::vector<std::string_view>& values, std::vector<int>& counts)
+    {
+        return this->engine->dbNumEqualToMany(values, counts);
+    }
+    virtual int dbExpire(std::string_view key, int64_t deadlineMs);
+    virtual int dbSetExpiring(std::string_view key, std::string_view value, int64_t deadlineMs);
+    virtual int dbGetExpiry(std::string_view key, int64_t& deadlineMs)
+    {
+        return this->engine->dbGetExpiry(key, deadlineMs);
+    }
+    virtual int dbScan(std::string_view from, std::string_view to, size_t count, std::vector<std::string>& keys,
+                       std::string& next)
+    {
+        return this->engine->dbScan(from, to, count, keys, next);
+    }
+
+    virtual void begin();
+    virtual bool rollback();
+    virtual bool commit();
+    virtual bool commitBlock();
+    virtual size_t depth() const {return this->engine->depth();}
+    virtual bool buffersBlocks() const {return this->buffered;}
+    virtual int save(Snapshot& snapshot, bool background) {return this->engine->save(snapshot, background);}
+    virtual EngineStats stats() {return this->engine->stats();}
+
+private:
+    std::shared_ptr<Engine> engine;
+    std::shared_ptr<Wal> wal;
+    bool buffered; // The engine buffers the writes of blocks.
+    std::string batch; // Encoded writes of the open blocks if buffered, or of the current write.
+    std::vector<std::string> keys; // Keys written by the open blocks if not buffered.
+    std::vector<size_t> frames; // Size of batch, or of keys, at the BEGIN of each open block.
+    uint64_t block; // The Wal number of the open blocks if not buffered, once they have logged a write, or 0.
+    std::set<std::string, std::less<> > recorded; // Keys whose value before the blocks has been logged.
+    std::vector<std::string> fresh; // Keys of the current write whose value before the blocks is still to log.
+    uint64_t lsn; // The last batch appended by the open blocks, synced when they end.
+
+    bool buffering() const {return this->buffered && !this->frames.empty();} // Writes go to the batch only.
+    void track(std::string_view key); // Remember a key written by the open blocks.
+    void endBlock(); // Forget the keys and the Wal number of the blocks once the outermost one is closed.
+    void encodeBefore(std::string& payload, std::string_view key); // Encode the value of a key before the blocks.
+    template <typename Apply>
+    void log(Apply apply); // Append the batch with Wal::append(), syncing it unless blocks are open.
+    void encodeCurrent(std::string_view key); // Encode the value and expiry time of a key as they are now.
+    int logged(int status); // Report a write of the log that has failed.
+};
+
+#endif /* LoggedEngine_hpp */
@@ -0,0 +1,58 @@
+#ifndef MvccEngine_hpp
+#define MvccEngine_hpp
+
+#include "BufferedEngine.hpp"
+#include "Snapshot.hpp"
+#include "VersionedDatabase.hpp"
+#include <memory>
+#include <string>
+
+/**
+ * This class is the snapshot isolation engine on a VersionedDatabase. Outside a transaction block every command reads
+ * the newest committed version and every write commits at once. The outermost BEGIN pins a snapshot: until the block
+ * is closed, reads and NUMEQUALTO see the store as of that version plus the session's own buffered writes (see
+ * BufferedEngine), and nothing committed by other sessions in the meantime. COMMIT publishes the newest write of every
+ * key as one new version, so other sessions see either all of the block or none of it. A block that writes a key
+ * another session committed to after the snapshot cannot commit: the first COMMIT wins, and the later one rolls its
+ * block back and fails.
+ */
+class MvccEngine: public BufferedEngine
+{
+public:
+    MvccEngine(std::shared_ptr<VersionedDatabase> inDb): db(inDb), snapshot(VersionedDatabase::LATEST) {}
+    virtual ~MvccEngine() {baseEnd();}
+
+    virtual int save(Snapshot& snapshot, bool background) {return snapshot.save(*this->db, background);}
+
+protected:
+    virtual int baseSet(std::string_view key, std::string_view value) {return this->db->dbSet(key, value);}
+    virtual int baseUnset(std::string_view key) {return this->db->dbUnset(key);}
+    virtual bool baseGet(std::string_view key, std::string_view& value)
+    {
+        if(this->db->dbGet(key, this->snapshot, this->scratch) != Database::DB_GOOD)
+            return false;
+        value = this->scratch;
+        return true;
+    }
+    virtual int baseNumEqualTo(std::string_view value, int& count)
+    {
+        return this->db->dbNumEqualTo(value, this->snapshot, count);
+    }
+    virtual bool baseApply(const std::vector<KeyChange>& changes) {return this->db->apply(changes, this->snapshot);}
+    virtual StoreStats baseStats() {return this->db->stats();}
+    virtual void baseBegin() {this->snapshot = this->db->openSnapshot();}
+    virtual void baseEnd()
+    {
+        if(this->snapshot != VersionedDatabase::LATEST)
+            this->db->closeSnapshot(this->snapshot);
+        this->snapshot = VersionedDatabase::LATEST;
+    }
+    virtual bool baseIsSnapshot() const {return true;}
+
+private:
+    std::shared_ptr<VersionedDatabase> db;
+    VersionedDatabase::Version snapshot; // The pinned snapshot, or LATEST outside of a transaction block.
+    std::string scratch; // Holds the value returned by baseGet().
+};
+
+#endif /* MvccEngine_hpp */
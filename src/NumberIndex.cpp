@@ -0,0 +1,133 @@
+#include "NumberIndex.hpp"
+
+uint32_t NumberIndex::priority(Id id)
+{
+    // The finalizer of MurmurHash3: consecutive ids get unrelated priorities.
+    uint32_t h = id;
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+void NumberIndex::add(Id id, int64_t number, int64_t delta)
+{
+    if(id >= this->nodes.size())
+        this->nodes.resize(id + 1, Node{0, 0, 0, NIL, NIL});
+    Node& node = this->nodes[id];
+    if(node.count == 0)
+    {
+        node = Node{number, delta, delta, NIL, NIL};
+        this->root = insert(this->root, id);
+        this->values++;
+        return;
+    }
+    if(node.count + delta == 0)
+    {
+        this->root = erase(this->root, number);
+        this->nodes[id].count = 0;
+        this->values--;
+        return;
+    }
+    // The value stays: only the sums on the path to it change.
+    for(Id t = this->root; ; t = number < this->nodes[t].number ? this->nodes[t].left : this->nodes[t].right)
+    {
+        this->nodes[t].sum += delta;
+        if(t == id)
+            break;
+    }
+    node.count += delta;
+}
+
+int64_t NumberIndex::countBetween(int64_t low, int64_t high) const
+{
+    if(low > high)
+        return 0;
+    return countBelow(high, true) - countBelow(low, false);
+}
+
+int64_t NumberIndex::countBelow(int64_t bound, bool inclusive) const
+{
+    int64_t total = 0;
+    for(Id t = this->root; t != NIL; )
+    {
+        const Node& node = this->nodes[t];
+        if(node.number < bound || (inclusive && node.number == bound))
+        {
+            total += sum(node.left) + node.count;
+            t = node.right;
+        }
+        else
+            t = node.left;
+    }
+    return total;
+}
+
+NumberIndex::Id NumberIndex::insert(Id tree, Id node)
+{
+    if(tree == NIL)
+        return node;
+    if(priority(node) > priority(tree))
+    {
+        split(tree, this->nodes[node].number, this->nodes[node].left, this->nodes[node].right);
+        update(node);
+        return node;
+    }
+    if(this->nodes[node].number < this->nodes[tree].number)
+        this->nodes[tree].left = insert(this->nodes[tree].left, node);
+    else
+        this->nodes[tree].right = insert(this->nodes[tree].right, node);
+    update(tree);
+    return tree;
+}
+
+NumberIndex::Id NumberIndex::erase(Id tree, int64_t number)
+{
+    Node& node = this->nodes[tree];
+    if(node.number == number)
+        return merge(node.left, node.right);
+    if(number < node.number)
+        node.left = erase(node.left, number);
+    else
+        node.right = erase(node.right, number);
+    update(tree);
+    return tree;
+}
+
+void NumberIndex::split(Id tree, int64_t number, Id& below, Id& rest)
+{
+    if(tree == NIL)
+    {
+        below = rest = NIL;
+        return;
+    }
+    Node& node = this->nodes[tree];
+    if(node.number < number)
+    {
+        split(node.right, number, node.right, rest);
+        below = tree;
+    }
+    else
+    {
+        split(node.left, number, below, node.left);
+        rest = tree;
+    }
+    update(tree);
+}
+
+NumberIndex::Id NumberIndex::merge(Id below, Id above)
+{
+    if(below == NIL || above == NIL)
+        return below == NIL ? above : below;
+    if(priority(below) > priority(above))
+    {
+        this->nodes[below].right = merge(this->nodes[below].right, above);
+        update(below);
+        return below;
+    }
+    this->nodes[above].left = merge(below, this->nodes[above].left);
+    update(above);
+    return above;
+}
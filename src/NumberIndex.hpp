@@ -0,0 +1,67 @@
+#ifndef NumberIndex_hpp
+#define NumberIndex_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * This class counts the keys of a Database whose value is an integer, ordered by that integer, so that the keys with
+ * a value in a range are counted in O(log n) instead of going through every value. It is a treap, a binary search
+ * tree balanced by random priorities, with one node per distinct integer value held by at least one key. A node
+ * holds the number of keys with its value, the count of valueToCount, and the sum of the counts of its subtree, so a
+ * count below a bound adds up the subtrees left of the path to it.
+ * Nodes are identified by the value ids of the ValuePool, and stored in an array indexed by id, like valueToCount:
+ * the priority of a node is a hash of its id, and the node of a value is found from its id without a search.
+ */
+class NumberIndex
+{
+public:
+    typedef uint32_t Id;
+
+    NumberIndex(): root(NIL), values(0) {}
+
+    // Add delta to the count of the value id, whose integer is number: a value is added when its count becomes
+    // positive and removed when it becomes 0.
+    void add(Id id, int64_t number, int64_t delta);
+    int64_t countBetween(int64_t low, int64_t high) const; // The sum of the counts of the values in [low, high].
+
+    size_t size() const {return this->values;} // Number of distinct values.
+    size_t memoryUsage() const {return this->nodes.capacity() * sizeof(Node);}
+    size_t liveBytes() const {return this->values * sizeof(Node);} // Bytes of the nodes in the tree.
+
+private:
+    NumberIndex(const NumberIndex& index);
+    NumberIndex& operator=(const NumberIndex& index);
+
+    static constexpr Id NIL = UINT32_MAX;
+
+    struct Node
+    {
+        int64_t number;
+        int64_t count; // 0 for an id that is not in the tree.
+        int64_t sum; // Of the counts of the subtree.
+        Id left;
+        Id right;
+    };
+
+    std::vector<Node> nodes; // Indexed by value id.
+    Id root;
+    size_t values;
+
+    static uint32_t priority(Id id); // Larger priorities are nearer the root.
+    int64_t sum(Id node) const {return node == NIL ? 0 : this->nodes[node].sum;}
+    void update(Id node) // Recompute the sum of a node from its children.
+    {
+        Node& n = this->nodes[node];
+        n.sum = sum(n.left) + n.count + sum(n.right);
+    }
+    int64_t countBelow(int64_t bound, bool inclusive) const; // The sum of the counts of the values below bound.
+
+    Id insert(Id tree, Id node); // Return the new root of the subtree.
+    Id erase(Id tree, int64_t number);
+    void split(Id tree, int64_t number, Id& below, Id& rest); // Split into the values below number and the others.
+    Id merge(Id below, Id above); // Join two trees where every value of below is less than every value of above.
+};
+
+#endif /* NumberIndex_hpp */
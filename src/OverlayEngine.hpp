@@ -0,0 +1,46 @@
+#ifndef OverlayEngine_hpp
+#define OverlayEngine_hpp
+
+#include "BufferedEngine.hpp"
+#include "Database.hpp"
+#include "Snapshot.hpp"
+#include <memory>
+
+/**
+ * This class is the overlay (write-buffer) engine on a Database: the writes of transaction blocks are buffered in
+ * overlays (see BufferedEngine), so rollback never touches the Database or valueToCount, and commit applies the
+ * newest write of every key to the Database once.
+ */
+class OverlayEngine: public BufferedEngine
+{
+public:
+    OverlayEngine(std::shared_ptr<Database> inDb): db(inDb) {}
+
+    virtual int save(Snapshot& snapshot, bool background) {return snapshot.save(*this->db, background);}
+
+protected:
+    virtual int baseSet(std::string_view key, std::string_view value) {return this->db->dbSet(key, value);}
+    virtual int baseUnset(std::string_view key) {return this->db->dbUnset(key);}
+    virtual bool baseGet(std::string_view key, std::string_view& value)
+    {
+        return this->db->dbGetView(key, value) == Database::DB_GOOD;
+    }
+    virtual int baseNumEqualTo(std::string_view value, int& count) {return this->db->dbNumEqualTo(value, count);}
+    virtual StoreStats baseStats() {return this->db->stats();}
+    virtual bool baseApply(const std::vector<KeyChange>& changes)
+    {
+        for(const KeyChange& change: changes)
+        {
+            if(change.present)
+                this->db->dbSet(change.key, change.value);
+            else
+                this->db->dbUnset(change.key);
+        }
+        return true;
+    }
+
+private:
+    std::shared_ptr<Database> db;
+};
+
+#endif /* OverlayEngine_hpp */
@@ -0,0 +1,158 @@
+#include "Parser.hpp"
+#include "Command.hpp"
+#include "Scanner.hpp"
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+int Parser::keyword(std::string_view word)
+{
+    switch(word.size())
+    {
+        case 3:
+            switch(word[0])
+            {
+                case 'S': return word == "SET" ? Command::CMD_SET : Command::CMD_INVALID;
+                case 'G': return word == "GET" ? Command::CMD_GET : Command::CMD_INVALID;
+                case 'E': return word == "END" ? Command::CMD_END : Command::CMD_INVALID;
+                case 'T': return word == "TTL" ? Command::CMD_TTL : Command::CMD_INVALID;
+            }
+            break;
+        case 4:
+            switch(word[0])
+            {
+                case 'S':
+                    if(word == "SAVE")
+                        return Command::CMD_SAVE;
+                    return word == "SCAN" ? Command::CMD_SCAN : Command::CMD_INVALID;
+                case 'I': return word == "INFO" ? Command::CMD_INFO : Command::CMD_INVALID;
+                case 'E': return word == "EVAL" ? Command::CMD_EVAL : Command::CMD_INVALID;
+                case 'M':
+                    if(word == "MSET")
+                        return Command::CMD_MSET;
+                    return word == "MGET" ? Command::CMD_MGET : Command::CMD_INVALID;
+            }
+            break;
+        case 5:
+            switch(word[0])
+            {
+                case 'U': return word == "UNSET" ? Command::CMD_UNSET : Command::CMD_INVALID;
+                case 'B': return word == "BEGIN" ? Command::CMD_BEGIN : Command::CMD_INVALID;
+            }
+            break;
+        case 6:
+            switch(word[0])
+            {
+                case 'C': return word == "COMMIT" ? Command::CMD_COMMIT : Command::CMD_INVALID;
+                case 'B': return word == "BGSAVE" ? Command::CMD_BGSAVE : Command::CMD_INVALID;
+                case 'M': return word == "MUNSET" ? Command::CMD_MUNSET : Command::CMD_INVALID;
+                case 'E': return word == "EXPIRE" ? Command::CMD_EXPIRE : Command::CMD_INVALID;
+                case 'I': return word == "INCRBY" ? Command::CMD_INCRBY : Command::CMD_INVALID;
+                case 'D': return word == "DECRBY" ? Command::CMD_DECRBY : Command::CMD_INVALID;
+            }
+            break;
+        case 8:
+            return word == "ROLLBACK" ? Command::CMD_ROLLBACK : Command::CMD_INVALID;
+        case 10:
+            if(word == "NUMEQUALTO")
+                return Command::CMD_NUMEQUALTO;
+            return word == "NUMBETWEEN" ? Command::CMD_NUMBETWEEN : Command::CMD_INVALID;
+    }
+    return Command::CMD_INVALID;
+}
+
+std::string_view Parser::nextToken(std::string_view line, size_t& pos)
+{
+    while(pos < line.size() && isSpace(line[pos]))
+        pos++;
+    size_t start = pos;
+    while(pos < line.size() && !isSpace(line[pos]))
+        pos++;
+    return line.substr(start, pos - start);
+}
+
+int Parser::parse(std::string_view line, ParsedCommand& out)
+{
+    out.args.clear();
+    Scanner::split(line, out.args);
+    out.name = out.args.empty() ? Command::CMD_INVALID : keyword(out.args[0]);
+    if(out.name == Command::CMD_INVALID)
+        out.args.clear();
+    else
+        out.args.erase(out.args.begin());
+    return out.name;
+}
+
+// Read a "<prefix><decimal>\r\n" header at pos, e.g. "*3\r\n" or "$5\r\n".
+static int parseHeader(std::string_view buffer, size_t& pos, char prefix, long long limit, long long& value)
+{
+    if(pos >= buffer.size())
+        return Parser::REQUEST_INCOMPLETE;
+    if(buffer[pos] != prefix)
+        return Parser::REQUEST_ERROR;
+    size_t end = buffer.find('\r', pos + 1);
+    if(end == std::string_view::npos || end + 1 >= buffer.size())
+        return end == std::string_view::npos && buffer.size() - pos > 32 ? Parser::REQUEST_ERROR
+                                                                       : Parser::REQUEST_INCOMPLETE;
+    if(buffer[end + 1] != '\n' || end == pos + 1 || end - pos > 20)
+        return Parser::REQUEST_ERROR;
+    value = 0;
+    for(size_t i = pos + 1; i < end; i++)
+    {
+        if(buffer[i] < '0' || buffer[i] > '9')
+            return Parser::REQUEST_ERROR;
+        value = value * 10 + (buffer[i] - '0');
+        if(value > limit)
+            return Parser::REQUEST_ERROR;
+    }
+    pos = end + 2;
+    return Parser::REQUEST_DONE;
+}
+
+int Parser::parseRequest(std::string_view buffer, size_t& consumed, ParsedCommand& out)
+{
+    static const long long MAX_ARGS = 1024 * 1024;
+    static const long long MAX_BULK = 512LL * 1024 * 1024;
+    static const size_t MAX_INLINE = 64 * 1024;
+
+    out.args.clear();
+    out.name = Command::CMD_INVALID;
+    if(buffer.empty())
+        return REQUEST_INCOMPLETE;
+    if(buffer[0] != '*')
+    {
+        size_t end = Scanner::findNewline(buffer.data(), buffer.data() + buffer.size()) - buffer.data();
+        if(end == buffer.size())
+            return buffer.size() > MAX_INLINE ? REQUEST_ERROR : REQUEST_INCOMPLETE;
+        parse(buffer.substr(0, end), out);
+        consumed = end + 1;
+        return REQUEST_DONE;
+    }
+
+    size_t pos = 0;
+    long long count = 0;
+    int status = parseHeader(buffer, pos, '*', MAX_ARGS, count);
+    if(status != REQUEST_DONE)
+        return status;
+    for(long long i = 0; i < count; i++)
+    {
+        long long length = 0;
+        status = parseHeader(buffer, pos, '$', MAX_BULK, length);
+        if(status != REQUEST_DONE)
+            return status;
+        if(buffer.size() - pos < (size_t)length + 2)
+            return REQUEST_INCOMPLETE;
+        if(buffer[pos + length] != '\r' || buffer[pos + length + 1] != '\n')
+            return REQUEST_ERROR;
+        std::string_view arg = buffer.substr(pos, length);
+        if(i == 0)
+            out.name = keyword(arg);
+        else
+            out.args.push_back(arg);
+        pos += length + 2;
+    }
+    consumed = pos;
+    return REQUEST_DONE;
+}
@@ -0,0 +1,43 @@
+#ifndef Parser_hpp
+#define Parser_hpp
+
+#include <string_view>
+#include <vector>
+
+/**
+ * The result of parsing one input line: the command name (one of Command::CMD_*) and its arguments. The arguments
+ * are views into the parsed line, so they are only valid while that line is alive. The object is meant to be reused
+ * from line to line, in which case parsing does not allocate once the argument vector has grown to its working size.
+ */
+struct ParsedCommand
+{
+    int name;
+    std::vector<std::string_view> args;
+};
+
+/**
+ * This class turns a line of text into a ParsedCommand. The line is split on whitespace in place by the Scanner, a
+ * block of bytes at a time, and the leading keyword is classified with a switch on its length followed by a single
+ * comparison, instead of trying every keyword as a prefix in turn.
+ * parseRequest() reads one request from the input buffer of a network connection. A request is either a RESP array
+ * of bulk strings ("*3\r\n$3\r\nSET\r\n$1\r\na\r\n$2\r\n10\r\n"), whose arguments are length-prefixed and may
+ * contain any bytes, or an inline line of text as typed in a terminal.
+ */
+class Parser
+{
+public:
+    enum
+    {
+        REQUEST_DONE, // A complete request was parsed.
+        REQUEST_INCOMPLETE, // The buffer ends inside a request; call again when more bytes have arrived.
+        REQUEST_ERROR // The buffer does not hold a valid request.
+    };
+
+    static int keyword(std::string_view word); // Map a keyword to Command::CMD_*, or Command::CMD_INVALID.
+    static int parse(std::string_view line, ParsedCommand& out); // Parse a line, return out.name.
+    static int parseRequest(std::string_view buffer, size_t& consumed, ParsedCommand& out); // Return REQUEST_*.
+
+    static std::string_view nextToken(std::string_view line, size_t& pos); // Return the token at or after pos.
+};
+
+#endif /* Parser_hpp */
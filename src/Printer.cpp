@@ -1 +1,126 @@
 #include "Printer.hpp"
+#include <cstring>
+
+Printer::Printer(int inProtocol, bool inToStdout): buffer(64 * 1024), start(0), used(0),
+    policy(inToStdout ? FLUSH_LINE : FLUSH_FULL), protocol(inProtocol), echo(inProtocol == PROTOCOL_TEXT),
+    toStdout(inToStdout) {}
+
+void Printer::reply(std::string_view value)
+{
+    if(this->protocol == PROTOCOL_RESP)
+    {
+        write("$", 1);
+        writeNumber((long long)value.size());
+        write("\r\n", 2);
+    }
+    else
+        write("> ", 2);
+    write(value.data(), value.size());
+    endLine();
+}
+
+void Printer::reply(long long value)
+{
+    write(this->protocol == PROTOCOL_RESP ? ":" : "> ", this->protocol == PROTOCOL_RESP ? 1 : 2);
+    writeNumber(value);
+    endLine();
+}
+
+void Printer::replyNull()
+{
+    if(this->protocol == PROTOCOL_RESP)
+        write("$-1\r\n", 5);
+    else
+    {
+        write("> NULL", 6);
+        endLine();
+    }
+}
+
+void Printer::replyArray(size_t count)
+{
+    if(this->protocol != PROTOCOL_RESP)
+        return;
+    write("*", 1);
+    writeNumber((long long)count);
+    write("\r\n", 2);
+}
+
+void Printer::replyError(std::string_view message)
+{
+    write(this->protocol == PROTOCOL_RESP ? "-" : "> ", this->protocol == PROTOCOL_RESP ? 1 : 2);
+    write(message.data(), message.size());
+    endLine();
+}
+
+void Printer::setBufferSize(size_t size)
+{
+    flush();
+    this->buffer.assign(size == 0 ? 1 : size, 0);
+}
+
+void Printer::flush()
+{
+    if(!this->toStdout || this->used == 0)
+        return;
+    std::cout.write(this->buffer.data(), this->used);
+    std::cout.flush();
+    this->start = 0;
+    this->used = 0;
+}
+
+void Printer::consume(size_t size)
+{
+    this->start += size;
+    if(this->start == this->used)
+    {
+        this->start = 0;
+        this->used = 0;
+    }
+}
+
+void Printer::write(const char* data, size_t size)
+{
+    if(this->used + size > this->buffer.size())
+    {
+        if(!this->toStdout)
+        {
+            // Keep everything for pending(); drop the consumed prefix before growing.
+            if(this->start > 0)
+            {
+                std::memmove(this->buffer.data(), this->buffer.data() + this->start, this->used - this->start);
+                this->used -= this->start;
+                this->start = 0;
+            }
+            if(this->used + size > this->buffer.size())
+                this->buffer.resize(std::max(this->buffer.size() * 2, this->used + size));
+        }
+        else
+        {
+            flush();
+            if(size > this->buffer.size())
+            {
+                std::cout.write(data, size);
+                return;
+            }
+        }
+    }
+    std::memcpy(this->buffer.data() + this->used, data, size);
+    this->used += size;
+}
+
+void Printer::writeNumber(long long value)
+{
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* begin = end;
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    do
+    {
+        *--begin = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while(magnitude != 0);
+    if(value < 0)
+        *--begin = '-';
+    write(begin, end - begin);
+}
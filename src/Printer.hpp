@@ -2,26 +2,109 @@
 #define Printer_hpp
 
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
 
 /**
- * This class is a singleton class, responsible for showing results to users.
+ * This class is responsible for showing results to users. getInstance() returns the printer of the session that is
+ * being executed on the calling thread, which is the stdout printer unless a server has installed the printer of a
+ * client connection with setCurrent().
+ * Output is collected in a reusable buffer. The stdout printer writes it out in large chunks: the buffer is flushed
+ * when it is full, when END is executed, on an explicit flush(), and after every line when the FLUSH_LINE policy is
+ * selected (used for interactive sessions). A connection printer keeps everything until the server takes it with
+ * pending() and consume(), so the replies to a pipelined batch of commands go out in one write.
+ * Replies are rendered in one of two protocols. PROTOCOL_TEXT is the original output: the echo of each input
+ * command and "> ..." lines, where successful writes print nothing. PROTOCOL_RESP gives every command exactly one
+ * RESP reply (+OK, -error, :integer, $bulk, $-1 for null or an array of those) and never echoes. In quiet mode the echo is suppressed
+ * and commands do not need to build their echo string at all.
  */
 class Printer {
 public:
+    enum
+    {
+        FLUSH_LINE, // Flush after every line, same as writing with std::endl.
+        FLUSH_FULL  // Flush only when the buffer is full, on END or on an explicit flush().
+    };
+
+    enum
+    {
+        PROTOCOL_TEXT,
+        PROTOCOL_RESP
+    };
+
     static Printer& getInstance() {
-        static Printer printer;
+        Printer* printer = current();
+        return printer != nullptr ? *printer : getStdout();
+    }
+
+    static Printer& getStdout() {
+        static Printer printer(PROTOCOL_TEXT, true);
         return printer;
     }
 
+    static void setCurrent(Printer* printer) {current() = printer;} // nullptr selects the stdout printer again.
+
+    Printer(int inProtocol, bool inToStdout = false);
+    ~Printer() {flush();}
+
     template <typename T>
     void print(const T& value) {
-        std::cout << value << std::endl;
+        std::ostringstream stream;
+        stream << value;
+        print(stream.str());
     }
-    
+
+    void print(const std::string& value) {write(value.data(), value.size()); endLine();}
+    void print(const char* value) {print(std::string(value));}
+
+    void reply(std::string_view value); // A value: "> value" or a bulk string.
+    void reply(long long value); // A number: "> number" or an integer.
+    void replyNull(); // A missing value: "> NULL" or a null bulk string.
+    void replyError(std::string_view message); // A failure: "> message" or an error.
+    void replyOk() {if(protocol == PROTOCOL_RESP) write("+OK\r\n", 5);} // Success without a value.
+    void replyArray(size_t count); // The header of count replies that follow: nothing or an array.
+
+    bool isEcho() const {return echo;}
+    void setEcho(bool inEcho) {echo = inEcho && protocol == PROTOCOL_TEXT;}
+    int getProtocol() const {return protocol;}
+    void setProtocol(int inProtocol) {protocol = inProtocol; setEcho(echo);}
+    void setFlushPolicy(int inPolicy) {policy = inPolicy; if(policy == FLUSH_LINE) flush();}
+    void setBufferSize(size_t size);
+
+    void flush(); // Write out all buffered output of the stdout printer.
+
+    std::string_view pending() const {return std::string_view(buffer.data() + start, used - start);}
+    void consume(size_t size); // Drop bytes from the front of pending() after they have been sent.
+
 private:
-    Printer() {}
     Printer(const Printer& printer);
     Printer& operator=(const Printer& printer);
+
+    std::vector<char> buffer; // Reusable output buffer.
+    size_t start; // Start of the bytes in buffer that have not been consumed yet.
+    size_t used; // End of the bytes in buffer.
+    int policy; // One of FLUSH_LINE, FLUSH_FULL.
+    int protocol; // One of PROTOCOL_TEXT, PROTOCOL_RESP.
+    bool echo; // Whether input commands are echoed before their replies.
+    bool toStdout; // Whether the buffer is written to stdout, or kept for pending().
+
+    static Printer*& current() {
+        thread_local Printer* printer = nullptr;
+        return printer;
+    }
+
+    void write(const char* data, size_t size); // Append bytes to the buffer, flushing first if they do not fit.
+    void writeNumber(long long value);
+    void endLine() {
+        if(protocol == PROTOCOL_RESP) {
+            write("\r\n", 2);
+            return;
+        }
+        write("\n", 1);
+        if(policy == FLUSH_LINE) flush();
+    }
 };
 
 
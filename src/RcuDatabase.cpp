@@ -0,0 +1,277 @@
+#include "RcuDatabase.hpp"
+#include "FlatMap.hpp"
+#include <cstring>
+#include <new>
+
+static_assert(sizeof(void*) == 8, "table slots keep a hash tag in the top 16 bits of a pointer");
+
+static const size_t MIN_CAPACITY = 16;
+static const int TAG_SHIFT = 48; // User space addresses fit in the low 48 bits.
+
+static inline uintptr_t tagOf(size_t h) {return (uintptr_t)(h >> TAG_SHIFT) << TAG_SHIFT;}
+
+template <typename Node>
+static inline uintptr_t pack(Node* node) {return tagOf(node->hash) | reinterpret_cast<uintptr_t>(node);}
+
+template <typename Node>
+static inline Node* unpack(uintptr_t slot) {return reinterpret_cast<Node*>(slot & ((uintptr_t(1) << TAG_SHIFT) - 1));}
+
+RcuDatabase::RcuDatabase(): distinctValues(0), nextReclaim(RECLAIM_BATCH), undoLogs(0)
+{
+    this->keys.store(makeTable<KeyNode>(MIN_CAPACITY), std::memory_order_relaxed);
+    this->values.store(makeTable<ValueNode>(MIN_CAPACITY), std::memory_order_relaxed);
+}
+
+int RcuDatabase::dbSet(std::string_view key, std::string_view value)
+{
+    return setNode(key, intern(value));
+}
+
+int RcuDatabase::dbSetId(std::string_view key, ValuePool::Id value)
+{
+    ValueNode* node = this->valueNodes[value];
+    node->refs++;
+    return setNode(key, node);
+}
+
+int RcuDatabase::dbUnset(std::string_view key)
+{
+    Table<KeyNode>* table = this->keys.load(std::memory_order_relaxed);
+    KeyNode* node = find(table, key, StringHash()(key));
+    if(node == nullptr)
+        return Database::DB_NOT_FOUND;
+    ValueNode* old = node->value.load(std::memory_order_relaxed);
+    erase(table, node);
+    node->value.store(nullptr, std::memory_order_release); // For readers still probing an older table.
+    addCount(old, -1);
+    release(old);
+    retire(node, sizeof(KeyNode) + node->length);
+    return Database::DB_GOOD;
+}
+
+int RcuDatabase::dbGetId(std::string_view key, ValuePool::Id& value)
+{
+    KeyNode* node = find(this->keys.load(std::memory_order_relaxed), key, StringHash()(key));
+    if(node == nullptr)
+        return Database::DB_NOT_FOUND;
+    value = node->value.load(std::memory_order_relaxed)->id;
+    return Database::DB_GOOD;
+}
+
+void RcuDatabase::reclaim()
+{
+    Epoch::advance();
+    uint64_t safe = Epoch::oldestActive();
+    while(!this->retired.empty() && this->retired.front().epoch < safe)
+    {
+        this->arena.free(this->retired.front().block, this->retired.front().size);
+        this->retired.pop_front();
+    }
+    this->nextReclaim = this->retired.size() + RECLAIM_BATCH;
+}
+
+int RcuDatabase::dbGet(std::string_view key, std::string& value) const
+{
+    size_t h = StringHash()(key);
+    Epoch::Guard guard;
+    const KeyNode* node = find(this->keys.load(std::memory_order_acquire), key, h);
+    const ValueNode* current = node == nullptr ? nullptr : node->value.load(std::memory_order_acquire);
+    if(current == nullptr)
+        return Database::DB_NOT_FOUND;
+    value.assign(current->view());
+    return Database::DB_GOOD;
+}
+
+int RcuDatabase::dbNumEqualTo(std::string_view value, int& count) const
+{
+    size_t h = StringHash()(value);
+    Epoch::Guard guard;
+    const ValueNode* node = find(this->values.load(std::memory_order_acquire), value, h);
+    count = node == nullptr ? 0 : node->count.load(std::memory_order_relaxed);
+    return count == 0 ? Database::DB_NOT_FOUND : Database::DB_GOOD;
+}
+
+template <typename Node>
+Node* RcuDatabase::find(const Table<Node>* table, std::string_view s, size_t h)
+{
+    // A table is never more than 3/4 full, so every probe sequence ends at an empty slot.
+    const std::atomic<uintptr_t>* slots = table->slots();
+    uintptr_t tag = tagOf(h);
+    for(size_t i = h & table->mask; ; i = (i + 1) & table->mask)
+    {
+        uintptr_t slot = slots[i].load(std::memory_order_acquire);
+        if(slot == EMPTY)
+            return nullptr;
+        if((slot >> TAG_SHIFT << TAG_SHIFT) == tag && slot != TOMBSTONE)
+        {
+            Node* node = unpack<Node>(slot);
+            if(node->hash == h && node->view() == s)
+                return node;
+        }
+    }
+}
+
+template <typename Node>
+RcuDatabase::Table<Node>* RcuDatabase::makeTable(size_t capacity)
+{
+    char* block = this->arena.allocate(sizeof(Table<Node>) + capacity * sizeof(std::atomic<uintptr_t>));
+    Table<Node>* table = new(block) Table<Node>();
+    table->mask = capacity - 1;
+    table->live = 0;
+    table->used = 0;
+    for(size_t i = 0; i < capacity; i++)
+        new(&table->slots()[i]) std::atomic<uintptr_t>(EMPTY);
+    return table;
+}
+
+template <typename Node>
+void RcuDatabase::insert(std::atomic<Table<Node>*>& root, Node* node)
+{
+    Table<Node>* table = root.load(std::memory_order_relaxed);
+    if((table->used + 1) * 4 > (table->mask + 1) * 3)
+    {
+        // Copy the live nodes into a table at most half full. Readers still probing the old table find the same
+        // nodes there until it is freed.
+        size_t capacity = MIN_CAPACITY;
+        while(capacity < (table->live + 1) * 2)
+            capacity *= 2;
+        Table<Node>* copy = makeTable<Node>(capacity);
+        for(size_t i = 0; i <= table->mask; i++)
+        {
+            uintptr_t slot = table->slots()[i].load(std::memory_order_relaxed);
+            if(slot == EMPTY || slot == TOMBSTONE)
+                continue;
+            size_t j = unpack<Node>(slot)->hash & copy->mask;
+            while(copy->slots()[j].load(std::memory_order_relaxed) != EMPTY)
+                j = (j + 1) & copy->mask;
+            copy->slots()[j].store(slot, std::memory_order_relaxed);
+            copy->live++;
+            copy->used++;
+        }
+        root.store(copy, std::memory_order_release);
+        retire(table, sizeof(Table<Node>) + (table->mask + 1) * sizeof(std::atomic<uintptr_t>));
+        table = copy;
+    }
+
+    std::atomic<uintptr_t>* slots = table->slots();
+    size_t i = node->hash & table->mask;
+    while(true)
+    {
+        uintptr_t slot = slots[i].load(std::memory_order_relaxed);
+        if(slot == TOMBSTONE)
+            break;
+        if(slot == EMPTY)
+        {
+            table->used++;
+            break;
+        }
+        i = (i + 1) & table->mask;
+    }
+    slots[i].store(pack(node), std::memory_order_release);
+    table->live++;
+}
+
+template <typename Node>
+void RcuDatabase::erase(Table<Node>* table, Node* node)
+{
+    std::atomic<uintptr_t>* slots = table->slots();
+    uintptr_t packed = pack(node);
+    size_t i = node->hash & table->mask;
+    while(slots[i].load(std::memory_order_relaxed) != packed)
+        i = (i + 1) & table->mask;
+    slots[i].store(TOMBSTONE, std::memory_order_release);
+    table->live--;
+}
+
+RcuDatabase::ValueNode* RcuDatabase::intern(std::string_view value)
+{
+    size_t h = StringHash()(value);
+    ValueNode* node = find(this->values.load(std::memory_order_relaxed), value, h);
+    if(node != nullptr)
+    {
+        node->refs++;
+        return node;
+    }
+    char* block = this->arena.allocate(sizeof(ValueNode) + value.size());
+    std::memcpy(block + sizeof(ValueNode), value.data(), value.size());
+    node = new(block) ValueNode();
+    node->hash = h;
+    node->length = (uint32_t)value.size();
+    node->count.store(0, std::memory_order_relaxed);
+    node->refs = 1;
+    if(!this->freeIds.empty())
+    {
+        node->id = this->freeIds.back();
+        this->freeIds.pop_back();
+        this->valueNodes[node->id] = node;
+    }
+    else
+    {
+        node->id = (ValuePool::Id)this->valueNodes.size();
+        this->valueNodes.push_back(node);
+    }
+    insert(this->values, node);
+    return node;
+}
+
+void RcuDatabase::release(ValueNode* node)
+{
+    if(--node->refs > 0)
+        return;
+    erase(this->values.load(std::memory_order_relaxed), node);
+    this->valueNodes[node->id] = nullptr;
+    this->freeIds.push_back(node->id);
+    retire(node, sizeof(ValueNode) + node->length);
+}
+
+StoreStats RcuDatabase::stats() const
+{
+    return StoreStats{this->keys.load(std::memory_order_relaxed)->live, this->distinctValues,
+                      this->arena.stats().reservedBytes + this->valueNodes.capacity() * sizeof(ValueNode*) +
+                      this->freeIds.capacity() * sizeof(ValuePool::Id), 0, 0, 0, 0, 0};
+}
+
+void RcuDatabase::addCount(ValueNode* node, int delta)
+{
+    int count = node->count.load(std::memory_order_relaxed);
+    node->count.store(count + delta, std::memory_order_relaxed);
+    if(count == 0)
+        this->distinctValues++;
+    else if(count + delta == 0)
+        this->distinctValues--;
+}
+
+int RcuDatabase::setNode(std::string_view key, ValueNode* value)
+{
+    size_t h = StringHash()(key);
+    KeyNode* node = find(this->keys.load(std::memory_order_relaxed), key, h);
+    ValueNode* old = node == nullptr ? nullptr : node->value.load(std::memory_order_relaxed);
+    if(old == value)
+    {
+        release(value);
+        return Database::DB_GOOD;
+    }
+    addCount(value, 1);
+    if(node == nullptr)
+    {
+        char* block = this->arena.allocate(sizeof(KeyNode) + key.size());
+        std::memcpy(block + sizeof(KeyNode), key.data(), key.size());
+        node = new(block) KeyNode();
+        node->hash = h;
+        node->length = (uint32_t)key.size();
+        node->value.store(value, std::memory_order_relaxed);
+        insert(this->keys, node);
+        return Database::DB_GOOD;
+    }
+    node->value.store(value, std::memory_order_release);
+    addCount(old, -1);
+    release(old);
+    return Database::DB_GOOD;
+}
+
+void RcuDatabase::retire(void* block, size_t size)
+{
+    this->retired.push_back(Retired{Epoch::current(), static_cast<char*>(block), size});
+    if(this->retired.size() >= this->nextReclaim)
+        reclaim();
+}
@@ -0,0 +1,142 @@
+#ifndef RcuDatabase_hpp
+#define RcuDatabase_hpp
+
+#include "Arena.hpp"
+#include "Database.hpp"
+#include "Epoch.hpp"
+#include "ValuePool.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * This class is a key-value store for one writer and any number of lock-free readers. dbGet() and dbNumEqualTo() may
+ * be called from any thread at any time and take no lock; all other methods are the writer side and must be called
+ * by one thread at a time, e.g. while holding writeLock().
+ * Keys and distinct values are immutable nodes. A key node points to the node of its value, and every value node
+ * holds the number of keys pointing to it. Two open-addressing tables of node pointers, one for keys and one for
+ * values, find them; the unused top 16 bits of each pointer hold bits of the node's hash, so a probe only
+ * dereferences nodes that are likely to match. The writer never modifies a node that readers can see, other than
+ * the value pointer of a key and the count of a value, which are single atomic words: SET swaps the value pointer to
+ * another value node, UNSET replaces the key's slot with a tombstone, and a table that gets too full is copied into a
+ * bigger one that is then published with a single pointer store. A reader therefore sees every key either with its old value or with
+ * its new one, never with a value torn between the two, without retrying and without a seqlock.
+ * Nodes and tables that have been unlinked are retired with an epoch stamp (see Epoch) and freed into the arena once
+ * no reader can still be looking at them.
+ * Value nodes are reference counted like ValuePool entries and have ids, so a Transaction undo log can hold them.
+ */
+class RcuDatabase
+{
+public:
+    RcuDatabase();
+
+    // Writer side.
+    int dbSet(std::string_view key, std::string_view value);
+    int dbSetId(std::string_view key, ValuePool::Id value);
+    int dbUnset(std::string_view key);
+    int dbGetId(std::string_view key, ValuePool::Id& value);
+    void retainValue(ValuePool::Id value) {this->valueNodes[value]->refs++;}
+    void releaseValue(ValuePool::Id value) {release(this->valueNodes[value]);}
+    void reclaim(); // Free the retired memory no reader can reach any more.
+    std::mutex& writeLock() {return this->lock;}
+    template <typename F>
+    void forEach(F f) const // Call f(key, value) with string views of every key-value pair, in no particular order.
+    {
+        const Table<KeyNode>* table = this->keys.load(std::memory_order_relaxed);
+        for(size_t i = 0; i <= table->mask; i++)
+        {
+            uintptr_t slot = table->slots()[i].load(std::memory_order_relaxed);
+            if(slot != EMPTY && slot != TOMBSTONE)
+            {
+                const KeyNode* node = reinterpret_cast<const KeyNode*>(slot & POINTER_MASK);
+                f(node->view(), node->value.load(std::memory_order_relaxed)->view());
+            }
+        }
+    }
+
+    // Reader side, lock-free.
+    int dbGet(std::string_view key, std::string& value) const;
+    int dbNumEqualTo(std::string_view value, int& count) const;
+
+    size_t retiredCount() const {return this->retired.size();} // Writer side: blocks waiting to be freed.
+    // Writer side: undo logs report when they start and stop holding entries, see Database::undoLogCount().
+    void addUndoLog(int delta) {this->undoLogs += delta;}
+    size_t undoLogCount() const {return this->undoLogs;}
+    StoreStats stats() const; // Writer side.
+
+private:
+    RcuDatabase(const RcuDatabase& db);
+    RcuDatabase& operator=(const RcuDatabase& db);
+
+    static const size_t RECLAIM_BATCH = 256; // Retired blocks between two reclaim() calls.
+    static const uintptr_t EMPTY = 0; // Table slot values that are not nodes.
+    static const uintptr_t TOMBSTONE = 1;
+    static const uintptr_t POINTER_MASK = (uintptr_t(1) << 48) - 1; // The node pointer of a slot, without its hash tag.
+
+    struct ValueNode
+    {
+        size_t hash;
+        uint32_t length;
+        ValuePool::Id id;
+        std::atomic<int> count; // Number of keys holding the value.
+        uint32_t refs; // Keys and undo records holding the value. Writer only.
+        std::string_view view() const {return std::string_view(reinterpret_cast<const char*>(this + 1), length);}
+    };
+
+    struct KeyNode
+    {
+        size_t hash;
+        uint32_t length;
+        std::atomic<ValueNode*> value; // nullptr once the key has been unset.
+        std::string_view view() const {return std::string_view(reinterpret_cast<const char*>(this + 1), length);}
+    };
+
+    template <typename Node>
+    struct Table
+    {
+        size_t mask; // Capacity - 1.
+        size_t live; // Slots holding a node. Writer only.
+        size_t used; // Slots holding a node or a tombstone. Writer only.
+        std::atomic<uintptr_t>* slots() {return reinterpret_cast<std::atomic<uintptr_t>*>(this + 1);}
+        const std::atomic<uintptr_t>* slots() const {return reinterpret_cast<const std::atomic<uintptr_t>*>(this + 1);}
+    };
+
+    struct Retired
+    {
+        uint64_t epoch; // Epoch::current() when the block was unlinked.
+        char* block;
+        size_t size;
+    };
+
+    std::mutex lock; // Serializes writers.
+    SlabArena arena; // Nodes and tables. Writer only.
+    std::atomic<Table<KeyNode>*> keys;
+    std::atomic<Table<ValueNode>*> values;
+    std::vector<ValueNode*> valueNodes; // Indexed by id. Writer only.
+    std::vector<ValuePool::Id> freeIds;
+    size_t distinctValues; // Value nodes with a non-zero count. Writer only.
+    std::deque<Retired> retired; // In epoch order.
+    size_t nextReclaim; // Size of retired at which the next reclaim() runs.
+    size_t undoLogs; // Writer only.
+
+    template <typename Node>
+    static Node* find(const Table<Node>* table, std::string_view s, size_t h);
+    template <typename Node>
+    Table<Node>* makeTable(size_t capacity);
+    template <typename Node>
+    void insert(std::atomic<Table<Node>*>& table, Node* node);
+    template <typename Node>
+    void erase(Table<Node>* table, Node* node);
+
+    ValueNode* intern(std::string_view value); // Find or add a value node and take a reference on it.
+    void release(ValueNode* node);
+    void addCount(ValueNode* node, int delta); // Change the number of keys holding a value by one.
+    int setNode(std::string_view key, ValueNode* node); // Point a key to a referenced value node.
+    void retire(void* block, size_t size);
+};
+
+#endif /* RcuDatabase_hpp */
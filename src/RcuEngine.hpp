@@ -0,0 +1,91 @@
+#ifndef RcuEngine_hpp
+#define RcuEngine_hpp
+
+#include "Engine.hpp"
+#include "RcuDatabase.hpp"
+#include "Snapshot.hpp"
+#include "Transaction.hpp"
+#include <memory>
+#include <mutex>
+
+/**
+ * This class is the undo-replay engine of a session on an RcuDatabase. Writes, rollbacks and commits take the
+ * database's write lock, so the sessions of all threads take turns as its single writer; GET and NUMEQUALTO take no
+ * lock at all and never wait for a writer. As with UndoEngine, the writes of an open block are visible to other
+ * sessions and a rollback restores the values the keys had before the block.
+ */
+class RcuEngine: public Engine
+{
+public:
+    RcuEngine(std::shared_ptr<RcuDatabase> inDb): db(inDb), transaction(inDb) {}
+    virtual ~RcuEngine() {commit();}
+
+    virtual int dbSet(std::string_view key, std::string_view value)
+    {
+        std::lock_guard<std::mutex> guard(this->db->writeLock());
+        this->transaction.record(key);
+        return this->db->dbSet(key, value);
+    }
+
+    virtual int dbUnset(std::string_view key)
+    {
+        std::lock_guard<std::mutex> guard(this->db->writeLock());
+        this->transaction.record(key);
+        return this->db->dbUnset(key);
+    }
+
+    virtual int dbGet(std::string_view key, std::string& value) {return this->db->dbGet(key, value);}
+    virtual int dbNumEqualTo(std::string_view value, int& count) {return this->db->dbNumEqualTo(value, count);}
+
+    virtual int dbSetMany(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& values)
+    {
+        std::lock_guard<std::mutex> guard(this->db->writeLock());
+        for(size_t i = 0; i < keys.size(); i++)
+        {
+            this->transaction.record(keys[i]);
+            this->db->dbSet(keys[i], values[i]);
+        }
+        return Database::DB_GOOD;
+    }
+
+    virtual int dbUnsetMany(const std::vector<std::string_view>& keys)
+    {
+        std::lock_guard<std::mutex> guard(this->db->writeLock());
+        for(std::string_view key: keys)
+        {
+            this->transaction.record(key);
+            this->db->dbUnset(key);
+        }
+        return Database::DB_GOOD;
+    }
+
+    virtual void begin() {this->transaction.begin();}
+    virtual bool rollback()
+    {
+        std::lock_guard<std::mutex> guard(this->db->writeLock());
+        return this->transaction.rollback();
+    }
+    virtual bool commit()
+    {
+        std::lock_guard<std::mutex> guard(this->db->writeLock());
+        return this->transaction.commit();
+    }
+    virtual bool commitBlock()
+    {
+        std::lock_guard<std::mutex> guard(this->db->writeLock());
+        return this->transaction.commitBlock();
+    }
+    virtual size_t depth() const {return this->transaction.depth();}
+    virtual int save(Snapshot& snapshot, bool background) {return snapshot.save(*this->db, background);}
+    virtual EngineStats stats()
+    {
+        std::lock_guard<std::mutex> guard(this->db->writeLock());
+        return EngineStats{this->db->stats(), depth(), this->transaction.size()};
+    }
+
+private:
+    std::shared_ptr<RcuDatabase> db;
+    BasicTransaction<RcuDatabase> transaction;
+};
+
+#endif /* RcuEngine_hpp */
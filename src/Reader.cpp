@@ -1,99 +1,256 @@
+#include "Printer.hpp"
 #include "Reader.hpp"
+#include "Stats.hpp"
 
-Reader::Reader(std::shared_ptr<Database> inDb): db(inDb) {}
+Reader::Reader(std::shared_ptr<Database> inDb, int engineType): engine(Engine::create(engineType, inDb)), setCmd("", ""), unsetCmd(""), getCmd(""), numEqualToCmd(""), incrByCmd(false), decrByCmd(true), saveCmd(false), bgsaveCmd(true) {}
 
-void Reader::run(std::string& inCmd)
+Reader::Reader(std::shared_ptr<Engine> inEngine, std::shared_ptr<Snapshot> inSnapshot): engine(inEngine),
+    snapshot(inSnapshot), setCmd("", ""), unsetCmd(""), getCmd(""), numEqualToCmd(""), incrByCmd(false),
+    decrByCmd(true), saveCmd(false), bgsaveCmd(true)
 {
-    std::stringstream buffer(inCmd);
-    if(isPrefix(inCmd, "SET"))
-    {
-        std::string cmd, key, value;
-        buffer >> cmd >> key >> value;
-        if(value != "") execute(std::shared_ptr<Command>(new CmdSet(key, value)));
-    }
-    else if(isPrefix(inCmd, "UNSET"))
-    {
-        std::string cmd, key;
-        buffer >> cmd >> key;
-        execute(std::shared_ptr<Command>(new CmdUnset(key)));
-    }
-    else if(isPrefix(inCmd, "GET"))
-    {
-        std::string cmd, key;
-        buffer >> cmd >> key;
-        execute(std::shared_ptr<Command>(new CmdGet(key)));
-    }
-    else if(isPrefix(inCmd, "NUMEQUALTO"))
+    this->saveCmd.setSnapshot(inSnapshot.get());
+    this->bgsaveCmd.setSnapshot(inSnapshot.get());
+}
+
+static const long long MAX_TTL_MS = 1LL << 50; // Over 35000 years.
+static const long long DEFAULT_SCAN_COUNT = 10;
+
+// Parse a decimal integer, optionally negative, of at most 18 digits.
+static bool parseInteger(std::string_view text, long long& value)
+{
+    bool negative = !text.empty() && text[0] == '-';
+    if(negative)
+        text.remove_prefix(1);
+    if(text.empty() || text.size() > 18)
+        return false;
+    value = 0;
+    for(char c: text)
     {
-        std::string cmd, value;
-        buffer >> cmd >> value;
-        execute(std::shared_ptr<Command>(new CmdNumEqualTo(value)));
+        if(c < '0' || c > '9')
+            return false;
+        value = value * 10 + (c - '0');
     }
-    else if(isPrefix(inCmd, "BEGIN"))
-        execute(std::shared_ptr<Command>(new CmdBegin()));
-    else if(isPrefix(inCmd, "ROLLBACK"))
-        execute(std::shared_ptr<Command>(new CmdRollback()));
-    else if(isPrefix(inCmd, "COMMIT"))
-        execute(std::shared_ptr<Command>(new CmdCommit()));
-    else if(isPrefix(inCmd, "END"))
-        execute(std::shared_ptr<Command>(new CmdEnd()));
+    if(negative)
+        value = -value;
+    return true;
 }
 
-void Reader::execute(std::shared_ptr<Command> cmd)
+// The first string above every string that starts with prefix, or an empty string if there is none.
+static std::string prefixEnd(std::string_view prefix)
 {
-    if(cmd->name() == Command::CMD_SET || cmd->name() == Command::CMD_UNSET)
+    std::string end(prefix);
+    while(!end.empty() && (unsigned char)end.back() == 0xFF)
+        end.pop_back();
+    if(!end.empty())
+        end.back()++;
+    return end;
+}
+
+int Reader::run(std::string_view inCmd)
+{
+    Parser::parse(inCmd, this->parsed);
+    return run(this->parsed);
+}
+
+int Reader::run(const ParsedCommand& inCmd)
+{
+    static const std::string_view none;
+    const std::string_view& first = inCmd.args.size() > 0 ? inCmd.args[0] : none;
+    switch(inCmd.name)
     {
-        cmd->execute(db);
-        if(!this->tranStk.empty())
+        case Command::CMD_SET:
+            if(inCmd.args.size() < 2 || inCmd.args[1].empty())
+                return invalid("ERR wrong number of arguments for 'SET'");
+            if(inCmd.args.size() >= 3 && (inCmd.args[2] == "EX" || inCmd.args[2] == "PX"))
+            {
+                // SET key value EX seconds | PX milliseconds; other trailing words are ignored as before.
+                long long ttl = 0;
+                long long scale = inCmd.args[2] == "EX" ? 1000 : 1;
+                if(inCmd.args.size() < 4 || !parseInteger(inCmd.args[3], ttl) || ttl <= 0 || ttl > MAX_TTL_MS / scale)
+                    return invalid("ERR invalid expire time in 'SET'");
+                this->setCmd.assign(first, inCmd.args[1], ttl * scale, scale != 1);
+            }
+            else
+                this->setCmd.assign(first, inCmd.args[1]);
+            execute(this->setCmd);
+            break;
+        case Command::CMD_UNSET:
+            this->unsetCmd.assign(first);
+            execute(this->unsetCmd);
+            break;
+        case Command::CMD_GET:
+            this->getCmd.assign(first);
+            execute(this->getCmd);
+            break;
+        case Command::CMD_NUMEQUALTO:
+            if(inCmd.args.size() > 1)
+            {
+                this->numEqualToManyCmd.assign(inCmd.args);
+                execute(this->numEqualToManyCmd);
+                break;
+            }
+            this->numEqualToCmd.assign(first);
+            execute(this->numEqualToCmd);
+            break;
+        case Command::CMD_MSET:
+            if(inCmd.args.empty() || inCmd.args.size() % 2 != 0)
+                return invalid("ERR wrong number of arguments for 'MSET'");
+            for(size_t i = 1; i < inCmd.args.size(); i += 2)
+            {
+                if(inCmd.args[i].empty())
+                    return invalid("ERR wrong number of arguments for 'MSET'");
+            }
+            this->msetCmd.assign(inCmd.args);
+            execute(this->msetCmd);
+            break;
+        case Command::CMD_MUNSET:
+            if(inCmd.args.empty())
+                return invalid("ERR wrong number of arguments for 'MUNSET'");
+            this->munsetCmd.assign(inCmd.args);
+            execute(this->munsetCmd);
+            break;
+        case Command::CMD_MGET:
+            if(inCmd.args.empty())
+                return invalid("ERR wrong number of arguments for 'MGET'");
+            this->mgetCmd.assign(inCmd.args);
+            execute(this->mgetCmd);
+            break;
+        case Command::CMD_EXPIRE:
         {
-            std::shared_ptr<Transaction> tran = this->tranStk.top();
-            tran->record(cmd);
+            long long seconds = 0;
+            if(inCmd.args.size() < 2)
+                return invalid("ERR wrong number of arguments for 'EXPIRE'");
+            if(!parseInteger(inCmd.args[1], seconds) || seconds > MAX_TTL_MS / 1000)
+                return invalid("ERR value is not an integer or out of range");
+            this->expireCmd.assign(first, seconds);
+            execute(this->expireCmd);
+            break;
         }
-        return;
-    }
-    else if(cmd->name() == Command::CMD_GET || cmd->name() == Command::CMD_NUMEQUALTO)
-    {
-        cmd->execute(db);
-        return;
-    }
-    else if(cmd->name() == Command::CMD_BEGIN)
-    {
-        cmd->execute(db);
-        std::shared_ptr<Transaction> tran(new Transaction(db));
-        this->tranStk.push(tran);
-        return;
-    }
-    else if(cmd->name() == Command::CMD_ROLLBACK)
-    {
-        cmd->execute(db);
-        if(this->tranStk.empty())
-            Printer::getInstance().print("> NO TRANSACTION");
-        else
+        case Command::CMD_TTL:
+            this->ttlCmd.assign(first);
+            execute(this->ttlCmd);
+            break;
+        case Command::CMD_SCAN:
         {
-            std::shared_ptr<Transaction> tran = this->tranStk.top();
-            this->tranStk.pop();
-            tran->rollback();
+            // SCAN [PREFIX prefix | RANGE from below] [FROM cursor] [COUNT n]
+            std::string_view from, cursor;
+            std::string to;
+            long long count = DEFAULT_SCAN_COUNT;
+            for(size_t i = 0; i < inCmd.args.size(); i += 2)
+            {
+                std::string_view option = inCmd.args[i];
+                if(i + 1 == inCmd.args.size())
+                    return invalid("ERR syntax error");
+                if(option == "PREFIX")
+                {
+                    from = inCmd.args[i + 1];
+                    to = prefixEnd(from);
+                }
+                else if(option == "RANGE" && i + 2 < inCmd.args.size())
+                {
+                    from = inCmd.args[i + 1];
+                    to.assign(inCmd.args[i + 2]);
+                    i++;
+                }
+                else if(option == "FROM")
+                    cursor = inCmd.args[i + 1];
+                else if(option == "COUNT")
+                {
+                    if(!parseInteger(inCmd.args[i + 1], count) || count <= 0)
+                        return invalid("ERR value is not an integer or out of range");
+                }
+                else
+                    return invalid("ERR syntax error");
+            }
+            this->scanCmd.assign(std::max(from, cursor), to, (size_t)count);
+            execute(this->scanCmd);
+            break;
         }
-        return;
-    }
-    else if(cmd->name() == Command::CMD_COMMIT)
-    {
-        cmd->execute(db);
-        if(this->tranStk.empty())
-            Printer::getInstance().print("> NO TRANSACTION");
-        while(!this->tranStk.empty())
-            this->tranStk.pop();
-        return;
-    }
-    else if(cmd->name() == Command::CMD_END)
-    {
-        cmd->execute(db);
-        return;
+        case Command::CMD_INCRBY:
+        case Command::CMD_DECRBY:
+        {
+            int64_t amount = 0;
+            bool decrement = inCmd.name == Command::CMD_DECRBY;
+            if(inCmd.args.size() < 2)
+                return invalid(decrement ? "ERR wrong number of arguments for 'DECRBY'"
+                                         : "ERR wrong number of arguments for 'INCRBY'");
+            if(!ValuePool::parseNumber(inCmd.args[1], amount))
+                return invalid("ERR value is not an integer or out of range");
+            if(decrement && amount == INT64_MIN)
+                return invalid("ERR decrement would overflow");
+            CmdIncrBy& cmd = decrement ? this->decrByCmd : this->incrByCmd;
+            cmd.assign(first, amount);
+            execute(cmd);
+            break;
+        }
+        case Command::CMD_NUMBETWEEN:
+        {
+            int64_t low = 0, high = 0;
+            if(inCmd.args.size() < 2)
+                return invalid("ERR wrong number of arguments for 'NUMBETWEEN'");
+            if(!ValuePool::parseNumber(inCmd.args[0], low) || !ValuePool::parseNumber(inCmd.args[1], high))
+                return invalid("ERR value is not an integer or out of range");
+            this->numBetweenCmd.assign(low, high);
+            execute(this->numBetweenCmd);
+            break;
+        }
+        case Command::CMD_EVAL:
+            if(inCmd.args.empty() || first == "ARGS")
+                return invalid("ERR wrong number of arguments for 'EVAL'");
+            this->evalCmd.assign(inCmd.args);
+            execute(this->evalCmd);
+            break;
+        case Command::CMD_BEGIN:
+            execute(this->beginCmd);
+            break;
+        case Command::CMD_ROLLBACK:
+            execute(this->rollbackCmd);
+            break;
+        case Command::CMD_COMMIT:
+            execute(this->commitCmd);
+            break;
+        case Command::CMD_SAVE:
+            execute(this->saveCmd);
+            break;
+        case Command::CMD_BGSAVE:
+            execute(this->bgsaveCmd);
+            break;
+        case Command::CMD_INFO:
+            this->infoCmd.assign(first);
+            execute(this->infoCmd);
+            break;
+        case Command::CMD_END:
+            execute(this->endCmd);
+            break;
+        default:
+            // The text protocol ignores unknown lines; a network client still needs its one reply.
+            if(Printer::getInstance().getProtocol() == Printer::PROTOCOL_RESP)
+                Printer::getInstance().replyError("ERR unknown command");
+            break;
     }
-    
+    return inCmd.name;
+}
+
+void Reader::reset()
+{
+    while(this->engine->rollback()) {}
+}
+
+void Reader::execute(Command& cmd)
+{
+    Stats& stats = Stats::getInstance();
+    uint64_t start = Stats::ticks();
+    cmd.execute(*this->engine);
+    uint64_t end = Stats::ticks();
+    uint64_t ticks = end > start ? end - start : 0; // The thread may have moved to another CPU.
+    stats.record(cmd.name(), ticks);
+    if(stats.mayBeSlow(ticks))
+        stats.logSlow(ticks, cmd.toString());
 }
 
-bool Reader::isPrefix(const std::string &haystack, const std::string &needle)
+int Reader::invalid(const char* message)
 {
-    return haystack.substr(0, needle.size()) == needle;
+    if(Printer::getInstance().getProtocol() == Printer::PROTOCOL_RESP)
+        Printer::getInstance().replyError(message);
+    return Command::CMD_INVALID;
 }
@@ -3,33 +3,66 @@
 
 #include "Command.hpp"
 #include "Database.hpp"
-#include "Transaction.hpp"
+#include "Parser.hpp"
+#include "Engine.hpp"
 #include "Printer.hpp"
-#include <stack>
-#include <sstream>
+#include "Snapshot.hpp"
+#include <memory>
+#include <string_view>
 
 /**
  * This class provides an API, run(), for the database users. It reads a line of command, parses it, and call
  * a private method, execute(), to handle operation required by the input command on the in-memory database.
- * To satisfy the rollback operation of transaction, a FILO stack is used to store all pending transaction that
- * are initiated after the most recent Commit() operation. When a Rollback() command is initiated by user, the
- * most recent transaction, which is on the top of the stack, will be popped from the stack and rollbacked. When
- * a Commit() operation is initiated by user, all transactions in the stack will be popped, without any impact on
- * the underlying in-memory database.
+ * To satisfy the rollback operation of transaction, the Reader owns an Engine that keeps all pending transaction
+ * blocks that are initiated after the most recent Commit() operation, either as an undo log (Engine::ENGINE_UNDO)
+ * or as overlays of buffered writes (Engine::ENGINE_OVERLAY). When a Rollback() command is initiated by user, the
+ * most recent block is undone and closed. When a Commit() operation is initiated by user, all blocks are closed and
+ * their changes are kept in the underlying in-memory database.
+ * The Reader owns one command object per command type and refills it for every line, so parsing and executing a
+ * command does not touch the heap. A Reader is one session: the server keeps one per client connection.
+ * execute() times every command for the statistics reported by INFO (see Stats).
  */
 class Reader
 {
 public:
-    Reader(std::shared_ptr<Database> inDb);
+    Reader(std::shared_ptr<Database> inDb, int engineType = Engine::ENGINE_UNDO);
+    // A session on an existing engine, e.g. of a ShardedDatabase. SAVE and BGSAVE write to snapshot, if given.
+    Reader(std::shared_ptr<Engine> inEngine, std::shared_ptr<Snapshot> inSnapshot = nullptr);
     
-    void run(std::string& inCmd);
+    int run(std::string_view inCmd); // Parse and execute one line, return the command name (Command::CMD_*).
+    int run(const ParsedCommand& inCmd); // Execute an already parsed command, return its name.
+    void reset(); // Roll back all open transaction blocks, e.g. when the client of a session disconnects.
     
 private:
-    std::shared_ptr<Database> db;
-    std::stack<std::shared_ptr<Transaction> > tranStk;
+    std::shared_ptr<Engine> engine;
+    std::shared_ptr<Snapshot> snapshot;
     
-    void execute(std::shared_ptr<Command> cmd);
-    bool isPrefix(const std::string& haystack, const std::string& needle);
+    ParsedCommand parsed; // Reused for every line.
+    CmdSet setCmd;
+    CmdUnset unsetCmd;
+    CmdGet getCmd;
+    CmdNumEqualTo numEqualToCmd;
+    CmdNumEqualToMany numEqualToManyCmd;
+    CmdMSet msetCmd;
+    CmdMUnset munsetCmd;
+    CmdMGet mgetCmd;
+    CmdExpire expireCmd;
+    CmdTtl ttlCmd;
+    CmdScan scanCmd;
+    CmdIncrBy incrByCmd;
+    CmdIncrBy decrByCmd;
+    CmdNumBetween numBetweenCmd;
+    CmdEval evalCmd;
+    CmdBegin beginCmd;
+    CmdRollback rollbackCmd;
+    CmdCommit commitCmd;
+    CmdSave saveCmd;
+    CmdSave bgsaveCmd;
+    CmdInfo infoCmd;
+    CmdEnd endCmd;
+    
+    void execute(Command& cmd);
+    int invalid(const char* message); // Reply a RESP error for a malformed command.
 };
 
 #endif /* Reader_hpp */
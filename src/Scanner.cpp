@@ -0,0 +1,221 @@
+#include "Scanner.hpp"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCANNER_X86 1
+#endif
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+// Collects tokens from the whitespace masks of consecutive blocks of a line.
+class TokenMasks
+{
+public:
+    TokenMasks(std::string_view inLine, std::vector<std::string_view>& inTokens): line(inLine), tokens(inTokens),
+        start(0), inToken(false) {}
+
+    // Bit i of space is set if byte offset + i is whitespace; width is at most 64.
+    void block(size_t offset, uint64_t space, size_t width)
+    {
+        uint64_t all = width == 64 ? ~0ULL : (1ULL << width) - 1;
+        uint64_t word = ~space & all;
+        uint64_t edges = (word ^ ((word << 1) | (this->inToken ? 1 : 0))) & all;
+        while(edges != 0)
+        {
+            size_t pos = offset + __builtin_ctzll(edges);
+            if(this->inToken)
+                this->tokens.push_back(this->line.substr(this->start, pos - this->start));
+            else
+                this->start = pos;
+            this->inToken = !this->inToken;
+            edges &= edges - 1;
+        }
+    }
+
+    void finish()
+    {
+        if(this->inToken)
+            this->tokens.push_back(this->line.substr(this->start));
+    }
+
+private:
+    std::string_view line;
+    std::vector<std::string_view>& tokens;
+    size_t start; // Start of the current token.
+    bool inToken;
+};
+
+static const char* scalarFindNewline(const char* begin, const char* end)
+{
+    while(begin < end && *begin != '\n')
+        begin++;
+    return begin;
+}
+
+static void scalarSplit(std::string_view line, std::vector<std::string_view>& tokens)
+{
+    size_t pos = 0;
+    while(true)
+    {
+        while(pos < line.size() && isSpace(line[pos]))
+            pos++;
+        if(pos == line.size())
+            return;
+        size_t start = pos;
+        while(pos < line.size() && !isSpace(line[pos]))
+            pos++;
+        tokens.push_back(line.substr(start, pos - start));
+    }
+}
+
+#if defined(SCANNER_X86) && defined(__SSE2__)
+
+// ' ' or one of '\t' to '\r' (9 to 13). Bytes above 127 compare as negative, so they are never whitespace.
+static inline uint64_t sse2Space(const char* p)
+{
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i space = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    __m128i control = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(8)), _mm_cmplt_epi8(bytes, _mm_set1_epi8(14)));
+    return (uint32_t)_mm_movemask_epi8(_mm_or_si128(space, control));
+}
+
+static const char* sse2FindNewline(const char* begin, const char* end)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    for(; end - begin >= 32; begin += 32)
+    {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin)), newline);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + 16)), newline);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(a) | ((uint32_t)_mm_movemask_epi8(b) << 16);
+        if(mask != 0)
+            return begin + __builtin_ctz(mask);
+    }
+    for(; end - begin >= 16; begin += 16)
+    {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin)), newline);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(a);
+        if(mask != 0)
+            return begin + __builtin_ctz(mask);
+    }
+    return scalarFindNewline(begin, end);
+}
+
+static void sse2Split(std::string_view line, std::vector<std::string_view>& tokens)
+{
+    TokenMasks masks(line, tokens);
+    const char* p = line.data();
+    size_t i = 0;
+    for(; i + 16 <= line.size(); i += 16)
+        masks.block(i, sse2Space(p + i), 16);
+    if(i < line.size())
+    {
+        char tail[16];
+        std::memset(tail, ' ', sizeof(tail));
+        std::memcpy(tail, p + i, line.size() - i);
+        masks.block(i, sse2Space(tail), 16);
+    }
+    masks.finish();
+}
+
+__attribute__((target("avx2"))) static inline uint64_t avx2Space(const char* p)
+{
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i space = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+    __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(8)),
+                                       _mm256_cmpgt_epi8(_mm256_set1_epi8(14), bytes));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(space, control));
+}
+
+__attribute__((target("avx2"))) static const char* avx2FindNewline(const char* begin, const char* end)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    for(; end - begin >= 64; begin += 64)
+    {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin)), newline);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin + 32)), newline);
+        if(!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b)))
+        {
+            uint64_t mask = (uint32_t)_mm256_movemask_epi8(a) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(b) << 32);
+            return begin + __builtin_ctzll(mask);
+        }
+    }
+    for(; end - begin >= 32; begin += 32)
+    {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin)), newline);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(a);
+        if(mask != 0)
+            return begin + __builtin_ctz(mask);
+    }
+    return sse2FindNewline(begin, end);
+}
+
+__attribute__((target("avx2"))) static void avx2Split(std::string_view line, std::vector<std::string_view>& tokens)
+{
+    TokenMasks masks(line, tokens);
+    const char* p = line.data();
+    size_t i = 0;
+    for(; i + 64 <= line.size(); i += 64)
+        masks.block(i, avx2Space(p + i) | (avx2Space(p + i + 32) << 32), 64);
+    for(; i + 32 <= line.size(); i += 32)
+        masks.block(i, avx2Space(p + i), 32);
+    if(i < line.size())
+    {
+        char tail[32];
+        std::memset(tail, ' ', sizeof(tail));
+        std::memcpy(tail, p + i, line.size() - i);
+        masks.block(i, avx2Space(tail), 32);
+    }
+    masks.finish();
+}
+
+#endif
+
+Scanner::Functions Scanner::current = {SCANNER_SCALAR, scalarFindNewline, scalarSplit};
+
+static const bool selected = Scanner::setLevel(Scanner::bestLevel());
+
+int Scanner::bestLevel()
+{
+#if defined(SCANNER_X86) && defined(__SSE2__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? SCANNER_AVX2 : SCANNER_SSE2;
+#else
+    return SCANNER_SCALAR;
+#endif
+}
+
+bool Scanner::setLevel(int level)
+{
+    if(level < SCANNER_SCALAR || level > bestLevel())
+        return false;
+    switch(level)
+    {
+#if defined(SCANNER_X86) && defined(__SSE2__)
+        case SCANNER_AVX2:
+            current = Functions{level, avx2FindNewline, avx2Split};
+            break;
+        case SCANNER_SSE2:
+            current = Functions{level, sse2FindNewline, sse2Split};
+            break;
+#endif
+        default:
+            current = Functions{SCANNER_SCALAR, scalarFindNewline, scalarSplit};
+            break;
+    }
+    return true;
+}
+
+const char* Scanner::levelName(int level)
+{
+    switch(level)
+    {
+        case SCANNER_SSE2: return "sse2";
+        case SCANNER_AVX2: return "avx2";
+    }
+    return "scalar";
+}
@@ -0,0 +1,50 @@
+#ifndef Scanner_hpp
+#define Scanner_hpp
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+/**
+ * This class finds line and token boundaries in the command input with vector instructions. A block of 16 (SSE2) or
+ * 32 (AVX2) bytes is compared against the newline, or against the whitespace characters, in a few instructions and
+ * turned into a bit mask with one bit per byte; the boundaries are then read off the mask with count-trailing-zeros,
+ * so the cost is per block instead of per byte. The last partial block of a range is copied into a padded buffer
+ * rather than read past the end, since a line can end at the end of a mapped file.
+ * The implementation is chosen once at startup from what the CPU supports: AVX2 if present, SSE2 on any x86-64, and
+ * a portable byte-at-a-time loop elsewhere. All of them give the same results; setLevel() selects another one for
+ * benchmarks and comparisons, and must not be called while other threads are scanning.
+ * Whitespace is ' ', '\t', '\n', '\v', '\f' and '\r', as for Parser::nextToken().
+ */
+class Scanner
+{
+public:
+    enum
+    {
+        SCANNER_SCALAR,
+        SCANNER_SSE2,
+        SCANNER_AVX2
+    };
+
+    // The first '\n' in [begin, end), or end.
+    static const char* findNewline(const char* begin, const char* end) {return current.findNewline(begin, end);}
+    // Append the whitespace-separated tokens of line to tokens.
+    static void split(std::string_view line, std::vector<std::string_view>& tokens) {current.split(line, tokens);}
+
+    static int level() {return current.level;}
+    static int bestLevel(); // The fastest level the CPU supports.
+    static bool setLevel(int level); // Return false if the CPU does not support it.
+    static const char* levelName(int level);
+
+private:
+    struct Functions
+    {
+        int level;
+        const char* (*findNewline)(const char* begin, const char* end);
+        void (*split)(std::string_view line, std::vector<std::string_view>& tokens);
+    };
+
+    static Functions current; // Selected at startup.
+};
+
+#endif /* Scanner_hpp */
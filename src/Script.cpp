@@ -0,0 +1,408 @@
+#include "Script.hpp"
+#include "FlatMap.hpp"
+#include "ValuePool.hpp"
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+/**
+ * This class compiles the source of a Script, one statement at a time, into its instructions.
+ */
+class ScriptCompiler
+{
+public:
+    ScriptCompiler(Script& inScript, std::string& inError): script(inScript), error(inError) {}
+
+    bool compile(std::string_view source);
+
+private:
+    static const Script::Operand NONE = Script::NIL << Script::KIND_SHIFT; // An unused operand.
+
+    Script& script;
+    std::string& error;
+    // Names of the variables, in the source, to their numbers.
+    FlatMap<std::string_view, uint32_t, std::hash<std::string_view>, std::equal_to<std::string_view> > variables;
+    std::vector<size_t> blocks; // The open IFs: the index of their comparison, or of the JUMP of their ELSE.
+    std::vector<bool> elses; // Whether each open IF has had its ELSE.
+
+    struct Syntax
+    {
+        const char* name;
+        uint8_t op;
+        size_t operands;
+        bool value; // Whether it has a value to assign.
+    };
+    static const Syntax COMMANDS[];
+
+    static bool isCommand(std::string_view word);
+    bool statement(const std::vector<std::string_view>& words);
+    bool command(const std::vector<std::string_view>& words, size_t first, uint8_t target);
+    bool operand(std::string_view word, Script::Operand& o);
+    bool variable(std::string_view word, uint8_t& number);
+    bool fail(const std::string& message) {error = "ERR script: " + message; return false;}
+    void emit(uint8_t op, uint8_t target, Script::Operand a, Script::Operand b)
+    {
+        script.code.push_back(Script::Instruction{op, target, 0, a, b});
+    }
+};
+
+const ScriptCompiler::Syntax ScriptCompiler::COMMANDS[] = {
+    {"SET", Script::OP_SET, 2, false},
+    {"UNSET", Script::OP_UNSET, 1, false},
+    {"GET", Script::OP_GET, 1, true},
+    {"INCRBY", Script::OP_INCRBY, 2, true},
+    {"DECRBY", Script::OP_DECRBY, 2, true},
+    {"NUMEQUALTO", Script::OP_NUMEQUALTO, 1, true},
+    {"NUMBETWEEN", Script::OP_NUMBETWEEN, 2, true}
+};
+
+bool ScriptCompiler::compile(std::string_view source)
+{
+    std::vector<std::string_view> words;
+    size_t i = 0;
+    while(i <= source.size())
+    {
+        // Split a statement into words on spaces and tabs; ';' or the end of the source ends it.
+        while(i < source.size() && (source[i] == ' ' || source[i] == '\t'))
+            i++;
+        if(i == source.size() || source[i] == ';')
+        {
+            if(!words.empty() && !statement(words))
+                return false;
+            words.clear();
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while(i < source.size() && source[i] != ' ' && source[i] != '\t' && source[i] != ';')
+            i++;
+        words.push_back(source.substr(start, i - start));
+    }
+    if(!blocks.empty())
+        return fail("IF without END");
+    if(script.code.size() >= Script::MAX_INSTRUCTIONS)
+        return fail("too long");
+    return true;
+}
+
+bool ScriptCompiler::statement(const std::vector<std::string_view>& words)
+{
+    std::string_view word = words[0];
+    if(word == "IF")
+    {
+        static const char* const OPERATORS[] = {"==", "!=", "<", "<=", ">", ">="};
+        if(words.size() != 4)
+            return fail("IF needs two operands and an operator");
+        uint8_t op = Script::OP_RETURN;
+        for(size_t i = 0; i < 6; i++)
+        {
+            if(words[2] == OPERATORS[i])
+                op = (uint8_t)(Script::OP_EQ + i);
+        }
+        Script::Operand a, b;
+        if(op == Script::OP_RETURN)
+            return fail("unknown operator " + std::string(words[2]));
+        if(!operand(words[1], a) || !operand(words[3], b))
+            return false;
+        blocks.push_back(script.code.size());
+        elses.push_back(false);
+        emit(op, Script::NO_TARGET, a, b);
+        return true;
+    }
+    if(word == "ELSE" || word == "END")
+    {
+        if(words.size() != 1)
+            return fail(std::string(word) + " takes no operand");
+        if(blocks.empty())
+            return fail(std::string(word) + " without IF");
+        if(word == "ELSE")
+        {
+            if(elses.back())
+                return fail("ELSE twice in an IF");
+            // The block before ELSE jumps past END; the comparison jumps here when it does not hold.
+            emit(Script::OP_JUMP, Script::NO_TARGET, NONE, NONE);
+            script.code[blocks.back()].jump = (uint16_t)script.code.size();
+            blocks.back() = script.code.size() - 1;
+            elses.back() = true;
+            return true;
+        }
+        script.code[blocks.back()].jump = (uint16_t)script.code.size();
+        blocks.pop_back();
+        elses.pop_back();
+        return true;
+    }
+    if(word == "RETURN")
+    {
+        Script::Operand a;
+        if(words.size() != 2)
+            return fail("RETURN needs one operand");
+        if(!operand(words[1], a))
+            return false;
+        emit(Script::OP_RETURN, Script::NO_TARGET, a, NONE);
+        return true;
+    }
+    if(word[0] == '@')
+    {
+        uint8_t target;
+        if(words.size() < 3 || words[1] != "=")
+            return fail("expected " + std::string(word) + " = ...");
+        if(!variable(word, target))
+            return false;
+        if(words.size() == 3 && !isCommand(words[2]))
+        {
+            Script::Operand a;
+            if(!operand(words[2], a))
+                return false;
+            emit(Script::OP_ASSIGN, target, a, NONE);
+            return true;
+        }
+        return command(words, 2, target);
+    }
+    return command(words, 0, Script::NO_TARGET);
+}
+
+bool ScriptCompiler::isCommand(std::string_view word)
+{
+    for(const Syntax& syntax: COMMANDS)
+    {
+        if(word == syntax.name)
+            return true;
+    }
+    return false;
+}
+
+bool ScriptCompiler::command(const std::vector<std::string_view>& words, size_t first, uint8_t target)
+{
+    for(const Syntax& syntax: COMMANDS)
+    {
+        if(words[first] != syntax.name)
+            continue;
+        if(words.size() - first - 1 != syntax.operands)
+            return fail(std::string(syntax.name) + " needs " + std::to_string(syntax.operands) + " operand" +
+                        (syntax.operands == 1 ? "" : "s"));
+        if(target != Script::NO_TARGET && !syntax.value)
+            return fail(std::string(syntax.name) + " has no value to assign");
+        Script::Operand a, b = NONE;
+        if(!operand(words[first + 1], a) || (syntax.operands == 2 && !operand(words[first + 2], b)))
+            return false;
+        emit(syntax.op, target, a, b);
+        return true;
+    }
+    return fail("unknown command " + std::string(words[first]));
+}
+
+bool ScriptCompiler::operand(std::string_view word, Script::Operand& o)
+{
+    if(word == "NULL")
+    {
+        o = NONE;
+        return true;
+    }
+    if(word[0] == '@')
+    {
+        uint8_t number;
+        if(!variable(word, number))
+            return false;
+        o = Script::VARIABLE << Script::KIND_SHIFT | number;
+        return true;
+    }
+    if(word[0] == '$')
+    {
+        uint32_t n = 0;
+        for(size_t i = 1; i < word.size(); i++)
+        {
+            if(word[i] < '0' || word[i] > '9' || n > Script::INDEX_MASK / 10)
+                return fail("bad argument " + std::string(word));
+            n = n * 10 + (word[i] - '0');
+        }
+        if(n == 0 || n > Script::INDEX_MASK)
+            return fail("bad argument " + std::string(word));
+        script.arguments = std::max<size_t>(script.arguments, n);
+        o = Script::ARGUMENT << Script::KIND_SHIFT | (n - 1);
+        return true;
+    }
+    o = Script::CONSTANT << Script::KIND_SHIFT | (uint32_t)script.constants.size();
+    script.constants.emplace_back(word);
+    return true;
+}
+
+bool ScriptCompiler::variable(std::string_view word, uint8_t& number)
+{
+    if(word.size() < 2)
+        return fail("a variable needs a name");
+    std::string_view name = word.substr(1);
+    uint64_t h = variables.hash(name);
+    if(auto found = variables.find(name, h))
+    {
+        number = (uint8_t)found->value;
+        return true;
+    }
+    if(script.variables == Script::MAX_VARIABLES)
+        return fail("too many variables");
+    number = (uint8_t)script.variables++;
+    variables.insert(name, h).first->value = number;
+    return true;
+}
+
+Script* Script::compile(std::string_view source, std::string& error)
+{
+    std::unique_ptr<Script> script(new Script(source));
+    ScriptCompiler compiler(*script, error);
+    // Names and constants are views of the copy of the source held by the script.
+    if(!compiler.compile(script->text))
+        return nullptr;
+    script->registers.resize(script->variables);
+    return script.release();
+}
+
+int Script::run(Engine& engine, const std::vector<std::string_view>& args, std::string_view& value)
+{
+    for(Variable& variable: this->registers)
+    {
+        variable.value.clear();
+        variable.null = true;
+    }
+    engine.begin();
+    int status = execute(engine, args, value);
+    if(status == SCRIPT_ERROR)
+        engine.rollback();
+    else if(!engine.commitBlock())
+        return fail(value, "ERR write conflict, the script was rolled back");
+    return status;
+}
+
+bool Script::operand(Operand o, const std::vector<std::string_view>& args, std::string_view& value) const
+{
+    uint32_t index = o & INDEX_MASK;
+    switch(o >> KIND_SHIFT)
+    {
+        case CONSTANT:
+            value = this->constants[index];
+            return true;
+        case VARIABLE:
+            value = this->registers[index].value;
+            return !this->registers[index].null;
+        case ARGUMENT:
+            value = args[index];
+            return true;
+        default:
+            return false;
+    }
+}
+
+int Script::fail(std::string_view& value, const char* message)
+{
+    this->scratch = message;
+    value = this->scratch;
+    return SCRIPT_ERROR;
+}
+
+void Script::assign(uint8_t target, std::string_view value)
+{
+    if(target == NO_TARGET)
+        return;
+    Variable& variable = this->registers[target];
+    if(value.data() != variable.value.data()) // @a = @a
+        variable.value.assign(value);
+    variable.null = false;
+}
+
+int Script::execute(Engine& engine, const std::vector<std::string_view>& args, std::string_view& value)
+{
+    if(args.size() < this->arguments)
+    {
+        this->scratch = "ERR script: needs " + std::to_string(this->arguments) + " arguments";
+        value = this->scratch;
+        return SCRIPT_ERROR;
+    }
+    char buffer[ValuePool::NUMBER_CHARS];
+    std::string_view a, b;
+    int64_t x, y;
+    int count;
+    for(size_t pc = 0; pc < this->code.size(); )
+    {
+        const Instruction& instruction = this->code[pc++];
+        bool hasA = operand(instruction.a, args, a);
+        bool hasB = operand(instruction.b, args, b);
+        switch(instruction.op)
+        {
+            case OP_SET:
+            case OP_UNSET:
+            case OP_GET:
+            case OP_NUMEQUALTO:
+                if(!hasA || (instruction.op == OP_SET && !hasB))
+                    return fail(value, "ERR script: NULL operand");
+                if(instruction.op == OP_SET)
+                    engine.dbSet(a, b);
+                else if(instruction.op == OP_UNSET)
+                    engine.dbUnset(a);
+                else if(instruction.op == OP_NUMEQUALTO)
+                {
+                    engine.dbNumEqualTo(a, count);
+                    assign(instruction.target, ValuePool::formatNumber(count, buffer));
+                }
+                else if(engine.dbGet(a, this->scratch) == Database::DB_GOOD)
+                    assign(instruction.target, this->scratch);
+                else if(instruction.target != NO_TARGET)
+                    this->registers[instruction.target].null = true;
+                break;
+            case OP_INCRBY:
+            case OP_DECRBY:
+            {
+                if(!hasA || !hasB || !ValuePool::parseNumber(b, y))
+                    return fail(value, "ERR script: the amount is not an integer");
+                if(instruction.op == OP_DECRBY && y == INT64_MIN)
+                    return fail(value, "ERR decrement would overflow");
+                int status = engine.dbIncrBy(a, instruction.op == OP_DECRBY ? -y : y, x);
+                if(status == Database::DB_ERROR)
+                    return fail(value, "ERR INCRBY and DECRBY are not supported by this engine");
+                if(status == Database::DB_NOT_A_NUMBER)
+                    return fail(value, "ERR value is not an integer or out of range");
+                assign(instruction.target, ValuePool::formatNumber(x, buffer));
+                break;
+            }
+            case OP_NUMBETWEEN:
+                if(!hasA || !hasB || !ValuePool::parseNumber(a, x) || !ValuePool::parseNumber(b, y))
+                    return fail(value, "ERR script: NUMBETWEEN needs integers");
+                if(engine.dbNumBetween(x, y, count) == Database::DB_ERROR)
+                    return fail(value, "ERR NUMBETWEEN is not supported by this engine");
+                assign(instruction.target, ValuePool::formatNumber(count, buffer));
+                break;
+            case OP_ASSIGN:
+                if(hasA)
+                    assign(instruction.target, a);
+                else
+                    this->registers[instruction.target].null = true;
+                break;
+            case OP_EQ:
+            case OP_NE:
+            {
+                // NULL only equals NULL.
+                bool equal = hasA == hasB && (!hasA || a == b);
+                if(equal != (instruction.op == OP_EQ))
+                    pc = instruction.jump;
+                break;
+            }
+            case OP_LT:
+            case OP_LE:
+            case OP_GT:
+            case OP_GE:
+            {
+                if(!hasA || !hasB || !ValuePool::parseNumber(a, x) || !ValuePool::parseNumber(b, y))
+                    return fail(value, "ERR script: <, <=, > and >= need integers");
+                bool holds = instruction.op == OP_LT ? x < y : instruction.op == OP_LE ? x <= y :
+                             instruction.op == OP_GT ? x > y : x >= y;
+                if(!holds)
+                    pc = instruction.jump;
+                break;
+            }
+            case OP_JUMP:
+                pc = instruction.jump;
+                break;
+            case OP_RETURN:
+                value = a;
+                return hasA ? SCRIPT_VALUE : SCRIPT_NULL;
+        }
+    }
+    return SCRIPT_DONE;
+}
@@ -0,0 +1,116 @@
+#ifndef Script_hpp
+#define Script_hpp
+
+#include "Engine.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * This class is a script of commands run by EVAL, compiled once into bytecode and then run by an interpreter loop
+ * against the Engine of a session, so a multi-step rule costs one request and no parsing per step. A script is a
+ * list of statements separated by ';':
+ *   SET k v | UNSET k | GET k | INCRBY k n | DECRBY k n | NUMEQUALTO v | NUMBETWEEN low high
+ *   @var = <one of the commands above that reads a value: GET, INCRBY, DECRBY, NUMEQUALTO or NUMBETWEEN>
+ *   @var = operand
+ *   IF operand <op> operand | ELSE | END      where <op> is == or != on strings, or <, <=, > or >= on integers
+ *   RETURN operand
+ * An operand is a literal word, a variable (@name, NULL until assigned; GET of a missing key assigns NULL), an
+ * argument of the EVAL ($1 for the first one), or NULL. Words are separated by spaces, and ';' ends a statement
+ * wherever it appears, so values with spaces or ';' are passed as arguments.
+ * The bytecode is a flat array of fixed-size instructions whose operands are indexes, tagged by kind, into the
+ * constants, the variables or the arguments, so the interpreter never looks at a name. An IF compiles to a
+ * comparison that jumps past its block when it does not hold, and ELSE to a jump past the END. There are no loops,
+ * so a script runs at most as many instructions as it has.
+ * A script runs in a transaction block of its own: if a command fails, e.g. INCRBY of a value that is not an
+ * integer, the block is rolled back and the script has made no change; otherwise it is closed into the block of
+ * the session, if one is open, or committed. A script is therefore as isolated as a block of the session's engine.
+ */
+class Script
+{
+public:
+    enum
+    {
+        SCRIPT_DONE, // The script ended without RETURN.
+        SCRIPT_VALUE, // It returned a value.
+        SCRIPT_NULL, // It returned NULL.
+        SCRIPT_ERROR // A command failed and the script was rolled back.
+    };
+    
+    // Compile source. Return nullptr, with the reason in error, if it is not a valid script.
+    static Script* compile(std::string_view source, std::string& error);
+
+    // Run the script with its arguments and return SCRIPT_*, with value set to the returned value, or to the error
+    // message; it is valid until the next run.
+    int run(Engine& engine, const std::vector<std::string_view>& args, std::string_view& value);
+
+    std::string_view source() const {return text;}
+    size_t size() const {return code.size();} // Number of instructions.
+
+private:
+    Script(std::string_view inSource): text(inSource), variables(0), arguments(0) {}
+    Script(const Script& script);
+    Script& operator=(const Script& script);
+
+    enum
+    {
+        OP_SET,
+        OP_UNSET,
+        OP_GET,
+        OP_INCRBY,
+        OP_DECRBY,
+        OP_NUMEQUALTO,
+        OP_NUMBETWEEN,
+        OP_ASSIGN,
+        OP_EQ, // The comparisons jump when they do not hold.
+        OP_NE,
+        OP_LT,
+        OP_LE,
+        OP_GT,
+        OP_GE,
+        OP_JUMP,
+        OP_RETURN
+    };
+
+    // An operand: its kind in the top two bits, an index into the constants, variables or arguments below.
+    typedef uint32_t Operand;
+    static const uint32_t KIND_SHIFT = 30;
+    static const uint32_t CONSTANT = 0, VARIABLE = 1, ARGUMENT = 2, NIL = 3;
+    static const uint32_t INDEX_MASK = (1U << KIND_SHIFT) - 1;
+    static const uint8_t NO_TARGET = UINT8_MAX;
+    static const size_t MAX_VARIABLES = NO_TARGET; // Variables are numbered by a byte.
+    static const size_t MAX_INSTRUCTIONS = UINT16_MAX; // Jumps are 16-bit.
+
+    struct Instruction
+    {
+        uint8_t op;
+        uint8_t target; // The variable set by the instruction, or NO_TARGET.
+        uint16_t jump; // Where a comparison that does not hold, or a JUMP, continues.
+        Operand a;
+        Operand b;
+    };
+
+    struct Variable
+    {
+        std::string value;
+        bool null;
+    };
+
+    std::string text;
+    std::vector<Instruction> code;
+    std::vector<std::string> constants;
+    size_t variables;
+    size_t arguments; // The highest $n of the script.
+    std::vector<Variable> registers; // The variables while the script runs.
+    std::string scratch; // Values read into no variable, and error messages.
+
+    bool operand(Operand o, const std::vector<std::string_view>& args, std::string_view& value) const; // False if NULL.
+    int execute(Engine& engine, const std::vector<std::string_view>& args, std::string_view& value);
+    int fail(std::string_view& value, const char* message); // Set value to the error message, return SCRIPT_ERROR.
+    void assign(uint8_t target, std::string_view value); // Set a variable, or the scratch value.
+
+    friend class ScriptCompiler;
+};
+
+#endif /* Script_hpp */
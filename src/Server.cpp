@@ -0,0 +1,344 @@
+#include "Server.hpp"
+#include "Command.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+Server::Connection::Connection(Worker& inWorker, std::shared_ptr<Engine> engine, std::shared_ptr<Snapshot> snapshot,
+    int inFd): worker(inWorker), fd(inFd), input(SERVER_READ_SIZE), inputUsed(0), printer(Printer::PROTOCOL_RESP),
+    reader(engine, snapshot), events(0), closing(false) {}
+
+Server::Server(std::shared_ptr<Database> inDb, int inEngineType)
+{
+    this->newEngine = [inDb, inEngineType]() {return Engine::create(inEngineType, inDb);};
+    init(1);
+}
+
+Server::Server(std::function<std::shared_ptr<Engine>()> inNewEngine, size_t threads,
+               std::shared_ptr<Snapshot> inSnapshot): newEngine(inNewEngine), snapshot(inSnapshot)
+{
+    init(threads);
+}
+
+void Server::init(size_t threads)
+{
+    this->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    for(size_t i = 0; i < threads || i == 0; i++)
+    {
+        this->workers.emplace_back(new Worker());
+        Worker& worker = *this->workers.back();
+        worker.epollFd = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = this->wakeFd;
+        epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, this->wakeFd, &event);
+    }
+}
+
+Server::~Server()
+{
+    for(auto& worker: this->workers)
+    {
+        for(auto& conn: worker->connections)
+            if(conn)
+                close(*conn);
+        ::close(worker->epollFd);
+    }
+    for(int fd: this->listeners)
+        ::close(fd);
+    for(const std::string& path: this->unixPaths)
+        unlink(path.c_str());
+    ::close(this->wakeFd);
+}
+
+int Server::listen(const std::string& address)
+{
+    if(address.compare(0, 5, "unix:") == 0)
+        return listenUnix(address.substr(5));
+    size_t colon = address.rfind(':');
+    if(colon == std::string::npos)
+        return listenTcp("", address);
+    std::string host = address.substr(0, colon);
+    if(host.size() >= 2 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+    return listenTcp(host, address.substr(colon + 1));
+}
+
+int Server::listenTcp(const std::string& host, const std::string& port)
+{
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    struct addrinfo* result = nullptr;
+    if(getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0)
+    {
+        errno = EINVAL;
+        return SERVER_ERROR;
+    }
+
+    int status = SERVER_ERROR;
+    for(struct addrinfo* info = result; info != nullptr && status != SERVER_GOOD; info = info->ai_next)
+    {
+        int fd = socket(info->ai_family, info->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, info->ai_protocol);
+        if(fd < 0)
+            continue;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if(bind(fd, info->ai_addr, info->ai_addrlen) != 0 || ::listen(fd, SOMAXCONN) != 0)
+        {
+            int error = errno;
+            ::close(fd);
+            errno = error;
+            continue;
+        }
+        addListener(fd);
+        status = SERVER_GOOD;
+    }
+    freeaddrinfo(result);
+    return status;
+}
+
+int Server::listenUnix(const std::string& path)
+{
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    if(path.empty() || path.size() >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return SERVER_ERROR;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return SERVER_ERROR;
+    unlink(path.c_str()); // A socket file left behind by a previous run.
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        return SERVER_ERROR;
+    }
+    addListener(fd);
+    this->unixPaths.push_back(path);
+    return SERVER_GOOD;
+}
+
+void Server::addListener(int fd)
+{
+    // EPOLLEXCLUSIVE wakes one of the waiting workers per new connection instead of all of them.
+    uint32_t exclusive = this->workers.size() > 1 ? (uint32_t)EPOLLEXCLUSIVE : 0;
+    for(auto& worker: this->workers)
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN | exclusive;
+        event.data.fd = fd;
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+    this->listeners.push_back(fd);
+}
+
+int Server::run()
+{
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < this->workers.size(); i++)
+        threads.emplace_back([this, i]() {loop(*this->workers[i]);});
+    int status = loop(*this->workers[0]);
+    if(status != SERVER_GOOD)
+        stop();
+    for(std::thread& thread: threads)
+        thread.join();
+    uint64_t value;
+    while(read(this->wakeFd, &value, sizeof(value)) > 0) {}
+    return status;
+}
+
+int Server::loop(Worker& worker)
+{
+    struct epoll_event events[256];
+    while(true)
+    {
+        int count = epoll_wait(worker.epollFd, events, 256, -1);
+        if(count < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return SERVER_ERROR;
+        }
+        for(int i = 0; i < count; i++)
+        {
+            int fd = events[i].data.fd;
+            if(fd == this->wakeFd)
+                return SERVER_GOOD; // Left readable so that every worker sees it.
+            if((size_t)fd >= worker.connections.size() || !worker.connections[fd])
+            {
+                if(std::find(this->listeners.begin(), this->listeners.end(), fd) != this->listeners.end())
+                    accept(worker, fd);
+                continue;
+            }
+            Connection& conn = *worker.connections[fd];
+            if(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                onReadable(conn);
+            else if(events[i].events & EPOLLOUT)
+                onWritable(conn);
+        }
+    }
+}
+
+void Server::stop()
+{
+    uint64_t value = 1;
+    ssize_t written = write(this->wakeFd, &value, sizeof(value));
+    (void)written;
+}
+
+void Server::accept(Worker& worker, int listener)
+{
+    while(true)
+    {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0)
+            return; // EAGAIN once the backlog is empty; on EMFILE and the like, retry on the next event.
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // Fails harmlessly on Unix sockets.
+        if((size_t)fd >= worker.connections.size())
+            worker.connections.resize(fd + 1);
+        worker.connections[fd].reset(new Connection(worker, this->newEngine(), this->snapshot, fd));
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, fd, &event);
+        worker.connections[fd]->events = EPOLLIN;
+    }
+}
+
+void Server::onReadable(Connection& conn)
+{
+    // One read per event: the loop is level-triggered, so a client that keeps sending is served again on the next
+    // round instead of starving the others.
+    if(conn.input.size() - conn.inputUsed < SERVER_READ_SIZE)
+        conn.input.resize(conn.input.size() * 2);
+    ssize_t n = read(conn.fd, conn.input.data() + conn.inputUsed, conn.input.size() - conn.inputUsed);
+    if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return;
+    if(n > 0)
+        conn.inputUsed += n;
+    process(conn);
+    if(n <= 0)
+    {
+        // The client has shut down its side: send the replies still pending, then close.
+        conn.closing = true;
+        conn.inputUsed = 0;
+    }
+    onWritable(conn);
+}
+
+bool Server::process(Connection& conn)
+{
+    size_t pos = 0;
+    Printer::setCurrent(&conn.printer);
+    while(!conn.closing && conn.printer.pending().size() < SERVER_OUTPUT_LIMIT)
+    {
+        size_t consumed = 0;
+        std::string_view buffer(conn.input.data() + pos, conn.inputUsed - pos);
+        int status = Parser::parseRequest(buffer, consumed, conn.parsed);
+        if(status == Parser::REQUEST_INCOMPLETE)
+            break;
+        if(status == Parser::REQUEST_ERROR)
+        {
+            conn.printer.replyError("ERR protocol error");
+            conn.closing = true;
+            break;
+        }
+        pos += consumed;
+        if(conn.reader.run(conn.parsed) == Command::CMD_END)
+            conn.closing = true;
+    }
+    Printer::setCurrent(nullptr);
+
+    if(pos > 0)
+    {
+        std::memmove(conn.input.data(), conn.input.data() + pos, conn.inputUsed - pos);
+        conn.inputUsed -= pos;
+    }
+    if(conn.inputUsed == 0 && conn.input.size() > 16 * SERVER_READ_SIZE)
+        std::vector<char>(SERVER_READ_SIZE).swap(conn.input); // Release the room taken by a large request.
+    return pos > 0 || conn.closing;
+}
+
+void Server::onWritable(Connection& conn)
+{
+    while(true)
+    {
+        std::string_view pending = conn.printer.pending();
+        if(pending.empty())
+        {
+            if(conn.closing)
+            {
+                close(conn);
+                return;
+            }
+            // Requests left in the buffer when the output limit was reached get executed now that the replies are out.
+            if(conn.inputUsed > 0 && process(conn))
+                continue;
+            break;
+        }
+        ssize_t n = send(conn.fd, pending.data(), pending.size(), MSG_NOSIGNAL);
+        if(n > 0)
+        {
+            conn.printer.consume(n);
+            continue;
+        }
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        close(conn);
+        return;
+    }
+
+    size_t pending = conn.printer.pending().size();
+    unsigned events = 0;
+    if(!conn.closing && pending < SERVER_OUTPUT_LIMIT)
+        events |= EPOLLIN;
+    if(pending > 0)
+        events |= EPOLLOUT;
+    watch(conn, events);
+}
+
+void Server::watch(Connection& conn, unsigned events)
+{
+    if(conn.events == events)
+        return;
+    struct epoll_event event;
+    event.events = events;
+    event.data.fd = conn.fd;
+    epoll_ctl(conn.worker.epollFd, EPOLL_CTL_MOD, conn.fd, &event);
+    conn.events = events;
+}
+
+void Server::close(Connection& conn)
+{
+    int fd = conn.fd;
+    Printer::setCurrent(&conn.printer);
+    conn.reader.reset();
+    Printer::setCurrent(nullptr);
+    Worker& worker = conn.worker;
+    epoll_ctl(worker.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    worker.connections[fd].reset();
+}
@@ -0,0 +1,98 @@
+#ifndef Server_hpp
+#define Server_hpp
+
+#include "Database.hpp"
+#include "Engine.hpp"
+#include "Parser.hpp"
+#include "Printer.hpp"
+#include "Reader.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * This class serves many clients over TCP or Unix-domain sockets from epoll event loops. Every connection is a
+ * session of its own: it owns a Reader, and so its own transaction blocks, and a Printer in PROTOCOL_RESP mode that
+ * collects its replies. All sessions share one database. On a Database there is a single loop, which executes the
+ * commands of all sessions one at a time. On a store that synchronizes itself (a ShardedDatabase, a CoreDatabase or
+ * a VersionedDatabase), the sessions' engines come from a factory and there is one loop per worker thread: all
+ * workers wait on the listening sockets, each accepted connection stays with the worker that accepted it, and the
+ * sessions of different workers run in parallel.
+ * Clients may pipeline: everything that arrived with one read is parsed and executed in order, and the replies to
+ * the whole batch are sent with one write. Requests are RESP arrays of length-prefixed bulk strings, so keys and
+ * values may contain any bytes, or inline lines of text (see Parser::parseRequest()).
+ * A connection whose replies are not being read is not read from either once SERVER_OUTPUT_LIMIT bytes are
+ * pending, until the client catches up. END closes the connection after its reply; a client that disconnects with
+ * open transaction blocks has them rolled back.
+ */
+class Server
+{
+public:
+    enum
+    {
+        SERVER_GOOD,
+        SERVER_ERROR
+    };
+
+    Server(std::shared_ptr<Database> inDb, int inEngineType = Engine::ENGINE_UNDO);
+    // The store must be thread-safe. SAVE and BGSAVE of all sessions write to snapshot, if given.
+    Server(std::function<std::shared_ptr<Engine>()> inNewEngine, size_t threads,
+           std::shared_ptr<Snapshot> inSnapshot = nullptr);
+    ~Server();
+
+    int listen(const std::string& address); // Listen on "[host:]port" or "unix:<path>". Sets errno on failure.
+    int run(); // Serve clients on all worker threads until stop() is called.
+    void stop(); // Make run() return. Safe to call from a signal handler or another thread.
+
+private:
+    Server(const Server& server);
+    Server& operator=(const Server& server);
+
+    static const size_t SERVER_READ_SIZE = 64 * 1024; // Minimum free space for one read.
+    static const size_t SERVER_OUTPUT_LIMIT = 16 * 1024 * 1024; // Pending reply bytes that pause reading.
+
+    struct Connection;
+
+    struct Worker
+    {
+        int epollFd;
+        std::vector<std::unique_ptr<Connection> > connections; // Indexed by file descriptor.
+    };
+
+    struct Connection
+    {
+        Connection(Worker& inWorker, std::shared_ptr<Engine> engine, std::shared_ptr<Snapshot> snapshot, int inFd);
+
+        Worker& worker; // The worker whose loop serves the connection.
+        int fd;
+        std::vector<char> input; // Received bytes; the first inputUsed are valid.
+        size_t inputUsed;
+        Printer printer; // Replies not yet sent.
+        Reader reader;
+        ParsedCommand parsed; // Reused for every request.
+        unsigned events; // The epoll events the connection is registered for.
+        bool closing; // Close once the pending replies are sent (after END or a protocol error).
+    };
+
+    std::function<std::shared_ptr<Engine>()> newEngine; // Creates the engine of a new session.
+    std::shared_ptr<Snapshot> snapshot;
+    int wakeFd; // eventfd written by stop().
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::vector<int> listeners;
+    std::vector<std::string> unixPaths; // Socket files to remove on destruction.
+
+    void init(size_t threads);
+    int listenTcp(const std::string& host, const std::string& port);
+    int listenUnix(const std::string& path);
+    void addListener(int fd);
+    int loop(Worker& worker); // Run the event loop of a worker until stop() is called.
+    void accept(Worker& worker, int listener);
+    void onReadable(Connection& conn);
+    bool process(Connection& conn); // Execute the complete requests in the input buffer, return whether any ran.
+    void onWritable(Connection& conn); // Send pending replies, then update the registered events.
+    void watch(Connection& conn, unsigned events);
+    void close(Connection& conn);
+};
+
+#endif /* Server_hpp */
@@ -0,0 +1,143 @@
+#include "ShardedDatabase.hpp"
+#include <algorithm>
+#include <iterator>
+
+ShardedDatabase::ShardedDatabase(size_t inShardCount)
+{
+    for(size_t i = 0; i < inShardCount || i == 0; i++)
+        this->shards.emplace_back(new Shard());
+}
+
+int ShardedDatabase::dbSet(std::string_view key, std::string_view value)
+{
+    Shard& shard = *this->shards[shardOf(key)];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return shard.db.dbSet(key, value);
+}
+
+int ShardedDatabase::dbUnset(std::string_view key)
+{
+    Shard& shard = *this->shards[shardOf(key)];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return shard.db.dbUnset(key);
+}
+
+int ShardedDatabase::dbExpire(std::string_view key, int64_t deadlineMs)
+{
+    Shard& shard = *this->shards[shardOf(key)];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return shard.db.dbExpire(key, deadlineMs);
+}
+
+int ShardedDatabase::dbGet(std::string_view key, std::string& value)
+{
+    Shard& shard = *this->shards[shardOf(key)];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return shard.db.dbGet(key, value);
+}
+
+int ShardedDatabase::dbNumEqualTo(std::string_view value, int& count)
+{
+    count = 0;
+    for(auto& shard: this->shards)
+    {
+        int partial = 0;
+        {
+            std::lock_guard<std::mutex> guard(shard->lock);
+            shard->db.dbNumEqualTo(value, partial);
+        }
+        count += partial;
+    }
+    return count > 0 ? Database::DB_GOOD : Database::DB_NOT_FOUND;
+}
+
+int ShardedDatabase::dbNumBetween(int64_t low, int64_t high, int& count)
+{
+    count = 0;
+    for(auto& shard: this->shards)
+    {
+        int partial = 0;
+        {
+            std::lock_guard<std::mutex> guard(shard->lock);
+            shard->db.dbNumBetween(low, high, partial);
+        }
+        count += partial;
+    }
+    return count > 0 ? Database::DB_GOOD : Database::DB_NOT_FOUND;
+}
+
+int ShardedDatabase::dbScan(std::string_view from, std::string_view to, size_t count, std::vector<std::string>& keys,
+                            std::string& next)
+{
+    std::vector<std::string> found;
+    std::string limit, shardNext; // The smallest key a shard has not listed, empty if every shard listed all.
+    for(auto& shard: this->shards)
+    {
+        {
+            std::lock_guard<std::mutex> guard(shard->lock);
+            if(shard->db.dbScan(from, to, count, found, shardNext) == Database::DB_ERROR)
+                return Database::DB_ERROR;
+        }
+        if(!shardNext.empty() && (limit.empty() || shardNext < limit))
+            limit.swap(shardNext);
+    }
+    std::sort(found.begin(), found.end());
+    size_t n = limit.empty() ? found.size() : std::lower_bound(found.begin(), found.end(), limit) - found.begin();
+    n = std::min(n, count);
+    if(n < found.size() && (limit.empty() || found[n] < limit))
+        next = found[n];
+    else
+        next = limit;
+    keys.insert(keys.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.begin() + n));
+    return Database::DB_GOOD;
+}
+
+void ShardedDatabase::reserve(size_t keys)
+{
+    for(auto& shard: this->shards)
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->db.reserve(keys / this->shards.size() + 1);
+    }
+}
+
+void ShardedDatabase::setMaxMemory(size_t maxBytes, int policy, unsigned samples)
+{
+    size_t part = maxBytes == 0 ? 0 : std::max<size_t>(maxBytes / this->shards.size(), 1);
+    for(auto& shard: this->shards)
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->db.setMaxMemory(part, policy, samples);
+    }
+}
+
+void ShardedDatabase::enableKeyIndex()
+{
+    for(auto& shard: this->shards)
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->db.enableKeyIndex();
+    }
+}
+
+StoreStats ShardedDatabase::stats()
+{
+    StoreStats total = {0, 0, 0, 0, 0, 0, 0, 0};
+    for(auto& shard: this->shards)
+    {
+        StoreStats partial;
+        {
+            std::lock_guard<std::mutex> guard(shard->lock);
+            partial = shard->db.stats();
+        }
+        total.keys += partial.keys;
+        total.values += partial.values;
+        total.memoryBytes += partial.memoryBytes;
+        total.trackedBytes += partial.trackedBytes;
+        total.maxBytes += partial.maxBytes;
+        total.evictedKeys += partial.evictedKeys;
+        total.expiringKeys += partial.expiringKeys;
+        total.expiredKeys += partial.expiredKeys;
+    }
+    return total;
+}
@@ -0,0 +1,68 @@
+#ifndef ShardedDatabase_hpp
+#define ShardedDatabase_hpp
+
+#include "Database.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * This class is the concurrent variant of Database. The keys are partitioned into shards by the high bits of their
+ * hash (the low bits pick the slot inside a shard's table). Each shard is a complete Database, with its own key
+ * table, interned values and valueToCount, and a lock of its own, so sessions running on different threads only
+ * wait for each other when they touch the same shard. A shard's valueToCount is a partial count over its own keys: NUMEQUALTO locks one shard at a time and adds
+ * up the partial counts, without ever holding more than one lock. The sum is therefore exact when no writes run
+ * concurrently, and otherwise reflects each shard at a slightly different moment.
+ * Value ids are local to a shard: an id obtained for a key is only meaningful to the Database of that key's shard,
+ * which is how the session engines use them (see ShardedEngine).
+ * With key indexes, SCAN locks one shard at a time too: each shard lists its next keys of the range in order, and
+ * the lists are merged up to the first key a shard has not listed, so no key is skipped.
+ */
+class ShardedDatabase
+{
+public:
+    static const size_t DEFAULT_SHARDS = 64;
+
+    ShardedDatabase(size_t inShardCount = DEFAULT_SHARDS);
+
+    int dbSet(std::string_view key, std::string_view value);
+    int dbUnset(std::string_view key);
+    int dbExpire(std::string_view key, int64_t deadlineMs);
+    int dbGet(std::string_view key, std::string& value);
+    int dbNumEqualTo(std::string_view value, int& count); // Sum of the partial counts of all shards.
+    int dbNumBetween(int64_t low, int64_t high, int& count); // Likewise.
+    // Merge the next keys of every shard, see Database::dbScan(). Each shard visits at most count keys.
+    int dbScan(std::string_view from, std::string_view to, size_t count, std::vector<std::string>& keys,
+               std::string& next);
+
+    size_t shardCount() const {return shards.size();}
+    size_t shardOf(std::string_view key) const
+    {
+        return (size_t)(((unsigned __int128)ArenaStringHash()(key) * this->shards.size()) >> 64);
+    }
+    Database& shard(size_t index) {return shards[index]->db;}
+    std::mutex& lock(size_t index) {return shards[index]->lock;}
+
+    void reserve(size_t keys); // Size the key tables for an expected total number of keys.
+    // Give each shard an equal part of a memory limit; each evicts its own keys (see Database::setMaxMemory()).
+    void setMaxMemory(size_t maxBytes, int policy, unsigned samples);
+    void enableKeyIndex(); // Of every shard.
+    // Sums over the shards. A value held by keys of several shards is counted once per shard.
+    StoreStats stats();
+
+private:
+    ShardedDatabase(const ShardedDatabase& db);
+    ShardedDatabase& operator=(const ShardedDatabase& db);
+
+    struct alignas(64) Shard // Aligned so that the locks of neighbouring shards do not share a cache line.
+    {
+        std::mutex lock;
+        Database db;
+    };
+
+    std::vector<std::unique_ptr<Shard> > shards;
+};
+
+#endif /* ShardedDatabase_hpp */
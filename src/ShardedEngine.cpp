@@ -0,0 +1,106 @@
+#include "ShardedEngine.hpp"
+
+ShardedEngine::ShardedEngine(std::shared_ptr<ShardedDatabase> inDb): db(inDb), frames(0)
+{
+    for(size_t i = 0; i < inDb->shardCount(); i++)
+        this->transactions.emplace_back(new Transaction(std::shared_ptr<Database>(inDb, &inDb->shard(i))));
+}
+
+int ShardedEngine::dbSet(std::string_view key, std::string_view value)
+{
+    size_t index = this->db->shardOf(key);
+    std::lock_guard<std::mutex> guard(this->db->lock(index));
+    this->transactions[index]->record(key);
+    return this->db->shard(index).dbSet(key, value);
+}
+
+int ShardedEngine::dbUnset(std::string_view key)
+{
+    size_t index = this->db->shardOf(key);
+    std::lock_guard<std::mutex> guard(this->db->lock(index));
+    this->transactions[index]->record(key);
+    return this->db->shard(index).dbUnset(key);
+}
+
+int ShardedEngine::dbIncrBy(std::string_view key, int64_t delta, int64_t& result)
+{
+    size_t index = this->db->shardOf(key);
+    std::lock_guard<std::mutex> guard(this->db->lock(index));
+    this->transactions[index]->record(key);
+    return this->db->shard(index).dbIncrBy(key, delta, result);
+}
+
+int ShardedEngine::dbExpire(std::string_view key, int64_t deadlineMs)
+{
+    size_t index = this->db->shardOf(key);
+    std::lock_guard<std::mutex> guard(this->db->lock(index));
+    this->transactions[index]->record(key);
+    return this->db->shard(index).dbExpire(key, deadlineMs);
+}
+
+int ShardedEngine::dbSetExpiring(std::string_view key, std::string_view value, int64_t deadlineMs)
+{
+    size_t index = this->db->shardOf(key);
+    std::lock_guard<std::mutex> guard(this->db->lock(index));
+    this->transactions[index]->record(key);
+    return this->db->shard(index).dbSetExpiring(key, value, deadlineMs);
+}
+
+int ShardedEngine::dbGetExpiry(std::string_view key, int64_t& deadlineMs)
+{
+    size_t index = this->db->shardOf(key);
+    std::lock_guard<std::mutex> guard(this->db->lock(index));
+    return this->db->shard(index).dbGetExpiry(key, deadlineMs);
+}
+
+void ShardedEngine::begin()
+{
+    for(auto& transaction: this->transactions)
+        transaction->begin();
+    this->frames++;
+}
+
+bool ShardedEngine::rollback()
+{
+    if(this->frames == 0)
+        return false;
+    for(size_t i = 0; i < this->transactions.size(); i++)
+    {
+        std::lock_guard<std::mutex> guard(this->db->lock(i));
+        this->transactions[i]->rollback();
+    }
+    this->frames--;
+    return true;
+}
+
+bool ShardedEngine::commit()
+{
+    if(this->frames == 0)
+        return false;
+    for(size_t i = 0; i < this->transactions.size(); i++)
+    {
+        std::lock_guard<std::mutex> guard(this->db->lock(i));
+        this->transactions[i]->commit();
+    }
+    this->frames = 0;
+    return true;
+}
+
+bool ShardedEngine::commitBlock()
+{
+    if(this->frames <= 1)
+        return commit();
+    // Only the outermost block touches the shards; an inner one just hands its entries to the enclosing block.
+    for(auto& transaction: this->transactions)
+        transaction->commitBlock();
+    this->frames--;
+    return true;
+}
+
+EngineStats ShardedEngine::stats()
+{
+    size_t entries = 0;
+    for(auto& transaction: this->transactions)
+        entries += transaction->size();
+    return EngineStats{this->db->stats(), this->frames, entries};
+}
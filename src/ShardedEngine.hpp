@@ -0,0 +1,53 @@
+#ifndef ShardedEngine_hpp
+#define ShardedEngine_hpp
+
+#include "Engine.hpp"
+#include "ShardedDatabase.hpp"
+#include "Snapshot.hpp"
+#include "Transaction.hpp"
+#include <memory>
+#include <vector>
+
+/**
+ * This class is the undo-replay engine of a session on a ShardedDatabase. It keeps one Transaction undo log per
+ * shard, since value ids are local to a shard, and every write records the old value and applies the new one while
+ * holding the lock of the key's shard. BEGIN opens a frame in every log; ROLLBACK and COMMIT close them shard by
+ * shard, each under its shard's lock. As with UndoEngine, the writes of an open block are visible to other sessions
+ * and a rollback restores the values the keys had before the block.
+ */
+class ShardedEngine: public Engine
+{
+public:
+    ShardedEngine(std::shared_ptr<ShardedDatabase> inDb);
+    virtual ~ShardedEngine() {commit();}
+
+    virtual int dbSet(std::string_view key, std::string_view value);
+    virtual int dbUnset(std::string_view key);
+    virtual int dbGet(std::string_view key, std::string& value) {return this->db->dbGet(key, value);}
+    virtual int dbNumEqualTo(std::string_view value, int& count) {return this->db->dbNumEqualTo(value, count);}
+    virtual int dbIncrBy(std::string_view key, int64_t delta, int64_t& result);
+    virtual int dbNumBetween(int64_t low, int64_t high, int& count) {return this->db->dbNumBetween(low, high, count);}
+    virtual int dbExpire(std::string_view key, int64_t deadlineMs);
+    virtual int dbSetExpiring(std::string_view key, std::string_view value, int64_t deadlineMs);
+    virtual int dbGetExpiry(std::string_view key, int64_t& deadlineMs);
+    virtual int dbScan(std::string_view from, std::string_view to, size_t count, std::vector<std::string>& keys,
+                       std::string& next)
+    {
+        return this->db->dbScan(from, to, count, keys, next);
+    }
+
+    virtual void begin();
+    virtual bool rollback();
+    virtual bool commit();
+    virtual bool commitBlock();
+    virtual size_t depth() const {return this->frames;}
+    virtual int save(Snapshot& snapshot, bool background) {return snapshot.save(*this->db, background);}
+    virtual EngineStats stats();
+
+private:
+    std::shared_ptr<ShardedDatabase> db;
+    std::vector<std::unique_ptr<Transaction> > transactions; // Undo log of each shard.
+    size_t frames; // Number of open blocks.
+};
+
+#endif /* ShardedEngine_hpp */
@@ -0,0 +1,497 @@
+#include "Snapshot.hpp"
+#include "Checksum.hpp"
+#include "CoreDatabase.hpp"
+#include "Database.hpp"
+#include "RcuDatabase.hpp"
+#include "ShardedDatabase.hpp"
+#include "VersionedDatabase.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static const char MAGIC[8] = {'S', 'D', 'B', 'S', 'N', 'A', 'P', '1'};
+static const size_t SECTION_HEADER = 16; // Payload length, number of pairs and checksum.
+static const size_t TRAILER = 32;
+static const uint32_t EXPIRING = 1U << 31; // Flag of the key length of a pair that has an expiry time.
+
+static void putU32(char* p, uint32_t value)
+{
+    for(int i = 0; i < 4; i++)
+        p[i] = (char)(value >> (8 * i));
+}
+
+static void putU64(char* p, uint64_t value)
+{
+    for(int i = 0; i < 8; i++)
+        p[i] = (char)(value >> (8 * i));
+}
+
+static uint32_t getU32(const char* p)
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+static uint64_t getU64(const char* p)
+{
+    return getU32(p) | (uint64_t)getU32(p + 4) << 32;
+}
+
+static bool writeAll(int fd, const char* data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool syncDirectory(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+// Call f(key, value, deadline) for every pair of a section payload, with Database::NO_EXPIRY for pairs without an
+// expiry time. Return the number of pairs, or -1 if it is malformed.
+template <typename F>
+static long long parsePairs(const char* p, const char* end, F f)
+{
+    long long pairs = 0;
+    while(p < end)
+    {
+        if(end - p < 4 || (uint64_t)(end - p - 4) < (getU32(p) & ~EXPIRING))
+            return -1;
+        bool expiring = (getU32(p) & EXPIRING) != 0;
+        std::string_view key(p + 4, getU32(p) & ~EXPIRING);
+        p += 4 + key.size();
+        if(end - p < 4 || (uint64_t)(end - p - 4) < getU32(p))
+            return -1;
+        std::string_view value(p + 4, getU32(p));
+        p += 4 + value.size();
+        int64_t deadline = Database::NO_EXPIRY;
+        if(expiring)
+        {
+            if(end - p < 8)
+                return -1;
+            deadline = (int64_t)getU64(p);
+            p += 8;
+        }
+        f(key, value, deadline);
+        pairs++;
+    }
+    return pairs;
+}
+
+// Whether a pair loaded from a snapshot has expired since it was saved.
+static bool expired(int64_t deadline, int64_t now)
+{
+    return deadline != Database::NO_EXPIRY && deadline <= now;
+}
+
+// Run f on the calling thread and on threads - 1 more threads, and wait for all of them.
+template <typename F>
+static void inParallel(size_t threads, F f)
+{
+    std::vector<std::thread> helpers;
+    for(size_t i = 1; i < threads; i++)
+        helpers.emplace_back(f);
+    f();
+    for(std::thread& helper: helpers)
+        helper.join();
+}
+
+/**
+ * Streams pairs into the sections of a snapshot file. A section is built in one buffer, header included, and written
+ * with a single write() once its payload reaches SECTION_BYTES.
+ */
+class SnapshotWriter
+{
+public:
+    SnapshotWriter(int inFd): fd(inFd), pairs(0), offset(sizeof(MAGIC)), keys(0), ok(true)
+    {
+        this->section.reserve(SECTION_HEADER + Snapshot::SECTION_BYTES + 1024);
+        this->section.resize(SECTION_HEADER);
+        this->ok = writeAll(this->fd, MAGIC, sizeof(MAGIC));
+    }
+
+    void add(std::string_view key, std::string_view value, int64_t deadline)
+    {
+        char length[8];
+        putU32(length, (uint32_t)key.size() | (deadline != Database::NO_EXPIRY ? EXPIRING : 0));
+        this->section.append(length, 4).append(key.data(), key.size());
+        putU32(length, (uint32_t)value.size());
+        this->section.append(length, 4).append(value.data(), value.size());
+        if(deadline != Database::NO_EXPIRY)
+        {
+            putU64(length, (uint64_t)deadline);
+            this->section.append(length, 8);
+        }
+        this->pairs++;
+        if(this->section.size() >= SECTION_HEADER + Snapshot::SECTION_BYTES)
+            flushSection();
+    }
+
+    bool finish() // Write the last section, the index and the trailer.
+    {
+        if(this->pairs > 0)
+            flushSection();
+        std::string tail(this->offsets.size() * 8 + TRAILER, '\0');
+        for(size_t i = 0; i < this->offsets.size(); i++)
+            putU64(&tail[i * 8], this->offsets[i]);
+        char* trailer = &tail[this->offsets.size() * 8];
+        putU64(trailer, this->offset);
+        putU64(trailer + 8, this->offsets.size());
+        putU64(trailer + 16, this->keys);
+        putU32(trailer + 24, crc32c(tail.data(), tail.size() - 8));
+        return this->ok && writeAll(this->fd, tail.data(), tail.size());
+    }
+
+private:
+    int fd;
+    std::string section; // Header and payload of the open section.
+    uint32_t pairs; // Pairs in the open section.
+    uint64_t offset; // File offset of the open section.
+    uint64_t keys; // Pairs in the closed sections.
+    std::vector<uint64_t> offsets; // File offsets of the closed sections.
+    bool ok;
+
+    void flushSection()
+    {
+        size_t length = this->section.size() - SECTION_HEADER;
+        putU64(&this->section[0], length);
+        putU32(&this->section[8], this->pairs);
+        putU32(&this->section[12], crc32c(this->section.data() + SECTION_HEADER, length));
+        this->ok = this->ok && writeAll(this->fd, this->section.data(), this->section.size());
+        this->offsets.push_back(this->offset);
+        this->offset += this->section.size();
+        this->keys += this->pairs;
+        this->pairs = 0;
+        this->section.resize(SECTION_HEADER);
+    }
+};
+
+// Write a snapshot to temp and rename it to path. Return false, with errno set and temp removed, on failure.
+template <typename ForEach>
+static bool writeFile(const std::string& path, const std::string& temp, ForEach forEach)
+{
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+        return false;
+    {
+        SnapshotWriter writer(fd);
+        forEach([&](std::string_view key, std::string_view value, int64_t deadline) {
+            writer.add(key, value, deadline);
+        });
+        if(writer.finish() && fdatasync(fd) == 0 && close(fd) == 0)
+        {
+            fd = -1;
+            if(rename(temp.c_str(), path.c_str()) == 0 && syncDirectory(path))
+                return true;
+        }
+    }
+    int saved = errno;
+    if(fd >= 0)
+        close(fd);
+    unlink(temp.c_str());
+    errno = saved;
+    return false;
+}
+
+Snapshot::~Snapshot()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    reap(true);
+}
+
+// Pass the pairs of a store without expiry times to f(key, value, deadline).
+template <typename Store, typename F>
+static void withoutExpiry(Store& db, F f)
+{
+    db.forEach([&](std::string_view key, std::string_view value) {f(key, value, Database::NO_EXPIRY);});
+}
+
+// Pass the pairs of a Database with their expiry times to f(key, value, deadline).
+template <typename F>
+static void withExpiry(const Database& db, F f)
+{
+    db.forEach([&](std::string_view key, std::string_view value) {f(key, value, db.expiryOf(key));});
+}
+
+int Snapshot::save(Database& db, bool background)
+{
+    if(db.undoLogCount() != 0)
+        return SNAPSHOT_OPEN_BLOCK;
+    return write(background, [&](auto f) {withExpiry(db, f);});
+}
+
+int Snapshot::save(ShardedDatabase& db, bool background)
+{
+    std::vector<std::unique_lock<std::mutex> > guards;
+    for(size_t i = 0; i < db.shardCount(); i++)
+    {
+        guards.emplace_back(db.lock(i));
+        if(db.shard(i).undoLogCount() != 0)
+            return SNAPSHOT_OPEN_BLOCK;
+    }
+    return write(background, [&](auto f) {
+        for(size_t i = 0; i < db.shardCount(); i++)
+            withExpiry(db.shard(i), f);
+    });
+}
+
+int Snapshot::save(VersionedDatabase& db, bool background)
+{
+    std::lock_guard<std::mutex> guard(db.mutex());
+    return write(background, [&](auto f) {withoutExpiry(db, f);});
+}
+
+int Snapshot::save(RcuDatabase& db, bool background)
+{
+    std::lock_guard<std::mutex> guard(db.writeLock());
+    if(db.undoLogCount() != 0)
+        return SNAPSHOT_OPEN_BLOCK;
+    return write(background, [&](auto f) {withoutExpiry(db, f);});
+}
+
+int Snapshot::save(CoreDatabase& db, bool background)
+{
+    int status = SNAPSHOT_GOOD;
+    CoreDatabase::Channel channel(db);
+    db.exclusive(channel, [&]() {
+        for(size_t i = 0; i < db.coreCount(); i++)
+        {
+            if(db.shard(i).undoLogCount() != 0)
+                status = SNAPSHOT_OPEN_BLOCK;
+        }
+        if(status == SNAPSHOT_OPEN_BLOCK)
+            return;
+        status = write(background, [&](auto f) {
+            for(size_t i = 0; i < db.coreCount(); i++)
+                withExpiry(db.shard(i), f);
+        });
+    });
+    return status;
+}
+
+int Snapshot::load(Database& db, size_t threads)
+{
+    int64_t now = Database::nowMs();
+    return read(threads, false, [&](uint64_t keys) {db.reserve(keys);}, [&](const char* p, const char* end) {
+        parsePairs(p, end, [&](std::string_view key, std::string_view value, int64_t deadline) {
+            if(expired(deadline, now))
+                return;
+            db.dbSet(key, value);
+            if(deadline != Database::NO_EXPIRY)
+                db.dbExpire(key, deadline);
+        });
+    });
+}
+
+int Snapshot::load(ShardedDatabase& db, size_t threads)
+{
+    int64_t now = Database::nowMs();
+    return read(threads, true, [&](uint64_t keys) {db.reserve(keys);}, [&](const char* p, const char* end) {
+        parsePairs(p, end, [&](std::string_view key, std::string_view value, int64_t deadline) {
+            if(expired(deadline, now))
+                return;
+            db.dbSet(key, value);
+            if(deadline != Database::NO_EXPIRY)
+                db.dbExpire(key, deadline);
+        });
+    });
+}
+
+int Snapshot::load(VersionedDatabase& db, size_t threads)
+{
+    int64_t now = Database::nowMs();
+    std::vector<KeyChange> changes;
+    return read(threads, false, [](uint64_t) {}, [&](const char* p, const char* end) {
+        changes.clear();
+        parsePairs(p, end, [&](std::string_view key, std::string_view value, int64_t deadline) {
+            if(!expired(deadline, now))
+                changes.push_back(KeyChange{key, value, true});
+        });
+        db.apply(changes);
+    });
+}
+
+int Snapshot::load(RcuDatabase& db, size_t threads)
+{
+    int64_t now = Database::nowMs();
+    std::lock_guard<std::mutex> guard(db.writeLock());
+    return read(threads, false, [](uint64_t) {}, [&](const char* p, const char* end) {
+        parsePairs(p, end, [&](std::string_view key, std::string_view value, int64_t deadline) {
+            if(!expired(deadline, now))
+                db.dbSet(key, value);
+        });
+    });
+}
+
+int Snapshot::load(CoreDatabase& db, size_t threads)
+{
+    int64_t now = Database::nowMs();
+    int status = SNAPSHOT_GOOD;
+    CoreDatabase::Channel channel(db);
+    db.exclusive(channel, [&]() {
+        auto prepare = [&](uint64_t keys) {
+            for(size_t i = 0; i < db.coreCount(); i++)
+                db.shard(i).reserve(keys / db.coreCount() + 1);
+        };
+        status = read(threads, false, prepare, [&](const char* p, const char* end) {
+            parsePairs(p, end, [&](std::string_view key, std::string_view value, int64_t deadline) {
+                if(expired(deadline, now))
+                    return;
+                Database& shard = db.shard(db.shardOf(key));
+                shard.dbSet(key, value);
+                if(deadline != Database::NO_EXPIRY)
+                    shard.dbExpire(key, deadline);
+            });
+        });
+    });
+    return status;
+}
+
+bool Snapshot::busy()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return !reap(false);
+}
+
+int Snapshot::lastBackgroundStatus()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    reap(false);
+    return this->childStatus;
+}
+
+template <typename ForEach>
+int Snapshot::write(bool background, ForEach forEach)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    if(!reap(false))
+        return SNAPSHOT_BUSY;
+    std::string temp = this->path + ".tmp";
+    if(!background)
+        return writeFile(this->path, temp, forEach) ? SNAPSHOT_GOOD : SNAPSHOT_ERROR;
+    pid_t pid = fork();
+    if(pid < 0)
+        return SNAPSHOT_ERROR;
+    if(pid == 0)
+        _exit(writeFile(this->path, temp, forEach) ? 0 : 1); // No destructors or atexit handlers of the parent.
+    this->child = pid;
+    return SNAPSHOT_GOOD;
+}
+
+template <typename Prepare, typename Insert>
+int Snapshot::read(size_t threads, bool parallel, Prepare prepare, Insert insert)
+{
+    int fd = ::open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return SNAPSHOT_ERROR;
+    struct stat info;
+    if(fstat(fd, &info) != 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return SNAPSHOT_ERROR;
+    }
+    size_t size = info.st_size;
+    void* addr = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(addr == MAP_FAILED)
+    {
+        errno = size > 0 ? errno : EINVAL;
+        return SNAPSHOT_ERROR;
+    }
+    const char* data = static_cast<const char*>(addr);
+
+    // Check the trailer and the index, then every section, in parallel.
+    std::vector<const char*> sections;
+    uint64_t keys = 0;
+    bool valid = size >= sizeof(MAGIC) + TRAILER && memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+    if(valid)
+    {
+        const char* trailer = data + size - TRAILER;
+        uint64_t index = getU64(trailer);
+        uint64_t count = getU64(trailer + 8);
+        keys = getU64(trailer + 16);
+        valid = index >= sizeof(MAGIC) && index <= size - TRAILER && count == (size - TRAILER - index) / 8 &&
+                (size - TRAILER - index) % 8 == 0 && crc32c(data + index, size - index - 8) == getU32(trailer + 24);
+        for(uint64_t i = 0; valid && i < count; i++)
+        {
+            uint64_t offset = getU64(data + index + i * 8);
+            valid = offset >= sizeof(MAGIC) && offset + SECTION_HEADER <= index &&
+                    getU64(data + offset) <= index - SECTION_HEADER - offset;
+            sections.push_back(data + offset);
+        }
+    }
+    std::atomic<size_t> next(0);
+    std::atomic<uint64_t> found(0);
+    std::atomic<bool> damaged(!valid);
+    threads = std::max<size_t>(1, std::min(threads, sections.size()));
+    inParallel(threads, [&]() {
+        for(size_t i = next++; i < sections.size() && !damaged; i = next++)
+        {
+            const char* payload = sections[i] + SECTION_HEADER;
+            uint64_t length = getU64(sections[i]);
+            long long pairs = parsePairs(payload, payload + length, [](std::string_view, std::string_view, int64_t) {});
+            if(pairs != getU32(sections[i] + 8) || crc32c(payload, length) != getU32(sections[i] + 12))
+                damaged = true;
+            found += pairs;
+        }
+    });
+    if(damaged || found != keys)
+    {
+        munmap(addr, size);
+        errno = EINVAL;
+        return SNAPSHOT_ERROR;
+    }
+
+    prepare(keys);
+    next = 0;
+    inParallel(parallel ? threads : 1, [&]() {
+        for(size_t i = next++; i < sections.size(); i = next++)
+            insert(sections[i] + SECTION_HEADER, sections[i] + SECTION_HEADER + getU64(sections[i]));
+    });
+    munmap(addr, size);
+    return SNAPSHOT_GOOD;
+}
+
+bool Snapshot::reap(bool wait)
+{
+    if(this->child < 0)
+        return true;
+    int status = 0;
+    pid_t done;
+    do
+        done = waitpid(this->child, &status, wait ? 0 : WNOHANG);
+    while(done < 0 && errno == EINTR);
+    if(done == 0)
+        return false;
+    bool ok = done == this->child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    this->childStatus = ok ? SNAPSHOT_GOOD : SNAPSHOT_ERROR;
+    this->child = -1;
+    return true;
+}
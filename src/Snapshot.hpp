@@ -0,0 +1,92 @@
+#ifndef Snapshot_hpp
+#define Snapshot_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+class CoreDatabase;
+class Database;
+class RcuDatabase;
+class ShardedDatabase;
+class VersionedDatabase;
+
+/**
+ * This class writes the key-value pairs of a store to a binary snapshot file and loads them back, so that a restart
+ * rebuilds the tables directly instead of replaying commands. The file starts with an 8-byte magic and holds the
+ * pairs in sections of about SECTION_BYTES, each one checksummed on its own:
+ *   section:  payload length (uint64), number of pairs (uint32), CRC-32C of the payload (uint32), payload
+ *   payload:  per pair, the key length (uint32) and the key, the value length (uint32) and the value, then if the top
+ *             bit of the key length is set, the expiry time of the key (int64, Unix time in milliseconds)
+ * followed by an index of the section offsets (uint64 each) and a 32-byte trailer: the offset of the index, the
+ * number of sections, the number of pairs (uint64 each), the CRC-32C of the index and of the first 24 trailer bytes,
+ * and 4 zero bytes. Integers are little-endian. The file is written under a temporary name, fsynced and renamed over
+ * the old snapshot, so a crash during a save leaves the previous snapshot in place.
+ * save() with background false writes the file while holding the store's locks (every shard of a ShardedDatabase; every
+ * core of a CoreDatabase is prepared instead, see CoreDatabase::exclusive()), so all sessions wait for it. With
+ * background true, the process forks while holding those locks and the child process writes its copy-on-write image of
+ * the store, so sessions only wait for the fork itself; pages the parent modifies meanwhile are copied by the kernel.
+ * One save runs at a time; the child is reaped by the next call. The engines that apply the writes of a transaction
+ * block to the store at once leave them there until the block is closed, where a rollback after the save would undo
+ * them: save() refuses while any session has such writes, whose undo logs the store counts (Database::undoLogCount()).
+ * load() maps the file and verifies the sections in parallel threads before it changes anything, so a damaged file
+ * is rejected as a whole. The pairs are then inserted by one thread, except into a ShardedDatabase, whose shards
+ * take inserts from several threads at once. Keys whose expiry time has passed since the save are skipped; engines
+ * without expiry load the other keys without their expiry times.
+ */
+class Snapshot
+{
+public:
+    enum
+    {
+        SNAPSHOT_GOOD,
+        SNAPSHOT_BUSY, // Another save is running.
+        SNAPSHOT_OPEN_BLOCK, // A session has written to the store in a transaction block it has not closed.
+        SNAPSHOT_ERROR // See errno.
+    };
+
+    static const size_t SECTION_BYTES = 4 * 1024 * 1024; // Payload size at which a section is closed.
+
+    Snapshot(const std::string& inPath): path(inPath), child(-1), childStatus(SNAPSHOT_GOOD) {}
+    ~Snapshot(); // Wait for a background save to finish.
+
+    int save(Database& db, bool background);
+    int save(ShardedDatabase& db, bool background);
+    int save(VersionedDatabase& db, bool background);
+    int save(RcuDatabase& db, bool background);
+    int save(CoreDatabase& db, bool background);
+
+    // Add the pairs of the file to an empty store, using up to threads threads. Sets errno to ENOENT if there is no
+    // file, and to EINVAL if it is not a complete snapshot.
+    int load(Database& db, size_t threads);
+    int load(ShardedDatabase& db, size_t threads);
+    int load(VersionedDatabase& db, size_t threads);
+    int load(RcuDatabase& db, size_t threads);
+    int load(CoreDatabase& db, size_t threads);
+
+    bool busy(); // Whether a background save is still running.
+    int lastBackgroundStatus(); // SNAPSHOT_GOOD or SNAPSHOT_ERROR for the last background save that has finished.
+    const std::string& getPath() const {return this->path;}
+
+private:
+    Snapshot(const Snapshot& snapshot);
+    Snapshot& operator=(const Snapshot& snapshot);
+
+    std::string path;
+    std::mutex lock; // Guards child and childStatus, and serializes saves.
+    pid_t child; // The process of the background save, or -1.
+    int childStatus;
+
+    template <typename ForEach>
+    int write(bool background, ForEach forEach); // Called with the store's locks held.
+    // Verify the file, then call prepare(number of pairs) and insert(payload, end) for every section, from threads
+    // threads if parallel.
+    template <typename Prepare, typename Insert>
+    int read(size_t threads, bool parallel, Prepare prepare, Insert insert);
+    bool reap(bool wait); // Collect a finished background save. Return false if one is still running.
+};
+
+#endif /* Snapshot_hpp */
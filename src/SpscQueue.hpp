@@ -0,0 +1,80 @@
+#ifndef SpscQueue_hpp
+#define SpscQueue_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/**
+ * This class is a bounded lock-free queue for exactly one producer thread and one consumer thread: a ring of a power
+ * of two items with two ever-growing counters, tail written by the producer and head by the consumer. push() stores
+ * the item and then publishes it with a release store of tail; pop() reads it after an acquire load of tail and
+ * hands the slot back with a release store of head. Neither side ever waits for the other or takes a lock.
+ * The two counters are on cache lines of their own, so the producer and the consumer only share a line when one of
+ * them reads the other's counter. Each side also keeps the last value it read of the other's counter, and only reads
+ * it again when that value says the ring is full (producer) or empty (consumer), so a side that is ahead of the other
+ * runs on its own line.
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+    SpscQueue(size_t capacity): head(0), tailSeen(0), tail(0), headSeen(0)
+    {
+        size_t size = 1;
+        while(size < capacity)
+            size *= 2;
+        this->items.reset(new T[size]);
+        this->mask = size - 1;
+    }
+
+    // Producer side. Return false if the ring is full.
+    bool push(const T& item)
+    {
+        size_t at = this->tail.load(std::memory_order_relaxed);
+        if(at - this->headSeen > this->mask)
+        {
+            this->headSeen = this->head.load(std::memory_order_acquire);
+            if(at - this->headSeen > this->mask)
+                return false;
+        }
+        this->items[at & this->mask] = item;
+        this->tail.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Return false if the queue is empty.
+    bool pop(T& item)
+    {
+        size_t at = this->head.load(std::memory_order_relaxed);
+        if(at == this->tailSeen)
+        {
+            this->tailSeen = this->tail.load(std::memory_order_acquire);
+            if(at == this->tailSeen)
+                return false;
+        }
+        item = this->items[at & this->mask];
+        this->head.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    bool empty()
+    {
+        size_t at = this->head.load(std::memory_order_relaxed);
+        return at == this->tailSeen && at == (this->tailSeen = this->tail.load(std::memory_order_acquire));
+    }
+
+private:
+    SpscQueue(const SpscQueue& queue);
+    SpscQueue& operator=(const SpscQueue& queue);
+
+    alignas(64) std::atomic<size_t> head; // Items popped. Written by the consumer.
+    size_t tailSeen; // The consumer's copy of tail.
+    alignas(64) std::atomic<size_t> tail; // Items pushed. Written by the producer.
+    size_t headSeen; // The producer's copy of head.
+    alignas(64) std::unique_ptr<T[]> items;
+    size_t mask;
+};
+
+#endif /* SpscQueue_hpp */
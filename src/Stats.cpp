@@ -0,0 +1,131 @@
+#include "Stats.hpp"
+#include "Command.hpp"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+
+Stats::Stats(): startTicks(ticks()), startNs(steadyNs()), slowThreshold(0), slowTicks(0), slowSize(0), slowId(0)
+{
+    setSlowLog(DEFAULT_SLOW_THRESHOLD_NS, DEFAULT_SLOW_LOG_SIZE);
+}
+
+Stats& Stats::getInstance()
+{
+    static Stats stats;
+    return stats;
+}
+
+// Add to a counter that only the calling thread writes.
+static inline void add(std::atomic<uint64_t>& counter, uint64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void Stats::record(int command, uint64_t ticks)
+{
+    Counters& counters = local()->counters[command];
+    add(counters.buckets[Histogram::bucket(ticks)], 1);
+    add(counters.sum, ticks);
+    if(ticks > counters.max.load(std::memory_order_relaxed))
+        counters.max.store(ticks, std::memory_order_relaxed);
+}
+
+void Stats::logSlow(uint64_t ticks, const std::string& command)
+{
+    uint64_t ns = (uint64_t)(ticks * nsPerTick());
+    if(ns < getSlowThreshold())
+        return;
+    SlowEntry entry{0, (int64_t)std::time(nullptr), ns, command.substr(0, SLOW_COMMAND_MAX)};
+    for(char& c: entry.command)
+    {
+        if(c == '\r' || c == '\n')
+            c = ' '; // INFO reports one entry per line.
+    }
+    std::lock_guard<std::mutex> guard(this->slowLock);
+    if(this->slowSize == 0)
+        return;
+    entry.id = this->slowId++;
+    this->slow.push_front(std::move(entry));
+    if(this->slow.size() > this->slowSize)
+        this->slow.pop_back();
+}
+
+void Stats::setSlowLog(uint64_t thresholdNs, size_t size)
+{
+    this->slowThreshold.store(thresholdNs, std::memory_order_relaxed);
+    this->slowTicks.store(thresholdNs == UINT64_MAX ? UINT64_MAX : thresholdNs / 1000 * MIN_TICKS_PER_US,
+                          std::memory_order_relaxed);
+    std::lock_guard<std::mutex> guard(this->slowLock);
+    this->slowSize = size;
+    if(this->slow.size() > size)
+        this->slow.resize(size);
+}
+
+CommandLatency Stats::latency(int command) const
+{
+    Histogram total;
+    uint64_t sum = 0, max = 0;
+    {
+        std::lock_guard<std::mutex> guard(this->blocksLock);
+        for(const auto& block: this->blocks)
+        {
+            const Counters& counters = block->counters[command];
+            for(size_t i = 0; i < Histogram::BUCKETS; i++)
+                total.record(Histogram::highest(i), counters.buckets[i].load(std::memory_order_relaxed));
+            sum += counters.sum.load(std::memory_order_relaxed);
+            max = std::max(max, counters.max.load(std::memory_order_relaxed));
+        }
+    }
+    // The buckets only bound each value from above; the sum and the maximum are exact.
+    double scale = nsPerTick();
+    double mean = total.count() == 0 ? 0 : (double)sum / total.count();
+    return CommandLatency{total.count(), mean * scale, std::min(total.percentile(0.5), max) * scale,
+                          std::min(total.percentile(0.99), max) * scale, std::min(total.percentile(0.999), max) * scale,
+                          max * scale};
+}
+
+std::vector<SlowEntry> Stats::slowLog() const
+{
+    std::lock_guard<std::mutex> guard(this->slowLock);
+    return std::vector<SlowEntry>(this->slow.begin(), this->slow.end());
+}
+
+size_t Stats::threadCount() const
+{
+    std::lock_guard<std::mutex> guard(this->blocksLock);
+    return this->blocks.size();
+}
+
+Stats::Block* Stats::local()
+{
+    thread_local Block* block = nullptr;
+    if(block == nullptr)
+    {
+        std::unique_ptr<Block> added(new Block());
+        added->counters.reset(new Counters[Command::CMD_INVALID]()); // Zeroed.
+        block = added.get();
+        std::lock_guard<std::mutex> guard(this->blocksLock);
+        this->blocks.push_back(std::move(added));
+    }
+    return block;
+}
+
+uint64_t Stats::steadyNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double Stats::nsPerTick() const
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const uint64_t MIN_SPAN_NS = 100000; // Clock reads cost tens of ns; over 100 us that is below 0.1%.
+    uint64_t ns = steadyNs();
+    while(ns - this->startNs < MIN_SPAN_NS)
+        ns = steadyNs();
+    uint64_t elapsed = ticks() - this->startTicks;
+    return elapsed == 0 ? 1.0 : (double)(ns - this->startNs) / elapsed;
+#else
+    return 1.0;
+#endif
+}
@@ -0,0 +1,119 @@
+#ifndef Stats_hpp
+#define Stats_hpp
+
+#include "Histogram.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * One command that took at least the slow log threshold.
+ */
+struct SlowEntry
+{
+    uint64_t id; // Increases with every logged command.
+    int64_t time; // Unix time, in seconds, at which the command finished.
+    uint64_t ns; // How long it took.
+    std::string command; // The command line, cut after SLOW_COMMAND_MAX bytes.
+};
+
+/**
+ * The latencies of all commands of one type, in nanoseconds.
+ */
+struct CommandLatency
+{
+    uint64_t calls;
+    double mean;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+};
+
+/**
+ * This class collects the metrics INFO reports about executed commands: for every command type (Command::CMD_*) the
+ * number of commands and a histogram of their latencies in nanoseconds, as measured by Reader::execute(), and a slow
+ * log of the most recent commands that took at least a threshold. getInstance() returns the one instance of the
+ * process.
+ * Recording is cheap enough to stay on. Commands are timed in ticks of the CPU's time-stamp counter, which takes a few
+ * nanoseconds to read where a clock call takes tens; ticks are converted to nanoseconds only when the statistics are
+ * read, at the rate measured against the steady clock since the instance was created (other CPUs use the steady
+ * clock, at one tick per nanosecond). Every thread that executes commands records into a block of histogram buckets
+ * of its own, found through a thread_local pointer, so threads never write to each other's cache lines and recording
+ * takes no lock: the owning thread is the only writer of a block, and updates its counters with relaxed atomic loads
+ * and stores, which are plain moves. A reader of the statistics adds up the blocks of all threads into a Histogram; a
+ * command being recorded meanwhile may be counted in its bucket but not yet in the sum. Blocks outlive their threads,
+ * so the totals include the commands of threads that have exited. A command is checked against the slow
+ * log threshold in ticks first, with a bound that holds for any counter of at least MIN_TICKS_PER_US, and only the
+ * few that pass are converted exactly. The slow log has a lock of its own, which only slow commands take.
+ */
+class Stats
+{
+public:
+    static const uint64_t DEFAULT_SLOW_THRESHOLD_NS = 10000000; // 10 ms.
+    static const size_t DEFAULT_SLOW_LOG_SIZE = 128;
+    static const size_t SLOW_COMMAND_MAX = 256;
+    static const uint64_t MIN_TICKS_PER_US = 500; // A lower bound of the rate of the time-stamp counter.
+
+    static Stats& getInstance();
+    static uint64_t ticks() // Read the time-stamp counter.
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        return steadyNs();
+#endif
+    }
+
+    void record(int command, uint64_t ticks); // Count one command of a type that took a number of ticks.
+    bool mayBeSlow(uint64_t ticks) const {return ticks >= this->slowTicks.load(std::memory_order_relaxed);}
+    void logSlow(uint64_t ticks, const std::string& command); // Add a command to the slow log if it is slow.
+
+    // Log commands that take at least thresholdNs (UINT64_MAX for none), keeping the most recent size of them.
+    void setSlowLog(uint64_t thresholdNs, size_t size);
+    uint64_t getSlowThreshold() const {return this->slowThreshold.load(std::memory_order_relaxed);}
+
+    CommandLatency latency(int command) const; // Of all commands of a type, over all threads.
+    std::vector<SlowEntry> slowLog() const; // Newest first.
+    size_t threadCount() const; // Threads that have recorded commands.
+
+private:
+    Stats();
+    Stats(const Stats& stats);
+    Stats& operator=(const Stats& stats);
+
+    struct Counters // The latencies of one command type on one thread.
+    {
+        std::atomic<uint64_t> buckets[Histogram::BUCKETS]; // See Histogram::bucket().
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+    };
+
+    struct Block // The counters of one thread, indexed by command type.
+    {
+        std::unique_ptr<Counters[]> counters;
+    };
+
+    uint64_t startTicks; // Counter and clock at creation, to measure the rate of the counter.
+    uint64_t startNs;
+
+    mutable std::mutex blocksLock;
+    std::vector<std::unique_ptr<Block> > blocks;
+
+    std::atomic<uint64_t> slowThreshold;
+    std::atomic<uint64_t> slowTicks; // Every command of at least slowThreshold takes at least as many ticks.
+    mutable std::mutex slowLock;
+    std::deque<SlowEntry> slow; // Newest first.
+    size_t slowSize; // Most entries kept.
+    uint64_t slowId; // Id of the next entry.
+
+    Block* local(); // The block of the calling thread, added on first use.
+    static uint64_t steadyNs();
+    double nsPerTick() const;
+};
+
+#endif /* Stats_hpp */
@@ -0,0 +1,220 @@
+#ifndef TimerWheel_hpp
+#define TimerWheel_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * This class is a hierarchical timing wheel (Varghese and Lauck, "Hashed and Hierarchical Timing Wheels"): timers
+ * that fire at a tick, such as a time in milliseconds, each carrying a payload of type T. There are LEVELS wheels of
+ * SLOTS slots. A slot of level l spans SLOTS^l ticks and holds the timers due in it, as long as it is part of the span
+ * of SLOTS^(l+1) ticks the current tick is in; timers due later than SLOTS^LEVELS ticks ahead wait in an overflow
+ * list. Each slot is a doubly linked list of timers, linked by index into one vector with a free list, so add() and
+ * cancel() are O(1) and a handle stays valid until its timer fires or is cancelled.
+ * advance() moves the current tick forward and fires the timers of each level-0 slot it passes. It jumps straight to
+ * the next occupied slot by a bitmap of the occupied slots of each level, so idle time costs nothing. When it enters
+ * a slot of a higher level, the timers of that slot are placed again relative to the new current tick, which moves
+ * them to lower levels (cascading); a timer is moved at most LEVELS times. advance() fires at most a given number of
+ * timers per call and continues where it stopped on the next call, so a burst of expirations is spread out.
+ */
+template <typename T>
+class TimerWheel
+{
+public:
+    typedef uint32_t Handle;
+    static constexpr Handle NONE = UINT32_MAX;
+
+    TimerWheel(): current(0), count(0), freeList(NONE)
+    {
+        for(Handle& head: this->heads)
+            head = NONE;
+        for(uint64_t& bits: this->occupied)
+            bits = 0;
+    }
+
+    // Add a timer due at tick deadline; one due at or before the current tick fires on the next advance().
+    Handle add(uint64_t deadline, const T& payload)
+    {
+        Handle handle = this->freeList;
+        if(handle == NONE)
+        {
+            handle = (Handle)this->timers.size();
+            this->timers.emplace_back();
+        }
+        else
+            this->freeList = this->timers[handle].next;
+        this->timers[handle].deadline = deadline;
+        this->timers[handle].payload = payload;
+        place(handle);
+        this->count++;
+        return handle;
+    }
+
+    void cancel(Handle handle)
+    {
+        unlink(handle);
+        release(handle);
+        this->count--;
+    }
+
+    uint64_t deadline(Handle handle) const {return this->timers[handle].deadline;}
+    const T& payload(Handle handle) const {return this->timers[handle].payload;}
+    size_t size() const {return this->count;}
+    bool empty() const {return this->count == 0;}
+    size_t memoryUsage() const {return this->timers.capacity() * sizeof(Timer);}
+    size_t liveBytes() const {return this->count * sizeof(Timer);} // Bytes of the timers that are set.
+
+    // Fire the timers due at or before tick now, in the order of their ticks: each one is removed and then passed to
+    // f(payload). Stop after limit timers. Return the number fired; if it is below limit, none due is left.
+    template <typename F>
+    size_t advance(uint64_t now, size_t limit, F f)
+    {
+        size_t fired = 0;
+        if(this->count == 0)
+        {
+            if(now > this->current)
+                this->current = now;
+            return 0;
+        }
+        while(this->current <= now)
+        {
+            unsigned list = (unsigned)(this->current & MASK);
+            while(this->heads[list] != NONE)
+            {
+                if(fired == limit)
+                    return fired;
+                Handle handle = this->heads[list];
+                unlink(handle);
+                T payload = this->timers[handle].payload;
+                release(handle);
+                this->count--;
+                fired++;
+                f(payload);
+            }
+            uint64_t next = nextTick();
+            if(next > now)
+            {
+                this->current = now; // Every slot up to now is empty.
+                break;
+            }
+            this->current = next;
+            enter();
+        }
+        return fired;
+    }
+
+private:
+    static const unsigned BITS = 6;
+    static const unsigned SLOTS = 1 << BITS;
+    static const uint64_t MASK = SLOTS - 1;
+    static const unsigned LEVELS = 6; // 2^36 ticks, over two years of milliseconds, before the overflow list.
+    static const unsigned OVERFLOW = LEVELS * SLOTS; // Index of the overflow list in heads.
+
+    struct Timer
+    {
+        uint64_t deadline;
+        T payload;
+        Handle prev;
+        Handle next; // Also links the free list.
+        uint16_t list; // Index of the list in heads.
+    };
+
+    std::vector<Timer> timers;
+    Handle heads[LEVELS * SLOTS + 1]; // First timer of each slot, level by level, then of the overflow list.
+    uint64_t occupied[LEVELS]; // Bit s of level l is set if slot s of level l has timers.
+    uint64_t current; // The tick whose level-0 slot fires next.
+    size_t count;
+    Handle freeList;
+
+    void place(Handle handle) // Link a timer into the slot of its deadline relative to the current tick.
+    {
+        uint64_t deadline = this->timers[handle].deadline > this->current ? this->timers[handle].deadline
+                                                                            : this->current;
+        for(unsigned level = 0; level < LEVELS; level++)
+        {
+            unsigned shift = BITS * (level + 1);
+            if((deadline >> shift) == (this->current >> shift))
+            {
+                link(handle, level * SLOTS + (unsigned)((deadline >> (BITS * level)) & MASK));
+                return;
+            }
+        }
+        link(handle, OVERFLOW);
+    }
+
+    void link(Handle handle, unsigned list)
+    {
+        Timer& timer = this->timers[handle];
+        timer.list = (uint16_t)list;
+        timer.prev = NONE;
+        timer.next = this->heads[list];
+        if(timer.next != NONE)
+            this->timers[timer.next].prev = handle;
+        this->heads[list] = handle;
+        if(list != OVERFLOW)
+            this->occupied[list / SLOTS] |= 1ULL << (list % SLOTS);
+    }
+
+    void unlink(Handle handle)
+    {
+        Timer& timer = this->timers[handle];
+        if(timer.prev != NONE)
+            this->timers[timer.prev].next = timer.next;
+        else
+            this->heads[timer.list] = timer.next;
+        if(timer.next != NONE)
+            this->timers[timer.next].prev = timer.prev;
+        if(this->heads[timer.list] == NONE && timer.list != OVERFLOW)
+            this->occupied[timer.list / SLOTS] &= ~(1ULL << (timer.list % SLOTS));
+    }
+
+    void release(Handle handle)
+    {
+        this->timers[handle].next = this->freeList;
+        this->freeList = handle;
+    }
+
+    uint64_t nextTick() const // The first tick after the current one at which a slot with timers starts.
+    {
+        for(unsigned level = 0; level < LEVELS; level++)
+        {
+            unsigned shift = BITS * level;
+            unsigned slot = (unsigned)((this->current >> shift) & MASK);
+            uint64_t bits = slot == MASK ? 0 : this->occupied[level] & (~0ULL << (slot + 1));
+            if(bits != 0)
+                return (this->current >> (shift + BITS) << (shift + BITS)) | (uint64_t)__builtin_ctzll(bits) << shift;
+        }
+        if(this->heads[OVERFLOW] != NONE)
+            return ((this->current >> (BITS * LEVELS)) + 1) << (BITS * LEVELS);
+        return UINT64_MAX;
+    }
+
+    void enter() // Cascade the slots that start at the current tick, from the highest level down.
+    {
+        if((this->current & ((1ULL << (BITS * LEVELS)) - 1)) == 0)
+            cascade(OVERFLOW);
+        for(unsigned level = LEVELS; level-- > 1; )
+        {
+            unsigned shift = BITS * level;
+            if((this->current & ((1ULL << shift) - 1)) == 0)
+                cascade(level * SLOTS + (unsigned)((this->current >> shift) & MASK));
+        }
+    }
+
+    void cascade(unsigned list)
+    {
+        Handle handle = this->heads[list];
+        this->heads[list] = NONE;
+        if(list != OVERFLOW)
+            this->occupied[list / SLOTS] &= ~(1ULL << (list % SLOTS));
+        while(handle != NONE)
+        {
+            Handle next = this->timers[handle].next;
+            place(handle);
+            handle = next;
+        }
+    }
+};
+
+#endif /* TimerWheel_hpp */
@@ -1,20 +1,155 @@
+#include "RcuDatabase.hpp"
 #include "Transaction.hpp"
+#include <type_traits>
 
-Transaction::Transaction(std::shared_ptr<Database> inDb): db(inDb) {}
+template <typename Store>
+BasicTransaction<Store>::BasicTransaction(std::shared_ptr<Store> inDb): db(inDb), reported(0) {}
 
-void Transaction::record(std::shared_ptr<Command> cmd)
+template <typename Store>
+void BasicTransaction<Store>::begin()
 {
-    this->cmdStk.push(cmd);
-    return;
+    this->frames.push_back((uint32_t)this->log.size());
 }
 
-void Transaction::rollback()
+template <typename Store>
+bool BasicTransaction<Store>::rollback()
 {
-    while(!this->cmdStk.empty())
+    if(this->frames.empty())
+        return false;
+    uint32_t start = this->frames.back();
+    this->frames.pop_back();
+    if(start == 0 && !this->log.empty())
+        this->db->addUndoLog(-1);
+    for(size_t i = this->log.size(); i-- > start; )
     {
-        std::shared_ptr<Command> cmd = this->cmdStk.top();
-        this->cmdStk.pop();
-        cmd->undo(this->db);
+        Entry& entry = this->log[i];
+        std::string_view key = entry.key.view();
+        if(entry.oldValue == ValuePool::NONE)
+            this->db->dbUnset(key);
+        else
+        {
+            this->db->dbSetId(key, entry.oldValue);
+            this->db->releaseValue(entry.oldValue);
+        }
+        if(!this->expiries.empty() && this->expiries.back().first == i)
+        {
+            if constexpr(std::is_same<Store, Database>::value)
+                this->db->dbExpire(key, this->expiries.back().second);
+            this->expiries.pop_back();
+        }
+        auto slot = this->latest.find(key);
+        if(entry.prev != NONE)
+            slot->value = entry.prev;
+        else
+        {
+            pin(key, false);
+            this->latest.erase(slot);
+            entry.key.release(this->arena);
+        }
     }
-    return;
+    this->log.resize(start);
+    account();
+    return true;
 }
+
+template <typename Store>
+bool BasicTransaction<Store>::commit()
+{
+    if(this->frames.empty())
+        return false;
+    if(!this->log.empty())
+        this->db->addUndoLog(-1);
+    for(Entry& entry: this->log)
+    {
+        if(entry.oldValue != ValuePool::NONE)
+            this->db->releaseValue(entry.oldValue);
+        if(entry.prev == NONE)
+        {
+            pin(entry.key.view(), false);
+            entry.key.release(this->arena);
+        }
+    }
+    this->log.clear();
+    this->frames.clear();
+    // Short blocks, such as those of scripts, keep the table of the index for the next block.
+    if(this->latest.slotCount() <= REUSED_SLOTS)
+        this->latest.reset();
+    else
+        this->latest.clear();
+    this->expiries.clear();
+    account();
+    return true;
+}
+
+template <typename Store>
+bool BasicTransaction<Store>::commitBlock()
+{
+    if(this->frames.size() <= 1)
+        return commit();
+    // The entries now belong to the enclosing frame. A key recorded in both frames keeps both entries: a rollback
+    // replays the inner one first and then the outer one, so the key still ends at its value before the outer frame.
+    this->frames.pop_back();
+    return true;
+}
+
+template <typename Store>
+void BasicTransaction<Store>::record(std::string_view key)
+{
+    if(this->frames.empty())
+        return;
+    auto slot = this->latest.insertWith(key, this->latest.hash(key),
+                                        [&]() {return ArenaString::make(key, this->arena);});
+    if(!slot.second && slot.first->value >= this->frames.back())
+        return; // Already recorded in this frame.
+    if(slot.second)
+        pin(key, true);
+    
+    Entry entry;
+    entry.key = slot.first->key;
+    entry.prev = slot.second ? NONE : slot.first->value;
+    if(this->db->dbGetId(key, entry.oldValue) == Database::DB_GOOD)
+    {
+        this->db->retainValue(entry.oldValue);
+        if constexpr(std::is_same<Store, Database>::value)
+        {
+            int64_t deadline = this->db->expiryOf(key);
+            if(deadline != Database::NO_EXPIRY)
+                this->expiries.emplace_back((uint32_t)this->log.size(), deadline);
+        }
+    }
+    else
+        entry.oldValue = ValuePool::NONE;
+    slot.first->value = (uint32_t)this->log.size();
+    if(this->log.empty())
+        this->db->addUndoLog(1);
+    this->log.push_back(entry);
+    account();
+}
+
+template <typename Store>
+void BasicTransaction<Store>::pin(std::string_view key, bool on)
+{
+    if constexpr(std::is_same<Store, Database>::value)
+    {
+        if(on)
+            this->db->pin(key);
+        else
+            this->db->unpin(key);
+    }
+}
+
+template <typename Store>
+void BasicTransaction<Store>::account()
+{
+    if constexpr(std::is_same<Store, Database>::value)
+    {
+        size_t bytes = this->arena.stats().liveBytes + this->log.size() * sizeof(Entry) +
+            this->latest.size() * (sizeof(typename decltype(this->latest)::Slot) + 1) +
+            this->frames.size() * sizeof(uint32_t) + this->expiries.size() * sizeof(this->expiries[0]);
+        this->db->addUndoMemory((ptrdiff_t)bytes - (ptrdiff_t)this->reported);
+        this->reported = bytes;
+    }
+}
+
+template class BasicTransaction<Database>;
+template class BasicTransaction<RcuDatabase>;
@@ -1,30 +1,75 @@
 #ifndef Transaction_hpp
 #define Transaction_hpp
 
-#include "Command.hpp"
+#include "Arena.hpp"
 #include "Database.hpp"
-#include <stack>
+#include "FlatMap.hpp"
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
 
 /**
- * This class encapsulates a group of database commands to simulate a SQL-like transaction. The databse commands that
- * belongs to a transaction is stored in a FILO stack. When a transaction is rollbacked, each method is popped out from
- * the stack, and undone one by one. Note that the transaction object contains only commands that modifies the in-memory
- * database, such as Set() and Unset(), so it does not contain any read-only commands, such as Get(), NumEqualTo(). This
- * ensures that each transaction should consume at most O(M) additional memory, where M is the number of variables that
- * are updated within a transaction.
+ * This class keeps the undo log of all open transaction blocks of one session. The log is a flat array of entries,
+ * and each block is a frame: the index of the first entry written after its BEGIN, so a nested BEGIN only pushes one
+ * index. Before a key is modified, record() saves the value the key had when the current frame started, but only the
+ * first time the key is modified in that frame; later writes to the same key in the same frame add nothing. When a
+ * block is rollbacked, each entry of the top frame restores its key once, and the frame is dropped. Undo memory
+ * therefore grows with the number of distinct keys modified per block, not with the number of commands.
+ * An entry holds a reference on the interned old value (or NONE if the key was not set) and the key bytes in an
+ * arena of its own; entries for the same key in nested frames share those bytes. An index from key to its most
+ * recent entry tells whether the key has been recorded in the current frame.
+ * The store is a Database or an RcuDatabase: anything with value ids and dbGetId(), dbSetId(), dbUnset(),
+ * retainValue() and releaseValue(). Both instantiations are compiled in Transaction.cpp. On a Database, which can
+ * have a memory limit, every key in the index is pinned so that it is not evicted while its writes are pending, and
+ * the bytes of the log are added to the memory the database accounts for. The expiry time of a recorded key is saved
+ * too, in a separate list that only has entries for keys that had one, and a rollback sets it again, which unsets the
+ * key if that time has passed meanwhile. The store counts the logs that hold entries, so that a snapshot is not taken
+ * while a block's writes could still be rolled back.
  */
-class Transaction
+template <typename Store>
+class BasicTransaction
 {
 public:
-    Transaction(std::shared_ptr<Database> inDb);
+    BasicTransaction(std::shared_ptr<Store> inDb);
+    ~BasicTransaction() {commit();}
     
-    void record(std::shared_ptr<Command> cmd);
+    void begin(); // Open a (nested) transaction block.
+    bool rollback(); // Undo and close the most recent block. Return false if no block is open.
+    bool commit(); // Close all blocks, keeping their changes. Return false if no block is open.
+    bool commitBlock(); // Close the most recent block, leaving its entries to the enclosing one, or commit.
     
-    void rollback();
+    void record(std::string_view key); // Save the current value of a key that is about to be modified.
+    
+    size_t depth() const {return frames.size();} // Number of open blocks.
+    size_t size() const {return log.size();} // Number of undo entries.
     
 private:
-    std::shared_ptr<Database> db;
-    std::stack<std::shared_ptr<Command> > cmdStk;
+    BasicTransaction(const BasicTransaction& tran);
+    BasicTransaction& operator=(const BasicTransaction& tran);
+    
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static const size_t REUSED_SLOTS = 256; // Largest index table kept by commit().
+    
+    struct Entry
+    {
+        ArenaString key;
+        ValuePool::Id oldValue; // The value before the frame modified the key, or ValuePool::NONE.
+        uint32_t prev; // The entry of the same key in an outer frame, or NONE.
+    };
+    
+    std::shared_ptr<Store> db;
+    size_t reported; // Bytes last added to the database's undo memory.
+    SlabArena arena; // Key bytes of the entries.
+    std::vector<Entry> log;
+    std::vector<uint32_t> frames; // Index of the first entry of each open block.
+    std::vector<std::pair<uint32_t, int64_t> > expiries; // Entries whose key had an expiry time, and that time.
+    FlatMap<ArenaString, uint32_t, ArenaStringHash, ArenaStringEq> latest; // Key to its most recent entry.
+    
+    void pin(std::string_view key, bool on); // Pin or unpin a key on a Database.
+    void account(); // Report the change of the log's bytes to a Database.
 };
 
+typedef BasicTransaction<Database> Transaction;
+
 #endif /* Transaction_hpp */
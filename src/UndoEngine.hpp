@@ -0,0 +1,110 @@
+#ifndef UndoEngine_hpp
+#define UndoEngine_hpp
+
+#include "Database.hpp"
+#include "Engine.hpp"
+#include "Snapshot.hpp"
+#include "Transaction.hpp"
+
+/**
+ * This class is the undo-replay engine: every write is applied to the Database right away, after its key's old value
+ * has been recorded in the Transaction undo log. Rollback replays the log of the closed block.
+ */
+class UndoEngine: public Engine
+{
+public:
+    UndoEngine(std::shared_ptr<Database> inDb): db(inDb), transaction(inDb) {}
+    
+    virtual int dbSet(std::string_view key, std::string_view value)
+    {
+        this->transaction.record(key);
+        return this->db->dbSet(key, value);
+    }
+    
+    virtual int dbUnset(std::string_view key)
+    {
+        this->transaction.record(key);
+        return this->db->dbUnset(key);
+    }
+    
+    virtual int dbGet(std::string_view key, std::string& value) {return this->db->dbGet(key, value);}
+    virtual int dbNumEqualTo(std::string_view value, int& count) {return this->db->dbNumEqualTo(value, count);}
+    
+    virtual int dbIncrBy(std::string_view key, int64_t delta, int64_t& result)
+    {
+        this->transaction.record(key);
+        return this->db->dbIncrBy(key, delta, result);
+    }
+    
+    virtual int dbNumBetween(int64_t low, int64_t high, int& count) {return this->db->dbNumBetween(low, high, count);}
+    
+    virtual int dbSetMany(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& values)
+    {
+        for(std::string_view key: keys)
+            this->transaction.record(key);
+        this->db->dbSetMany(keys.data(), values.data(), keys.size());
+        return Database::DB_GOOD;
+    }
+    
+    virtual int dbUnsetMany(const std::vector<std::string_view>& keys)
+    {
+        for(std::string_view key: keys)
+            this->transaction.record(key);
+        this->db->dbUnsetMany(keys.data(), keys.size());
+        return Database::DB_GOOD;
+    }
+    
+    virtual int dbGetMany(const std::vector<std::string_view>& keys, std::vector<std::string>& values,
+                          std::vector<int>& status)
+    {
+        if(values.size() < keys.size())
+            values.resize(keys.size());
+        status.resize(keys.size());
+        this->db->dbGetViews(keys.data(), keys.size(), [&](size_t i, int found, std::string_view value)
+        {
+            status[i] = found;
+            values[i].assign(value);
+        });
+        return Database::DB_GOOD;
+    }
+    
+    virtual int dbNumEqualToMany(const std::vector<std::string_view>& values, std::vector<int>& counts)
+    {
+        counts.resize(values.size());
+        this->db->dbNumEqualToMany(values.data(), values.size(), counts.data());
+        return Database::DB_GOOD;
+    }
+    
+    virtual int dbExpire(std::string_view key, int64_t deadlineMs)
+    {
+        this->transaction.record(key);
+        return this->db->dbExpire(key, deadlineMs);
+    }
+    
+    virtual int dbSetExpiring(std::string_view key, std::string_view value, int64_t deadlineMs)
+    {
+        this->transaction.record(key);
+        return this->db->dbSetExpiring(key, value, deadlineMs);
+    }
+    
+    virtual int dbGetExpiry(std::string_view key, int64_t& deadlineMs) {return this->db->dbGetExpiry(key, deadlineMs);}
+    virtual int dbScan(std::string_view from, std::string_view to, size_t count, std::vector<std::string>& keys,
+                       std::string& next)
+    {
+        return this->db->dbScan(from, to, count, keys, next);
+    }
+    
+    virtual void begin() {this->transaction.begin();}
+    virtual bool rollback() {return this->transaction.rollback();}
+    virtual bool commit() {return this->transaction.commit();}
+    virtual bool commitBlock() {return this->transaction.commitBlock();}
+    virtual size_t depth() const {return this->transaction.depth();}
+    virtual int save(Snapshot& snapshot, bool background) {return snapshot.save(*this->db, background);}
+    virtual EngineStats stats() {return EngineStats{this->db->stats(), depth(), this->transaction.size()};}
+    
+private:
+    std::shared_ptr<Database> db;
+    Transaction transaction;
+};
+
+#endif /* UndoEngine_hpp */
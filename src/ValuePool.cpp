@@ -0,0 +1,78 @@
+#include "ValuePool.hpp"
+
+ValuePool::Id ValuePool::intern(std::string_view value, size_t h)
+{
+    auto slot = this->index.find(value, h);
+    if(slot != nullptr)
+    {
+        this->entries[slot->key].refs++;
+        return slot->key;
+    }
+    
+    Id id;
+    if(!this->freeIds.empty())
+    {
+        id = this->freeIds.back();
+        this->freeIds.pop_back();
+    }
+    else
+    {
+        id = (Id)this->entries.size();
+        this->entries.emplace_back();
+    }
+    Entry& entry = this->entries[id];
+    entry.value = ArenaString::make(value, this->arena);
+    entry.hash = h;
+    entry.refs = 1;
+    int64_t number;
+    entry.isNumber = parseNumber(value, number);
+    this->index.insert(id, h);
+    return id;
+}
+
+ValuePool::Id ValuePool::find(std::string_view value, size_t h) const
+{
+    auto slot = this->index.find(value, h);
+    return slot != nullptr ? slot->key : NONE;
+}
+
+void ValuePool::remove(Id id)
+{
+    Entry& entry = this->entries[id];
+    this->index.erase(this->index.find(id, entry.hash));
+    entry.value.release(this->arena);
+    this->freeIds.push_back(id);
+}
+
+bool ValuePool::parseNumber(std::string_view text, int64_t& number)
+{
+    bool negative = !text.empty() && text[0] == '-';
+    std::string_view digits = text.substr(negative);
+    if(digits.empty() || digits.size() > NUMBER_CHARS - 1 || (digits[0] == '0' && text.size() > 1))
+        return false;
+    // Accumulate negatively, so that INT64_MIN, which has no positive counterpart, fits.
+    int64_t value = 0;
+    for(char c: digits)
+    {
+        if(c < '0' || c > '9' || __builtin_mul_overflow(value, 10, &value) ||
+           __builtin_sub_overflow(value, c - '0', &value))
+            return false;
+    }
+    if(!negative && value == INT64_MIN)
+        return false;
+    number = negative ? value : -value;
+    return true;
+}
+
+std::string_view ValuePool::formatNumber(int64_t number, char* buffer)
+{
+    char* end = buffer + NUMBER_CHARS;
+    char* p = end;
+    uint64_t magnitude = number < 0 ? 0 - (uint64_t)number : (uint64_t)number;
+    *--p = (char)('0' + magnitude % 10);
+    while((magnitude /= 10) != 0)
+        *--p = (char)('0' + magnitude % 10);
+    if(number < 0)
+        *--p = '-';
+    return std::string_view(p, end - p);
+}
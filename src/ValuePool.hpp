@@ -0,0 +1,105 @@
+#ifndef ValuePool_hpp
+#define ValuePool_hpp
+
+#include "Arena.hpp"
+#include "FlatMap.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * This class interns value strings. Each distinct value is stored once and identified by a small integer id, so the
+ * key table stores a 4-byte id per key instead of a string, and counters can be kept in arrays indexed by id. Ids
+ * are reference counted: every key holding the value and every undo record that may restore it owns a reference,
+ * and an id is recycled once its last reference is released. Lookups by string hash the value once and go through
+ * an index of ids whose hash and equality functors read the strings back from the pool. The strings themselves are
+ * ArenaStrings: inline when short, otherwise allocated from the arena of the owning Database.
+ * A value whose string is the decimal form of a 64-bit integer, as formatNumber() writes it (no sign for positive
+ * numbers, no leading zeros), is flagged as a number when it is added, in what would otherwise be padding of its
+ * entry, so integer values are told apart without looking at the strings. The string stays the value: number()
+ * parses it again, which for at most 20 digits costs less than keeping 8 more bytes in every entry.
+ */
+class ValuePool
+{
+public:
+    typedef uint32_t Id;
+    static constexpr Id NONE = UINT32_MAX; // No value, e.g. for a key that is not set.
+    static const size_t NUMBER_CHARS = 20; // Longest decimal form of an int64_t, "-9223372036854775808".
+    
+    // Whether text is the decimal form of an int64_t as formatNumber() writes it, and if so its number.
+    static bool parseNumber(std::string_view text, int64_t& number);
+    static std::string_view formatNumber(int64_t number, char* buffer); // In buffer, of at least NUMBER_CHARS.
+    
+    ValuePool(SlabArena& inArena): arena(inArena), index(IdHash(this), IdEq(this)) {}
+    
+    // Return the id of value, adding it if needed, and take a reference on it.
+    Id intern(std::string_view value) {return intern(value, hash(value));}
+    Id intern(std::string_view value, size_t h); // With h = hash(value), computed beforehand.
+    // Return the id of value, or NONE. Does not take a reference.
+    Id find(std::string_view value) const {return find(value, hash(value));}
+    Id find(std::string_view value, size_t h) const;
+    
+    size_t hash(std::string_view value) const {return this->index.hash(value);}
+    void prefetch(size_t h) const {this->index.prefetch(h);} // Start loading what a lookup of hash h would probe.
+    void prefetchId(Id id) const {__builtin_prefetch(&this->entries[id]);} // Start loading the entry of an id.
+    
+    void retain(Id id) {this->entries[id].refs++;}
+    void release(Id id) {if(--this->entries[id].refs == 0) remove(id);}
+    
+    std::string_view value(Id id) const {return this->entries[id].value.view();}
+    bool isNumber(Id id) const {return this->entries[id].isNumber;}
+    int64_t number(Id id) const // The integer of a value for which isNumber().
+    {
+        int64_t n = 0;
+        parseNumber(value(id), n);
+        return n;
+    }
+    size_t size() const {return this->index.size();} // Number of distinct values alive.
+    size_t capacity() const {return this->entries.size();} // One more than the largest id handed out.
+    size_t memoryUsage() const // Bytes used by the entries and the index, excluding the arena.
+    {
+        return this->entries.capacity() * sizeof(Entry) + this->freeIds.capacity() * sizeof(Id) + this->index.memoryUsage();
+    }
+    size_t liveBytes() const // Bytes of the entries and index slots of live values, excluding the arena.
+    {
+        return size() * (sizeof(Entry) + sizeof(FlatMap<Id, char, IdHash, IdEq>::Slot) + 1);
+    }
+    
+private:
+    ValuePool(const ValuePool& pool);
+    ValuePool& operator=(const ValuePool& pool);
+    
+    struct Entry
+    {
+        ArenaString value;
+        size_t hash;
+        uint32_t refs;
+        bool isNumber;
+    };
+    
+    struct IdHash
+    {
+        const ValuePool* pool;
+        IdHash(const ValuePool* inPool): pool(inPool) {}
+        size_t operator()(Id id) const {return pool->entries[id].hash;}
+        size_t operator()(std::string_view value) const {return StringHash()(value);}
+    };
+    
+    struct IdEq
+    {
+        const ValuePool* pool;
+        IdEq(const ValuePool* inPool): pool(inPool) {}
+        bool operator()(Id id, std::string_view value) const {return pool->entries[id].value.view() == value;}
+        bool operator()(Id a, Id b) const {return a == b;}
+    };
+    
+    SlabArena& arena;
+    std::vector<Entry> entries; // Indexed by id.
+    std::vector<Id> freeIds; // Ids of removed entries, reused before the vector grows.
+    FlatMap<Id, char, IdHash, IdEq> index; // Ids of all live entries, searchable by value.
+    
+    void remove(Id id);
+};
+
+#endif /* ValuePool_hpp */
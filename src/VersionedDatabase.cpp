@@ -0,0 +1,249 @@
+#include "VersionedDatabase.hpp"
+
+VersionedDatabase::VersionedDatabase(): values(arena), current(0), liveKeys(0), distinctValues(0) {}
+
+int VersionedDatabase::dbSet(std::string_view key, std::string_view value)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    if(write(key, this->values.intern(value), this->current + 1))
+        this->current++;
+    collectLocked(2);
+    return Database::DB_GOOD;
+}
+
+int VersionedDatabase::dbUnset(std::string_view key)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    if(!write(key, ValuePool::NONE, this->current + 1))
+        return Database::DB_NOT_FOUND;
+    this->current++;
+    collectLocked(2);
+    return Database::DB_GOOD;
+}
+
+int VersionedDatabase::dbGet(std::string_view key, Version at, std::string& value)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    const Record* record = visible(key, at);
+    if(record == nullptr || record->value == ValuePool::NONE)
+        return Database::DB_NOT_FOUND;
+    value.assign(this->values.value(record->value));
+    return Database::DB_GOOD;
+}
+
+int VersionedDatabase::dbNumEqualTo(std::string_view value, Version at, int& count)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    count = 0;
+    ValuePool::Id id = this->values.find(value);
+    if(id == ValuePool::NONE || id >= this->counts.size())
+        return Database::DB_NOT_FOUND;
+    const std::vector<CountVersion>& history = this->counts[id];
+    for(size_t i = history.size(); i-- > 0; )
+    {
+        if(history[i].version <= at)
+        {
+            count = history[i].count;
+            break;
+        }
+    }
+    return count == 0 ? Database::DB_NOT_FOUND : Database::DB_GOOD;
+}
+
+bool VersionedDatabase::apply(const std::vector<KeyChange>& changes, Version snapshot)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    for(size_t i = 0; snapshot != LATEST && i < changes.size(); i++)
+    {
+        // The newest record of a key is never trimmed, and a snapshot keeps those newer than it.
+        auto slot = this->keys.find(changes[i].key);
+        if(slot != nullptr && this->records[slot->value].version > snapshot)
+            return false;
+    }
+    Version version = this->current + 1;
+    bool changed = false;
+    for(const KeyChange& change: changes)
+    {
+        ValuePool::Id id = change.present ? this->values.intern(change.value) : ValuePool::NONE;
+        changed |= write(change.key, id, version);
+    }
+    if(changed)
+        this->current = version;
+    collectLocked(2 * changes.size() + 2);
+    return true;
+}
+
+VersionedDatabase::Version VersionedDatabase::openSnapshot()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->snapshots[this->current]++;
+    return this->current;
+}
+
+void VersionedDatabase::closeSnapshot(Version snapshot)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    auto slot = this->snapshots.find(snapshot);
+    if(slot != this->snapshots.end() && --slot->second == 0)
+        this->snapshots.erase(slot);
+    collectLocked(64);
+}
+
+void VersionedDatabase::collect(size_t budget)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    collectLocked(budget);
+}
+
+size_t VersionedDatabase::versionCount() const
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->records.size() - this->freeRecords.size();
+}
+
+StoreStats VersionedDatabase::stats() const
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return StoreStats{this->liveKeys, this->distinctValues,
+                      this->arena.stats().reservedBytes + this->values.memoryUsage() + this->keys.memoryUsage() +
+                      this->records.capacity() * sizeof(Record) + this->freeRecords.capacity() * sizeof(uint32_t) +
+                      this->counts.capacity() * sizeof(std::vector<CountVersion>), 0, 0, 0, 0, 0};
+}
+
+const VersionedDatabase::Record* VersionedDatabase::visible(std::string_view key, Version at) const
+{
+    auto slot = this->keys.find(key);
+    if(slot == nullptr)
+        return nullptr;
+    for(uint32_t index = slot->value; index != NONE; index = this->records[index].older)
+        if(this->records[index].version <= at)
+            return &this->records[index];
+    return nullptr;
+}
+
+bool VersionedDatabase::write(std::string_view key, ValuePool::Id value, Version version)
+{
+    auto slot = this->keys.insertWith(key, this->keys.hash(key), [&]() {return ArenaString::make(key, this->arena);});
+    uint32_t head = slot.second ? NONE : slot.first->value;
+    ValuePool::Id old = head == NONE ? ValuePool::NONE : this->records[head].value;
+    if(old == value)
+    {
+        if(value != ValuePool::NONE)
+            this->values.release(value);
+        if(slot.second)
+        {
+            slot.first->key.release(this->arena);
+            this->keys.erase(slot.first);
+        }
+        return false;
+    }
+
+    uint32_t index;
+    if(!this->freeRecords.empty())
+    {
+        index = this->freeRecords.back();
+        this->freeRecords.pop_back();
+    }
+    else
+    {
+        index = (uint32_t)this->records.size();
+        this->records.emplace_back();
+    }
+    this->records[index] = Record{version, value, head};
+    slot.first->value = index;
+
+    if(value != ValuePool::NONE)
+        addCount(value, 1, version);
+    if(old != ValuePool::NONE)
+        addCount(old, -1, version);
+    if(old == ValuePool::NONE)
+        this->liveKeys++;
+    else if(value == ValuePool::NONE)
+        this->liveKeys--;
+    if(head != NONE)
+        this->pending.push_back(Pending{version, ArenaString::make(key, this->arena)});
+    return true;
+}
+
+void VersionedDatabase::addCount(ValuePool::Id value, int delta, Version version)
+{
+    if(value >= this->counts.size())
+        this->counts.resize(this->values.capacity());
+    std::vector<CountVersion>& history = this->counts[value];
+    int latest = history.empty() ? 0 : history.back().count;
+    if(latest == 0)
+        this->distinctValues++;
+    else if(latest + delta == 0)
+        this->distinctValues--;
+    if(history.empty())
+    {
+        this->values.retain(value);
+        history.push_back(CountVersion{version, delta});
+    }
+    else if(history.back().version == version)
+        history.back().count += delta;
+    else
+        history.push_back(CountVersion{version, history.back().count + delta});
+    trimCounts(value, oldestNeeded());
+}
+
+void VersionedDatabase::trimCounts(ValuePool::Id value, Version oldest)
+{
+    std::vector<CountVersion>& history = this->counts[value];
+    // Every reader is at oldest or later: the newest pair not after oldest is the first one anybody needs.
+    size_t first = 0;
+    while(first + 1 < history.size() && history[first + 1].version <= oldest)
+        first++;
+    if(first > 0)
+        history.erase(history.begin(), history.begin() + first);
+    if(history.size() == 1 && history[0].count == 0 && history[0].version <= oldest)
+    {
+        std::vector<CountVersion>().swap(history);
+        this->values.release(value);
+    }
+}
+
+void VersionedDatabase::trimKey(std::string_view key, Version oldest)
+{
+    auto slot = this->keys.find(key);
+    if(slot == nullptr)
+        return;
+    // Keep the records newer than oldest and the newest one not after it; everything below is unreachable.
+    uint32_t keep = slot->value;
+    while(keep != NONE && this->records[keep].version > oldest)
+        keep = this->records[keep].older;
+    if(keep == NONE)
+        return;
+    uint32_t index = this->records[keep].older;
+    this->records[keep].older = NONE;
+    while(index != NONE)
+    {
+        Record& record = this->records[index];
+        if(record.value != ValuePool::NONE)
+        {
+            trimCounts(record.value, oldest);
+            this->values.release(record.value);
+        }
+        this->freeRecords.push_back(index);
+        index = record.older;
+    }
+    if(keep == slot->value && this->records[keep].value == ValuePool::NONE)
+    {
+        // The key is unset for every reader.
+        this->freeRecords.push_back(keep);
+        slot->key.release(this->arena);
+        this->keys.erase(slot);
+    }
+}
+
+void VersionedDatabase::collectLocked(size_t budget)
+{
+    Version oldest = oldestNeeded();
+    while(budget-- > 0 && !this->pending.empty() && this->pending.front().version <= oldest)
+    {
+        Pending& entry = this->pending.front();
+        trimKey(entry.key.view(), oldest);
+        entry.key.release(this->arena);
+        this->pending.pop_front();
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef VersionedDatabase_hpp
+#define VersionedDatabase_hpp
+
+#include "Arena.hpp"
+#include "Database.hpp"
+#include "FlatMap.hpp"
+#include "ValuePool.hpp"
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * This class is a multi-version store for snapshot isolation. Every commit, whether a single write outside of a
+ * transaction block or all the writes of a block at COMMIT, creates one new version, numbered in commit order. A key
+ * maps to a chain of version records, newest first, each holding the interned value the key had from that version on
+ * (or NONE once it was unset). A reader passes the version it reads at: LATEST for the newest committed state, or a
+ * snapshot pinned with openSnapshot(), which keeps seeing the store as of that version no matter what is committed
+ * later, and never sees part of a commit.
+ * NUMEQUALTO is snapshot-consistent too: instead of a single counter, every value has a short history of
+ * (version, count) pairs, and a read takes the newest pair not after its version.
+ * Old versions are garbage-collected incrementally. A record is kept only while an open snapshot may still read it;
+ * keys that got a new version are queued, and each commit and each closed snapshot trims a bounded number of queued
+ * keys whose old records no snapshot needs any more, together with the count history of the values they dropped.
+ * All methods take one lock for the duration of the call, so a reader never waits for an open transaction, only for
+ * the short critical section of a concurrent call.
+ */
+class VersionedDatabase
+{
+public:
+    typedef uint64_t Version;
+    static constexpr Version LATEST = UINT64_MAX;
+
+    VersionedDatabase();
+
+    int dbSet(std::string_view key, std::string_view value); // Commit a single write.
+    int dbUnset(std::string_view key);
+    int dbGet(std::string_view key, Version at, std::string& value);
+    int dbNumEqualTo(std::string_view value, Version at, int& count);
+    // Commit a set of writes, to distinct keys, as one version. Made at a snapshot, the commit is refused, and false
+    // returned, if one of the keys was committed to after the snapshot: the first committer wins.
+    bool apply(const std::vector<KeyChange>& changes, Version snapshot = LATEST);
+
+    Version openSnapshot(); // Pin the newest committed version for reading until closeSnapshot().
+    void closeSnapshot(Version snapshot);
+    void collect(size_t budget); // Trim up to budget queued keys.
+
+    size_t versionCount() const; // Number of version records alive.
+    StoreStats stats() const; // Of the newest version.
+
+    // Call f(key, value) with string views of every key-value pair of the newest version, in no particular order.
+    // The caller must hold mutex().
+    template <typename F>
+    void forEach(F f) const
+    {
+        this->keys.forEach([&](const ArenaString& key, uint32_t index) {
+            if(this->records[index].value != ValuePool::NONE)
+                f(key.view(), this->values.value(this->records[index].value));
+        });
+    }
+    std::mutex& mutex() const {return this->lock;} // The lock every method takes.
+
+private:
+    VersionedDatabase(const VersionedDatabase& db);
+    VersionedDatabase& operator=(const VersionedDatabase& db);
+
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Record
+    {
+        Version version; // The commit that wrote the value.
+        ValuePool::Id value; // ValuePool::NONE if the key was unset.
+        uint32_t older; // The previous record of the key, or NONE.
+    };
+
+    struct CountVersion
+    {
+        Version version;
+        int count; // Number of keys holding the value from version on.
+    };
+
+    struct Pending
+    {
+        Version version; // The commit that added a record on top of older ones.
+        ArenaString key;
+    };
+
+    mutable std::mutex lock;
+    SlabArena arena; // Key and value bytes.
+    ValuePool values; // A reference is held by every record and by every non-empty count history.
+    FlatMap<ArenaString, uint32_t, ArenaStringHash, ArenaStringEq> keys; // Key to its newest record.
+    std::vector<Record> records;
+    std::vector<uint32_t> freeRecords;
+    std::vector<std::vector<CountVersion> > counts; // Count history of each value, indexed by value id.
+    std::map<Version, size_t> snapshots; // Open snapshots and how many sessions hold each.
+    std::deque<Pending> pending; // Keys that may have records to trim, in commit order.
+    Version current; // The newest committed version.
+    size_t liveKeys; // Keys whose newest record holds a value.
+    size_t distinctValues; // Values whose newest count is not zero.
+
+    Version oldestNeeded() const {return this->snapshots.empty() ? this->current : this->snapshots.begin()->first;}
+    const Record* visible(std::string_view key, Version at) const; // The record a reader at a version sees.
+    bool write(std::string_view key, ValuePool::Id value, Version version); // Value carries a reference.
+    void addCount(ValuePool::Id value, int delta, Version version);
+    void trimCounts(ValuePool::Id value, Version oldest);
+    void trimKey(std::string_view key, Version oldest);
+    void collectLocked(size_t budget);
+};
+
+#endif /* VersionedDatabase_hpp */
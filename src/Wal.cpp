@@ -0,0 +1,623 @@
+#include "Wal.hpp"
+#include "Checksum.hpp"
+#include "Database.hpp"
+#include "Engine.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char MAGIC[8] = {'S', 'D', 'B', 'W', 'A', 'L', '0', '1'};
+static const size_t BATCH_HEADER = 8; // Payload length and checksum.
+static const char RECORD_SET = 1;
+static const char RECORD_UNSET = 2;
+static const char RECORD_EXPIRE = 3;
+static const char RECORD_INCRBY = 4;
+static const char RECORD_BEGIN = 5;
+static const char RECORD_BEFORE = 6;
+static const char RECORD_END = 7;
+static const uint32_t NOT_SET = UINT32_MAX; // Value length of a RECORD_BEFORE for a key that was not set.
+static const size_t COMPACT_BATCH = 64 * 1024; // Payload size of the batches written by compaction.
+static const size_t COPY_BLOCK = 1 << 20;
+
+static void putU32(std::string& out, uint32_t value)
+{
+    char bytes[4] = {(char)value, (char)(value >> 8), (char)(value >> 16), (char)(value >> 24)};
+    out.append(bytes, 4);
+}
+
+static uint32_t getU32(const char* p)
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+static void putU64(std::string& out, uint64_t value)
+{
+    putU32(out, (uint32_t)value);
+    putU32(out, (uint32_t)(value >> 32));
+}
+
+static uint64_t getU64(const char* p)
+{
+    return getU32(p) | (uint64_t)getU32(p + 4) << 32;
+}
+
+static void putBatch(std::string& out, std::string_view payload, uint32_t crc)
+{
+    putU32(out, (uint32_t)payload.size());
+    putU32(out, crc);
+    out.append(payload.data(), payload.size());
+}
+
+static bool writeAll(int fd, const char* data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool syncDirectory(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+// Call the method of visitor for every record of a batch payload: set(key, value), unset(key), expire(key,
+// deadline), incrBy(key, delta), begin(block), before(block, key, value or nullptr, deadline) and end(block). Return
+// false if the payload is malformed.
+template <typename Visitor>
+static bool parseBatch(const char* p, const char* end, Visitor& visitor)
+{
+    while(p < end)
+    {
+        char type = *p++;
+        if(type == RECORD_BEGIN || type == RECORD_END)
+        {
+            if(end - p < 8)
+                return false;
+            if(type == RECORD_BEGIN)
+                visitor.begin(getU64(p));
+            else
+                visitor.end(getU64(p));
+            p += 8;
+            continue;
+        }
+        uint64_t block = 0;
+        if(type == RECORD_BEFORE)
+        {
+            if(end - p < 8)
+                return false;
+            block = getU64(p);
+            p += 8;
+        }
+        if(end - p < 4 || (uint32_t)(end - p - 4) < getU32(p))
+            return false;
+        std::string_view key(p + 4, getU32(p));
+        p += 4 + key.size();
+        if(type == RECORD_UNSET)
+        {
+            visitor.unset(key);
+            continue;
+        }
+        if(type == RECORD_EXPIRE || type == RECORD_INCRBY)
+        {
+            if(end - p < 8)
+                return false;
+            if(type == RECORD_EXPIRE)
+                visitor.expire(key, (int64_t)getU64(p));
+            else
+                visitor.incrBy(key, (int64_t)getU64(p));
+            p += 8;
+            continue;
+        }
+        if(type == RECORD_BEFORE && end - p >= 4 && getU32(p) == NOT_SET)
+        {
+            if(end - p < 12)
+                return false;
+            visitor.before(block, key, nullptr, (int64_t)getU64(p + 4));
+            p += 12;
+            continue;
+        }
+        if((type != RECORD_SET && type != RECORD_BEFORE) || end - p < 4 || (uint32_t)(end - p - 4) < getU32(p))
+            return false;
+        std::string_view value(p + 4, getU32(p));
+        p += 4 + value.size();
+        if(type == RECORD_SET)
+        {
+            visitor.set(key, value);
+            continue;
+        }
+        if(end - p < 8)
+            return false;
+        visitor.before(block, key, &value, (int64_t)getU64(p));
+        p += 8;
+    }
+    return true;
+}
+
+// A visitor of parseBatch() that checks the records only.
+struct Validator
+{
+    void set(std::string_view, std::string_view) {}
+    void unset(std::string_view) {}
+    void expire(std::string_view, int64_t) {}
+    void incrBy(std::string_view, int64_t) {}
+    void begin(uint64_t) {}
+    void before(uint64_t, std::string_view, const std::string_view*, int64_t) {}
+    void end(uint64_t) {}
+};
+
+// A visitor of parseBatch() that replays the records into a store, an Engine or a Database, and keeps the values
+// the keys had before the blocks without an END record so far first wrote them.
+template <typename Store>
+class Replay
+{
+public:
+    Replay(Store& inStore): store(inStore), lastBlock(0) {}
+
+    void set(std::string_view key, std::string_view value) {this->store.dbSet(key, value);}
+    void unset(std::string_view key) {this->store.dbUnset(key);}
+    void expire(std::string_view key, int64_t deadline) {this->store.dbExpire(key, deadline);}
+    void incrBy(std::string_view key, int64_t delta)
+    {
+        int64_t result;
+        this->store.dbIncrBy(key, delta, result);
+    }
+    void begin(uint64_t block)
+    {
+        this->blocks.emplace_back();
+        this->blocks.back().id = block;
+        this->lastBlock = std::max(this->lastBlock, block);
+    }
+    void before(uint64_t block, std::string_view key, const std::string_view* value, int64_t deadline)
+    {
+        Block* open = find(block);
+        if(open != nullptr)
+            open->before.push_back(Before{std::string(key), std::string(value == nullptr ? "" : *value),
+                                          value != nullptr, deadline});
+    }
+    void end(uint64_t block)
+    {
+        Block* open = find(block);
+        if(open != nullptr)
+            this->blocks.erase(this->blocks.begin() + (open - this->blocks.data()));
+    }
+
+    uint64_t last() const {return this->lastBlock;} // The highest block number seen.
+    // Encode the blocks still open as they were logged: a BEGIN and the values before their first writes.
+    void encodeOpen(std::string& payload) const
+    {
+        for(const Block& block: this->blocks)
+        {
+            Wal::encodeBegin(payload, block.id);
+            for(const Before& before: block.before)
+            {
+                std::string_view value(before.value);
+                Wal::encodeBefore(payload, block.id, before.key, before.present ? &value : nullptr, before.deadline);
+            }
+        }
+    }
+    // Roll back the blocks still open, the newest first, and encode what that writes, and an END for each of them.
+    void rollbackOpen(std::string& payload)
+    {
+        for(size_t i = this->blocks.size(); i-- > 0; )
+        {
+            const Block& block = this->blocks[i];
+            for(size_t j = block.before.size(); j-- > 0; )
+            {
+                const Before& before = block.before[j];
+                if(!before.present)
+                {
+                    unset(before.key);
+                    Wal::encodeUnset(payload, before.key);
+                    continue;
+                }
+                set(before.key, before.value);
+                Wal::encodeSet(payload, before.key, before.value);
+                if(before.deadline != Database::NO_EXPIRY)
+                {
+                    expire(before.key, before.deadline);
+                    Wal::encodeExpire(payload, before.key, before.deadline);
+                }
+            }
+            Wal::encodeEnd(payload, block.id);
+        }
+        this->blocks.clear();
+    }
+
+private:
+    struct Before
+    {
+        std::string key;
+        std::string value;
+        bool present; // False if the key was not set.
+        int64_t deadline;
+    };
+
+    struct Block
+    {
+        uint64_t id;
+        std::vector<Before> before; // In the order the keys were first written.
+    };
+
+    Store& store;
+    std::vector<Block> blocks; // Blocks without an END yet, in the order they began.
+    uint64_t lastBlock;
+
+    Block* find(uint64_t block)
+    {
+        for(Block& open: this->blocks)
+        {
+            if(open.id == block)
+                return &open;
+        }
+        return nullptr;
+    }
+};
+
+// Replay the batches of a log file image, which starts with MAGIC, into a visitor. Return the end of the last intact
+// batch.
+template <typename Visitor>
+static size_t parseLog(const char* data, size_t size, Visitor& visitor)
+{
+    size_t pos = sizeof(MAGIC);
+    Validator validator;
+    while(size - pos >= BATCH_HEADER)
+    {
+        uint32_t length = getU32(data + pos);
+        const char* payload = data + pos + BATCH_HEADER;
+        if(length > size - pos - BATCH_HEADER || crc32c(payload, length) != getU32(data + pos + 4) ||
+           !parseBatch(payload, payload + length, validator))
+            break;
+        parseBatch(payload, payload + length, visitor);
+        pos += BATCH_HEADER + length;
+    }
+    return pos;
+}
+
+// Map the first size bytes of a file and pass them to f. Return false if the file cannot be mapped.
+template <typename F>
+static bool withMapping(int fd, size_t size, F f)
+{
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(addr == MAP_FAILED)
+        return false;
+    madvise(addr, size, MADV_SEQUENTIAL);
+    f(static_cast<const char*>(addr));
+    munmap(addr, size);
+    return true;
+}
+
+Wal::Wal(const std::string& inPath, int inPolicy, unsigned inIntervalMs, uint64_t inCompactSize):
+    path(inPath), policy(inPolicy), intervalMs(inIntervalMs), compactSize(inCompactSize), fd(-1), appended(0),
+    written(0), fileBytes(0), compactedBytes(0), flushing(false), compacting(false), stopping(false), error(0),
+    blocks(1) {}
+
+Wal::~Wal()
+{
+    if(this->background.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stopping = true;
+        }
+        this->wake.notify_all();
+        this->background.join();
+    }
+    if(this->fd >= 0)
+    {
+        std::unique_lock<std::mutex> guard(this->lock);
+        flushLocked(guard, this->policy != SYNC_NONE);
+        close(this->fd);
+    }
+}
+
+int Wal::open(Engine& engine)
+{
+    this->fd = ::open(this->path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat info;
+    if(this->fd < 0 || fstat(this->fd, &info) != 0)
+        return WAL_ERROR;
+
+    size_t size = info.st_size;
+    Replay<Engine> replay(engine);
+    if(size >= sizeof(MAGIC))
+    {
+        bool valid = false;
+        bool mapped = withMapping(this->fd, size, [&](const char* data) {
+            valid = std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+            if(valid)
+                size = parseLog(data, size, replay);
+        });
+        if(!mapped)
+            return WAL_ERROR;
+        if(!valid)
+        {
+            errno = EINVAL; // Not a log file.
+            return WAL_ERROR;
+        }
+        if((off_t)size < info.st_size && ftruncate(this->fd, size) != 0)
+            return WAL_ERROR; // Drop a batch torn by a crash.
+    }
+    else
+    {
+        // A new file, or one whose creation was interrupted before the magic was complete.
+        if(ftruncate(this->fd, 0) != 0 || !writeAll(this->fd, MAGIC, sizeof(MAGIC)) || fdatasync(this->fd) != 0)
+            return WAL_ERROR;
+        size = sizeof(MAGIC);
+    }
+    // Blocks left open by a crash are rolled back, and the rollback is logged, so that writes logged from now on are
+    // replayed after it.
+    std::string payload, chunk;
+    replay.rollbackOpen(payload);
+    if(!payload.empty())
+    {
+        putBatch(chunk, payload, checksum(payload));
+        if(!writeAll(this->fd, chunk.data(), chunk.size()) || fdatasync(this->fd) != 0)
+            return WAL_ERROR;
+        size += chunk.size();
+    }
+    this->blocks = replay.last() + 1;
+    this->fileBytes = size;
+    this->background = std::thread(&Wal::run, this);
+    return WAL_GOOD;
+}
+
+void Wal::encodeSet(std::string& payload, std::string_view key, std::string_view value)
+{
+    payload.push_back(RECORD_SET);
+    putU32(payload, (uint32_t)key.size());
+    payload.append(key.data(), key.size());
+    putU32(payload, (uint32_t)value.size());
+    payload.append(value.data(), value.size());
+}
+
+void Wal::encodeUnset(std::string& payload, std::string_view key)
+{
+    payload.push_back(RECORD_UNSET);
+    putU32(payload, (uint32_t)key.size());
+    payload.append(key.data(), key.size());
+}
+
+void Wal::encodeExpire(std::string& payload, std::string_view key, int64_t deadlineMs)
+{
+    payload.push_back(RECORD_EXPIRE);
+    putU32(payload, (uint32_t)key.size());
+    payload.append(key.data(), key.size());
+    putU64(payload, (uint64_t)deadlineMs);
+}
+
+void Wal::encodeIncrBy(std::string& payload, std::string_view key, int64_t delta)
+{
+    payload.push_back(RECORD_INCRBY);
+    putU32(payload, (uint32_t)key.size());
+    payload.append(key.data(), key.size());
+    putU64(payload, (uint64_t)delta);
+}
+
+void Wal::encodeBegin(std::string& payload, uint64_t block)
+{
+    payload.push_back(RECORD_BEGIN);
+    putU64(payload, block);
+}
+
+void Wal::encodeBefore(std::string& payload, uint64_t block, std::string_view key, const std::string_view* value,
+                       int64_t deadlineMs)
+{
+    payload.push_back(RECORD_BEFORE);
+    putU64(payload, block);
+    putU32(payload, (uint32_t)key.size());
+    payload.append(key.data(), key.size());
+    putU32(payload, value == nullptr ? NOT_SET : (uint32_t)value->size());
+    if(value != nullptr)
+        payload.append(value->data(), value->size());
+    putU64(payload, (uint64_t)deadlineMs);
+}
+
+void Wal::encodeEnd(std::string& payload, uint64_t block)
+{
+    payload.push_back(RECORD_END);
+    putU64(payload, block);
+}
+
+uint32_t Wal::checksum(std::string_view payload)
+{
+    return crc32c(payload.data(), payload.size());
+}
+
+void Wal::sync(uint64_t lsn)
+{
+    if(this->policy != SYNC_ALWAYS || lsn == 0)
+        return;
+    std::unique_lock<std::mutex> guard(this->lock);
+    while(this->written < lsn && this->error == 0)
+    {
+        if(this->flushing)
+            this->flushed.wait(guard);
+        else
+            flushLocked(guard, true); // Takes the batches of every committer waiting, not just this one.
+    }
+}
+
+int Wal::compact()
+{
+    uint64_t cut;
+    {
+        std::unique_lock<std::mutex> guard(this->lock);
+        if(this->compacting)
+            return WAL_GOOD;
+        if(!flushLocked(guard, false))
+            return WAL_ERROR;
+        this->compacting = true;
+        cut = this->fileBytes;
+    }
+
+    // Fold the batches before the cut. The file only grows, so that part of it does not change while it is read.
+    Database folded;
+    Replay<Database> replay(folded);
+    bool mapped = withMapping(this->fd, cut, [&](const char* data) {parseLog(data, cut, replay);});
+    std::string temp = this->path + ".compact";
+    int out = mapped ? ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644) : -1;
+    bool ok = out >= 0;
+    std::string chunk(MAGIC, sizeof(MAGIC));
+    std::string payload;
+    uint64_t size = 0;
+    auto writeChunk = [&]() {
+        ok = ok && writeAll(out, chunk.data(), chunk.size());
+        size += chunk.size();
+        chunk.clear();
+    };
+    auto closeBatch = [&]() {
+        if(payload.size() < COMPACT_BATCH)
+            return;
+        putBatch(chunk, payload, checksum(payload));
+        payload.clear();
+        if(chunk.size() >= COPY_BLOCK)
+            writeChunk();
+    };
+    folded.forEach([&](std::string_view key, std::string_view value) {
+        encodeSet(payload, key, value);
+        closeBatch();
+    });
+    folded.forEachExpiry([&](std::string_view key, int64_t deadline) {
+        encodeExpire(payload, key, deadline);
+        closeBatch();
+    });
+    // The pairs include the writes of the blocks still open at the cut; the values before them go along.
+    replay.encodeOpen(payload);
+    if(!payload.empty())
+        putBatch(chunk, payload, checksum(payload));
+    writeChunk();
+
+    // Copy what has been logged since the cut: most of it while appends go on, the rest while they wait.
+    uint64_t copied = cut;
+    {
+        std::unique_lock<std::mutex> guard(this->lock);
+        flushLocked(guard, false);
+        cut = this->fileBytes;
+    }
+    ok = ok && copyRange(out, copied, cut) && fdatasync(out) == 0;
+    size += cut - copied;
+    {
+        std::unique_lock<std::mutex> guard(this->lock);
+        while(this->flushing)
+            this->flushed.wait(guard);
+        ok = ok && copyRange(out, cut, this->fileBytes) && fdatasync(out) == 0 &&
+             rename(temp.c_str(), this->path.c_str()) == 0;
+        if(ok)
+        {
+            syncDirectory(this->path);
+            close(this->fd);
+            this->fd = out;
+            this->fileBytes = size + this->fileBytes - cut;
+        }
+        // After a failure, wait for the log to double again before retrying.
+        this->compactedBytes = this->fileBytes;
+        this->compacting = false;
+    }
+    if(!ok && out >= 0)
+    {
+        int code = errno;
+        close(out);
+        unlink(temp.c_str());
+        errno = code;
+    }
+    return ok ? WAL_GOOD : WAL_ERROR;
+}
+
+uint64_t Wal::fileSize()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->fileBytes;
+}
+
+uint64_t Wal::appendLocked(std::string_view payload, uint32_t crc)
+{
+    if(payload.empty() || this->error != 0)
+        return 0;
+    putBatch(this->buffer, payload, crc);
+    this->appended += BATCH_HEADER + payload.size();
+    return this->appended;
+}
+
+bool Wal::flushLocked(std::unique_lock<std::mutex>& guard, bool sync)
+{
+    while(this->flushing)
+        this->flushed.wait(guard);
+    if(this->error != 0)
+        return false;
+    if(this->buffer.empty())
+        return true;
+    this->flushing = true;
+    this->writing.swap(this->buffer);
+    uint64_t end = this->appended;
+    guard.unlock();
+    bool ok = writeAll(this->fd, this->writing.data(), this->writing.size()) && (!sync || fdatasync(this->fd) == 0);
+    int code = ok ? 0 : errno;
+    size_t bytes = this->writing.size();
+    this->writing.clear();
+    guard.lock();
+    this->flushing = false;
+    if(ok)
+    {
+        this->written = end;
+        this->fileBytes += bytes;
+    }
+    else
+        this->error = code;
+    this->flushed.notify_all();
+    return ok;
+}
+
+void Wal::run()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    while(!this->stopping)
+    {
+        this->wake.wait_for(guard, std::chrono::milliseconds(this->intervalMs));
+        if(this->stopping)
+            break;
+        if(this->policy != SYNC_ALWAYS)
+            flushLocked(guard, this->policy == SYNC_EVERY);
+        if(this->error == 0 && this->fileBytes >= this->compactSize && this->fileBytes >= 2 * this->compactedBytes)
+        {
+            guard.unlock();
+            compact();
+            guard.lock();
+        }
+    }
+}
+
+bool Wal::copyRange(int out, uint64_t from, uint64_t to)
+{
+    std::string block(COPY_BLOCK, '\0');
+    while(from < to)
+    {
+        ssize_t n = pread(this->fd, &block[0], std::min<uint64_t>(COPY_BLOCK, to - from), from);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0 || !writeAll(out, block.data(), n))
+            return false;
+        from += n;
+    }
+    return true;
+}
@@ -0,0 +1,140 @@
+#ifndef Wal_hpp
+#define Wal_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+class Engine;
+
+/**
+ * This class is the write-ahead log: an append-only file of the writes made visible, from which the store is rebuilt at
+ * startup instead of replaying the command history. The file starts with an 8-byte magic, followed by batches in the
+ * order their writes became visible (see LoggedEngine):
+ *   payload length (uint32), CRC-32C of the payload (uint32), payload
+ * where the payload is a sequence of records: SET (1), UNSET (2), EXPIRE (3) or INCRBY (4) in one byte, the key
+ * length (uint32) and the key, then for SET the value length (uint32) and the value, for EXPIRE the expiry time in
+ * Unix milliseconds (int64, 0 for none) and for INCRBY the amount added (int64). Integers are little-endian. A
+ * batch is replayed whole or not at all: replay stops at the first batch that is cut short or fails its checksum,
+ * i.e. a write interrupted by a crash, and the file is truncated to the batches before it.
+ * The writes of transaction blocks that reach the store before their COMMIT are logged between the records of the
+ * block: BEGIN (5) and END (7), each with the block number (uint64), and BEFORE (6), with the block number, the key,
+ * the value (length 0xFFFFFFFF if the key was not set) and the expiry time, for the value a key had before the block
+ * first wrote it. The blocks that have no END when the replay is over were open at a crash: open() restores those
+ * values, newest block first, and logs the writes it made and an END for each block.
+ *
+ * append() only copies a batch into a memory buffer; the sync policy decides when the buffer reaches the disk:
+ *   SYNC_ALWAYS - sync() returns once the batch has been written and fsynced. A committer that finds a write in
+ *                 progress waits for it, and the next write takes the batches of everybody who arrived meanwhile, so
+ *                 concurrent commits share one write and one fsync (group commit).
+ *   SYNC_EVERY  - a background thread writes and fsyncs the buffer every interval; a crash loses at most the commits
+ *                 of the last interval.
+ *   SYNC_NONE   - the background thread writes the buffer every interval and leaves flushing to the kernel.
+ * The same thread compacts the log when it has grown past compactSize and to twice its size after the previous
+ * compaction: it folds the batches up to the current end of the file into a Database, writes the surviving
+ * key-value pairs into a new file, followed by the BEGIN and BEFORE records of the blocks still open, copies over
+ * whatever was logged in the meantime and renames the new file over the old one. Appends only wait while the last
+ * few batches are copied, and the time to replay the log at startup stays proportional to the number of keys rather
+ * than to the number of writes ever made.
+ * Write errors are sticky: once a write or fsync has failed, status() is WAL_ERROR and nothing more is written.
+ */
+class Wal
+{
+public:
+    enum
+    {
+        WAL_GOOD,
+        WAL_ERROR
+    };
+
+    enum
+    {
+        SYNC_ALWAYS,
+        SYNC_EVERY,
+        SYNC_NONE
+    };
+
+    static const unsigned DEFAULT_INTERVAL_MS = 1000;
+    static const uint64_t DEFAULT_COMPACT_SIZE = 64 * 1024 * 1024;
+
+    Wal(const std::string& inPath, int inPolicy = SYNC_EVERY, unsigned inIntervalMs = DEFAULT_INTERVAL_MS,
+        uint64_t inCompactSize = DEFAULT_COMPACT_SIZE);
+    ~Wal(); // Write out every batch appended and stop the background thread.
+
+    // Replay the log into an engine, creating the file if needed, roll back the blocks left open and start logging.
+    int open(Engine& engine);
+
+    static void encodeSet(std::string& payload, std::string_view key, std::string_view value);
+    static void encodeUnset(std::string& payload, std::string_view key);
+    static void encodeExpire(std::string& payload, std::string_view key, int64_t deadlineMs);
+    static void encodeIncrBy(std::string& payload, std::string_view key, int64_t delta);
+    static void encodeBegin(std::string& payload, uint64_t block);
+    // The value of a key, nullptr if it was not set, and its expiry time, before block first wrote it.
+    static void encodeBefore(std::string& payload, uint64_t block, std::string_view key, const std::string_view* value,
+                             int64_t deadlineMs);
+    static void encodeEnd(std::string& payload, uint64_t block);
+    uint64_t newBlock() {return this->blocks++;} // A block number not used by the log yet.
+
+    // Run apply, which makes a batch visible in the store and returns whether it changed anything, and append the
+    // batch if so, so that batches are logged in the order their writes were applied. Return the batch's log sequence
+    // number for sync(), or 0 if nothing was appended.
+    template <typename Apply>
+    uint64_t append(std::string_view payload, Apply apply)
+    {
+        uint32_t crc = checksum(payload);
+        std::lock_guard<std::mutex> guard(this->lock);
+        return apply() ? appendLocked(payload, crc) : 0;
+    }
+    // Like append(), for a batch that depends on the state its writes leave: apply makes them visible and encodes the
+    // batch into payload, which is appended unless it is empty.
+    template <typename Apply>
+    uint64_t appendApplied(std::string& payload, Apply apply)
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        apply();
+        return appendLocked(payload, checksum(payload));
+    }
+    void sync(uint64_t lsn); // Return once the batch is as durable as the policy requires.
+
+    int compact(); // Rewrite the log to the current key-value pairs now.
+    int status() const {return this->error == 0 ? WAL_GOOD : WAL_ERROR;}
+    int lastError() const {return this->error;} // The errno of the failed write, if any.
+    uint64_t fileSize(); // Current size of the log file.
+
+private:
+    Wal(const Wal& wal);
+    Wal& operator=(const Wal& wal);
+
+    std::string path;
+    int policy;
+    unsigned intervalMs;
+    uint64_t compactSize;
+    int fd;
+    std::mutex lock; // Orders append() and guards every member below.
+    std::condition_variable flushed; // Signalled when a write of the buffer ends.
+    std::condition_variable wake; // Wakes the background thread to stop.
+    std::string buffer; // Batches appended but not written yet.
+    std::string writing; // The buffer taken by the write in progress.
+    uint64_t appended; // Bytes appended since open(); the sequence number of the last batch.
+    uint64_t written; // Bytes of appended that are in the file, and fsynced unless the policy is SYNC_NONE.
+    uint64_t fileBytes; // Size of the file.
+    uint64_t compactedBytes; // Size of the file after the last compaction, 0 before the first one.
+    bool flushing; // A thread is writing to the file; no one else may touch it.
+    bool compacting;
+    bool stopping;
+    std::atomic<int> error; // errno of the first failed write, or 0.
+    std::atomic<uint64_t> blocks; // The next block number.
+    std::thread background;
+
+    static uint32_t checksum(std::string_view payload);
+    uint64_t appendLocked(std::string_view payload, uint32_t crc);
+    bool flushLocked(std::unique_lock<std::mutex>& guard, bool sync); // Write the buffer, unlocked meanwhile.
+    void run(); // Background thread.
+    bool copyRange(int out, uint64_t from, uint64_t to); // Append bytes of the log file to another file.
+};
+
+#endif /* Wal_hpp */
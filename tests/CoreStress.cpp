@@ -0,0 +1,211 @@
+#include "../bench/BenchUtil.hpp"
+#include "../src/CoreDatabase.hpp"
+#include "../src/Engine.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Stress test of the transactions of CoreEngine across cores. Each writer session owns pairs of keys whose two keys,
+ * a and b, are on different cores, and writes them in transaction blocks only: BEGIN, SET a to a new number, SET b to
+ * the same number, sometimes in a nested block, then ROLLBACK or COMMIT. The numbers of a pair only grow and a is
+ * always written before b, so in any state the store goes through, a holds a number at least as large as b. A
+ * rollback of a block restores both keys; if it restored a before b on its own, b would be seen ahead of a for a
+ * moment, so it must be atomic across the two cores. Reader threads check the invariant from exclusive(), which
+ * stops every core, and writers check that GET returns what they wrote. At the end every key is compared with the
+ * writer's model of it.
+ *
+ * Usage: simpleDB_core_stress [seconds] [cores] [writers] [readers]   (default: 5 4 3 1). Exits with 1 on the first
+ *                                                                      failure.
+ */
+
+static const size_t PAIRS = 16; // Per writer.
+
+static std::atomic<bool> stop(false);
+static std::atomic<bool> failed(false);
+static std::mutex reportLock;
+
+static void fail(const std::string& message)
+{
+    std::lock_guard<std::mutex> guard(reportLock);
+    if(!failed.exchange(true))
+        std::printf("FAILED: %s\n", message.c_str());
+    stop = true;
+}
+
+struct Pair
+{
+    std::string a;
+    std::string b;
+    uint64_t valueA; // What the writer expects the keys to hold.
+    uint64_t valueB;
+};
+
+// The pairs of a writer, with b moved to another core than a.
+static std::vector<Pair> makePairs(const CoreDatabase& db, size_t writer)
+{
+    std::vector<Pair> pairs;
+    for(size_t i = 0; i < PAIRS; i++)
+    {
+        Pair pair;
+        pair.a = "w" + std::to_string(writer) + ":a" + std::to_string(i);
+        for(size_t k = 0; pair.b.empty() || (db.coreCount() > 1 && db.shardOf(pair.b) == db.shardOf(pair.a)); k++)
+            pair.b = "w" + std::to_string(writer) + ":b" + std::to_string(i) + ":" + std::to_string(k);
+        pair.valueA = pair.valueB = 0;
+        pairs.push_back(pair);
+    }
+    return pairs;
+}
+
+static void checkGet(Engine& engine, const std::string& key, uint64_t expected)
+{
+    std::string value;
+    if(engine.dbGet(key, value) != Database::DB_GOOD || value != std::to_string(expected))
+        fail("GET " + key + " is " + value + ", expected " + std::to_string(expected));
+}
+
+static void write(std::shared_ptr<CoreDatabase> db, std::vector<Pair>& pairs, uint64_t seed, size_t& blocks)
+{
+    std::shared_ptr<Engine> engine = Engine::create(db);
+    Random random(seed);
+    uint64_t next = 0;
+    for(Pair& pair: pairs)
+    {
+        engine->dbSet(pair.a, "0");
+        engine->dbSet(pair.b, "0");
+    }
+    while(!stop)
+    {
+        uint64_t r = random.next();
+        Pair& pair = pairs[(r >> 16) % PAIRS];
+        uint64_t oldA = pair.valueA, oldB = pair.valueB, value = ++next;
+        engine->begin();
+        engine->dbSet(pair.a, std::to_string(value));
+        pair.valueA = value;
+        if(r % 4 == 0)
+        {
+            // b in a nested block, which is rolled back or closed into the outer one.
+            engine->begin();
+            engine->dbSet(pair.b, std::to_string(value));
+            if((r >> 8) % 2 == 0)
+                engine->rollback();
+            else
+            {
+                engine->commitBlock();
+                pair.valueB = value;
+            }
+        }
+        else
+        {
+            engine->dbSet(pair.b, std::to_string(value));
+            pair.valueB = value;
+        }
+        checkGet(*engine, pair.a, pair.valueA);
+        checkGet(*engine, pair.b, pair.valueB);
+        if((r >> 4) % 3 == 0)
+            engine->commit();
+        else
+        {
+            engine->rollback();
+            pair.valueA = oldA;
+            pair.valueB = oldB;
+        }
+        checkGet(*engine, pair.a, pair.valueA);
+        checkGet(*engine, pair.b, pair.valueB);
+        blocks++;
+    }
+}
+
+static uint64_t parse(const std::string& key, const std::string& value)
+{
+    char* end = nullptr;
+    uint64_t n = std::strtoull(value.c_str(), &end, 10);
+    if(value.empty() || *end != '\0')
+        fail(key + " holds " + value);
+    return n;
+}
+
+static void read(std::shared_ptr<CoreDatabase> db, const std::vector<std::vector<Pair> >& writers, size_t& rounds)
+{
+    CoreDatabase::Channel channel(*db);
+    std::string a, b;
+    while(!stop)
+    {
+        db->exclusive(channel, [&]() {
+            for(const std::vector<Pair>& pairs: writers)
+            {
+                for(const Pair& pair: pairs)
+                {
+                    // Keys are set before the writers start their blocks.
+                    if(db->shard(db->shardOf(pair.a)).dbGet(pair.a, a) != Database::DB_GOOD ||
+                       db->shard(db->shardOf(pair.b)).dbGet(pair.b, b) != Database::DB_GOOD)
+                        continue;
+                    if(parse(pair.a, a) < parse(pair.b, b))
+                        fail(pair.b + " is " + b + " while " + pair.a + " is " + a);
+                }
+            }
+        });
+        rounds++;
+    }
+}
+
+static bool compare(std::shared_ptr<CoreDatabase> db, const std::vector<std::vector<Pair> >& writers)
+{
+    std::shared_ptr<Engine> engine = Engine::create(db);
+    std::string value;
+    for(const std::vector<Pair>& pairs: writers)
+    {
+        for(const Pair& pair: pairs)
+        {
+            if(engine->dbGet(pair.a, value) != Database::DB_GOOD || value != std::to_string(pair.valueA) ||
+               engine->dbGet(pair.b, value) != Database::DB_GOOD || value != std::to_string(pair.valueB))
+            {
+                std::printf("FAILED: %s or %s differs from the model\n", pair.a.c_str(), pair.b.c_str());
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    double seconds = argc > 1 ? std::atof(argv[1]) : 5;
+    size_t cores = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4;
+    size_t writers = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 3;
+    size_t readers = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 1;
+
+    auto db = std::shared_ptr<CoreDatabase>(new CoreDatabase(cores, false));
+    std::vector<std::vector<Pair> > pairs;
+    for(size_t w = 0; w < writers; w++)
+        pairs.push_back(makePairs(*db, w));
+    std::vector<size_t> blocks(writers, 0), rounds(readers, 0);
+    std::vector<std::thread> threads;
+    for(size_t w = 0; w < writers; w++)
+        threads.emplace_back([&, w]() {write(db, pairs[w], w + 1, blocks[w]);});
+    for(size_t t = 0; t < readers; t++)
+        threads.emplace_back([&, t]() {read(db, pairs, rounds[t]);});
+    Timer timer;
+    while(!stop && timer.seconds() < seconds)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stop = true;
+    for(std::thread& thread: threads)
+        thread.join();
+
+    size_t totalBlocks = 0, totalRounds = 0;
+    for(size_t count: blocks)
+        totalBlocks += count;
+    for(size_t count: rounds)
+        totalRounds += count;
+    std::printf("%zu cores, %zu writers, %zu blocks, %zu readers, %zu exclusive reads in %.1f s\n", db->coreCount(),
+                writers, totalBlocks, readers, totalRounds, timer.seconds());
+    if(failed || !compare(db, pairs))
+        return 1;
+    std::printf("Core stress test is OK!\n");
+    return 0;
+}
@@ -0,0 +1,243 @@
+#include "../bench/BenchUtil.hpp"
+#include "../src/Database.hpp"
+#include "../src/Engine.hpp"
+#include "../src/RcuDatabase.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Stress test of the lock-free read path of RcuDatabase. One writer session runs SETs, UNSETs and nested transaction
+ * blocks that are committed or rolled back, while reader threads call dbGet() and dbNumEqualTo() without any lock and
+ * check everything they observe:
+ *   - every value is well formed: "<n>#" followed by filler bytes whose length and character are derived from n, so
+ *     a value torn between two writes, or read from freed memory, does not parse back to itself. Lengths go from 2
+ *     to 300 bytes, so both short and long values are overwritten;
+ *   - the "mono:" keys are only written outside of blocks with increasing numbers, so one reader must never see one
+ *     of them go backwards;
+ *   - the value "token" is moved from one "tok:" key to another by a SET of the new key followed by an UNSET of the
+ *     old one, so NUMEQUALTO token is always 1 or 2.
+ * The writer mirrors every command on a plain Database with an undo engine, and at the end every key and count of the
+ * RcuDatabase is compared with the mirror. The key space is small and keys are unset often, so the tables grow,
+ * shrink and are copied all the time and retired memory is recycled while readers run.
+ *
+ * Usage: simpleDB_rcu_stress [seconds] [readers]   (default: 5 4). Exits with 1 on the first failure.
+ */
+
+static const size_t KEYS = 2000;
+static const size_t MONO_KEYS = 16;
+static const size_t TOKEN_KEYS = 8;
+
+static std::atomic<bool> stop(false);
+static std::atomic<bool> failed(false);
+static std::mutex reportLock;
+
+static void fail(const std::string& message)
+{
+    std::lock_guard<std::mutex> guard(reportLock);
+    if(!failed.exchange(true))
+        std::printf("FAILED: %s\n", message.c_str());
+    stop = true;
+}
+
+static std::string makeValue(uint64_t n)
+{
+    std::string value = std::to_string(n) + "#";
+    value.append(n * 7 % 300, (char)('a' + n % 26));
+    return value;
+}
+
+// Return the number a value was made from, or -1 if it is not a well-formed value.
+static long long parseValue(const std::string& value)
+{
+    size_t mark = value.find('#');
+    if(mark == 0 || mark == std::string::npos || mark > 20)
+        return -1;
+    uint64_t n = 0;
+    for(size_t i = 0; i < mark; i++)
+    {
+        if(value[i] < '0' || value[i] > '9')
+            return -1;
+        n = n * 10 + (value[i] - '0');
+    }
+    return value == makeValue(n) ? (long long)n : -1;
+}
+
+// One writer session on the RcuDatabase and its mirror.
+class Writer
+{
+public:
+    Writer(std::shared_ptr<RcuDatabase> db, std::shared_ptr<Database> inMirror):
+        rcu(Engine::create(db)), mirror(Engine::create(Engine::ENGINE_UNDO, inMirror)) {}
+
+    void set(const std::string& key, const std::string& value) {rcu->dbSet(key, value); mirror->dbSet(key, value);}
+    void unset(const std::string& key) {rcu->dbUnset(key); mirror->dbUnset(key);}
+    void begin() {rcu->begin(); mirror->begin();}
+    void rollback() {rcu->rollback(); mirror->rollback();}
+    void commit() {rcu->commit(); mirror->commit();}
+    size_t depth() const {return rcu->depth();}
+
+private:
+    std::shared_ptr<Engine> rcu;
+    std::shared_ptr<Engine> mirror;
+};
+
+static void write(std::shared_ptr<RcuDatabase> db, std::shared_ptr<Database> mirror, size_t& writes)
+{
+    Writer writer(db, mirror);
+    Random random(1);
+    uint64_t next = 0;
+    size_t token = 0;
+    writer.set("tok:0", "token");
+    for(size_t i = 0; i < MONO_KEYS; i++)
+        writer.set("mono:" + std::to_string(i), makeValue(next++));
+    while(!stop)
+    {
+        uint64_t r = random.next();
+        std::string key = "key:" + std::to_string((r >> 16) % KEYS);
+        unsigned op = r % 100;
+        if(op < 50)
+            writer.set(key, makeValue(next++ % 5000));
+        else if(op < 75)
+            writer.unset(key);
+        else if(op < 85)
+            writer.begin();
+        else if(op < 90 && writer.depth() > 0)
+            writer.rollback();
+        else if(op < 92 && writer.depth() > 0)
+            writer.commit();
+        else if(op < 96 && writer.depth() == 0)
+            writer.set("mono:" + std::to_string((r >> 16) % MONO_KEYS), makeValue(next++));
+        else if(writer.depth() == 0)
+        {
+            size_t moved = (token + 1 + (r >> 16) % (TOKEN_KEYS - 1)) % TOKEN_KEYS;
+            writer.set("tok:" + std::to_string(moved), "token");
+            writer.unset("tok:" + std::to_string(token));
+            token = moved;
+        }
+        if(writer.depth() > 32)
+            writer.rollback();
+        writes++;
+    }
+    while(writer.depth() > 0)
+        (writes & 1) ? writer.commit() : writer.rollback();
+}
+
+static void read(const RcuDatabase& db, uint64_t seed, size_t& reads)
+{
+    Random random(seed);
+    std::vector<long long> mono(MONO_KEYS, -1);
+    std::string value;
+    int count = 0;
+    while(!stop)
+    {
+        uint64_t r = random.next();
+        unsigned op = r % 100;
+        if(op < 70)
+        {
+            std::string key = "key:" + std::to_string((r >> 16) % KEYS);
+            if(db.dbGet(key, value) == Database::DB_GOOD && parseValue(value) < 0)
+                fail("torn value of " + key + ": " + value);
+        }
+        else if(op < 85)
+        {
+            size_t index = (r >> 16) % MONO_KEYS;
+            std::string key = "mono:" + std::to_string(index);
+            if(db.dbGet(key, value) != Database::DB_GOOD)
+                fail(key + " is missing");
+            long long n = parseValue(value);
+            if(n < 0)
+                fail("torn value of " + key + ": " + value);
+            if(n < mono[index])
+                fail(key + " went back from " + std::to_string(mono[index]) + " to " + std::to_string(n));
+            mono[index] = n;
+        }
+        else if(op < 95)
+        {
+            db.dbNumEqualTo("token", count);
+            if(count < 1 || count > 2)
+                fail("NUMEQUALTO token is " + std::to_string(count));
+        }
+        else
+        {
+            db.dbNumEqualTo(makeValue((r >> 16) % 5000), count);
+            if(count < 0 || count > (int)KEYS)
+                fail("NUMEQUALTO is " + std::to_string(count));
+        }
+        reads++;
+    }
+}
+
+static bool compare(RcuDatabase& db, Database& mirror)
+{
+    std::string got, expected;
+    int gotCount, expectedCount;
+    std::vector<std::string> keys;
+    for(size_t i = 0; i < KEYS; i++)
+        keys.push_back("key:" + std::to_string(i));
+    for(size_t i = 0; i < MONO_KEYS; i++)
+        keys.push_back("mono:" + std::to_string(i));
+    for(size_t i = 0; i < TOKEN_KEYS; i++)
+        keys.push_back("tok:" + std::to_string(i));
+    for(const std::string& key: keys)
+    {
+        int status = db.dbGet(key, got);
+        if(status != mirror.dbGet(key, expected) || (status == Database::DB_GOOD && got != expected))
+        {
+            std::printf("FAILED: %s differs from the mirror\n", key.c_str());
+            return false;
+        }
+        if(status == Database::DB_GOOD)
+        {
+            db.dbNumEqualTo(got, gotCount);
+            mirror.dbNumEqualTo(got, expectedCount);
+            if(gotCount != expectedCount)
+            {
+                std::printf("FAILED: NUMEQUALTO %s is %d, expected %d\n", got.c_str(), gotCount, expectedCount);
+                return false;
+            }
+        }
+    }
+    db.reclaim();
+    if(db.retiredCount() != 0)
+    {
+        std::printf("FAILED: %zu retired blocks left without readers\n", db.retiredCount());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    double seconds = argc > 1 ? std::atof(argv[1]) : 5;
+    size_t readers = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4;
+
+    auto db = std::shared_ptr<RcuDatabase>(new RcuDatabase());
+    auto mirror = std::shared_ptr<Database>(new Database());
+    size_t writes = 0;
+    std::vector<size_t> reads(readers, 0);
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]() {write(db, mirror, writes);});
+    for(size_t t = 0; t < readers; t++)
+        threads.emplace_back([&, t]() {read(*db, t + 2, reads[t]);});
+    Timer timer;
+    while(!stop && timer.seconds() < seconds)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stop = true;
+    for(std::thread& thread: threads)
+        thread.join();
+
+    size_t totalReads = 0;
+    for(size_t count: reads)
+        totalReads += count;
+    std::printf("%zu readers, %zu reads, %zu writes in %.1f s\n", readers, totalReads, writes, timer.seconds());
+    if(failed || !compare(*db, *mirror))
+        return 1;
+    std::printf("RCU stress test is OK!\n");
+    return 0;
+}
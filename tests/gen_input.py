@@ -0,0 +1,51 @@
+"""
+Generate a large, repeatable command file for throughput measurements.
+
+Usage: python gen_input.py <num_commands> [num_keys] [num_values] [seed] > input.big
+
+The mix is roughly 40% SET, 35% GET, 10% UNSET, 10% NUMEQUALTO and 5% transaction
+commands (BEGIN/ROLLBACK/COMMIT). The file always ends with END.
+"""
+import random
+import sys
+
+
+def main():
+    num_commands = int(sys.argv[1]) if len(sys.argv) > 1 else 1000000
+    num_keys = int(sys.argv[2]) if len(sys.argv) > 2 else 100000
+    num_values = int(sys.argv[3]) if len(sys.argv) > 3 else 100
+    rng = random.Random(int(sys.argv[4]) if len(sys.argv) > 4 else 42)
+
+    out = sys.stdout
+    depth = 0
+    lines = []
+    for _ in range(num_commands):
+        r = rng.random()
+        key = 'key%d' % rng.randrange(num_keys)
+        value = str(rng.randrange(num_values))
+        if r < 0.40:
+            lines.append('SET %s %s' % (key, value))
+        elif r < 0.75:
+            lines.append('GET %s' % key)
+        elif r < 0.85:
+            lines.append('UNSET %s' % key)
+        elif r < 0.95:
+            lines.append('NUMEQUALTO %s' % value)
+        elif r < 0.97:
+            lines.append('BEGIN')
+            depth += 1
+        elif r < 0.99 or depth == 0:
+            lines.append('ROLLBACK')
+            depth = max(depth - 1, 0)
+        else:
+            lines.append('COMMIT')
+            depth = 0
+        if len(lines) >= 65536:
+            out.write('\n'.join(lines) + '\n')
+            lines = []
+    lines.append('END')
+    out.write('\n'.join(lines) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,80 @@
+import sys
+
+from test_server import check
+from test_wal import run
+
+# Test of --maxmemory: runs ./../bin/simpleDB with a memory limit much smaller than the keys written to it, and checks
+# that the tracked memory stays under the limit, that NUMEQUALTO still counts exactly the keys left, that keys with
+# writes pending in an open block are never evicted and are rollbacked cleanly, and that keys read often survive
+# under both policies, for each engine that supports a limit.
+#
+# Usage: python test_eviction.py [keys]
+
+VALUES = 100
+LIMIT = 2 * 1024 * 1024
+
+
+def info(options, commands):
+    out = run(options, commands + ['INFO'])
+    fields = dict(line.split(':', 1) for line in out if ':' in line and not line.startswith('#'))
+    return out, fields
+
+
+def test_limit(options, count):
+    commands = ['SET k%d v%d' % (i, i % VALUES) for i in range(count)]
+    commands += ['NUMEQUALTO v%d' % i for i in range(VALUES)]
+    out, fields = info(options, commands)
+    keys, evicted = int(fields['keys']), int(fields['evicted_keys'])
+    if evicted == 0 or int(fields['maxmemory_tracked']) > LIMIT * 11 // 10:
+        raise AssertionError('limit not kept: %r' % fields)
+    check('keys and evicted keys', keys + evicted, count)
+    check('NUMEQUALTO after eviction', sum(int(n) for n in out[:VALUES]), keys)
+
+
+def test_pending(options, count):
+    commands = ['SET old%d v%d' % (i, i % VALUES) for i in range(count // 2)] + ['BEGIN']
+    commands += ['SET new%d v%d' % (i, i % VALUES) for i in range(count // 4)]
+    commands += ['GET new%d' % i for i in range(count // 4)] + ['ROLLBACK']
+    commands += ['GET new%d' % i for i in range(0, count // 4, 97)]
+    commands += ['NUMEQUALTO v%d' % i for i in range(VALUES)]
+    out, fields = info(options, commands)
+    check('pending keys', out[:count // 4], ['v%d' % (i % VALUES) for i in range(count // 4)])
+    start = count // 4
+    check('rollbacked keys', set(out[start:start + len(range(0, count // 4, 97))]), set(['NULL']))
+    start += len(range(0, count // 4, 97))
+    check('NUMEQUALTO after rollback', sum(int(n) for n in out[start:start + VALUES]), int(fields['keys']))
+
+
+def test_hot(options, count):
+    commands = ['SET hot%d h' % i for i in range(100)]
+    for i in range(count):
+        commands.append('SET k%d v%d' % (i, i % VALUES))
+        if i % 50 == 0:
+            commands += ['GET hot%d' % j for j in range(100)]
+    commands.append('NUMEQUALTO h')
+    out = run(options, commands)
+    if int(out[-1]) < 95:
+        raise AssertionError('only %s of 100 hot keys left' % out[-1])
+
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+    ok = True
+    configs = [('undo lru', []), ('undo lfu', ['--maxmemory-policy', 'lfu']),
+               ('overlay', ['--engine=overlay']), ('shards', ['--shards', '4', '--maxmemory-samples', '10']),
+               ('cores', ['--cores', '4', '--maxmemory-samples', '10'])]
+    for name, options in configs:
+        options = ['--maxmemory', str(LIMIT)] + options
+        try:
+            test_limit(options, count)
+            test_pending(options, count)
+            test_hot(options, count)
+            print('Eviction test %s is OK!' % name)
+        except Exception as error:
+            print('Eviction test %s is not OK! %s' % (name, error))
+            ok = False
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
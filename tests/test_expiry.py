@@ -0,0 +1,129 @@
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+from test_server import Client, check, exe_file, free_port
+from test_wal import run
+
+# Test of key expiry: runs ./../bin/simpleDB with keys set by SET EX/PX and EXPIRE, and checks that TTL reports their
+# time left, that they disappear once due, also for NUMEQUALTO, that ROLLBACK restores the expiry times a block
+# changed, and that expiry times survive a restart from the write-ahead log, a compacted log and a snapshot, for each
+# engine that supports expiry. Engines without it must reply an error.
+#
+# Usage: python test_expiry.py [keys]
+
+VALUES = 10
+
+
+# Run commands, wait for pause seconds, then run more commands, in one process.
+def run_paused(options, before, pause, after):
+    process = subprocess.Popen([exe_file, '-q'] + options, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    process.stdin.write(('\n'.join(before) + '\n').encode())
+    process.stdin.flush()
+    time.sleep(pause)
+    out = process.communicate(('\n'.join(after) + '\nEND\n').encode())[0]
+    return [line[2:] if line.startswith('> ') else line for line in out.decode().split('\n')[:-1]]
+
+
+def test_ttl(options):
+    commands = ['SET a 1 EX 100', 'SET b 1 PX 100000', 'SET c 1', 'EXPIRE c 10', 'SET d 1', 'EXPIRE missing 10',
+                'TTL a', 'TTL b', 'TTL c', 'TTL d', 'TTL missing', 'SET a 2', 'TTL a', 'EXPIRE d 0', 'GET d']
+    check('TTL', run(options, commands), ['1', '0', '100', '100', '10', '-1', '-2', '-1', '1', 'NULL'])
+    check('invalid times', run(options, ['SET a 1 EX 0', 'SET a 1 PX x', 'EXPIRE a x', 'GET a']), ['NULL'])
+
+
+def test_due(options, count):
+    before = ['SET short%d %d PX 100' % (i, i % VALUES) for i in range(count)]
+    before += ['SET long%d %d EX 100' % (i, i % VALUES) for i in range(count // 10)]
+    after = ['GET short0', 'GET long0'] + ['NUMEQUALTO %d' % i for i in range(VALUES)] + ['INFO Keyspace']
+    after += ['SET short1 x', 'GET short1', 'NUMEQUALTO x', 'GET short2']
+    out = run_paused(options, before, 0.5, after)
+    check('due keys', out[:2], ['NULL', '0'])
+    check('due keys set again', out[-3:], ['x', '1', 'NULL'])
+    check('NUMEQUALTO after expiry', sum(int(n) for n in out[2:2 + VALUES]), count // 10)
+    fields = dict(line.split(':', 1) for line in out if ':' in line)
+    check('expired keys', int(fields['expired_keys']), count)
+    check('expiring keys', int(fields['expiring_keys']), count // 10)
+    check('keys', int(fields['keys']), count // 10)
+
+
+def test_rollback(options):
+    commands = ['SET a 1 EX 100', 'SET b 1', 'BEGIN', 'SET a 2', 'EXPIRE b 50', 'UNSET c', 'SET c 3 EX 10',
+                'TTL a', 'TTL b', 'ROLLBACK', 'TTL a', 'TTL b', 'TTL c', 'BEGIN', 'EXPIRE a 0', 'COMMIT', 'GET a']
+    check('rollback', run(options, commands), ['1', '-1', '50', '100', '-1', '-2', '1', 'NULL'])
+
+
+def test_restart(options, directory):
+    wal = os.path.join(directory, 'expiry.log')
+    snapshot = os.path.join(directory, 'expiry.snap')
+    commands = ['SET a 1 EX 100', 'SET b 1 PX 300', 'SET c 1', 'EXPIRE c 50', 'BEGIN', 'EXPIRE c 20', 'ROLLBACK']
+    for name, path in [('--wal', wal), ('--snapshot', snapshot)]:
+        run(options + [name, path], commands + (['SAVE'] if name == '--snapshot' else []))
+        check('restart with %s' % name, run(options + [name, path], ['TTL a', 'TTL c', 'GET b']), ['100', '50', '1'])
+        time.sleep(0.4)
+        check('due after restart with %s' % name, run(options + [name, path], ['GET b', 'NUMEQUALTO 1']),
+              ['NULL', '2'])
+
+
+def test_compaction(directory):
+    path = os.path.join(directory, 'compact.log')
+    port = free_port()
+    server = subprocess.Popen([exe_file, '--wal', path, '--wal-sync', '20', '--wal-compact-size', '20000',
+                               '--listen', '127.0.0.1:%d' % port])
+    try:
+        for i in range(100):
+            try:
+                c = Client(('127.0.0.1', port))
+                break
+            except Exception:
+                time.sleep(0.05)
+        check('SET EX', c.call('SET', 'a', '1', 'EX', '100'), b'+OK')
+        check('EXPIRE', c.call('EXPIRE', 'b', '100'), 0)
+        size = 0
+        compactions = 0
+        for i in range(20000):
+            c.send(b'SET k%d %d\r\n' % (i % 50, i))
+            if i % 100 == 99:
+                for j in range(100):
+                    c.read_reply()
+                compactions += os.path.getsize(path) < size
+                size = os.path.getsize(path)
+        c.call('END')
+    finally:
+        server.terminate()
+        server.wait()
+    if compactions == 0:
+        raise AssertionError('the log was never compacted, it reached %d bytes' % size)
+    check('TTL after compaction', run(['--wal', path], ['TTL a', 'GET k49']), ['100', '19999'])
+
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 20000
+    directory = tempfile.mkdtemp()
+    ok = True
+    for name, options in [('undo', []), ('shards', ['--shards', '4']), ('cores', ['--cores', '4'])]:
+        try:
+            test_ttl(options)
+            test_due(options, count)
+            test_rollback(options)
+            test_restart(options, directory)
+            print('Expiry test %s is OK!' % name)
+        except Exception as error:
+            print('Expiry test %s is not OK! %s' % (name, error))
+            ok = False
+    try:
+        test_compaction(directory)
+        for options in [['--engine=overlay'], ['--engine=mvcc'], ['--engine=rcu']]:
+            check('reply of %s' % options[0], run(options, ['SET a 1 EX 10', 'TTL a', 'GET a']),
+                  ['ERR expiry not supported by this engine'] * 2 + ['NULL'])
+        print('Expiry test compaction and other engines is OK!')
+    except Exception as error:
+        print('Expiry test compaction and other engines is not OK! %s' % error)
+        ok = False
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,134 @@
+import os
+import random
+import sys
+import tempfile
+
+from test_server import check
+from test_wal import run
+
+# Test of integer values: runs random SET, UNSET, INCRBY and DECRBY commands, NUMBETWEEN and NUMEQUALTO queries and
+# nested transaction blocks through ./../bin/simpleDB, and checks every reply against a model of the store, for each
+# engine that supports INCRBY. Values that only look like integers ("05", "-0", "+5") must stay strings. Then checks
+# that increments survive a restart from the write-ahead log, and that the other engines reply an error.
+#
+# Usage: python test_numbers.py [commands]
+
+KEYS = 40
+MAX = 2 ** 63 - 1
+NOT_A_NUMBER = 'ERR value is not an integer or out of range'
+
+
+def is_number(value):
+    return value == str(int(value)) if value.lstrip('-').isdigit() else False
+
+
+def random_value(rng):
+    op = rng.randrange(10)
+    if op < 6:
+        return str(rng.randrange(-20, 21))
+    if op < 7:
+        return rng.choice(['05', '-0', '+5', 'x', '1.5', str(MAX), str(-MAX - 1)])
+    return 'v%d' % rng.randrange(5)
+
+
+# Random commands and the replies they should get.
+def make_commands(rng, count):
+    commands = []
+    expected = []
+    blocks = []
+    store = {}
+    for i in range(count):
+        op = rng.randrange(100)
+        key = 'k%d' % rng.randrange(KEYS)
+        if op < 30:
+            value = random_value(rng)
+            commands.append('SET %s %s' % (key, value))
+            store[key] = value
+        elif op < 38:
+            commands.append('UNSET %s' % key)
+            store.pop(key, None)
+        elif op < 60:
+            amount = rng.choice([1, -1, rng.randrange(-100, 101), MAX, -MAX - 1])
+            name = rng.choice(['INCRBY', 'DECRBY'])
+            if name == 'DECRBY' and amount == -MAX - 1:
+                amount = MAX  # DECRBY of the smallest integer is rejected without a reply in the text protocol.
+            commands.append('%s %s %d' % (name, key, amount))
+            old = store.get(key, '0')
+            new = int(old) + (amount if name == 'INCRBY' else -amount) if is_number(old) else None
+            if new is None or not -MAX - 1 <= new <= MAX:
+                expected.append(NOT_A_NUMBER)
+            else:
+                store[key] = str(new)
+                expected.append(str(new))
+        elif op < 72:
+            low = rng.randrange(-30, 30)
+            high = low + rng.randrange(-5, 40)
+            if rng.randrange(10) == 0:
+                low, high = -MAX - 1, MAX
+            commands.append('NUMBETWEEN %d %d' % (low, high))
+            expected.append(str(sum(1 for v in store.values() if is_number(v) and low <= int(v) <= high)))
+        elif op < 78:
+            value = random_value(rng)
+            commands.append('NUMEQUALTO %s' % value)
+            expected.append(str(sum(1 for v in store.values() if v == value)))
+        elif op < 84:
+            commands.append('GET %s' % key)
+            expected.append(store.get(key, 'NULL'))
+        elif op < 92 and len(blocks) < 5:
+            commands.append('BEGIN')
+            blocks.append(dict(store))
+        elif op < 97 and blocks:
+            commands.append('ROLLBACK')
+            store = blocks.pop()
+        elif blocks:
+            commands.append('COMMIT')
+            blocks = []
+    commands += ['GET k%d' % i for i in range(KEYS)]
+    expected += [store.get('k%d' % i, 'NULL') for i in range(KEYS)]
+    return commands, expected
+
+
+def test_random(options, count):
+    rng = random.Random(5)
+    for _ in range(5):
+        commands, expected = make_commands(rng, count)
+        check('replies', run(options, commands), expected)
+
+
+def test_restart(options, directory):
+    path = os.path.join(directory, 'numbers.log')
+    if os.path.exists(path):
+        os.remove(path)
+    commands = ['SET a 10', 'INCRBY a 5', 'DECRBY b 7', 'BEGIN', 'INCRBY a 100', 'ROLLBACK', 'BEGIN', 'INCRBY b 2',
+                'COMMIT', 'SET c x', 'INCRBY c 1']
+    check('before restart', run(options + ['--wal', path], commands), ['15', '-7', '115', '-5', NOT_A_NUMBER])
+    check('after restart', run(options + ['--wal', path], ['GET a', 'GET b', 'GET c', 'NUMBETWEEN -10 20']),
+          ['15', '-5', 'x', '2'])
+
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 3000
+    directory = tempfile.mkdtemp()
+    ok = True
+    for name, options in [('undo', []), ('shards', ['--shards', '8']), ('cores', ['--cores', '4'])]:
+        try:
+            test_random(options, count)
+            test_restart(options, directory)
+            print('Numbers test %s is OK!' % name)
+        except Exception as error:
+            print('Numbers test %s is not OK! %s' % (name, error))
+            ok = False
+    try:
+        for options in [['--engine=overlay'], ['--engine=mvcc'], ['--engine=rcu']]:
+            check('reply of %s' % options[0], run(options, ['SET a 1', 'INCRBY a 1', 'NUMBETWEEN 0 5', 'GET a']),
+                  ['ERR INCRBY and DECRBY are not supported by this engine',
+                   'ERR NUMBETWEEN is not supported by this engine', '1'])
+        print('Numbers test other engines is OK!')
+    except Exception as error:
+        print('Numbers test other engines is not OK! %s' % error)
+        ok = False
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,99 @@
+import random
+import sys
+
+from test_server import check
+from test_wal import run
+
+# Test of SCAN with --ordered-index: runs random SET/UNSET commands and nested transaction blocks through
+# ./../bin/simpleDB, then pages through all keys, through prefixes and through ranges with SCAN, following the
+# cursor, and checks that the pages list exactly the keys left after the rollbacks, in order, for each engine that
+# supports the index. Every page is checked against the COUNT it was given.
+#
+# Usage: python test_scan.py [commands]
+
+USERS = 30
+FIELDS = 20
+
+
+# Random commands and the keys they leave, with every block either rolled back or committed.
+def make_commands(rng, count):
+    commands = []
+    blocks = []
+    current = set()
+    for i in range(count):
+        op = rng.randrange(100)
+        key = 'user:%d:%d' % (rng.randrange(USERS), rng.randrange(FIELDS))
+        if op < 55:
+            commands.append('SET %s v%d' % (key, rng.randrange(10)))
+            current.add(key)
+        elif op < 80:
+            commands.append('UNSET %s' % key)
+            current.discard(key)
+        elif op < 90 and len(blocks) < 5:
+            commands.append('BEGIN')
+            blocks.append(set(current))
+        elif op < 96 and blocks:
+            commands.append('ROLLBACK')
+            current = blocks.pop()
+        elif blocks:
+            commands.append('COMMIT')
+            blocks = []
+    while blocks:
+        commands.append('ROLLBACK')
+        current = blocks.pop()
+    return commands, current
+
+
+# Page through a SCAN with the given options and return the keys of every page.
+def scan_all(options, commands, scan, count):
+    # One process per page, since the cursor comes from the previous reply.
+    pages = []
+    cursor = None
+    while True:
+        line = scan + ' COUNT %d' % count + ('' if cursor is None else ' FROM ' + cursor)
+        out = run(options, commands + [line])
+        cursor, keys = out[0], out[1:]
+        if len(keys) > count:
+            raise AssertionError('%s returned %d keys' % (line, len(keys)))
+        pages.append(keys)
+        if cursor == 'NULL':
+            return pages
+        if len(pages) > 1000:
+            raise AssertionError('%s does not end' % scan)
+
+
+def test_scan(options, count):
+    rng = random.Random(3)
+    commands, keys = make_commands(rng, count)
+    keys = sorted(keys)
+    check('SCAN of all keys', sum(scan_all(options, commands, 'SCAN', 97), []), keys)
+    for user in [0, 1, 3, 12]:
+        prefix = 'user:%d:' % user
+        pages = scan_all(options, commands, 'SCAN PREFIX ' + prefix, 7)
+        check('SCAN PREFIX ' + prefix, sum(pages, []), [k for k in keys if k.startswith(prefix)])
+    pages = scan_all(options, commands, 'SCAN RANGE user:10 user:2', 13)
+    check('SCAN RANGE', sum(pages, []), [k for k in keys if 'user:10' <= k < 'user:2'])
+    check('SCAN of an empty range', run(options, commands + ['SCAN PREFIX nothing:']), ['NULL'])
+
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 3000
+    ok = True
+    for name, options in [('undo', ['--ordered-index']), ('shards', ['--ordered-index', '--shards', '8'])]:
+        try:
+            test_scan(options, count)
+            print('Scan test %s is OK!' % name)
+        except Exception as error:
+            print('Scan test %s is not OK! %s' % (name, error))
+            ok = False
+    try:
+        check('SCAN without an index', run([], ['SCAN']), ['ERR SCAN needs --ordered-index and the undo engine'])
+        print('Scan test without an index is OK!')
+    except Exception as error:
+        print('Scan test without an index is not OK! %s' % error)
+        ok = False
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,164 @@
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import time
+
+from test_server import Client, check, exe_file, free_port
+from test_wal import run
+
+# Test of EVAL: runs random compare-and-set and transfer scripts, mixed with plain commands and nested transaction
+# blocks, through ./../bin/simpleDB and checks every reply against a model of the store, for each engine (transfers
+# need INCRBY, so only on the engines that support it). A transfer from a key that does not hold an integer fails
+# half-way and must leave no change. Then checks the errors of invalid scripts, that scripts survive a restart from
+# the write-ahead log, and a script sent over RESP as one bulk string with arguments holding spaces.
+#
+# Usage: python test_script.py [commands]
+
+KEYS = 20
+CAS = '@v = GET $1; IF @v == $2; SET $1 $3; RETURN 1; END; RETURN 0'
+TRANSFER = ('@f = GET $1; IF @f == NULL; @f = 0; END; IF @f < $3; RETURN NULL; END; DECRBY $1 $3; '
+            '@t = INCRBY $2 $3; RETURN @t')
+NOT_A_NUMBER = 'ERR value is not an integer or out of range'
+
+
+def is_number(value):
+    return value == str(int(value)) if value.lstrip('-').isdigit() else False
+
+
+# Random commands and the replies they should get.
+def make_commands(rng, count, transfers):
+    commands = []
+    expected = []
+    blocks = []
+    store = {}
+    for i in range(count):
+        op = rng.randrange(100)
+        key = 'k%d' % rng.randrange(KEYS)
+        value = rng.choice([str(rng.randrange(20)), 'x'])
+        if op < 25:
+            commands.append('SET %s %s' % (key, value))
+            store[key] = value
+        elif op < 30:
+            commands.append('UNSET %s' % key)
+            store.pop(key, None)
+        elif op < 55:
+            old = rng.choice([store.get(key, 'NULL'), value])
+            commands.append('EVAL %s ARGS %s %s %s' % (CAS, key, old, value))
+            # NULL is a word like any other when passed as an argument, so it only matches a value "NULL".
+            if store.get(key) == old:
+                store[key] = value
+                expected.append('1')
+            else:
+                expected.append('0')
+        elif op < 80 and transfers:
+            to = 'k%d' % rng.randrange(KEYS)
+            amount = rng.randrange(1, 10)
+            commands.append('EVAL %s ARGS %s %s %d' % (TRANSFER, key, to, amount))
+            source = store.get(key, '0')
+            if not is_number(source):
+                expected.append("ERR script: <, <=, > and >= need integers")
+            elif int(source) < amount:
+                expected.append('NULL')
+            elif not is_number(store.get(to, '0')):
+                expected.append(NOT_A_NUMBER)  # DECRBY of the source is rolled back.
+            else:
+                store[key] = str(int(source) - amount)
+                store[to] = str(int(store.get(to, '0')) + amount)
+                expected.append(store[to])
+        elif op < 85:
+            commands.append('GET %s' % key)
+            expected.append(store.get(key, 'NULL'))
+        elif op < 92 and len(blocks) < 5:
+            commands.append('BEGIN')
+            blocks.append(dict(store))
+        elif op < 97 and blocks:
+            commands.append('ROLLBACK')
+            store = blocks.pop()
+        elif blocks:
+            commands.append('COMMIT')
+            blocks = []
+    commands += ['GET k%d' % i for i in range(KEYS)]
+    expected += [store.get('k%d' % i, 'NULL') for i in range(KEYS)]
+    return commands, expected
+
+
+def test_random(options, count, transfers):
+    rng = random.Random(11)
+    for _ in range(5):
+        commands, expected = make_commands(rng, count, transfers)
+        check('replies', run(options, commands), expected)
+
+
+def test_errors():
+    commands = ['EVAL IF a == b; SET a 1', 'EVAL ELSE', 'EVAL IF a == b; ELSE; ELSE; END', 'EVAL @x = SET a 1',
+                'EVAL FLY a', 'EVAL IF 1 <> 2; END', 'EVAL GET', 'EVAL RETURN $2 ARGS 1', 'EVAL IF a < 1; END',
+                'EVAL SET a NULL', 'EVAL @a = 1; @b = @a; @a = 2; RETURN @b', 'EVAL SET a 1', 'GET a']
+    check('errors', run([], commands),
+          ['ERR script: IF without END', 'ERR script: ELSE without IF', 'ERR script: ELSE twice in an IF',
+           'ERR script: SET has no value to assign', 'ERR script: unknown command FLY',
+           'ERR script: unknown operator <>', 'ERR script: GET needs 1 operand', 'ERR script: needs 2 arguments',
+           'ERR script: <, <=, > and >= need integers', 'ERR script: NULL operand', '1', '1'])
+
+
+def test_restart(options, directory):
+    path = os.path.join(directory, 'script.log')
+    if os.path.exists(path):
+        os.remove(path)
+    commands = ['SET a 10', 'EVAL %s ARGS a b 4' % TRANSFER, 'BEGIN', 'EVAL %s ARGS a b 1' % TRANSFER, 'ROLLBACK',
+                'SET c x', 'EVAL %s ARGS a c 1' % TRANSFER]
+    check('before restart', run(options + ['--wal', path], commands), ['4', '5', NOT_A_NUMBER])
+    check('after restart', run(options + ['--wal', path], ['GET a', 'GET b', 'GET c']), ['6', '4', 'x'])
+
+
+def test_resp():
+    port = free_port()
+    server = subprocess.Popen([exe_file, '--listen', '127.0.0.1:%d' % port])
+    try:
+        for i in range(100):
+            try:
+                c = Client(('127.0.0.1', port))
+                break
+            except Exception:
+                time.sleep(0.05)
+        check('EVAL SET', c.call('EVAL', 'SET $1 $2', 'ARGS', 'a b', 'c; d'), b'+OK')
+        check('GET', c.call('GET', 'a b'), b'c; d')
+        check('EVAL RETURN', c.call('EVAL', '@x = GET $1; RETURN @x', 'ARGS', 'a b'), b'c; d')
+        check('EVAL NULL', c.call('EVAL', 'RETURN NULL'), None)
+        check('EVAL error', c.call('EVAL', 'INCRBY $1 1', 'ARGS', 'a b'), b'-' + NOT_A_NUMBER.encode())
+        check('EVAL without script', c.call('EVAL'), b"-ERR wrong number of arguments for 'EVAL'")
+        check('INFO', b'cmdstat_eval:calls=4' in c.call('INFO', 'commandstats'), True)
+    finally:
+        server.terminate()
+        server.wait()
+
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 3000
+    directory = tempfile.mkdtemp()
+    ok = True
+    for name, options, transfers in [('undo', [], True), ('shards', ['--shards', '8'], True),
+                                     ('cores', ['--cores', '4'], True),
+                                     ('overlay', ['--engine=overlay'], False), ('mvcc', ['--engine=mvcc'], False),
+                                     ('rcu', ['--engine=rcu'], False)]:
+        try:
+            test_random(options, count, transfers)
+            if transfers:
+                test_restart(options, directory)
+            print('Script test %s is OK!' % name)
+        except Exception as error:
+            print('Script test %s is not OK! %s' % (name, error))
+            ok = False
+    try:
+        test_errors()
+        test_resp()
+        print('Script test errors and RESP is OK!')
+    except Exception as error:
+        print('Script test errors and RESP is not OK! %s' % error)
+        ok = False
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
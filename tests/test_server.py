@@ -0,0 +1,302 @@
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+# Loopback test of the --listen mode: starts ./../bin/simpleDB on a Unix socket and a TCP port, checks the reply of
+# every command type, including the multi-key ones, and then runs many clients in parallel that pipeline batches of
+# requests, each inside its own transaction blocks, and verify every reply. The server runs with each engine, and with 4 worker threads on a
+# sharded database and on 4 cores.
+#
+# Usage: python test_server.py [clients] [batches] [batch_size]
+
+exe_file = './../bin/simpleDB'
+
+if not os.path.exists(exe_file):
+    print('no executable files, please compile first...')
+    sys.exit(0)
+
+
+def encode(*args):
+    out = b'*%d\r\n' % len(args)
+    for arg in args:
+        if not isinstance(arg, bytes):
+            arg = str(arg).encode()
+        out += b'$%d\r\n' % len(arg) + arg + b'\r\n'
+    return out
+
+
+class Client(object):
+    def __init__(self, address):
+        if isinstance(address, str):
+            self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        else:
+            self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.sock.connect(address)
+        self.buffer = b''
+        self.pos = 0
+
+    def send(self, data):
+        self.sock.sendall(data)
+
+    def fill(self):
+        chunk = self.sock.recv(65536)
+        if not chunk:
+            raise EOFError('connection closed')
+        self.buffer = self.buffer[self.pos:] + chunk
+        self.pos = 0
+
+    def read_line(self):
+        end = self.buffer.find(b'\r\n', self.pos)
+        while end < 0:
+            self.fill()
+            end = self.buffer.find(b'\r\n', self.pos)
+        line = self.buffer[self.pos:end]
+        self.pos = end + 2
+        return line
+
+    def read_reply(self):
+        line = self.read_line()
+        if line == b'$-1':
+            return None
+        if line[:1] == b'$':
+            size = int(line[1:])
+            while len(self.buffer) - self.pos < size + 2:
+                self.fill()
+            value = self.buffer[self.pos:self.pos + size]
+            self.pos += size + 2
+            return value
+        if line[:1] == b':':
+            return int(line[1:])
+        if line[:1] == b'*':
+            return [self.read_reply() for i in range(int(line[1:]))]
+        return line
+
+    def call(self, *args):
+        self.send(encode(*args))
+        return self.read_reply()
+
+    def close(self):
+        self.sock.close()
+
+
+def check(name, got, expected):
+    if got != expected:
+        raise AssertionError('%s: got %r, expected %r' % (name, got, expected))
+
+
+def test_commands(address):
+    c = Client(address)
+    for key in ['a', 'b key']:
+        c.call('UNSET', key)
+    check('GET missing', c.call('GET', 'a'), None)
+    check('SET', c.call('SET', 'a', '10'), b'+OK')
+    check('GET', c.call('GET', 'a'), b'10')
+    check('NUMEQUALTO', c.call('NUMEQUALTO', '10'), 1)
+    value = b'two words\r\n$-1\r\n\x00binary'
+    check('SET binary', c.call('SET', 'b key', value), b'+OK')
+    check('GET binary', c.call('GET', 'b key'), value)
+    check('ROLLBACK empty', c.call('ROLLBACK'), b'-NO TRANSACTION')
+    check('BEGIN', c.call('BEGIN'), b'+OK')
+    check('SET in tx', c.call('SET', 'a', '20'), b'+OK')
+    check('UNSET', c.call('UNSET', 'b key'), b'+OK')
+    check('ROLLBACK', c.call('ROLLBACK'), b'+OK')
+    check('GET after rollback', c.call('GET', 'a'), b'10')
+    check('GET binary after rollback', c.call('GET', 'b key'), value)
+    check('COMMIT empty', c.call('COMMIT'), b'-NO TRANSACTION')
+    check('unknown', c.call('FLY', 'away'), b'-ERR unknown command')
+    c.send(b'GET a\r\nNUMEQUALTO 10\n')
+    check('inline GET', c.read_reply(), b'10')
+    check('inline NUMEQUALTO', c.read_reply(), 1)
+    check('MSET', c.call('MSET', 'm1', 'x', 'm2', 'y', 'm3', 'x'), b'+OK')
+    check('MGET', c.call('MGET', 'm1', 'missing', 'm3'), [b'x', None, b'x'])
+    check('NUMEQUALTO many', c.call('NUMEQUALTO', 'x', 'y', 'z'), [2, 1, 0])
+    check('MSET odd', c.call('MSET', 'm1', 'x', 'm2'), b"-ERR wrong number of arguments for 'MSET'")
+    check('BEGIN before MUNSET', c.call('BEGIN'), b'+OK')
+    check('MUNSET', c.call('MUNSET', 'm1', 'm2', 'missing'), b'+OK')
+    check('MGET after MUNSET', c.call('MGET', 'm1', 'm2', 'm3'), [None, None, b'x'])
+    check('ROLLBACK MUNSET', c.call('ROLLBACK'), b'+OK')
+    check('MGET after rollback', c.call('MGET', 'm1', 'm2'), [b'x', b'y'])
+    check('MUNSET cleanup', c.call('MUNSET', 'm1', 'm2', 'm3'), b'+OK')
+    check('BEGIN before INFO', c.call('BEGIN'), b'+OK')
+    check('SET before INFO', c.call('SET', 'a', '11'), b'+OK')
+    info = dict(line.split(b':', 1) for line in c.call('INFO').split(b'\r\n') if b':' in line)
+    check('INFO tx_depth', info.get(b'tx_depth'), b'1')
+    check('INFO undo_entries', info.get(b'undo_entries'), b'1')
+    check('INFO cmdstat_mset', info.get(b'cmdstat_mset', b'').startswith(b'calls='), True)
+    check('INFO section', c.call('INFO', 'keyspace').split(b'\r\n')[0], b'# Keyspace')
+    check('ROLLBACK after INFO', c.call('ROLLBACK'), b'+OK')
+
+    # A client that disconnects inside a transaction block has it rolled back.
+    d = Client(address)
+    d.call('BEGIN')
+    d.call('SET', 'a', '30')
+    d.close()
+    time.sleep(0.2)
+    check('GET after disconnect', c.call('GET', 'a'), b'10')
+    check('END', c.call('END'), b'+OK')
+    c.close()
+
+
+def test_isolation(address):
+    a = Client(address)
+    b = Client(address)
+    a.call('SET', 'iso', 'old')
+    a.call('BEGIN')
+    a.call('SET', 'iso', 'new')
+    check('GET during open block', b.call('GET', 'iso'), b'old')
+    check('NUMEQUALTO during open block', b.call('NUMEQUALTO', 'new'), 0)
+    check('BEGIN snapshot', b.call('BEGIN'), b'+OK')
+    check('COMMIT', a.call('COMMIT'), b'+OK')
+    check('GET in older snapshot', b.call('GET', 'iso'), b'old')
+    check('NUMEQUALTO in older snapshot', b.call('NUMEQUALTO', 'old'), 1)
+    check('ROLLBACK snapshot', b.call('ROLLBACK'), b'+OK')
+    check('GET after commit', b.call('GET', 'iso'), b'new')
+    check('NUMEQUALTO after commit', b.call('NUMEQUALTO', 'new'), 1)
+    a.call('UNSET', 'iso')
+    a.close()
+    b.close()
+
+
+# Two blocks write the same key: the first COMMIT wins, and the later one fails and rolls its block back. A block that
+# writes other keys still commits.
+def test_conflict(address):
+    a = Client(address)
+    b = Client(address)
+    a.call('SET', 'cf', '0')
+    a.call('BEGIN')
+    b.call('BEGIN')
+    a.call('SET', 'cf', '1')
+    b.call('SET', 'cf', '2')
+    b.call('SET', 'cf other', '2')
+    check('first COMMIT', a.call('COMMIT'), b'+OK')
+    check('conflicting COMMIT', b.call('COMMIT'), b'-ERR write conflict, the transaction was rolled back')
+    check('GET after conflict', b.call('GET', 'cf'), b'1')
+    check('GET rolled back', b.call('GET', 'cf other'), None)
+    check('depth after conflict', b.call('COMMIT'), b'-NO TRANSACTION')
+    a.call('BEGIN')
+    b.call('BEGIN')
+    a.call('SET', 'cf', '3')
+    b.call('SET', 'cf other', '3')
+    check('COMMIT of other keys', b.call('COMMIT'), b'+OK')
+    check('COMMIT after other keys', a.call('COMMIT'), b'+OK')
+    check('GET after both', b.call('MGET', 'cf', 'cf other'), [b'3', b'3'])
+    a.call('MUNSET', 'cf', 'cf other')
+    a.close()
+    b.close()
+
+
+# The overlay engine reads the newest committed values: a block's NUMEQUALTO must count what another session commits
+# to a key the block writes too.
+def test_overlay_counts(address):
+    a = Client(address)
+    b = Client(address)
+    a.call('SET', 'ov', 'X')
+    b.call('BEGIN')
+    b.call('SET', 'ov', 'Z')
+    a.call('SET', 'ov', 'Y')
+    check('NUMEQUALTO of a replaced value', b.call('NUMEQUALTO', 'X'), 0)
+    check('NUMEQUALTO of a committed value', b.call('NUMEQUALTO', 'Y'), 0)
+    check('NUMEQUALTO of the own value', b.call('NUMEQUALTO', 'Z'), 1)
+    b.call('SET', 'ov', 'Y')
+    a.call('SET', 'ov', 'X')
+    check('NUMEQUALTO of a value set again', b.call('NUMEQUALTO', 'Y'), 1)
+    check('COMMIT', b.call('COMMIT'), b'+OK')
+    check('GET after commit', a.call('GET', 'ov'), b'Y')
+    check('NUMEQUALTO after commit', a.call('NUMEQUALTO', 'X'), 0)
+    a.call('UNSET', 'ov')
+    a.close()
+    b.close()
+
+
+def run_client(address, index, batches, batch_size, errors):
+    try:
+        c = Client(address)
+        for batch in range(batches):
+            request = [encode('BEGIN')]
+            expected = [b'+OK']
+            for i in range(batch_size):
+                key = 'c%d:k%d' % (index, i)
+                request.append(encode('SET', key, batch))
+                request.append(encode('GET', key))
+                expected += [b'+OK', str(batch).encode()]
+            request.append(encode('ROLLBACK') if batch % 2 else encode('COMMIT'))
+            expected.append(b'+OK')
+            request.append(encode('GET', 'c%d:k0' % index))
+            expected.append(str(batch - 1 if batch % 2 else batch).encode())
+            c.send(b''.join(request))
+            for i, value in enumerate(expected):
+                check('client %d batch %d reply %d' % (index, batch, i), c.read_reply(), value)
+        c.close()
+    except Exception as error:
+        errors.append(error)
+
+
+def test_load(address, clients, batches, batch_size):
+    errors = []
+    threads = [threading.Thread(target=run_client, args=(address, i, batches, batch_size, errors))
+               for i in range(clients)]
+    start = time.time()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    seconds = time.time() - start
+    if errors:
+        raise errors[0]
+    requests = clients * batches * (2 * batch_size + 3)
+    print('%d clients, %d requests in %.2f s (%.0f requests/s)' % (clients, requests, seconds, requests / seconds))
+
+
+def free_port():
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.bind(('127.0.0.1', 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+
+def main():
+    clients = int(sys.argv[1]) if len(sys.argv) > 1 else 16
+    batches = int(sys.argv[2]) if len(sys.argv) > 2 else 50
+    batch_size = int(sys.argv[3]) if len(sys.argv) > 3 else 100
+    path = os.path.join(tempfile.mkdtemp(), 'simpleDB.sock')
+    port = free_port()
+    ok = True
+    configs = [('undo', ['--engine=undo']), ('overlay', ['--engine=overlay']), ('threads', ['--threads', '4']),
+               ('mvcc', ['--engine=mvcc', '--threads', '4']), ('rcu', ['--engine=rcu', '--threads', '4']),
+               ('cores', ['--cores', '4', '--threads', '4'])]
+    for engine, options in configs:
+        server = subprocess.Popen([exe_file] + options + ['--listen', 'unix:' + path,
+                                                          '--listen', '127.0.0.1:%d' % port])
+        try:
+            for i in range(100):
+                if os.path.exists(path):
+                    break
+                time.sleep(0.05)
+            for address in [path, ('127.0.0.1', port)]:
+                name = 'unix' if isinstance(address, str) else 'tcp'
+                try:
+                    Client(address).call('NUMEQUALTO', '0')
+                    test_commands(address)
+                    if engine == 'mvcc':
+                        test_isolation(address)
+                        test_conflict(address)
+                    if engine == 'overlay':
+                        test_overlay_counts(address)
+                    test_load(address, clients, batches, batch_size)
+                    print('Server test %s %s is OK!' % (engine, name))
+                except Exception as error:
+                    print('Server test %s %s is not OK! %s' % (engine, name, error))
+                    ok = False
+        finally:
+            server.terminate()
+            server.wait()
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,143 @@
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import time
+
+from test_server import Client, check, exe_file, free_port
+from test_wal import KEYS, VALUES, connect, dump, expected_dump, make_commands, run
+
+# Restart test of SAVE, BGSAVE and --snapshot: runs random commands through ./../bin/simpleDB, saves, restarts it on
+# the snapshot and checks that it holds exactly the saved state, for each engine. A larger database is saved too, so
+# that the file has several sections to load in parallel, and a save inside a block that is then rolled back must not
+# keep the block's writes, nor a save by another connection while the block is open. Then a server with worker
+# threads takes a BGSAVE while clients keep writing, and finally a damaged snapshot must be refused at startup.
+#
+# Usage: python test_snapshot.py [commands]
+
+
+def test_restart(options, path, count):
+    rng = random.Random(2)
+    state = {}
+    for round in range(3):
+        commands, state = make_commands(rng, count, state, True)
+        commands.append('SAVE' if round % 2 else 'BGSAVE')
+        run(options + ['--snapshot', path], commands)
+        check('state after restart %d' % round, dump(options + ['--snapshot', path]), expected_dump(state))
+
+
+def test_sections(options, path):
+    commands = ['SET big%d %s' % (i, str(i % 1000) * 40) for i in range(100000)] + ['UNSET big7', 'SAVE']
+    run(options + ['--snapshot', path], commands)
+    if os.path.getsize(path) < 3 * 4 * 1024 * 1024:
+        raise AssertionError('the snapshot is too small to have several sections')
+    got = run(options + ['--snapshot', path], ['GET big6', 'GET big7', 'GET big99999', 'NUMEQUALTO ' + '999' * 40])
+    check('large snapshot', got, ['6' * 40, 'NULL', '999' * 40, '100'])
+
+
+def test_rollback(options, path):
+    run(options + ['--snapshot', path], ['SET a 0', 'SAVE', 'BEGIN', 'SET a 1', 'SAVE', 'ROLLBACK', 'BEGIN', 'SET b 1',
+                                         'BGSAVE', 'ROLLBACK'])
+    check('save in a rolled back block', run(options + ['--snapshot', path], ['GET a', 'GET b']), ['0', 'NULL'])
+
+
+# Session a writes in a block and b saves before a rolls the block back: the snapshot must not have a's write, so the
+# engines that apply it to the store at once refuse the save until the block is closed.
+def test_sessions(options, path):
+    if os.path.exists(path):
+        os.remove(path)
+    port = free_port()
+    server = subprocess.Popen([exe_file, '--snapshot', path, '--listen', '127.0.0.1:%d' % port] + options)
+    try:
+        a = connect(port)
+        b = Client(('127.0.0.1', port))
+        a.call('SET', 'a', '0')
+        a.call('BEGIN')
+        a.call('SET', 'a', '1')
+        saved = b.call('SAVE')
+        if saved != b'+OK':
+            check('SAVE with a block open', saved, b'-ERR SAVE while another session has a block open')
+            check('BGSAVE with a block open', b.call('BGSAVE'), b'-ERR BGSAVE while another session has a block open')
+        a.call('ROLLBACK')
+        if saved != b'+OK':
+            check('SAVE after the block', b.call('SAVE'), b'+OK')
+        a.call('END')
+        b.call('END')
+    finally:
+        server.terminate()
+        server.wait()
+    check('save of another session\'s block', run(options + ['--snapshot', path], ['GET a']), ['0'])
+
+
+def test_background(path):
+    port = free_port()
+    server = subprocess.Popen([exe_file, '--threads', '4', '--snapshot', path, '--listen', '127.0.0.1:%d' % port])
+    try:
+        for i in range(100):
+            try:
+                c = Client(('127.0.0.1', port))
+                break
+            except Exception:
+                time.sleep(0.05)
+        for i in range(KEYS):
+            c.call('SET', 'k%d' % i, i % VALUES)
+        writer = Client(('127.0.0.1', port))
+        writer.send(b''.join(b'SET w%d x%d\r\n' % (i, i) for i in range(20000)))
+        check('BGSAVE', c.call('BGSAVE'), b'+OK')
+        for i in range(20000):
+            writer.read_reply()
+        while c.call('BGSAVE') != b'+OK':
+            time.sleep(0.01)
+        c.call('END')
+    finally:
+        server.terminate()
+        server.wait()
+    state = dict(('k%d' % i, str(i % VALUES)) for i in range(KEYS))
+    check('state after BGSAVE', dump(['--snapshot', path]), expected_dump(state))
+    check('writes during BGSAVE', run(['--snapshot', path], ['GET w19999']), ['x19999'])
+
+
+def test_damaged(path):
+    with open(path, 'r+b') as f:
+        f.seek(20)
+        byte = f.read(1)
+        f.seek(20)
+        f.write(bytes([byte[0] ^ 1]))
+    process = subprocess.Popen([exe_file, '--snapshot', path], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                               stderr=subprocess.PIPE)
+    out, err = process.communicate(b'END\n')
+    check('exit status with damaged snapshot', process.returncode, 1)
+
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+    directory = tempfile.mkdtemp()
+    ok = True
+    configs = [('undo', []), ('overlay', ['--engine=overlay']), ('mvcc', ['--engine=mvcc']),
+               ('rcu', ['--engine=rcu']), ('shards', ['--shards', '8']),
+               ('cores', ['--cores', '4'])]
+    for name, options in configs:
+        path = os.path.join(directory, name + '.sdb')
+        try:
+            test_restart(options, path, count)
+            test_sections(options, path)
+            test_rollback(options, path)
+            test_sessions(options, path)
+            print('Snapshot test %s is OK!' % name)
+        except Exception as error:
+            print('Snapshot test %s is not OK! %s' % (name, error))
+            ok = False
+    path = os.path.join(directory, 'background.sdb')
+    try:
+        test_background(path)
+        test_damaged(path)
+        print('Snapshot background save test is OK!')
+    except Exception as error:
+        print('Snapshot background save test is not OK! %s' % error)
+        ok = False
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,219 @@
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import time
+
+from test_server import Client, check, exe_file, free_port
+
+# Restart test of the --wal option: runs random SET/UNSET commands and nested transaction blocks through ./../bin/simpleDB
+# with a write-ahead log, restarts it on the same log and checks that exactly the committed writes survived, for each
+# engine. The last block of every run is left open, so its writes must be lost. Two sessions of a server then
+# interleave a block with a write of the same key, and the state after a restart must be the one the server had; a
+# block still open when the server is killed must be lost, and the writes of the other session kept. Then a torn last
+# batch is appended to the log, which must be dropped without losing anything else, and finally a server with a small
+# compaction size is loaded with overwrites, while a block stays open, until the log has been compacted, and killed.
+#
+# Usage: python test_wal.py [commands]
+
+KEYS = 50
+VALUES = 10
+
+
+def run(options, commands):
+    process = subprocess.Popen([exe_file, '-q'] + options, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    out = process.communicate(('\n'.join(commands) + '\nEND\n').encode())[0]
+    return [line[2:] if line.startswith('> ') else line for line in out.decode().split('\n')[:-1]]
+
+
+def dump(options):
+    commands = ['GET k%d' % i for i in range(KEYS)] + ['NUMEQUALTO %d' % i for i in range(VALUES)]
+    return run(options, commands)
+
+
+def expected_dump(state):
+    out = [state.get('k%d' % i, 'NULL') for i in range(KEYS)]
+    return out + [str(list(state.values()).count(str(i))) for i in range(VALUES)]
+
+
+# Random commands and the state they leave once every open block has been dropped, or committed if commit is set.
+def make_commands(rng, count, state, commit=False):
+    commands = []
+    blocks = []
+    current = dict(state)
+    for i in range(count):
+        op = rng.randrange(100)
+        key = 'k%d' % rng.randrange(KEYS)
+        if op < 50:
+            value = str(rng.randrange(VALUES))
+            commands.append('SET %s %s' % (key, value))
+            current[key] = value
+        elif op < 70:
+            commands.append('UNSET %s' % key)
+            current.pop(key, None)
+        elif op < 85 and len(blocks) < 8:
+            commands.append('BEGIN')
+            blocks.append(dict(current))
+        elif op < 93 and blocks:
+            commands.append('ROLLBACK')
+            current = blocks.pop()
+        elif blocks:
+            commands.append('COMMIT')
+            blocks = []
+    if commit:
+        commands.append('COMMIT')
+        return commands, current
+    commands.append('BEGIN')
+    commands.append('SET k0 uncommitted')
+    committed = blocks[0] if blocks else current
+    return commands, committed
+
+
+def test_restart(options, path, count):
+    rng = random.Random(1)
+    state = {}
+    for round in range(3):
+        commands, state = make_commands(rng, count, state)
+        run(options + ['--wal', path], commands)
+        check('state after restart %d' % round, dump(options + ['--wal', path]), expected_dump(state))
+    return state
+
+
+def connect(port):
+    for i in range(100):
+        try:
+            return Client(('127.0.0.1', port))
+        except Exception:
+            time.sleep(0.05)
+    return Client(('127.0.0.1', port))
+
+
+# Session a writes k in a block, b writes k meanwhile and a ends the block; a restart must find the value the server
+# had, whatever the order the engine makes the writes visible in.
+def test_sessions(options, path):
+    for end in ['COMMIT', 'ROLLBACK']:
+        if os.path.exists(path):
+            os.remove(path)
+        port = free_port()
+        server = subprocess.Popen([exe_file, '--wal', path, '--wal-sync', 'always', '--listen',
+                                   '127.0.0.1:%d' % port] + options)
+        try:
+            a = connect(port)
+            b = Client(('127.0.0.1', port))
+            a.call('SET', 'k', '0')
+            a.call('BEGIN')
+            a.call('SET', 'k', '1')
+            b.call('SET', 'k', '2')
+            a.call(end)
+            live = b.call('GET', 'k')
+            live = 'NULL' if live is None else live.decode()
+            a.call('END')
+            b.call('END')
+        finally:
+            server.terminate()
+            server.wait()
+        check('k after %s and a restart' % end, run(options + ['--wal', path], ['GET k']), [live])
+    os.remove(path)
+    port = free_port()
+    server = subprocess.Popen([exe_file, '--wal', path, '--wal-sync', 'always', '--listen', '127.0.0.1:%d' % port] +
+                              options)
+    try:
+        a = connect(port)
+        b = Client(('127.0.0.1', port))
+        a.call('MSET', 'k', '0', 'j', '0')
+        a.call('BEGIN')
+        a.call('SET', 'k', '1')
+        a.call('UNSET', 'j')
+        a.call('SET', 'n', '1')
+        b.call('SET', 'm', '2')
+        a.call('SET', 'k', '3')
+    finally:
+        server.kill()
+        server.wait()
+    check('open block after a crash', run(options + ['--wal', path], ['MGET k j n m']), ['0', '0', 'NULL', '2'])
+    check('open block after two restarts', run(options + ['--wal', path], ['MGET k j n m']), ['0', '0', 'NULL', '2'])
+
+
+def test_torn_tail(path, state):
+    size = os.path.getsize(path)
+    with open(path, 'ab') as f:
+        f.write(b'\x40\x00\x00\x00\x12\x34\x56\x78\x01\x02\x00\x00\x00k1')
+    check('state with torn tail', dump(['--wal', path]), expected_dump(state))
+    check('size after truncating torn tail', os.path.getsize(path), size)
+
+
+def test_compaction(path):
+    port = free_port()
+    server = subprocess.Popen([exe_file, '--wal', path, '--wal-sync', '20', '--wal-compact-size', '20000',
+                               '--listen', '127.0.0.1:%d' % port])
+    try:
+        for i in range(100):
+            try:
+                c = Client(('127.0.0.1', port))
+                break
+            except Exception:
+                time.sleep(0.05)
+        d = Client(('127.0.0.1', port))
+        d.call('SET', 'open', 'before')
+        d.call('BEGIN')
+        d.call('SET', 'open', 'inside')
+        state = {}
+        size = 0
+        compactions = 0
+        for i in range(20000):
+            key = 'k%d' % (i % KEYS)
+            state[key] = str(i % VALUES)
+            c.send(b'SET %s %s\r\n' % (key.encode(), state[key].encode()))
+            if i % 100 == 99:
+                for j in range(100):
+                    c.read_reply()
+                compactions += os.path.getsize(path) < size
+                size = os.path.getsize(path)
+        for i in range(20000 % 100):
+            c.read_reply()
+        c.call('END')
+    finally:
+        server.kill()
+        server.wait()
+    if compactions == 0:
+        raise AssertionError('the log was never compacted, it reached %d bytes' % size)
+    check('state after compaction', dump(['--wal', path]), expected_dump(state))
+    check('block open during compaction', run(['--wal', path], ['GET open']), ['before'])
+
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+    directory = tempfile.mkdtemp()
+    ok = True
+    configs = [('undo', []), ('overlay', ['--engine=overlay']), ('mvcc', ['--engine=mvcc']),
+               ('rcu', ['--engine=rcu']), ('always', ['--wal-sync', 'always']), ('none', ['--wal-sync', 'none']),
+               ('shards', ['--shards', '4']), ('cores', ['--cores', '4'])]
+    for name, options in configs:
+        path = os.path.join(directory, name + '.wal')
+        try:
+            state = test_restart(options, path, count)
+            if name == 'undo':
+                test_torn_tail(path, state)
+            print('WAL test %s is OK!' % name)
+        except Exception as error:
+            print('WAL test %s is not OK! %s' % (name, error))
+            ok = False
+    for name, options in configs[:4] + configs[6:]:
+        try:
+            test_sessions(options, os.path.join(directory, name + '-sessions.wal'))
+            print('WAL sessions test %s is OK!' % name)
+        except Exception as error:
+            print('WAL sessions test %s is not OK! %s' % (name, error))
+            ok = False
+    try:
+        test_compaction(os.path.join(directory, 'compact.wal'))
+        print('WAL compaction test is OK!')
+    except Exception as error:
+        print('WAL compaction test is not OK! %s' % error)
+        ok = False
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()